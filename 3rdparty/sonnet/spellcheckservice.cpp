@@ -17,17 +17,21 @@
 #include "scritedocument.h"
 #include "garbagecollector.h"
 
+#include <QMutex>
 #include <QFuture>
 #include <QJsonObject>
+#include <QThread>
 #include <QTimerEvent>
 #include <QFutureWatcher>
 #include <QThreadStorage>
 #include <QtConcurrentRun>
 #include <QRandomGenerator>
+#include <QReadWriteLock>
 #include <QCoreApplication>
 
 #include "3rdparty/sonnet/sonnet/src/core/speller.h"
 #include "3rdparty/sonnet/sonnet/src/core/loader_p.h"
+#include "3rdparty/sonnet/sonnet/src/core/spellerplugin_p.h"
 #include "3rdparty/sonnet/sonnet/src/core/textbreaks_p.h"
 #include "3rdparty/sonnet/sonnet/src/core/guesslanguage.h"
 
@@ -44,6 +48,8 @@ public:
 
     int timestamp = -1;
     QString text;
+    QStringList characterNames;
+    QStringList ignoreList;
     QList<TextFragment> misspelledFragments;
 };
 Q_DECLARE_METATYPE(SpellCheckServiceResult)
@@ -69,19 +75,203 @@ struct SpellCheckServiceRequest
     int timestamp;
     QStringList characterNames;
     QStringList ignoreList;
+
+    // When checkTo >= 0, only words touching [checkFrom, checkTo) are looked up. Misspellings
+    // outside of that range are taken from knownFragments, which the service carries over
+    // from its previous result.
+    int checkFrom = 0;
+    int checkTo = -1;
+    QList<TextFragment> knownFragments;
 };
 Q_DECLARE_METATYPE(SpellCheckServiceRequest)
 
+/**
+ * Process-wide cache of spelling verdicts, keyed by language and word. Entries are spread
+ * across shards, each with its own lock, so that spell-check threads rarely contend.
+ */
+class SpellCheckWordCache
+{
+public:
+    SpellCheckWordCache() { }
+    ~SpellCheckWordCache() { }
+
+    struct Verdict
+    {
+        bool misspelled = false;
+        bool hasSuggestions = false;
+        QStringList suggestions;
+    };
+
+    bool lookup(const QString &language, const QString &word, Verdict &verdict)
+    {
+        const QString key = cacheKey(language, word);
+        Shard &shard = m_shards[qHash(key) % ShardCount];
+
+        QMutexLocker locker(&shard.mutex);
+        auto it = shard.verdicts.constFind(key);
+        if (it == shard.verdicts.constEnd()) {
+            m_misses.fetchAndAddRelaxed(1);
+            return false;
+        }
+
+        m_hits.fetchAndAddRelaxed(1);
+        verdict = it.value();
+        return true;
+    }
+
+    void insert(const QString &language, const QString &word, const Verdict &verdict)
+    {
+        const QString key = cacheKey(language, word);
+        Shard &shard = m_shards[qHash(key) % ShardCount];
+
+        QMutexLocker locker(&shard.mutex);
+        if (shard.verdicts.size() >= MaxWordsPerShard && !shard.verdicts.contains(key))
+            shard.verdicts.clear();
+        shard.verdicts.insert(key, verdict);
+    }
+
+    // Words added to the personal dictionary only reach the speller of the thread that
+    // added them, so we remember them here for spellers on other threads.
+    void addPersonalWord(const QString &word)
+    {
+        QWriteLocker locker(&m_personalWordsLock);
+        m_personalWords.insert(word);
+    }
+
+    bool isPersonalWord(const QString &word) const
+    {
+        QReadLocker locker(&m_personalWordsLock);
+        return m_personalWords.contains(word);
+    }
+
+    QJsonObject statistics() const
+    {
+        int nrWords = 0;
+        for (const Shard &shard : m_shards) {
+            QMutexLocker locker(&shard.mutex);
+            nrWords += shard.verdicts.size();
+        }
+
+        const qint64 hits = m_hits.loadRelaxed();
+        const qint64 misses = m_misses.loadRelaxed();
+        const qint64 lookups = hits + misses;
+
+        QJsonObject ret;
+        ret.insert(QStringLiteral("cacheHits"), double(hits));
+        ret.insert(QStringLiteral("cacheMisses"), double(misses));
+        ret.insert(QStringLiteral("hitRate"), lookups > 0 ? double(hits) / double(lookups) : 0.0);
+        ret.insert(QStringLiteral("cachedWords"), nrWords);
+        ret.insert(QStringLiteral("queueDepth"), queueDepth.loadRelaxed());
+        ret.insert(QStringLiteral("fullChecks"), fullChecks.loadRelaxed());
+        ret.insert(QStringLiteral("incrementalChecks"), incrementalChecks.loadRelaxed());
+        return ret;
+    }
+
+    QAtomicInt queueDepth;
+    QAtomicInt fullChecks;
+    QAtomicInt incrementalChecks;
+
+private:
+    static QString cacheKey(const QString &language, const QString &word)
+    {
+        return language + QLatin1Char('/') + word;
+    }
+
+private:
+    enum { ShardCount = 16, MaxWordsPerShard = 8192 };
+
+    struct Shard
+    {
+        mutable QMutex mutex;
+        QHash<QString, Verdict> verdicts;
+    };
+    Shard m_shards[ShardCount];
+
+    QAtomicInteger<qint64> m_hits;
+    QAtomicInteger<qint64> m_misses;
+
+    mutable QReadWriteLock m_personalWordsLock;
+    QSet<QString> m_personalWords;
+};
+Q_GLOBAL_STATIC(SpellCheckWordCache, GlobalSpellCheckWordCache)
+
 void InitializeSpellCheckThread()
 {
     Sonnet::Loader::openLoader();
 }
 
+Sonnet::SpellerPlugin *ThreadSpeller()
+{
+    /**
+     * Sonnet::Speller shares one SpellerPlugin (and hence one dictionary) per language across
+     * all its instances, which is not safe to use from more than one thread at a time. So
+     * each spell-check thread creates and owns a plugin of its own.
+     */
+    static QThreadStorage<Sonnet::SpellerPlugin *> threadSpellers;
+    if (threadSpellers.hasLocalData())
+        return threadSpellers.localData();
+
+    static QMutex mutex;
+    static QString language;
+
+    QMutexLocker locker(&mutex);
+
+    Sonnet::Loader *loader = Sonnet::Loader::openLoader();
+    if (loader == nullptr)
+        return nullptr;
+
+    if (language.isEmpty()) {
+        EnglishLanguageSpeller speller;
+        language = speller.language();
+    }
+
+    Sonnet::SpellerPlugin *speller = loader->createSpeller(language);
+    threadSpellers.setLocalData(speller);
+    return speller;
+}
+
+bool IsMisspelled(Sonnet::SpellerPlugin *speller, const QString &word)
+{
+    SpellCheckWordCache *cache = GlobalSpellCheckWordCache();
+    if (cache->isPersonalWord(word))
+        return false;
+
+    SpellCheckWordCache::Verdict verdict;
+    if (cache->lookup(speller->language(), word, verdict))
+        return verdict.misspelled;
+
+    verdict.misspelled = speller->isMisspelled(word);
+    cache->insert(speller->language(), word, verdict);
+    return verdict.misspelled;
+}
+
+QStringList SuggestionsFor(Sonnet::SpellerPlugin *speller, const QString &word)
+{
+    SpellCheckWordCache *cache = GlobalSpellCheckWordCache();
+
+    SpellCheckWordCache::Verdict verdict;
+    if (cache->lookup(speller->language(), word, verdict) && verdict.hasSuggestions)
+        return verdict.suggestions;
+
+    verdict.misspelled = speller->isMisspelled(word);
+    verdict.suggestions = speller->suggest(word);
+    verdict.hasSuggestions = true;
+    cache->insert(speller->language(), word, verdict);
+    return verdict.suggestions;
+}
+
 SpellCheckServiceResult CheckSpellings(const SpellCheckServiceRequest &request)
 {
     SpellCheckServiceResult result;
     result.timestamp = request.timestamp;
     result.text = request.text;
+    result.characterNames = request.characterNames;
+    result.ignoreList = request.ignoreList;
+
+    struct QueueDepthTracker
+    {
+        ~QueueDepthTracker() { GlobalSpellCheckWordCache()->queueDepth.deref(); }
+    } queueDepthTracker;
 
     if (request.text.isEmpty())
         return result; // Should never happen
@@ -106,10 +296,9 @@ SpellCheckServiceResult CheckSpellings(const SpellCheckServiceRequest &request)
      * Note and StructureElement also. This fits into the whole model-view thinking that
      * QML apps are required to leverage.
      *
-     * There is obviously room for improvement in this implementation. We could cache
-     * spell-check done in the previous round and only check for delta changes in here.
-     * But for now, we simply take a brute-force approach. But this function could be a
-     * good place for us to accept community contribution.
+     * Verdicts for individual words are cached across all SpellCheck instances, and when
+     * a SpellCheck instance re-checks its text after an edit, only words around the edited
+     * region are looked up. Misspellings elsewhere are carried over from the previous round.
      */
 
     const Sonnet::TextBreaks::Positions wordPositions =
@@ -117,8 +306,41 @@ SpellCheckServiceResult CheckSpellings(const SpellCheckServiceRequest &request)
     if (wordPositions.isEmpty() || Sonnet::Loader::openLoader() == nullptr)
         return result;
 
-    EnglishLanguageSpeller speller;
+    Sonnet::SpellerPlugin *speller = ThreadSpeller();
+    if (speller == nullptr)
+        return result;
+
+    // Expand the range to be checked so that it covers whole words touching it.
+    int checkFrom = 0;
+    int checkTo = request.text.length();
+    if (request.checkTo >= 0) {
+        checkFrom = request.checkFrom;
+        checkTo = request.checkTo;
+        for (const Sonnet::TextBreaks::Position &wordPosition : wordPositions) {
+            const int wordEnd = wordPosition.start + wordPosition.length;
+            if (wordPosition.start <= request.checkTo && wordEnd >= request.checkFrom) {
+                checkFrom = qMin(checkFrom, wordPosition.start);
+                checkTo = qMax(checkTo, wordEnd);
+            }
+        }
+
+        for (const TextFragment &fragment : request.knownFragments) {
+            if (fragment.end() >= checkFrom && fragment.start() < checkTo)
+                continue;
+
+            const QString word = request.text.mid(fragment.start(), fragment.length());
+            if (!GlobalSpellCheckWordCache()->isPersonalWord(word))
+                result.misspelledFragments << fragment;
+        }
+
+        GlobalSpellCheckWordCache()->incrementalChecks.ref();
+    } else
+        GlobalSpellCheckWordCache()->fullChecks.ref();
+
     for (const Sonnet::TextBreaks::Position &wordPosition : wordPositions) {
+        if (wordPosition.start < checkFrom || wordPosition.start >= checkTo)
+            continue;
+
         const QString word = request.text.mid(wordPosition.start, wordPosition.length);
         if (word.isEmpty())
             continue; // not sure why this would happen, but just keeping safe.
@@ -136,7 +358,7 @@ SpellCheckServiceResult CheckSpellings(const SpellCheckServiceRequest &request)
             break;
         }
 
-        const bool misspelled = speller.isMisspelled(word);
+        const bool misspelled = IsMisspelled(speller, word);
         if (misspelled) {
             if (request.ignoreList.contains(word))
                 continue;
@@ -150,13 +372,16 @@ SpellCheckServiceResult CheckSpellings(const SpellCheckServiceRequest &request)
                     continue;
             }
 
-            const QStringList suggestions = speller.suggest(word);
+            const QStringList suggestions = SuggestionsFor(speller, word);
             TextFragment fragment(wordPosition.start, wordPosition.length, suggestions);
             if (fragment.isValid())
                 result.misspelledFragments << fragment;
         }
     }
 
+    std::sort(result.misspelledFragments.begin(), result.misspelledFragments.end(),
+              [](const TextFragment &a, const TextFragment &b) { return a.start() < b.start(); });
+
     return result;
 }
 
@@ -165,8 +390,12 @@ bool AddToDictionary(const QString &word)
     /**
      * It is assumed that word contains a single word. We won't bother checking for that.
      */
-    EnglishLanguageSpeller speller;
-    return speller.addToPersonal(word);
+    Sonnet::SpellerPlugin *speller = ThreadSpeller();
+    if (speller == nullptr || !speller->addToPersonal(word))
+        return false;
+
+    GlobalSpellCheckWordCache()->addPersonalWord(word);
+    return true;
 }
 
 QStringList GetSpellingSuggestions(const QString &word)
@@ -174,8 +403,21 @@ QStringList GetSpellingSuggestions(const QString &word)
     /**
      * It is assumed that word contains a single word. We won't bother checking for that.
      */
-    EnglishLanguageSpeller speller;
-    return speller.suggest(word);
+    Sonnet::SpellerPlugin *speller = ThreadSpeller();
+    if (speller == nullptr)
+        return QStringList();
+
+    return SuggestionsFor(speller, word);
+}
+
+static int SpellCheckServiceThreadCount()
+{
+#ifdef Q_OS_MAC
+    // All NSSpellCheckerDict instances talk to the one shared NSSpellChecker.
+    return 1;
+#else
+    return qBound(1, QThread::idealThreadCount() - 1, 4);
+#endif
 }
 
 static QThreadPool *SpellCheckServiceThreadPool()
@@ -193,9 +435,9 @@ static QThreadPool *SpellCheckServiceThreadPool()
      * to looup spellings asynchronously and in the background. So, scheduling these
      * functions in a background thread works for us.
      *
-     * Moreover we need exactly one thread for this purpose. While a QThreadPool can
-     * allocate multiple threads for us, we need only one. And one that thread is created
-     * it should NEVER EVER terminate until the program finishes.
+     * Each thread in this pool owns its own speller (see ThreadSpeller()), which is
+     * expensive to create. So once a thread is created it should NEVER EVER terminate
+     * until the program finishes.
      */
     static bool initialized = false;
     static QThreadPool threadPool;
@@ -205,7 +447,7 @@ static QThreadPool *SpellCheckServiceThreadPool()
         NSSpellCheckerClient::ensureSpellCheckerAvailability();
 #endif
         threadPool.setExpiryTimeout(-1);
-        threadPool.setMaxThreadCount(1);
+        threadPool.setMaxThreadCount(SpellCheckServiceThreadCount());
         QFuture<void> future = QtConcurrent::run(&threadPool, InitializeSpellCheckThread);
         future.waitForFinished();
         initialized = true;
@@ -298,6 +540,39 @@ void SpellCheckService::update()
 
     request.characterNames << QStringLiteral("Rajkumar");
 
+    // Only words around the edit need to be looked up, if nothing else that affects the
+    // outcome has changed since the last check.
+    if (!m_checkedText.isEmpty() && request.characterNames == m_checkedCharacterNames
+        && request.ignoreList == m_checkedIgnoreList) {
+        const QString &oldText = m_checkedText;
+        const QString &newText = request.text;
+        const int minLength = qMin(oldText.length(), newText.length());
+
+        int prefix = 0;
+        while (prefix < minLength && oldText.at(prefix) == newText.at(prefix))
+            ++prefix;
+
+        int suffix = 0;
+        while (suffix < minLength - prefix
+               && oldText.at(oldText.length() - suffix - 1)
+                       == newText.at(newText.length() - suffix - 1))
+            ++suffix;
+
+        request.checkFrom = prefix;
+        request.checkTo = newText.length() - suffix;
+
+        const int delta = newText.length() - oldText.length();
+        for (const TextFragment &fragment : qAsConst(m_checkedFragments)) {
+            if (fragment.end() < prefix)
+                request.knownFragments << fragment;
+            else if (fragment.start() >= oldText.length() - suffix)
+                request.knownFragments << TextFragment(fragment.start() + delta,
+                                                       fragment.length(), fragment.suggestions());
+        }
+    }
+
+    GlobalSpellCheckWordCache()->queueDepth.ref();
+
     QFutureWatcher<SpellCheckServiceResult> *watcher =
             new QFutureWatcher<SpellCheckServiceResult>(this);
     connect(watcher, SIGNAL(finished()), this, SLOT(spellCheckComplete()), Qt::QueuedConnection);
@@ -307,6 +582,13 @@ void SpellCheckService::update()
     watcher->setFuture(future);
 }
 
+QJsonObject SpellCheckService::statistics() const
+{
+    QJsonObject ret = GlobalSpellCheckWordCache()->statistics();
+    ret.insert(QStringLiteral("threadCount"), SpellCheckServiceThreadCount());
+    return ret;
+}
+
 QStringList SpellCheckService::suggestions(const QString &word)
 {
     QThreadPool *threadPool = SpellCheckServiceThreadPool();
@@ -394,6 +676,11 @@ void SpellCheckService::spellCheckComplete()
 
 void SpellCheckService::acceptResult(const SpellCheckServiceResult &result)
 {
+    m_checkedText = result.text;
+    m_checkedFragments = result.misspelledFragments;
+    m_checkedCharacterNames = result.characterNames;
+    m_checkedIgnoreList = result.ignoreList;
+
     this->setMisspelledFragments(result.misspelledFragments);
     emit finished();
 }
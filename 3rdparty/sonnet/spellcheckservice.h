@@ -17,6 +17,7 @@
 #include <QObject>
 #include <QQmlEngine>
 #include <QJsonArray>
+#include <QJsonObject>
 #include <QQmlParserStatus>
 
 #include "modifiable.h"
@@ -101,6 +102,9 @@ public:
     Q_INVOKABLE void scheduleUpdate();
     Q_INVOKABLE void update();
 
+    // Process-wide cache hit-rate, queue-depth and thread-count of spell-check
+    Q_INVOKABLE QJsonObject statistics() const;
+
     static QStringList suggestions(const QString &word);
     static bool addToDictionary(const QString &word);
 
@@ -129,6 +133,12 @@ private:
     ModificationTracker m_textTracker;
     QJsonArray m_misspelledFragmentsJson;
     QList<TextFragment> m_misspelledFragments;
+
+    // Outcome of the last accepted check, used for checking only the edited region next time
+    QString m_checkedText;
+    QStringList m_checkedIgnoreList;
+    QStringList m_checkedCharacterNames;
+    QList<TextFragment> m_checkedFragments;
 };
 
 #endif // SPELL_CHECK_SERVICE_H
@@ -14,6 +14,7 @@
 #include "user.h"
 #include "appwindow.h"
 #include "application.h"
+#include "batchexport.h"
 #include "shortcutsmodel.h"
 #include "scritedocument.h"
 #include "crashpadmodule.h"
@@ -25,7 +26,10 @@
 
 int main(int argc, char **argv)
 {
-    if (CrashpadModule::isAvailable()) {
+    const bool batchExport = BatchExport::isRequested(argc, argv);
+    if (batchExport)
+        BatchExport::prepare(argc, argv);
+    else if (CrashpadModule::isAvailable()) {
         if (!CrashpadModule::prepare())
             return 0;
 
@@ -42,6 +46,14 @@ int main(int argc, char **argv)
 
     Application scriteApp(argc, argv, Application::prepare());
 
+    if (batchExport) {
+        User::instance();
+        TransliterationEngine::instance();
+        DocumentFileSystem::setMarker(QByteArrayLiteral("SCRITE"));
+        ScriteDocument::instance();
+        return BatchExport::exec();
+    }
+
     User::instance();
     TransliterationEngine::instance();
     SystemTextInputManager::instance();
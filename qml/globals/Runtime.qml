@@ -298,6 +298,7 @@ Item {
     // Global undo-redo object
     readonly property UndoStack undoStack: UndoStack {
         objectName: "MainUndoStack"
+        memoryLimit: 64 * 1024 * 1024
 
         property bool sceneListPanelActive: false
         property bool screenplayEditorActive: false
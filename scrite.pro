@@ -57,6 +57,7 @@ HEADERS += \
     src/automation/scriptautomationstep.h \
     src/automation/windowcapture.h \
     src/core/appwindow.h \
+    src/core/batchexport.h \
     src/core/filelocker.h \
     src/core/localstorage.h \
     src/core/pdfexportablegraphicsscene.h \
@@ -138,6 +139,7 @@ HEADERS += \
     src/utils/genericarraymodel.h \
     src/utils/qobjectfactory.h \
     src/utils/qobjectserializer.h \
+    src/utils/timeprofiler.h \
     src/utils/modifiable.h \
     src/document/formatting.h \
     src/document/transliteration.h \
@@ -148,6 +150,7 @@ HEADERS += \
     src/document/undoredo.h \
     src/document/screenplayadapter.h \
     src/document/screenplay.h \
+    src/document/screenplaysearchindex.h \
     src/document/scene.h \
     src/core/application.h \
     src/core/autoupdate.h \
@@ -192,6 +195,7 @@ SOURCES += \
     src/automation/windowcapture.cpp \
     src/core/application_build_timestamp.cpp \
     src/core/appwindow.cpp \
+    src/core/batchexport.cpp \
     src/core/filelocker.cpp \
     src/core/localstorage.cpp \
     src/core/pdfexportablegraphicsscene.cpp \
@@ -270,8 +274,10 @@ SOURCES += \
     src/utils/graphlayout.cpp \
     src/utils/garbagecollector.cpp \
     src/utils/qobjectserializer.cpp \
+    src/utils/timeprofiler.cpp \
     src/document/scritedocument.cpp \
     src/document/screenplay.cpp \
+    src/document/screenplaysearchindex.cpp \
     src/document/scene.cpp \
     src/document/documentfilesystem.cpp \
     src/document/structure.cpp \
@@ -323,11 +329,6 @@ RESOURCES += \
     scrite_images.qrc \
     scrite_ui.qrc
 
-exists(../profilingtools/timeprofiler.cpp) {
-    HEADERS += ../profilingtools/timeprofiler.h
-    SOURCES += ../profilingtools/timeprofiler.cpp
-}
-
 exists(../profilingtools/callgraph.cpp) {
     HEADERS += ../profilingtools/callgraph.h
     SOURCES += ../profilingtools/callgraph.cpp
@@ -365,6 +366,26 @@ linux {
     VERSION_INFO = "1.0.1-linux"
 }
 
+# Headless benchmarks of load, save, paginate, search, import and export. Configure with
+# qmake CONFIG+=scrite_benchmark to build scrite-benchmark instead of the application.
+scrite_benchmark {
+    TARGET = scrite-benchmark
+    CONFIG += console
+    CONFIG -= app_bundle
+
+    INCLUDEPATH += ./src/benchmark
+    HEADERS += \
+        src/benchmark/benchmark.h \
+        src/benchmark/syntheticscreenplay.h
+    SOURCES -= main.cpp
+    SOURCES += \
+        src/benchmark/benchmark.cpp \
+        src/benchmark/benchmarkmain.cpp \
+        src/benchmark/syntheticscreenplay.cpp
+
+    win32: LIBS += Psapi.lib
+}
+
 include($$PWD/3rdparty/sonnet/sonnet.pri)
 include($$PWD/3rdparty/quazip/quazip.pri)
 include($$PWD/3rdparty/simplecrypt/simplecrypt.pri)
@@ -0,0 +1,339 @@
+/****************************************************************************
+**
+** Copyright (C) VCreate Logic Pvt. Ltd. Bengaluru
+** Author: Prashanth N Udupa (prashanth@scrite.io)
+**
+** This code is distributed under GPL v3. Complete text of the license
+** can be found here: https://www.gnu.org/licenses/gpl-3.0.txt
+**
+** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+**
+****************************************************************************/
+
+#include "benchmark.h"
+
+#include "fountain.h"
+#include "aggregation.h"
+#include "errorreport.h"
+#include "screenplay.h"
+#include "application.h"
+#include "scritedocument.h"
+#include "abstractexporter.h"
+#include "documentfilesystem.h"
+#include "screenplaytextdocument.h"
+#include "abstractreportgenerator.h"
+
+#include <QDir>
+#include <QThread>
+#include <QSysInfo>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QTextStream>
+#include <QElapsedTimer>
+#include <QScopedPointer>
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+Benchmark::Benchmark(ScriteDocument *document, const QString &workDir)
+    : m_workDir(workDir), m_document(document)
+{
+}
+
+Benchmark::~Benchmark() { }
+
+QStringList Benchmark::availableStages()
+{
+    return { QStringLiteral("generate"),       QStringLiteral("save"),
+             QStringLiteral("load"),           QStringLiteral("paginate"),
+             QStringLiteral("search"),         QStringLiteral("fountain-write"),
+             QStringLiteral("fountain-parse"), QStringLiteral("export-pdf"),
+             QStringLiteral("export-fdx"),     QStringLiteral("reports"),
+             QStringLiteral("import-fdx") };
+}
+
+QJsonObject Benchmark::run()
+{
+    m_results = QJsonArray();
+
+    const QStringList characterNames = screenplay.characterNames();
+    const QString scriteFileName = this->filePath(QStringLiteral("benchmark.scrite"));
+    QString fdxFileName = this->filePath(QStringLiteral("benchmark.fdx"));
+
+    QTextStream(stderr) << QStringLiteral("%1 %2 %3 %4 %5  %6\n")
+                                   .arg(QStringLiteral("Status"), -6)
+                                   .arg(QStringLiteral("Min (ms)"), 10)
+                                   .arg(QStringLiteral("Median"), 10)
+                                   .arg(QStringLiteral("Max"), 10)
+                                   .arg(QStringLiteral("Peak (MB)"), 9)
+                                   .arg(QStringLiteral("Stage"));
+
+    this->runStage(QStringLiteral("generate"), 1, [=](QJsonObject &details) {
+        m_document->reset();
+        m_document->blockUI();
+        screenplay.populate(m_document, m_workDir);
+        m_document->unblockUI();
+
+        int paragraphCount = 0;
+        Screenplay *sp = m_document->screenplay();
+        for (int i = 0; i < sp->elementCount(); i++) {
+            const Scene *scene = sp->elementAt(i)->scene();
+            paragraphCount += scene ? scene->elementCount() : 0;
+        }
+
+        details.insert(QStringLiteral("sceneCount"), sp->elementCount());
+        details.insert(QStringLiteral("paragraphCount"), paragraphCount);
+        return sp->elementCount() == screenplay.sceneCount;
+    });
+
+    auto save = [=](QJsonObject &details) {
+        m_document->saveAs(scriteFileName);
+
+        const QFileInfo fi(scriteFileName);
+        details.insert(QStringLiteral("fileSize"), fi.size());
+        details.insert(QStringLiteral("zip"), m_document->fileSystem()->saveStatistics());
+        return fi.exists() && fi.size() > 0;
+    };
+    this->runStage(QStringLiteral("save"), iterations, save);
+
+    if (this->isStageEnabled(QStringLiteral("load"))) {
+        QJsonObject preparation;
+        if (!QFileInfo::exists(scriteFileName))
+            save(preparation);
+
+        this->runStage(QStringLiteral("load"), iterations, [=](QJsonObject &details) {
+            const bool ret = m_document->openAnonymously(scriteFileName);
+            details.insert(QStringLiteral("timings"), m_document->loadTimings());
+            return ret && m_document->screenplay()->elementCount() == screenplay.sceneCount;
+        });
+    }
+
+    this->runStage(QStringLiteral("paginate"), iterations, [=](QJsonObject &details) {
+        ScreenplayTextDocument stDoc;
+        stDoc.setSyncEnabled(false);
+        stDoc.setPurpose(ScreenplayTextDocument::ForPrinting);
+        stDoc.setTitlePage(true);
+        stDoc.setSceneNumbers(true);
+        stDoc.setScreenplay(m_document->screenplay());
+        stDoc.setFormatting(m_document->printFormat());
+        stDoc.syncNow();
+
+        details.insert(QStringLiteral("pageCount"), stDoc.pageCount());
+        return stDoc.pageCount() > 0;
+    });
+
+    this->runStage(QStringLiteral("search"), iterations, [=](QJsonObject &details) {
+        QStringList queries = { QStringLiteral("door"), QStringLiteral("remember"),
+                                QStringLiteral("the light"), QStringLiteral("COFFEE"),
+                                QStringLiteral("xyzzy") };
+        if (!characterNames.isEmpty())
+            queries.append(characterNames.first());
+
+        int matchCount = 0;
+        for (const QString &query : qAsConst(queries))
+            matchCount += m_document->screenplay()->search(query).size();
+
+        details.insert(QStringLiteral("queryCount"), queries.size());
+        details.insert(QStringLiteral("matchCount"), matchCount);
+        return true;
+    });
+
+    QByteArray fountain;
+    auto writeFountain = [&](QJsonObject &details) {
+        fountain = Fountain::Writer(m_document->screenplay()).toByteArray();
+        details.insert(QStringLiteral("bytes"), fountain.size());
+        return !fountain.isEmpty();
+    };
+    this->runStage(QStringLiteral("fountain-write"), iterations, writeFountain);
+
+    if (this->isStageEnabled(QStringLiteral("fountain-parse"))) {
+        QJsonObject preparation;
+        if (fountain.isEmpty())
+            writeFountain(preparation);
+
+        this->runStage(QStringLiteral("fountain-parse"), iterations, [&](QJsonObject &details) {
+            const Fountain::Parser parser(fountain);
+            details.insert(QStringLiteral("elementCount"), parser.body().size());
+            return !parser.body().isEmpty();
+        });
+    }
+
+    auto exportTo = [=](const QString &format, const QString &fileName,
+                        QString *exportedFileName, QJsonObject &details) {
+        QScopedPointer<AbstractExporter> exporter(m_document->createExporter(format));
+        if (exporter.isNull())
+            return false;
+
+        exporter->setFileName(fileName);
+        const bool ret = exporter->write();
+        if (!ret)
+            details.insert(QStringLiteral("error"),
+                           Aggregation::findErrorReport(exporter.data())->errorMessage());
+
+        const QFileInfo fi(exporter->fileName());
+        details.insert(QStringLiteral("fileSize"), fi.size());
+        if (exportedFileName)
+            *exportedFileName = exporter->fileName();
+
+        return ret && fi.exists();
+    };
+
+    this->runStage(QStringLiteral("export-pdf"), iterations, [=](QJsonObject &details) {
+        return exportTo(QStringLiteral("Screenplay/Adobe PDF"),
+                        this->filePath(QStringLiteral("benchmark.pdf")), nullptr, details);
+    });
+
+    auto exportFdx = [&](QJsonObject &details) {
+        return exportTo(QStringLiteral("Screenplay/Final Draft"), fdxFileName, &fdxFileName,
+                        details);
+    };
+    this->runStage(QStringLiteral("export-fdx"), iterations, exportFdx);
+
+    const QJsonArray reports = m_document->supportedReports();
+    for (const QJsonValue &item : reports) {
+        const QString reportName = item.toObject().value(QStringLiteral("name")).toString();
+        const QString fileName =
+                this->filePath(QStringLiteral("report - %1.pdf").arg(reportName));
+
+        this->runStage(QStringLiteral("report/") + reportName, iterations,
+                       [=](QJsonObject &details) {
+                           QScopedPointer<AbstractReportGenerator> report(
+                                   m_document->createReportGenerator(reportName));
+                           if (report.isNull())
+                               return false;
+
+                           // Character reports have nothing to report without characters.
+                           if (report->metaObject()->indexOfProperty("characterNames") >= 0)
+                               report->setConfigurationValue(QStringLiteral("characterNames"),
+                                                             characterNames.mid(0, 3));
+
+                           report->setFileName(fileName);
+                           const bool ret = report->generate();
+                           if (!ret)
+                               details.insert(QStringLiteral("error"),
+                                              Aggregation::findErrorReport(report.data())
+                                                      ->errorMessage());
+
+                           const QFileInfo fi(report->fileName());
+                           details.insert(QStringLiteral("fileSize"), fi.size());
+                           return ret && fi.exists();
+                       });
+    }
+
+    // Importing replaces the generated document, which is why this comes last.
+    if (this->isStageEnabled(QStringLiteral("import-fdx"))) {
+        QJsonObject preparation;
+        if (!QFileInfo::exists(fdxFileName))
+            exportFdx(preparation);
+
+        this->runStage(QStringLiteral("import-fdx"), iterations, [=](QJsonObject &details) {
+            m_document->reset();
+            const bool ret = m_document->importFile(fdxFileName, QStringLiteral("Final Draft"));
+            if (!ret)
+                details.insert(QStringLiteral("error"),
+                               Aggregation::findErrorReport(m_document)->errorMessage());
+            details.insert(QStringLiteral("sceneCount"), m_document->screenplay()->elementCount());
+            return ret;
+        });
+    }
+
+    QJsonObject ret;
+    ret.insert(QStringLiteral("version"), Application::instance()->versionNumber().toString());
+    ret.insert(QStringLiteral("qtVersion"), QString::fromLatin1(qVersion()));
+    ret.insert(QStringLiteral("platform"), QSysInfo::prettyProductName());
+    ret.insert(QStringLiteral("cpuArchitecture"), QSysInfo::currentCpuArchitecture());
+    ret.insert(QStringLiteral("idealThreadCount"), QThread::idealThreadCount());
+    ret.insert(QStringLiteral("timestamp"),
+               QDateTime::currentDateTimeUtc().toString(Qt::ISODate));
+    ret.insert(QStringLiteral("screenplay"), screenplay.toJson());
+    ret.insert(QStringLiteral("iterations"), iterations);
+    ret.insert(QStringLiteral("stages"), m_results);
+    ret.insert(QStringLiteral("peakMemoryBytes"), peakMemoryUsage());
+    return ret;
+}
+
+qint64 Benchmark::peakMemoryUsage()
+{
+#ifdef Q_OS_WIN
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return qint64(counters.PeakWorkingSetSize);
+    return 0;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+#ifdef Q_OS_MACOS
+    return qint64(usage.ru_maxrss); // bytes
+#else
+    return qint64(usage.ru_maxrss) * 1024; // kilobytes
+#endif
+#endif
+}
+
+void Benchmark::runStage(const QString &name, int iterations, const StageFunction &function)
+{
+    if (!this->isStageEnabled(name))
+        return;
+
+    const qint64 peakMemoryBefore = peakMemoryUsage();
+
+    bool success = true;
+    QJsonObject details;
+    QVector<qint64> timesNs;
+    for (int i = 0; i < qMax(iterations, 1) && success; i++) {
+        QElapsedTimer timer;
+        timer.start();
+        success = function(details);
+        timesNs.append(timer.nsecsElapsed());
+
+        // Let deferred deletes and queued calls of this iteration finish before the next one.
+        QCoreApplication::sendPostedEvents(nullptr, QEvent::DeferredDelete);
+        QCoreApplication::processEvents();
+    }
+
+    std::sort(timesNs.begin(), timesNs.end());
+
+    auto toMs = [](qint64 ns) { return qreal(ns) / 1e6; };
+    const qint64 peakMemory = peakMemoryUsage();
+
+    QJsonObject result;
+    result.insert(QStringLiteral("name"), name);
+    result.insert(QStringLiteral("success"), success);
+    result.insert(QStringLiteral("iterations"), timesNs.size());
+    result.insert(QStringLiteral("minMs"), toMs(timesNs.first()));
+    result.insert(QStringLiteral("medianMs"), toMs(timesNs.at(timesNs.size() / 2)));
+    result.insert(QStringLiteral("maxMs"), toMs(timesNs.last()));
+    result.insert(QStringLiteral("peakMemoryBytes"), peakMemory);
+    result.insert(QStringLiteral("peakMemoryGrowthBytes"), peakMemory - peakMemoryBefore);
+    result.insert(QStringLiteral("details"), details);
+    m_results.append(result);
+
+    QTextStream ts(stderr);
+    ts << QStringLiteral("%1 %2 %3 %4 %5  %6\n")
+                    .arg(success ? QStringLiteral("ok") : QStringLiteral("FAILED"), -6)
+                    .arg(toMs(timesNs.first()), 10, 'f', 2)
+                    .arg(toMs(timesNs.at(timesNs.size() / 2)), 10, 'f', 2)
+                    .arg(toMs(timesNs.last()), 10, 'f', 2)
+                    .arg(qreal(peakMemory) / (1024 * 1024), 9, 'f', 1)
+                    .arg(name);
+}
+
+bool Benchmark::isStageEnabled(const QString &name) const
+{
+    // Every other stage works on the generated document, so it is never skipped.
+    if (stages.isEmpty() || stages.contains(name) || name == QStringLiteral("generate"))
+        return true;
+
+    return name.startsWith(QStringLiteral("report/")) && stages.contains(QStringLiteral("reports"));
+}
+
+QString Benchmark::filePath(const QString &fileName) const
+{
+    return QDir(m_workDir).absoluteFilePath(fileName);
+}
@@ -0,0 +1,66 @@
+/****************************************************************************
+**
+** Copyright (C) VCreate Logic Pvt. Ltd. Bengaluru
+** Author: Prashanth N Udupa (prashanth@scrite.io)
+**
+** This code is distributed under GPL v3. Complete text of the license
+** can be found here: https://www.gnu.org/licenses/gpl-3.0.txt
+**
+** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+**
+****************************************************************************/
+
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include "syntheticscreenplay.h"
+
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QStringList>
+
+#include <functional>
+
+class ScriteDocument;
+
+/**
+ * Runs load, save, paginate, search, import and export stages headlessly against a
+ * SyntheticScreenplay, and reports timings and peak memory of each stage as JSON.
+ *
+ * Every stage is run the given number of iterations. Minimum, median and maximum times are
+ * reported, along with the process-wide peak resident memory once the stage is done (it can
+ * only grow, so the growth is reported separately).
+ */
+class Benchmark
+{
+public:
+    Benchmark(ScriteDocument *document, const QString &workDir);
+    ~Benchmark();
+
+    SyntheticScreenplay screenplay;
+    int iterations = 3;
+    QStringList stages; // runs all stages if empty
+
+    static QStringList availableStages();
+
+    QJsonObject run();
+
+    // Peak resident memory of this process so far, in bytes. Zero if it can't be determined.
+    static qint64 peakMemoryUsage();
+
+private:
+    // Functions return false on failure, and may fill in details to report with timings.
+    using StageFunction = std::function<bool(QJsonObject &details)>;
+    void runStage(const QString &name, int iterations, const StageFunction &function);
+    bool isStageEnabled(const QString &name) const;
+
+    QString filePath(const QString &fileName) const;
+
+private:
+    QString m_workDir;
+    ScriteDocument *m_document = nullptr;
+    QJsonArray m_results;
+};
+
+#endif // BENCHMARK_H
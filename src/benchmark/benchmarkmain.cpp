@@ -0,0 +1,160 @@
+/****************************************************************************
+**
+** Copyright (C) VCreate Logic Pvt. Ltd. Bengaluru
+** Author: Prashanth N Udupa (prashanth@scrite.io)
+**
+** This code is distributed under GPL v3. Complete text of the license
+** can be found here: https://www.gnu.org/licenses/gpl-3.0.txt
+**
+** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+**
+****************************************************************************/
+
+#include "benchmark.h"
+#include "application.h"
+#include "timeprofiler.h"
+#include "abstractdeviceio.h"
+#include "transliteration.h"
+#include "scritedocument.h"
+#include "documentfilesystem.h"
+
+#include <QFile>
+#include <QDir>
+#include <QTextStream>
+#include <QJsonDocument>
+#include <QTemporaryDir>
+#include <QStandardPaths>
+#include <QCommandLineParser>
+
+int main(int argc, char **argv)
+{
+    // Nothing is shown, so a display shouldn't be needed either.
+    if (!qEnvironmentVariableIsSet("QT_QPA_PLATFORM"))
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+
+    // Keeps settings, login and documents of the installed Scrite out of reach. Importers,
+    // exporters and reports, which otherwise need a login, are let through instead.
+    QStandardPaths::setTestModeEnabled(true);
+    AbstractDeviceIO::setFeatureCheckSkipped(true);
+
+    Application scriteApp(argc, argv, Application::prepare());
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(
+            QStringLiteral("Times load, save, paginate, search, import and export of synthetic "
+                           "screenplays. Timings are written as JSON, a summary to stderr."));
+    parser.addHelpOption();
+
+    const SyntheticScreenplay defaults;
+    auto intOption = [&parser](const QString &name, const QString &description, int value) {
+        const QCommandLineOption option(name, description, QStringLiteral("n"),
+                                        QString::number(value));
+        parser.addOption(option);
+        return option;
+    };
+    const QCommandLineOption scenesOption =
+            intOption(QStringLiteral("scenes"), QStringLiteral("Number of scenes."),
+                      defaults.sceneCount);
+    const QCommandLineOption paragraphsOption =
+            intOption(QStringLiteral("paragraphs"), QStringLiteral("Paragraphs per scene."),
+                      defaults.paragraphsPerScene);
+    const QCommandLineOption charactersOption =
+            intOption(QStringLiteral("characters"), QStringLiteral("Number of characters."),
+                      defaults.characterCount);
+    const QCommandLineOption attachmentsOption =
+            intOption(QStringLiteral("attachments"), QStringLiteral("Number of attached images."),
+                      defaults.attachmentCount);
+    const QCommandLineOption attachmentSizeOption = intOption(
+            QStringLiteral("attachment-size"),
+            QStringLiteral("Width and height of attached images, in pixels."),
+            defaults.attachmentSize);
+    const QCommandLineOption seedOption = intOption(
+            QStringLiteral("seed"), QStringLiteral("Seed of the screenplay generator."),
+            int(defaults.seed));
+    const QCommandLineOption iterationsOption =
+            intOption(QStringLiteral("iterations"), QStringLiteral("Runs of each stage."), 3);
+
+    const QCommandLineOption stagesOption(
+            QStringLiteral("stages"),
+            QStringLiteral("Comma separated stages to run, out of: %1. Runs all by default.")
+                    .arg(Benchmark::availableStages().join(QStringLiteral(", "))),
+            QStringLiteral("list"));
+    parser.addOption(stagesOption);
+
+    const QCommandLineOption outputOption(
+            QStringLiteral("output"),
+            QStringLiteral("File to write JSON results into, instead of stdout."),
+            QStringLiteral("file"));
+    parser.addOption(outputOption);
+
+    const QCommandLineOption workDirOption(
+            QStringLiteral("work-dir"),
+            QStringLiteral("Folder to keep generated files in. A temporary folder, removed on "
+                           "exit, is used by default."),
+            QStringLiteral("folder"));
+    parser.addOption(workDirOption);
+
+    const QCommandLineOption profileOption(
+            QStringLiteral("profile"),
+            QStringLiteral("Include TimeProfiler scopes hit during the run in the results."));
+    parser.addOption(profileOption);
+
+    parser.process(scriteApp);
+
+    QTemporaryDir tempDir;
+    const QString workDir = parser.isSet(workDirOption) ? parser.value(workDirOption)
+                                                        : tempDir.path();
+    if (workDir.isEmpty() || !QDir().mkpath(workDir)) {
+        QTextStream(stderr) << "Cannot create work folder.\n";
+        return 1;
+    }
+
+    if (parser.isSet(profileOption))
+        TimeProfiler::enable();
+
+    TransliterationEngine::instance();
+    DocumentFileSystem::setMarker(QByteArrayLiteral("SCRITE"));
+
+    ScriteDocument *document = ScriteDocument::instance();
+    document->setAutoSave(false);
+
+    Benchmark benchmark(document, workDir);
+    benchmark.iterations = parser.value(iterationsOption).toInt();
+    benchmark.screenplay.sceneCount = parser.value(scenesOption).toInt();
+    benchmark.screenplay.paragraphsPerScene = parser.value(paragraphsOption).toInt();
+    benchmark.screenplay.characterCount = parser.value(charactersOption).toInt();
+    benchmark.screenplay.attachmentCount = parser.value(attachmentsOption).toInt();
+    benchmark.screenplay.attachmentSize = parser.value(attachmentSizeOption).toInt();
+    benchmark.screenplay.seed = parser.value(seedOption).toUInt();
+    if (parser.isSet(stagesOption))
+        benchmark.stages = parser.value(stagesOption).split(QLatin1Char(','), Qt::SkipEmptyParts);
+
+    QJsonObject results = benchmark.run();
+    if (TimeProfiler::isEnabled())
+        results.insert(QStringLiteral("profile"), TimeProfiler::report());
+
+    const QByteArray json = QJsonDocument(results).toJson();
+
+    QFile output;
+    bool opened = false;
+    if (parser.isSet(outputOption)) {
+        output.setFileName(parser.value(outputOption));
+        opened = output.open(QFile::WriteOnly);
+    } else
+        opened = output.open(stdout, QFile::WriteOnly);
+
+    if (!opened || output.write(json) != json.size()) {
+        QTextStream(stderr) << "Cannot write results.\n";
+        return 1;
+    }
+    output.close();
+
+    const QJsonArray stages = results.value(QStringLiteral("stages")).toArray();
+    for (const QJsonValue &stage : stages) {
+        if (!stage.toObject().value(QStringLiteral("success")).toBool())
+            return 2;
+    }
+
+    return 0;
+}
@@ -0,0 +1,218 @@
+/****************************************************************************
+**
+** Copyright (C) VCreate Logic Pvt. Ltd. Bengaluru
+** Author: Prashanth N Udupa (prashanth@scrite.io)
+**
+** This code is distributed under GPL v3. Complete text of the license
+** can be found here: https://www.gnu.org/licenses/gpl-3.0.txt
+**
+** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+**
+****************************************************************************/
+
+#include "syntheticscreenplay.h"
+
+#include "scene.h"
+#include "structure.h"
+#include "screenplay.h"
+#include "application.h"
+#include "scritedocument.h"
+
+#include <QDir>
+#include <QSet>
+#include <QImage>
+#include <QRandomGenerator>
+
+static const QStringList &syntheticWords()
+{
+    static const QStringList ret = {
+        QStringLiteral("the"),     QStringLiteral("door"),    QStringLiteral("light"),
+        QStringLiteral("slowly"),  QStringLiteral("window"),  QStringLiteral("across"),
+        QStringLiteral("looks"),   QStringLiteral("never"),   QStringLiteral("rain"),
+        QStringLiteral("into"),    QStringLiteral("table"),   QStringLiteral("phone"),
+        QStringLiteral("quietly"), QStringLiteral("before"),  QStringLiteral("night"),
+        QStringLiteral("turns"),   QStringLiteral("money"),   QStringLiteral("around"),
+        QStringLiteral("waits"),   QStringLiteral("street"),  QStringLiteral("train"),
+        QStringLiteral("letter"),  QStringLiteral("smiles"),  QStringLiteral("under"),
+        QStringLiteral("again"),   QStringLiteral("city"),    QStringLiteral("coffee"),
+        QStringLiteral("nothing"), QStringLiteral("remember"), QStringLiteral("tomorrow"),
+        QStringLiteral("house"),   QStringLiteral("answer"),  QStringLiteral("with"),
+        QStringLiteral("and"),     QStringLiteral("a"),       QStringLiteral("of"),
+        QStringLiteral("back"),    QStringLiteral("walks"),   QStringLiteral("car"),
+        QStringLiteral("silence"), QStringLiteral("from"),    QStringLiteral("stairs"),
+    };
+    return ret;
+}
+
+static QString syntheticSentence(QRandomGenerator &rand, int minWords, int maxWords)
+{
+    const QStringList &words = syntheticWords();
+    const int count = rand.bounded(minWords, maxWords + 1);
+
+    QStringList ret;
+    ret.reserve(count);
+    for (int i = 0; i < count; i++)
+        ret.append(words.at(rand.bounded(words.size())));
+
+    QString sentence = ret.join(QLatin1Char(' '));
+    sentence[0] = sentence.at(0).toUpper();
+    sentence += rand.bounded(5) ? QLatin1Char('.') : QLatin1Char('?');
+    return sentence;
+}
+
+static QString syntheticParagraph(QRandomGenerator &rand, int maxSentences)
+{
+    QStringList sentences;
+    const int count = rand.bounded(1, maxSentences + 1);
+    for (int i = 0; i < count; i++)
+        sentences.append(syntheticSentence(rand, 4, 14));
+    return sentences.join(QLatin1Char(' '));
+}
+
+QStringList SyntheticScreenplay::characterNames() const
+{
+    static const QStringList syllables = {
+        QStringLiteral("RA"), QStringLiteral("VI"), QStringLiteral("AN"), QStringLiteral("MA"),
+        QStringLiteral("KI"), QStringLiteral("LO"), QStringLiteral("SU"), QStringLiteral("DE"),
+        QStringLiteral("TA"), QStringLiteral("NI"), QStringLiteral("KA"), QStringLiteral("JO"),
+    };
+
+    QRandomGenerator rand(seed);
+
+    QStringList ret;
+    QSet<QString> names;
+    while (ret.size() < characterCount) {
+        QString name;
+        const int nrSyllables = rand.bounded(2, 4);
+        for (int i = 0; i < nrSyllables; i++)
+            name += syllables.at(rand.bounded(syllables.size()));
+        if (names.contains(name))
+            name += QString::number(ret.size() + 1);
+
+        names.insert(name);
+        ret.append(name);
+    }
+
+    return ret;
+}
+
+QJsonObject SyntheticScreenplay::toJson() const
+{
+    QJsonObject ret;
+    ret.insert(QStringLiteral("scenes"), sceneCount);
+    ret.insert(QStringLiteral("paragraphsPerScene"), paragraphsPerScene);
+    ret.insert(QStringLiteral("characters"), characterCount);
+    ret.insert(QStringLiteral("attachments"), attachmentCount);
+    ret.insert(QStringLiteral("attachmentSize"), attachmentSize);
+    ret.insert(QStringLiteral("seed"), qint64(seed));
+    return ret;
+}
+
+void SyntheticScreenplay::populate(ScriteDocument *document, const QString &workDir) const
+{
+    static const QStringList locations = {
+        QStringLiteral("APARTMENT"),    QStringLiteral("POLICE STATION"),
+        QStringLiteral("RAILWAY PLATFORM"), QStringLiteral("ROOFTOP"),
+        QStringLiteral("TEA STALL"),    QStringLiteral("HOSPITAL CORRIDOR"),
+        QStringLiteral("OFFICE"),       QStringLiteral("MARKET"),
+        QStringLiteral("CAR"),          QStringLiteral("BEACH"),
+        QStringLiteral("SCHOOL"),       QStringLiteral("WAREHOUSE"),
+    };
+
+    QRandomGenerator rand(seed);
+    const QStringList names = this->characterNames();
+    const QVector<QColor> sceneColors = Application::standardColors(QVersionNumber());
+
+    Structure *structure = document->structure();
+    Screenplay *screenplay = document->screenplay();
+    screenplay->setTitle(QStringLiteral("Synthetic Screenplay"));
+    screenplay->setSubtitle(QStringLiteral("%1 scenes").arg(sceneCount));
+    screenplay->setAuthor(QStringLiteral("Scrite Benchmark"));
+    screenplay->setLogline(syntheticParagraph(rand, 2));
+    screenplay->setVersion(QStringLiteral("1"));
+
+    const qreal spacing = 400;
+    structure->setCanvasWidth(qMax(structure->canvasWidth(), sceneCount * spacing + 5500));
+    structure->setCanvasHeight(qMax(structure->canvasHeight(), sceneCount * spacing + 5500));
+
+    QList<Scene *> scenes;
+    scenes.reserve(sceneCount);
+
+    for (int i = 0; i < sceneCount; i++) {
+        StructureElement *structureElement = new StructureElement(structure);
+        Scene *scene = new Scene(structureElement);
+        scene->setColor(sceneColors.at(i % sceneColors.size()));
+        structureElement->setScene(scene);
+        structureElement->setX(5000 + (i % 2 ? spacing : 0));
+        structureElement->setY(5000 + spacing * i);
+        structure->addElement(structureElement);
+
+        ScreenplayElement *screenplayElement = new ScreenplayElement(screenplay);
+        screenplayElement->setScene(scene);
+        screenplay->addElement(screenplayElement);
+
+        const QString location = locations.at(rand.bounded(locations.size()));
+        scene->heading()->setEnabled(true);
+        scene->heading()->parseFrom(QStringLiteral("%1. %2 - %3")
+                                            .arg(rand.bounded(2) ? QStringLiteral("INT")
+                                                                 : QStringLiteral("EXT"),
+                                                 location,
+                                                 rand.bounded(3) ? QStringLiteral("DAY")
+                                                                 : QStringLiteral("NIGHT")));
+        scene->setSynopsis(syntheticSentence(rand, 6, 12));
+
+        auto addParagraph = [scene](SceneElement::Type type, const QString &text) {
+            SceneElement *element = new SceneElement(scene);
+            element->setType(type);
+            element->setText(text);
+            scene->addElement(element);
+        };
+
+        int paragraphCount = 0;
+        addParagraph(SceneElement::Action, syntheticParagraph(rand, 3));
+        ++paragraphCount;
+
+        while (paragraphCount < paragraphsPerScene) {
+            if (names.isEmpty() || rand.bounded(10) < 3) {
+                addParagraph(SceneElement::Action, syntheticParagraph(rand, 3));
+                ++paragraphCount;
+                continue;
+            }
+
+            addParagraph(SceneElement::Character, names.at(rand.bounded(names.size())));
+            if (rand.bounded(5) == 0) {
+                addParagraph(SceneElement::Parenthetical, syntheticSentence(rand, 1, 3));
+                ++paragraphCount;
+            }
+            addParagraph(SceneElement::Dialogue, syntheticParagraph(rand, 2));
+            paragraphCount += 2;
+        }
+
+        if (i % 5 == 4)
+            addParagraph(SceneElement::Transition, QStringLiteral("CUT TO:"));
+
+        scenes.append(scene);
+    }
+
+    if (attachmentCount <= 0 || scenes.isEmpty())
+        return;
+
+    const QDir dir(workDir);
+    for (int i = 0; i < attachmentCount; i++) {
+        // Noise doesn't compress, like most photos attached to real documents.
+        QImage image(attachmentSize, attachmentSize, QImage::Format_RGB32);
+        for (int y = 0; y < image.height(); y++) {
+            QRgb *line = reinterpret_cast<QRgb *>(image.scanLine(y));
+            for (int x = 0; x < image.width(); x++)
+                line[x] = rand.generate() | 0xff000000;
+        }
+
+        const QString fileName = dir.absoluteFilePath(QStringLiteral("attachment_%1.png").arg(i));
+        if (!image.save(fileName))
+            continue;
+
+        Scene *scene = scenes.at(int(qint64(i) * scenes.size() / attachmentCount));
+        scene->attachments()->includeAttachment(fileName);
+    }
+}
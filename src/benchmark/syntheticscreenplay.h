@@ -0,0 +1,43 @@
+/****************************************************************************
+**
+** Copyright (C) VCreate Logic Pvt. Ltd. Bengaluru
+** Author: Prashanth N Udupa (prashanth@scrite.io)
+**
+** This code is distributed under GPL v3. Complete text of the license
+** can be found here: https://www.gnu.org/licenses/gpl-3.0.txt
+**
+** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+**
+****************************************************************************/
+
+#ifndef SYNTHETICSCREENPLAY_H
+#define SYNTHETICSCREENPLAY_H
+
+#include <QStringList>
+#include <QJsonObject>
+
+class ScriteDocument;
+
+/**
+ * Generates screenplays of a given size for benchmarking. Output depends only on the sizes
+ * and the seed, so that numbers from different builds can be compared with each other.
+ */
+struct SyntheticScreenplay
+{
+    int sceneCount = 120;
+    int paragraphsPerScene = 16;
+    int characterCount = 24;
+    int attachmentCount = 0;
+    int attachmentSize = 256; // width and height of attached images, in pixels
+    quint32 seed = 1;
+
+    QStringList characterNames() const;
+    QJsonObject toJson() const;
+
+    // Adds scenes to an empty document. Attachments are generated as images in workDir, and
+    // spread evenly across scenes.
+    void populate(ScriteDocument *document, const QString &workDir) const;
+};
+
+#endif // SYNTHETICSCREENPLAY_H
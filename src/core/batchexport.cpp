@@ -0,0 +1,470 @@
+/****************************************************************************
+**
+** Copyright (C) VCreate Logic Pvt. Ltd. Bengaluru
+** Author: Prashanth N Udupa (prashanth@scrite.io)
+**
+** This code is distributed under GPL v3. Complete text of the license
+** can be found here: https://www.gnu.org/licenses/gpl-3.0.txt
+**
+** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+**
+****************************************************************************/
+
+#include "batchexport.h"
+
+#include "aggregation.h"
+#include "user.h"
+#include "errorreport.h"
+#include "restapicall.h"
+#include "localstorage.h"
+#include "scritedocument.h"
+#include "abstractexporter.h"
+
+#include <QDir>
+#include <QSet>
+#include <QFile>
+#include <QTimer>
+#include <QThread>
+#include <QPointer>
+#include <QProcess>
+#include <QEventLoop>
+#include <QJsonArray>
+#include <QTextStream>
+#include <QElapsedTimer>
+#include <QJsonDocument>
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QRegularExpression>
+
+#include <climits>
+#include <functional>
+
+static const QString batchExportArg = QStringLiteral("--batch-export");
+static const QString batchWorkerArg = QStringLiteral("--batch-worker");
+
+static bool hasArgument(int argc, char **argv, const QString &name)
+{
+    for (int i = 1; i < argc; i++) {
+        const QString arg = QString::fromLocal8Bit(argv[i]);
+        if (arg == name || arg.startsWith(name + QLatin1Char('=')))
+            return true;
+    }
+
+    return false;
+}
+
+static QString fileNameExtension(const QJsonObject &format)
+{
+    static const QRegularExpression extensionRegExp(QStringLiteral("\\*\\.(\\w+)"));
+    return extensionRegExp.match(format.value(QStringLiteral("nameFilters")).toString())
+            .captured(1);
+}
+
+static QString errorMessage(QObject *object, const QString &fallback)
+{
+    const ErrorReport *report = Aggregation::findErrorReport(object);
+    const QString ret = report == nullptr ? QString() : report->errorMessage();
+    return ret.isEmpty() ? fallback : ret;
+}
+
+static QString seconds(qint64 ms)
+{
+    return QStringLiteral("%1 s").arg(ms / 1000.0, 0, 'f', 2);
+}
+
+bool BatchExport::isRequested(int argc, char **argv)
+{
+    return hasArgument(argc, argv, batchExportArg);
+}
+
+void BatchExport::prepare(int argc, char **argv)
+{
+    // Nothing is shown while exporting, so a display shouldn't be needed either.
+    if (!qEnvironmentVariableIsSet("QT_QPA_PLATFORM"))
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+
+    // Many workers run at once, while the application may be running too. Each write into
+    // LocalStorage replaces everything stored, so workers leave that to the process that
+    // started them.
+    if (hasArgument(argc, argv, batchWorkerArg))
+        LocalStorage::setReadOnly(true);
+}
+
+int BatchExport::exec()
+{
+    QCommandLineParser parser;
+    parser.setApplicationDescription(
+            QStringLiteral("Exports Scrite documents into another format, several at a time."));
+    parser.addHelpOption();
+    parser.addPositionalArgument(
+            QStringLiteral("files"),
+            QStringLiteral("Scrite documents, folders of them, or wildcard patterns of file "
+                           "names, like screenplays/*.scrite."),
+            QStringLiteral("[files...]"));
+
+    const QCommandLineOption formatOption(
+            batchExportArg.mid(2),
+            QStringLiteral("Format to export into: a format like Screenplay/Adobe PDF, its name "
+                           "or its file extension, like fdx."),
+            QStringLiteral("format"));
+    const QCommandLineOption fileListOption(
+            QStringLiteral("file-list"),
+            QStringLiteral("Text file listing documents to export, one on each line."),
+            QStringLiteral("file"));
+    const QCommandLineOption outputDirOption(
+            QStringLiteral("output-dir"),
+            QStringLiteral("Folder to export into. Exports are placed next to their documents "
+                           "by default."),
+            QStringLiteral("folder"));
+    const QCommandLineOption jobsOption(QStringLiteral("jobs"),
+                                        QStringLiteral("Number of documents to export at once."),
+                                        QStringLiteral("n"),
+                                        QString::number(QThread::idealThreadCount()));
+
+    // Used by workers, each of which exports one document.
+    QCommandLineOption workerOption(batchWorkerArg.mid(2), QString(),
+                                    QStringLiteral("file"));
+    QCommandLineOption workerOutputOption(QStringLiteral("batch-output"), QString(),
+                                          QStringLiteral("file"));
+    QCommandLineOption sessionTokenOption(QStringLiteral("sessionToken"), QString(),
+                                          QStringLiteral("token"));
+    workerOption.setFlags(QCommandLineOption::HiddenFromHelp);
+    workerOutputOption.setFlags(QCommandLineOption::HiddenFromHelp);
+    sessionTokenOption.setFlags(QCommandLineOption::HiddenFromHelp);
+
+    parser.addOptions({ formatOption, fileListOption, outputDirOption, jobsOption, workerOption,
+                        workerOutputOption, sessionTokenOption });
+    parser.process(QCoreApplication::arguments());
+
+    if (parser.isSet(workerOption)) {
+        const QJsonObject result =
+                BatchExport::exportFile(parser.value(workerOption), parser.value(formatOption),
+                                        parser.value(workerOutputOption));
+        QTextStream(stdout) << QJsonDocument(result).toJson(QJsonDocument::Compact) << "\n";
+        return result.value(QStringLiteral("success")).toBool() ? 0 : 1;
+    }
+
+    QTextStream err(stderr);
+
+    const QJsonObject format = BatchExport::findFormat(parser.value(formatOption));
+    if (format.isEmpty()) {
+        err << "Unknown export format '" << parser.value(formatOption)
+            << "'. Available formats are:\n";
+        const QJsonArray formats = ScriteDocument::instance()->supportedExportFormats();
+        for (const QJsonValue &item : formats)
+            err << "    " << item.toObject().value(QStringLiteral("key")).toString() << "\n";
+        return 1;
+    }
+
+    QStringList patterns = parser.positionalArguments();
+    if (parser.isSet(fileListOption)) {
+        QFile fileList(parser.value(fileListOption));
+        if (!fileList.open(QFile::ReadOnly | QFile::Text)) {
+            err << "Cannot read file list " << fileList.fileName() << "\n";
+            return 1;
+        }
+
+        QTextStream ts(&fileList);
+        while (!ts.atEnd()) {
+            const QString line = ts.readLine().trimmed();
+            if (!line.isEmpty() && !line.startsWith(QLatin1Char('#')))
+                patterns.append(line);
+        }
+    }
+
+    QStringList missing;
+    const QStringList files = BatchExport::findFiles(patterns, missing);
+    for (const QString &pattern : qAsConst(missing))
+        err << "No Scrite documents found at " << pattern << "\n";
+    err.flush();
+
+    if (files.isEmpty()) {
+        err << "Nothing to export.\n";
+        return 1;
+    }
+
+    const QString outputDir = parser.value(outputDirOption);
+    if (!outputDir.isEmpty() && !QDir().mkpath(outputDir)) {
+        err << "Cannot create output folder " << outputDir << "\n";
+        return 1;
+    }
+
+    const int jobs = qBound(1, parser.value(jobsOption).toInt(), files.size());
+    const int ret = BatchExport::exportFiles(files, format, outputDir, jobs);
+    return missing.isEmpty() ? ret : 1;
+}
+
+QString BatchExport::waitForSessionToken()
+{
+    // User::instance() asks for a new session when this process starts. The token is kept in
+    // memory only, so it can be handed to workers once the answer comes.
+    QPointer<SessionNewRestApiCall> sessionCall =
+            User::instance()->findChild<SessionNewRestApiCall *>(QString(),
+                                                                 Qt::FindDirectChildrenOnly);
+    if (!sessionCall.isNull() && sessionCall->isBusy()) {
+        QEventLoop eventLoop;
+        QObject::connect(sessionCall, &RestApiCall::busyChanged, &eventLoop, &QEventLoop::quit);
+        QObject::connect(sessionCall, &QObject::destroyed, &eventLoop, &QEventLoop::quit);
+        QTimer::singleShot(30000, &eventLoop, &QEventLoop::quit);
+        eventLoop.exec();
+    }
+
+    return LocalStorage::load("sessionToken").toString();
+}
+
+QJsonObject BatchExport::findFormat(const QString &format)
+{
+    const QString given = format.trimmed();
+
+    QString extension = given;
+    while (extension.startsWith(QLatin1Char('*')) || extension.startsWith(QLatin1Char('.')))
+        extension.remove(0, 1);
+
+    // Keys match before names, and names before extensions. Several formats export PDFs, so
+    // among equal matches screenplay formats are preferred.
+    QJsonObject ret;
+    int retRank = INT_MAX;
+
+    const QJsonArray formats = ScriteDocument::instance()->supportedExportFormats();
+    for (const QJsonValue &item : formats) {
+        const QJsonObject object = item.toObject();
+
+        const QString key = object.value(QStringLiteral("key")).toString();
+        const QString name = object.value(QStringLiteral("name")).toString();
+
+        int rank = -1;
+        if (key.compare(given, Qt::CaseInsensitive) == 0)
+            rank = 0;
+        else if (name.compare(given, Qt::CaseInsensitive) == 0)
+            rank = 2;
+        else if (!extension.isEmpty()
+                 && fileNameExtension(object).compare(extension, Qt::CaseInsensitive) == 0)
+            rank = 4;
+        if (rank < 0)
+            continue;
+
+        if (object.value(QStringLiteral("category")).toString() != QStringLiteral("Screenplay"))
+            ++rank;
+
+        if (rank < retRank) {
+            ret = object;
+            retRank = rank;
+        }
+    }
+
+    return ret;
+}
+
+QStringList BatchExport::findFiles(const QStringList &patterns, QStringList &missing)
+{
+    QStringList ret;
+    QSet<QString> added;
+
+    for (const QString &pattern : patterns) {
+        const QFileInfo fi(pattern);
+        const QString name = fi.fileName();
+
+        QFileInfoList found;
+        if (fi.isDir())
+            found = QDir(fi.absoluteFilePath())
+                            .entryInfoList({ QStringLiteral("*.scrite") }, QDir::Files, QDir::Name);
+        else if (name.contains(QLatin1Char('*')) || name.contains(QLatin1Char('?'))
+                 || name.contains(QLatin1Char('[')))
+            found = fi.absoluteDir().entryInfoList({ name }, QDir::Files, QDir::Name);
+        else if (fi.isFile())
+            found.append(fi);
+
+        if (found.isEmpty())
+            missing.append(pattern);
+
+        for (const QFileInfo &file : qAsConst(found)) {
+            const QString filePath = file.absoluteFilePath();
+            if (added.contains(filePath))
+                continue;
+
+            added.insert(filePath);
+            ret.append(filePath);
+        }
+    }
+
+    return ret;
+}
+
+int BatchExport::exportFiles(const QStringList &files, const QJsonObject &format,
+                             const QString &outputDir, int jobs)
+{
+    const QString formatKey = format.value(QStringLiteral("key")).toString();
+    const QString extension = fileNameExtension(format);
+
+    // Documents with the same name, from different folders, would otherwise overwrite each
+    // other's exports.
+    QStringList outputFileNames;
+    QSet<QString> outputFileNamesTaken;
+    for (const QString &file : files) {
+        const QFileInfo fi(file);
+        const QDir dir(outputDir.isEmpty() ? fi.absolutePath() : outputDir);
+
+        QString outputFileName =
+                dir.absoluteFilePath(fi.completeBaseName() + QLatin1Char('.') + extension);
+        for (int i = 2; outputFileNamesTaken.contains(outputFileName.toLower()); i++)
+            outputFileName = dir.absoluteFilePath(QStringLiteral("%1 (%2).%3")
+                                                          .arg(fi.completeBaseName())
+                                                          .arg(i)
+                                                          .arg(extension));
+
+        outputFileNamesTaken.insert(outputFileName.toLower());
+        outputFileNames.append(outputFileName);
+    }
+
+    // Workers reuse this session, instead of each starting one of their own.
+    const QString sessionToken = BatchExport::waitForSessionToken();
+
+    QTextStream out(stdout);
+    out << "Exporting " << files.size() << " file(s) to " << formatKey << ", " << jobs
+        << " at a time." << Qt::endl;
+
+    const int counterWidth = QString::number(files.size()).length();
+    int nextFile = 0, running = 0, finished = 0, succeeded = 0;
+    qint64 totalFileMs = 0, totalLoadMs = 0, totalExportMs = 0;
+
+    QEventLoop eventLoop;
+    QElapsedTimer batchTimer;
+    batchTimer.start();
+
+    std::function<void()> startWorkers;
+    auto workerFinished = [&](int index, QProcess *process, qint64 fileMs) {
+        QJsonObject result;
+        const QList<QByteArray> lines = process->readAllStandardOutput().split('\n');
+        for (auto it = lines.crbegin(); it != lines.crend(); ++it) {
+            if (it->startsWith('{')) {
+                result = QJsonDocument::fromJson(*it).object();
+                break;
+            }
+        }
+
+        const bool crashed = process->error() == QProcess::FailedToStart
+                || process->exitStatus() == QProcess::CrashExit;
+        const bool success = !crashed && process->exitCode() == 0
+                && result.value(QStringLiteral("success")).toBool();
+
+        const QString counter =
+                QStringLiteral("[%1/%2]").arg(++finished, counterWidth).arg(files.size());
+        totalFileMs += fileMs;
+
+        if (success) {
+            const qint64 loadMs = qint64(result.value(QStringLiteral("loadMs")).toDouble());
+            const qint64 exportMs = qint64(result.value(QStringLiteral("exportMs")).toDouble());
+            totalLoadMs += loadMs;
+            totalExportMs += exportMs;
+            ++succeeded;
+
+            out << counter << " done    " << seconds(fileMs) << " (load " << seconds(loadMs)
+                << ", export " << seconds(exportMs) << ")  " << files.at(index) << " -> "
+                << result.value(QStringLiteral("output")).toString() << Qt::endl;
+        } else {
+            QString error = result.value(QStringLiteral("error")).toString();
+            if (error.isEmpty())
+                error = crashed ? process->errorString() : QStringLiteral("Export failed.");
+
+            out << counter << " FAILED  " << seconds(fileMs) << "  " << files.at(index) << ": "
+                << error << Qt::endl;
+        }
+
+        process->deleteLater();
+        --running;
+        startWorkers();
+    };
+
+    startWorkers = [&]() {
+        while (running < jobs && nextFile < files.size()) {
+            const int index = nextFile++;
+            ++running;
+
+            QElapsedTimer fileTimer;
+            fileTimer.start();
+
+            QStringList args = { batchExportArg, formatKey, batchWorkerArg, files.at(index),
+                                 QStringLiteral("--batch-output"), outputFileNames.at(index) };
+            if (!sessionToken.isEmpty())
+                args += { QStringLiteral("--sessionToken"), sessionToken };
+
+            QProcess *process = new QProcess(&eventLoop);
+            process->setProgram(QCoreApplication::applicationFilePath());
+            process->setArguments(args);
+            QObject::connect(process, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished),
+                             &eventLoop, [=, &workerFinished]() {
+                                 workerFinished(index, process, fileTimer.elapsed());
+                             });
+            QObject::connect(process, &QProcess::errorOccurred, &eventLoop,
+                             [=, &workerFinished](QProcess::ProcessError error) {
+                                 if (error == QProcess::FailedToStart)
+                                     workerFinished(index, process, fileTimer.elapsed());
+                             });
+            process->start();
+        }
+
+        if (running == 0)
+            eventLoop.quit();
+    };
+
+    startWorkers();
+    if (running > 0)
+        eventLoop.exec();
+
+    const qint64 batchMs = qMax<qint64>(batchTimer.elapsed(), 1);
+    const int failed = files.size() - succeeded;
+
+    out << Qt::endl
+        << "Exported " << succeeded << " of " << files.size() << " file(s) in "
+        << seconds(batchMs) << ", " << failed << " failed." << Qt::endl;
+    out << "Throughput: " << QString::number(succeeded * 1000.0 / batchMs, 'f', 2)
+        << " files/s, with " << jobs << " worker(s)." << Qt::endl;
+    out << "Time taken by files adds up to " << seconds(totalFileMs) << ", "
+        << QString::number(double(totalFileMs) / batchMs, 'f', 1) << "x the elapsed time."
+        << Qt::endl;
+    if (succeeded > 0)
+        out << "Average per file: load " << seconds(totalLoadMs / succeeded) << ", export "
+            << seconds(totalExportMs / succeeded) << "." << Qt::endl;
+
+    return failed == 0 ? 0 : 1;
+}
+
+QJsonObject BatchExport::exportFile(const QString &fileName, const QString &format,
+                                    const QString &outputFileName)
+{
+    QJsonObject ret;
+    ret.insert(QStringLiteral("file"), fileName);
+    ret.insert(QStringLiteral("success"), false);
+
+    ScriteDocument *document = ScriteDocument::instance();
+
+    QElapsedTimer timer;
+    timer.start();
+
+    const bool loaded = document->openAnonymously(fileName);
+    ret.insert(QStringLiteral("loadMs"), timer.restart());
+    if (!loaded) {
+        ret.insert(QStringLiteral("error"),
+                   errorMessage(document, QStringLiteral("Could not load the document.")));
+        return ret;
+    }
+
+    // The exporter is handed over to GarbageCollector once written.
+    AbstractExporter *exporter = document->createExporter(format);
+    if (exporter == nullptr) {
+        ret.insert(QStringLiteral("error"), QStringLiteral("Unknown export format %1").arg(format));
+        return ret;
+    }
+
+    exporter->setFileName(outputFileName);
+    const bool written = exporter->write();
+    ret.insert(QStringLiteral("exportMs"), timer.elapsed());
+    ret.insert(QStringLiteral("output"), exporter->fileName());
+    ret.insert(QStringLiteral("success"), written);
+    if (!written)
+        ret.insert(QStringLiteral("error"),
+                   errorMessage(exporter, QStringLiteral("Could not export the document.")));
+
+    return ret;
+}
@@ -0,0 +1,54 @@
+/****************************************************************************
+**
+** Copyright (C) VCreate Logic Pvt. Ltd. Bengaluru
+** Author: Prashanth N Udupa (prashanth@scrite.io)
+**
+** This code is distributed under GPL v3. Complete text of the license
+** can be found here: https://www.gnu.org/licenses/gpl-3.0.txt
+**
+** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+**
+****************************************************************************/
+
+#ifndef BATCHEXPORT_H
+#define BATCHEXPORT_H
+
+#include <QStringList>
+#include <QJsonObject>
+
+/**
+ * Exports a list of Scrite documents into one format from the command line, without showing
+ * any window. For example:
+ *
+ *     scrite --batch-export pdf --jobs 4 --output-dir exports ~/Screenplays/*.scrite
+ *
+ * ScriteDocument is a singleton, so every document is loaded and exported by a worker process
+ * (this same executable, launched with --batch-worker) and at most --jobs of them run at once.
+ * Workers are handed the login session of the process that starts them, and never write into
+ * LocalStorage. Timings of each file are printed as workers finish, followed by a throughput
+ * summary.
+ */
+class BatchExport
+{
+public:
+    // Whether the command line asks for a batch export instead of the application window.
+    static bool isRequested(int argc, char **argv);
+
+    // Must be called before Application is created, if isRequested().
+    static void prepare(int argc, char **argv);
+
+    // Must be called after ScriteDocument::instance() is created. Returns the exit code.
+    static int exec();
+
+private:
+    static QString waitForSessionToken();
+    static QJsonObject findFormat(const QString &format);
+    static QStringList findFiles(const QStringList &patterns, QStringList &missing);
+    static int exportFiles(const QStringList &files, const QJsonObject &format,
+                           const QString &outputDir, int jobs);
+    static QJsonObject exportFile(const QString &fileName, const QString &format,
+                                  const QString &outputFileName);
+};
+
+#endif // BATCHEXPORT_H
@@ -19,10 +19,13 @@
 
 #include <QDir>
 #include <QFile>
+#include <QSaveFile>
 #include <QDataStream>
 #include <QStandardPaths>
 #include <QSettings>
 
+static bool LocalStorageReadOnly = false;
+
 class EncryptedDataStore
 {
 public:
@@ -60,12 +63,14 @@ EncryptedDataStore::~EncryptedDataStore() { }
 
 void EncryptedDataStore::save()
 {
-    if (this->data.isEmpty())
+    if (this->data.isEmpty() || ::LocalStorageReadOnly)
         return;
 
     const QString appDataFolder = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
 
-    QFile file(QDir(appDataFolder).absoluteFilePath("localstore.db"));
+    // Other Scrite processes may be reading the file meanwhile, they must never find it
+    // half written.
+    QSaveFile file(QDir(appDataFolder).absoluteFilePath("localstore.db"));
     if (!file.open(QFile::WriteOnly))
         return;
 
@@ -84,6 +89,7 @@ void EncryptedDataStore::save()
     const QByteArray encryptedBytes = sc.encryptToByteArray(decryptedBytes);
 
     file.write(encryptedBytes);
+    file.commit();
 }
 
 Q_GLOBAL_STATIC(EncryptedDataStore, DataStore)
@@ -110,6 +116,16 @@ void LocalStorage::reset()
     ::DataStore->data.clear();
 }
 
+void LocalStorage::setReadOnly(bool val)
+{
+    ::LocalStorageReadOnly = val;
+}
+
+bool LocalStorage::isReadOnly()
+{
+    return ::LocalStorageReadOnly;
+}
+
 QJsonObject LocalStorage::compile(const QJsonObject &object)
 {
     QJsonObject ret;
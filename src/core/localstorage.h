@@ -26,6 +26,11 @@ public:
     static QVariant load(const QString &key, const QVariant &defaultValue = QVariant());
     static void reset();
 
+    // Stored values are kept in memory only, nothing is written to disk. For processes that
+    // run alongside the one that owns the storage, like batch export workers.
+    static void setReadOnly(bool val);
+    static bool isReadOnly();
+
     static QJsonObject compile(const QJsonObject &object);
 };
 
@@ -14,29 +14,379 @@
 #include "documentfilesystem.h"
 
 #include <QDir>
+#include <QSet>
+#include <QHash>
 #include <QtDebug>
+#include <QtEndian>
 #include <QDateTime>
+#include <QJsonArray>
 #include <QDataStream>
+#include <QJsonDocument>
+#include <QElapsedTimer>
 #include <QTemporaryDir>
 #include <QFutureWatcher>
 #include <QStandardPaths>
+#include <QCborValue>
+#include <QCborStreamReader>
+#include <QCborStreamWriter>
+#include <QtConcurrentMap>
 #include <QtConcurrentRun>
 
+#include <zlib.h>
+
 #include "quazip.h"
 #include "quazipfile.h"
 #include "simplecrypt.h"
+#include "timeprofiler.h"
 #include "restapikey/restapikey.h"
 
+/**
+ * Remembers the ZIP archive from which the DFS folder was last loaded, or into
+ * which it was last saved, along with the size and modification time of each
+ * entry as it was found in the folder at that time. Entries that have not been
+ * touched since can be copied as-is (without recompressing) from the archive
+ * during the next save.
+ */
+struct DocumentFileSystemArchive
+{
+    struct Entry
+    {
+        qint64 size = -1;
+        QDateTime lastModified;
+    };
+
+    QString fileName;
+    qint64 fileSize = -1;
+    QDateTime fileLastModified;
+    QHash<QString, Entry> entries;
+    QSet<QString> dirtyEntries;
+
+    void clear()
+    {
+        fileName.clear();
+        fileSize = -1;
+        fileLastModified = QDateTime();
+        entries.clear();
+        dirtyEntries.clear();
+    }
+
+    bool isUsable() const
+    {
+        if (fileName.isEmpty() || entries.isEmpty())
+            return false;
+
+        // If the archive was modified outside of this DFS, we cannot trust it anymore.
+        const QFileInfo fi(fileName);
+        return fi.exists() && fi.size() == fileSize && fi.lastModified() == fileLastModified;
+    }
+
+    bool isClean(const QString &path, const QFileInfo &fi) const
+    {
+        if (dirtyEntries.contains(path))
+            return false;
+
+        const auto it = entries.constFind(path);
+        if (it == entries.constEnd())
+            return false;
+
+        return it->size == fi.size() && it->lastModified == fi.lastModified();
+    }
+
+    void captureEntries(const QDir &folder, const QStringList &paths)
+    {
+        entries.clear();
+        for (const QString &path : paths) {
+            const QFileInfo entryInfo(folder.absoluteFilePath(path));
+            if (!entryInfo.exists())
+                continue;
+
+            Entry entry;
+            entry.size = entryInfo.size();
+            entry.lastModified = entryInfo.lastModified();
+            entries.insert(path, entry);
+        }
+    }
+
+    void captureFile(const QString &archiveFileName)
+    {
+        const QFileInfo fi(archiveFileName);
+        fileName = fi.absoluteFilePath();
+        fileSize = fi.size();
+        fileLastModified = fi.lastModified();
+    }
+};
+
+/**
+ * Keeps the ZIP archive from which the DFS was loaded open and memory mapped, so that
+ * its members need not be extracted into the DFS folder upfront. Stored members are
+ * copied straight out of the map, deflated ones are inflated when they are first read.
+ *
+ * Only archives written by Scrite are handled here, ie no ZIP64, encryption or compression
+ * methods other than deflate. open() returns false for anything else, in which case the
+ * archive has to be extracted the usual way.
+ */
+struct DocumentFileSystemLazyArchive
+{
+    struct Member
+    {
+        qint64 dataOffset = 0;
+        qint64 compressedSize = 0;
+        qint64 size = 0;
+        quint32 crc = 0;
+        int method = 0; // 0 for stored, Z_DEFLATED for deflated
+    };
+
+    QString fileName;
+    QFile file;
+    const uchar *map = nullptr;
+    qint64 mapSize = 0;
+    QHash<QString, Member> members;
+
+    ~DocumentFileSystemLazyArchive() { this->close(); }
+
+    bool open(const QString &archiveFileName);
+    void close();
+
+    QByteArray read(const QString &path, bool *ok = nullptr) const;
+    bool extract(const QString &path, const QString &dstFileName) const;
+
+    // Copies the given members, as is, into qzip. Members that also exist in rootDir are skipped,
+    // because the ones in the folder are newer. Returns false if any of the others could not be
+    // copied.
+    bool copyMembers(const QSet<QString> &paths, const QDir &rootDir, QuaZip &qzip,
+                     QSet<QString> &copiedEntries) const;
+
+private:
+    quint16 u16(qint64 offset) const { return qFromLittleEndian<quint16>(map + offset); }
+    quint32 u32(qint64 offset) const { return qFromLittleEndian<quint32>(map + offset); }
+};
+
+bool DocumentFileSystemLazyArchive::open(const QString &archiveFileName)
+{
+    this->close();
+
+    file.setFileName(archiveFileName);
+    if (!file.open(QFile::ReadOnly))
+        return false;
+
+    mapSize = file.size();
+    map = mapSize > 0 ? file.map(0, mapSize) : nullptr;
+    if (map == nullptr) {
+        this->close();
+        return false;
+    }
+
+    // Locate the end of central directory record, it is followed by a comment of upto 64K.
+    const qint64 eocdSize = 22;
+    qint64 eocd = -1;
+    for (qint64 pos = mapSize - eocdSize; pos >= qMax(qint64(0), mapSize - eocdSize - 65535);
+         pos--) {
+        if (u32(pos) == 0x06054b50) {
+            eocd = pos;
+            break;
+        }
+    }
+
+    const quint32 zip64Marker = 0xFFFFFFFF;
+    if (eocd < 0 || u16(eocd + 10) == 0xFFFF || u32(eocd + 16) == zip64Marker) {
+        this->close();
+        return false;
+    }
+
+    const int nrEntries = u16(eocd + 10);
+    qint64 pos = u32(eocd + 16);
+    for (int i = 0; i < nrEntries; i++) {
+        if (pos + 46 > eocd || u32(pos) != 0x02014b50) {
+            this->close();
+            return false;
+        }
+
+        const quint16 flags = u16(pos + 8);
+        const quint16 method = u16(pos + 10);
+        const quint32 compressedSize = u32(pos + 20);
+        const quint32 size = u32(pos + 24);
+        const int nameLength = u16(pos + 28);
+        const int extraLength = u16(pos + 30);
+        const int commentLength = u16(pos + 32);
+        const quint32 localHeader = u32(pos + 42);
+
+        const bool unsupported = (flags & 0x1) || (method != 0 && method != Z_DEFLATED)
+                || compressedSize == zip64Marker || size == zip64Marker
+                || localHeader == zip64Marker;
+        if (unsupported || localHeader + 30 > quint64(mapSize)
+            || u32(localHeader) != 0x04034b50) {
+            this->close();
+            return false;
+        }
+
+        const QString name = QString::fromUtf8(reinterpret_cast<const char *>(map + pos + 46),
+                                               nameLength);
+
+        Member member;
+        member.dataOffset = localHeader + 30 + u16(localHeader + 26) + u16(localHeader + 28);
+        member.compressedSize = compressedSize;
+        member.size = size;
+        member.crc = u32(pos + 16);
+        member.method = method;
+        if (member.dataOffset + member.compressedSize > mapSize) {
+            this->close();
+            return false;
+        }
+
+        if (!name.endsWith(QLatin1Char('/')))
+            members.insert(name, member);
+
+        pos += 46 + nameLength + extraLength + commentLength;
+    }
+
+    fileName = QFileInfo(archiveFileName).absoluteFilePath();
+    return true;
+}
+
+void DocumentFileSystemLazyArchive::close()
+{
+    if (map != nullptr)
+        file.unmap(const_cast<uchar *>(map));
+    file.close();
+
+    map = nullptr;
+    mapSize = 0;
+    members.clear();
+    fileName.clear();
+}
+
+QByteArray DocumentFileSystemLazyArchive::read(const QString &path, bool *ok) const
+{
+    if (ok)
+        *ok = false;
+
+    const auto it = members.constFind(path);
+    if (it == members.constEnd() || map == nullptr)
+        return QByteArray();
+
+    const Member &member = it.value();
+    const char *data = reinterpret_cast<const char *>(map + member.dataOffset);
+
+    QByteArray ret;
+    if (member.method == 0)
+        ret = QByteArray(data, int(member.compressedSize));
+    else {
+        ret.resize(int(member.size));
+
+        z_stream zs {};
+        if (inflateInit2(&zs, -MAX_WBITS) != Z_OK)
+            return QByteArray();
+
+        zs.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+        zs.avail_in = uInt(member.compressedSize);
+        zs.next_out = reinterpret_cast<Bytef *>(ret.data());
+        zs.avail_out = uInt(ret.size());
+
+        const bool inflatedFully = inflate(&zs, Z_FINISH) == Z_STREAM_END;
+        const qint64 inflatedSize = qint64(zs.total_out);
+        inflateEnd(&zs);
+
+        if (!inflatedFully || inflatedSize != member.size)
+            return QByteArray();
+    }
+
+    const quint32 crc = quint32(::crc32(::crc32(0L, nullptr, 0),
+                                        reinterpret_cast<const Bytef *>(ret.constData()),
+                                        uInt(ret.size())));
+    if (crc != member.crc) {
+        qInfo("Checksum mismatch for '%s' in %s", qPrintable(path), qPrintable(fileName));
+        return QByteArray();
+    }
+
+    if (ok)
+        *ok = true;
+    return ret;
+}
+
+bool DocumentFileSystemLazyArchive::extract(const QString &path, const QString &dstFileName) const
+{
+    bool ok = false;
+    const QByteArray bytes = this->read(path, &ok);
+    if (!ok)
+        return false;
+
+    QDir().mkpath(QFileInfo(dstFileName).absolutePath());
+
+    QFile dstFile(dstFileName);
+    if (!dstFile.open(QFile::WriteOnly)) {
+        qInfo("Could not open '%s' for writing.", qPrintable(dstFileName));
+        return false;
+    }
+
+    return dstFile.write(bytes) == bytes.size();
+}
+
+bool DocumentFileSystemLazyArchive::copyMembers(const QSet<QString> &paths, const QDir &rootDir,
+                                                QuaZip &qzip, QSet<QString> &copiedEntries) const
+{
+    for (const QString &path : paths) {
+        if (copiedEntries.contains(path) || QFileInfo::exists(rootDir.absoluteFilePath(path)))
+            continue;
+
+        const auto it = members.constFind(path);
+        if (it == members.constEnd() || map == nullptr) {
+            qInfo("Could not find '%s' in %s.", qPrintable(path), qPrintable(fileName));
+            return false;
+        }
+
+        const Member &member = it.value();
+
+        QuaZipNewInfo newInfo(path);
+        newInfo.uncompressedSize = ulong(member.size);
+
+        QuaZipFile dstFile(&qzip);
+        if (!dstFile.open(QFile::WriteOnly, newInfo, nullptr, member.crc, member.method,
+                          member.method == 0 ? 0 : Z_DEFAULT_COMPRESSION, true)) {
+            qInfo("Could not open '%s' for writing.", qPrintable(path));
+            return false;
+        }
+
+        const qint64 bytesWritten = dstFile.write(
+                reinterpret_cast<const char *>(map + member.dataOffset), member.compressedSize);
+        dstFile.close();
+
+        if (bytesWritten != member.compressedSize || dstFile.getZipError() != ZIP_OK) {
+            qInfo("Could not copy '%s' into the archive.", qPrintable(path));
+            return false;
+        }
+
+        copiedEntries.insert(path);
+    }
+
+    return true;
+}
+
 struct DocumentFileSystemData
 {
     QByteArray header;
+    DocumentFileSystem::HeaderFormat headerFormat = DocumentFileSystem::JsonHeader;
+    QByteArray metadata;
     QList<DocumentFile *> files;
     QMutex folderMutex;
     QScopedPointer<QTemporaryDir> folder;
     qint64 fileNameCounter = 0;
 
+    QMutex archiveMutex;
+    DocumentFileSystemArchive archive;
+    QJsonObject saveStatistics;
+
+    // Members of the lazy archive that are not (yet) in the folder. The lazy archive itself is
+    // replaced only while holding both folderMutex and archiveMutex, so holding either of them
+    // is enough to read from it.
+    QScopedPointer<DocumentFileSystemLazyArchive> lazyArchive;
+    QSet<QString> lazyMembers;
+
     static const QString normalHeaderFile;
     static const QString encryptedHeaderFile;
+    static const QString normalCborHeaderFile;
+    static const QString encryptedCborHeaderFile;
+    static const QString normalMetadataFile;
+    static const QString encryptedMetadataFile;
 
     void pack(QDataStream &ds, const QString &path);
 
@@ -47,6 +397,46 @@ struct DocumentFileSystemData
         return ret;
     }
 
+    void markDirty(const QString &absolutePath)
+    {
+        const QString path = QDir(folder->path()).relativeFilePath(absolutePath);
+
+        QMutexLocker archiveMutexLocker(&archiveMutex);
+        archive.dirtyEntries.insert(path);
+    }
+
+    QString lazyMemberPath(const QString &path) const
+    {
+        return QDir::isAbsolutePath(path) ? QDir(folder->path()).relativeFilePath(path)
+                                          : QDir::cleanPath(path);
+    }
+
+    bool isLazyMember(const QString &path)
+    {
+        QMutexLocker archiveMutexLocker(&archiveMutex);
+        return lazyMembers.contains(this->lazyMemberPath(path));
+    }
+
+    void forgetLazyMember(const QString &path)
+    {
+        QMutexLocker archiveMutexLocker(&archiveMutex);
+        lazyMembers.remove(this->lazyMemberPath(path));
+    }
+
+    QByteArray readLazyMember(const QString &path, bool *ok);
+    void extractLazyMember(const QString &path);
+
+    struct HeaderFile
+    {
+        QString name;
+        DocumentFileSystem::HeaderFormat format = DocumentFileSystem::JsonHeader;
+        bool encrypted = false;
+    };
+
+    // All header members, in the order in which load() looks for them.
+    static const QList<HeaderFile> &headerFiles();
+    static QString headerFileName(DocumentFileSystem::HeaderFormat format, bool encrypt);
+
 private:
     void filePaths(QStringList &paths, const QString &dirPath) const;
 };
@@ -54,6 +444,31 @@ private:
 const QString DocumentFileSystemData::normalHeaderFile = QStringLiteral("_header.json");
 const QString DocumentFileSystemData::encryptedHeaderFile =
         QStringLiteral("_header.json_encrypted");
+const QString DocumentFileSystemData::normalCborHeaderFile = QStringLiteral("_header.cbor");
+const QString DocumentFileSystemData::encryptedCborHeaderFile =
+        QStringLiteral("_header.cbor_encrypted");
+const QString DocumentFileSystemData::normalMetadataFile = QStringLiteral("_metadata.json");
+const QString DocumentFileSystemData::encryptedMetadataFile =
+        QStringLiteral("_metadata.json_encrypted");
+
+const QList<DocumentFileSystemData::HeaderFile> &DocumentFileSystemData::headerFiles()
+{
+    static const QList<HeaderFile> ret = {
+        { normalCborHeaderFile, DocumentFileSystem::CborHeader, false },
+        { encryptedCborHeaderFile, DocumentFileSystem::CborHeader, true },
+        { normalHeaderFile, DocumentFileSystem::JsonHeader, false },
+        { encryptedHeaderFile, DocumentFileSystem::JsonHeader, true },
+    };
+    return ret;
+}
+
+QString DocumentFileSystemData::headerFileName(DocumentFileSystem::HeaderFormat format,
+                                               bool encrypt)
+{
+    if (format == DocumentFileSystem::CborHeader)
+        return encrypt ? encryptedCborHeaderFile : normalCborHeaderFile;
+    return encrypt ? encryptedHeaderFile : normalHeaderFile;
+}
 
 void DocumentFileSystemData::pack(QDataStream &ds, const QString &path)
 {
@@ -94,6 +509,42 @@ void DocumentFileSystemData::pack(QDataStream &ds, const QString &path)
     }
 }
 
+QByteArray DocumentFileSystemData::readLazyMember(const QString &path, bool *ok)
+{
+    *ok = false;
+
+    QMutexLocker archiveMutexLocker(&archiveMutex);
+    const QString memberPath = this->lazyMemberPath(path);
+    if (!lazyMembers.contains(memberPath) || lazyArchive.isNull())
+        return QByteArray();
+
+    return lazyArchive->read(memberPath, ok);
+}
+
+void DocumentFileSystemData::extractLazyMember(const QString &path)
+{
+    QMutexLocker archiveMutexLocker(&archiveMutex);
+    const QString memberPath = this->lazyMemberPath(path);
+    if (!lazyMembers.contains(memberPath) || lazyArchive.isNull())
+        return;
+
+    const QString dstFileName = QDir(folder->path()).absoluteFilePath(memberPath);
+    if (!lazyArchive->extract(memberPath, dstFileName))
+        return;
+
+    lazyMembers.remove(memberPath);
+
+    // The extracted file is identical to the entry in the archive last loaded or saved, so it
+    // can be copied raw from there during the next save.
+    if (!archive.fileName.isEmpty()) {
+        const QFileInfo dstFileInfo(dstFileName);
+        DocumentFileSystemArchive::Entry entry;
+        entry.size = dstFileInfo.size();
+        entry.lastModified = dstFileInfo.lastModified();
+        archive.entries.insert(memberPath, entry);
+    }
+}
+
 void DocumentFileSystemData::filePaths(QStringList &paths, const QString &dirPath) const
 {
     QDir fsDir(this->folder->path());
@@ -136,6 +587,8 @@ void DocumentFileSystem::hardReset()
 void DocumentFileSystem::reset()
 {
     d->header.clear();
+    d->headerFormat = JsonHeader;
+    d->metadata.clear();
     d->fileNameCounter = QDateTime::currentMSecsSinceEpoch();
 
     while (!d->files.isEmpty()) {
@@ -145,6 +598,13 @@ void DocumentFileSystem::reset()
 
     d->folder.reset(new QTemporaryDir);
 
+    {
+        QMutexLocker archiveMutexLocker(&d->archiveMutex);
+        d->archive.clear();
+        d->lazyArchive.reset();
+        d->lazyMembers.clear();
+    }
+
 #ifndef QT_NO_DEBUG_OUTPUT_OUTPUT
     qDebug() << "PA: " << d->folder->path();
 #endif
@@ -205,8 +665,10 @@ bool doUnzip(const QFileInfo &fileInfo, const QTemporaryDir &dstDir)
     return true;
 }
 
-bool DocumentFileSystem::load(const QString &fileName, Format *format)
+bool DocumentFileSystem::load(const QString &fileName, Format *format, LoadMode mode)
 {
+    PROFILE_THIS_FUNCTION;
+
     QMutexLocker mutexLocker(&d->folderMutex);
 
 #ifndef QT_NO_DEBUG_OUTPUT_OUTPUT
@@ -238,28 +700,64 @@ bool DocumentFileSystem::load(const QString &fileName, Format *format)
     // document as a ZIP file.
     file.close();
 
+    if (mode == LazyLoadMode) {
+        QScopedPointer<DocumentFileSystemLazyArchive> lazyArchive(
+                new DocumentFileSystemLazyArchive);
+        if (lazyArchive->open(fileName)) {
+            for (const DocumentFileSystemData::HeaderFile &headerFile :
+                 DocumentFileSystemData::headerFiles()) {
+                if (!lazyArchive->members.contains(headerFile.name))
+                    continue;
+
+                const QByteArray headerData = lazyArchive->read(headerFile.name);
+                if (headerFile.encrypted) {
+                    SimpleCrypt sc(REST_CRYPT_KEY);
+                    d->header = sc.decryptToByteArray(headerData);
+                } else
+                    d->header = headerData;
+                d->headerFormat = headerFile.format;
+                break;
+            }
+
+            QMutexLocker archiveMutexLocker(&d->archiveMutex);
+            const QList<QString> memberPaths = lazyArchive->members.keys();
+            d->lazyMembers = QSet<QString>(memberPaths.begin(), memberPaths.end());
+            d->lazyArchive.reset(lazyArchive.take());
+            d->archive.captureFile(fileName);
+
+            if (format)
+                *format = ZipFormat;
+
+            return !d->header.isEmpty();
+        }
+    }
+
     if (doUnzip(QFileInfo(fileName), *d->folder)) {
-        QString headerPath;
-
-        const QString normalPath = d->folder->filePath(DocumentFileSystemData::normalHeaderFile);
-        const QString encryptedPath =
-                d->folder->filePath(DocumentFileSystemData::encryptedHeaderFile);
-        if (QFile::exists(normalPath))
-            headerPath = normalPath;
-        else if (QFile::exists(encryptedPath))
-            headerPath = encryptedPath;
-        else
+        const DocumentFileSystemData::HeaderFile *headerFile = nullptr;
+        for (const DocumentFileSystemData::HeaderFile &candidate :
+             DocumentFileSystemData::headerFiles()) {
+            if (QFile::exists(d->folder->filePath(candidate.name))) {
+                headerFile = &candidate;
+                break;
+            }
+        }
+
+        if (headerFile == nullptr)
             return false;
 
-        QFile headerFile(headerPath);
+        QFile file(d->folder->filePath(headerFile->name));
 
-        const QByteArray headerData =
-                headerFile.open(QFile::ReadOnly) ? headerFile.readAll() : QByteArray();
-        if (headerPath == encryptedPath) {
+        const QByteArray headerData = file.open(QFile::ReadOnly) ? file.readAll() : QByteArray();
+        if (headerFile->encrypted) {
             SimpleCrypt sc(REST_CRYPT_KEY);
             d->header = sc.decryptToByteArray(headerData);
         } else
             d->header = headerData;
+        d->headerFormat = headerFile->format;
+
+        QMutexLocker archiveMutexLocker(&d->archiveMutex);
+        d->archive.captureEntries(QDir(d->folder->path()), d->filePaths());
+        d->archive.captureFile(fileName);
 
         if (format)
             *format = ZipFormat;
@@ -268,49 +766,317 @@ bool DocumentFileSystem::load(const QString &fileName, Format *format)
     return !d->header.isEmpty();
 }
 
-void doZipRecursively(const QDir &dir, const QDir &rootDir, QuaZip &qzip)
+void DocumentFileSystem::adopt(DocumentFileSystem &other)
+{
+    if (&other == this)
+        return;
+
+    // Waits for saves of the previous document, which hold folderMutex, to finish.
+    QMutexLocker mutexLocker(&d->folderMutex);
+    QMutexLocker otherMutexLocker(&other.d->folderMutex);
+
+    this->reset();
+
+    QMutexLocker archiveMutexLocker(&d->archiveMutex);
+    QMutexLocker otherArchiveMutexLocker(&other.d->archiveMutex);
+
+    qSwap(d->header, other.d->header);
+    qSwap(d->headerFormat, other.d->headerFormat);
+    qSwap(d->metadata, other.d->metadata);
+    d->folder.swap(other.d->folder);
+    qSwap(d->archive, other.d->archive);
+    d->lazyArchive.swap(other.d->lazyArchive);
+    qSwap(d->lazyMembers, other.d->lazyMembers);
+}
+
+/**
+ * A file from the DFS folder, read and compressed ahead of time on a worker thread,
+ * so that it can be written into the archive as raw data in one go. Only writing into
+ * the archive (and its central directory) happens sequentially.
+ */
+struct DocumentFileSystemZipEntry
+{
+    QString path; // relative to the DFS folder
+    QString srcFilePath;
+    qint64 size = 0;
+    quint32 crc = 0;
+    int method = 0; // 0 for stored, Z_DEFLATED for deflated
+    int level = 0;
+    QByteArray data;
+    bool ready = false;
+};
+
+struct DocumentFileSystemZipStats
+{
+    int compressedEntries = 0;
+    int storedEntries = 0;
+    int copiedEntries = 0;
+    qint64 bytesIn = 0;
+    qint64 bytesOut = 0;
+    qint64 elapsed = 0;
+};
+
+// Files this large are streamed through QuaZip instead, so that memory use stays bounded.
+static const qint64 MaxInMemoryZipEntrySize = 64 * 1024 * 1024;
+static const qint64 MaxInMemoryZipBatchSize = 128 * 1024 * 1024;
+
+static bool isAlreadyCompressed(const QString &path)
+{
+    static const QStringList suffixes = { QStringLiteral("jpg"), QStringLiteral("jpeg"),
+                                          QStringLiteral("png"), QStringLiteral("pdf"),
+                                          QStringLiteral("gif"), QStringLiteral("webp"),
+                                          QStringLiteral("zip") };
+    return suffixes.contains(QFileInfo(path).suffix().toLower());
+}
+
+void doCollectZipEntries(const QDir &dir, const QDir &rootDir, const QSet<QString> &skipEntries,
+                         QList<DocumentFileSystemZipEntry> &zipEntries)
 {
     const QFileInfoList entries = dir.entryInfoList(QDir::NoDotAndDotDot | QDir::Files | QDir::Dirs,
                                                     QDir::Name | QDir::DirsLast);
     for (const QFileInfo &entry : entries) {
         if (entry.isDir()) {
-            doZipRecursively(entry.absoluteFilePath(), rootDir, qzip);
+            doCollectZipEntries(entry.absoluteFilePath(), rootDir, skipEntries, zipEntries);
             continue;
         }
 
         const QString srcFilePath = entry.absoluteFilePath();
         const QString dstFilePath = rootDir.relativeFilePath(srcFilePath);
+        if (skipEntries.contains(dstFilePath))
+            continue;
 
-        QFile srcFile(srcFilePath);
-        if (!srcFile.open(QFile::ReadOnly)) {
-            qInfo("Could not open '%s' for reading.", qPrintable(srcFilePath));
+        DocumentFileSystemZipEntry zipEntry;
+        zipEntry.path = dstFilePath;
+        zipEntry.srcFilePath = srcFilePath;
+        zipEntry.size = entry.size();
+        zipEntries.append(zipEntry);
+    }
+}
+
+void doCompressZipEntry(DocumentFileSystemZipEntry &entry)
+{
+    QFile srcFile(entry.srcFilePath);
+    if (!srcFile.open(QFile::ReadOnly)) {
+        qInfo("Could not open '%s' for reading.", qPrintable(entry.srcFilePath));
+        return;
+    }
+
+    const QByteArray bytes = srcFile.readAll();
+    srcFile.close();
+
+    entry.size = bytes.size();
+    entry.crc = quint32(::crc32(::crc32(0L, nullptr, 0),
+                                reinterpret_cast<const Bytef *>(bytes.constData()),
+                                uInt(bytes.size())));
+    entry.method = 0;
+    entry.level = 0;
+    entry.data = bytes;
+    entry.ready = true;
+
+    if (bytes.isEmpty() || isAlreadyCompressed(entry.path))
+        return;
+
+    z_stream zs {};
+    if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY)
+        != Z_OK)
+        return;
+
+    QByteArray deflated;
+    deflated.resize(int(deflateBound(&zs, uLong(bytes.size()))));
+    zs.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(bytes.constData()));
+    zs.avail_in = uInt(bytes.size());
+    zs.next_out = reinterpret_cast<Bytef *>(deflated.data());
+    zs.avail_out = uInt(deflated.size());
+
+    const bool deflatedFully = deflate(&zs, Z_FINISH) == Z_STREAM_END;
+    const qint64 deflatedSize = qint64(zs.total_out);
+    deflateEnd(&zs);
+
+    // Keep the entry stored if deflating doesn't make it any smaller
+    if (deflatedFully && deflatedSize < bytes.size()) {
+        deflated.resize(int(deflatedSize));
+        entry.method = Z_DEFLATED;
+        entry.level = Z_DEFAULT_COMPRESSION;
+        entry.data = deflated;
+    }
+}
+
+bool doWriteZipEntry(const DocumentFileSystemZipEntry &entry, QuaZip &qzip)
+{
+    if (!entry.ready)
+        return false;
+
+    QuaZipNewInfo newInfo(entry.path, entry.srcFilePath);
+    newInfo.uncompressedSize = ulong(entry.size);
+
+    QuaZipFile dstFile(&qzip);
+    if (!dstFile.open(QFile::WriteOnly, newInfo, nullptr, entry.crc, entry.method, entry.level,
+                      true)) {
+        qInfo("Could not open '%s' for writing.", qPrintable(entry.srcFilePath));
+        return false;
+    }
+
+    dstFile.write(entry.data);
+    dstFile.close();
+    return dstFile.getZipError() == ZIP_OK;
+}
+
+bool doStreamZipEntry(const DocumentFileSystemZipEntry &entry, QuaZip &qzip)
+{
+    QFile srcFile(entry.srcFilePath);
+    if (!srcFile.open(QFile::ReadOnly)) {
+        qInfo("Could not open '%s' for reading.", qPrintable(entry.srcFilePath));
+        return false;
+    }
+
+    const bool store = isAlreadyCompressed(entry.path);
+
+    QuaZipFile dstFile(&qzip);
+    if (!dstFile.open(QFile::WriteOnly, QuaZipNewInfo(entry.path, entry.srcFilePath), nullptr, 0,
+                      store ? 0 : Z_DEFLATED, store ? 0 : Z_DEFAULT_COMPRESSION)) {
+        qInfo("Could not open '%s' for writing.", qPrintable(entry.srcFilePath));
+        return false;
+    }
+
+    const int bufferLength = 65535;
+    char buffer[bufferLength];
+    while (!srcFile.atEnd()) {
+        const int nrBytes = srcFile.read(buffer, bufferLength);
+        dstFile.write(buffer, nrBytes);
+        if (nrBytes < bufferLength)
+            break;
+    }
+
+    dstFile.close();
+    srcFile.close();
+    return true;
+}
+
+void doZipEntries(QList<DocumentFileSystemZipEntry> &zipEntries, QuaZip &qzip,
+                  DocumentFileSystemZipStats &stats)
+{
+    // Entries are compressed in batches on the global thread pool, and each batch is
+    // written out (in order) before the next one is read in.
+    int batchStart = 0;
+    while (batchStart < zipEntries.size()) {
+        int batchEnd = batchStart;
+        qint64 batchSize = 0;
+        while (batchEnd < zipEntries.size()) {
+            const qint64 entrySize = zipEntries.at(batchEnd).size;
+            if (entrySize > MaxInMemoryZipEntrySize)
+                break;
+            if (batchEnd > batchStart && batchSize + entrySize > MaxInMemoryZipBatchSize)
+                break;
+            batchSize += entrySize;
+            ++batchEnd;
+        }
+
+        if (batchEnd == batchStart) {
+            const DocumentFileSystemZipEntry &entry = zipEntries.at(batchStart);
+            if (doStreamZipEntry(entry, qzip)) {
+                if (isAlreadyCompressed(entry.path))
+                    ++stats.storedEntries;
+                else
+                    ++stats.compressedEntries;
+                stats.bytesIn += entry.size;
+            }
+            ++batchStart;
             continue;
         }
 
+        auto batchBegin = zipEntries.begin() + batchStart;
+        QtConcurrent::blockingMap(batchBegin, zipEntries.begin() + batchEnd, doCompressZipEntry);
+
+        for (int i = batchStart; i < batchEnd; i++) {
+            DocumentFileSystemZipEntry &entry = zipEntries[i];
+            if (doWriteZipEntry(entry, qzip)) {
+                if (entry.method == 0)
+                    ++stats.storedEntries;
+                else
+                    ++stats.compressedEntries;
+                stats.bytesIn += entry.size;
+            }
+            entry.data.clear();
+        }
+
+        batchStart = batchEnd;
+    }
+}
+
+/**
+ * Copies entries that haven't changed since the archive was last loaded or saved
+ * straight from that archive into the new one, without decompressing and
+ * recompressing them. Names of entries copied this way are returned in
+ * copiedEntries. Returns false only if a copy failed half-way through, in which
+ * case the target archive cannot be trusted anymore.
+ */
+bool doCopyUnmodifiedEntries(const DocumentFileSystemArchive &archive, const QDir &rootDir,
+                             QuaZip &qzip, QSet<QString> &copiedEntries)
+{
+    QuaZip srcZip(archive.fileName);
+    srcZip.setUtf8Enabled(true);
+    if (!srcZip.open(QuaZip::mdUnzip))
+        return true;
+
+    for (bool more = srcZip.goToFirstFile(); more; more = srcZip.goToNextFile()) {
+        QuaZipFileInfo64 srcFileInfo;
+        if (!srcZip.getCurrentFileInfo(&srcFileInfo))
+            continue;
+
+        const QFileInfo entryInfo(rootDir.absoluteFilePath(srcFileInfo.name));
+        if (!entryInfo.exists() || !archive.isClean(srcFileInfo.name, entryInfo))
+            continue;
+
+        int method = 0, level = 0;
+        QuaZipFile srcFile(&srcZip);
+        if (!srcFile.open(QFile::ReadOnly, &method, &level, true))
+            continue;
+
         QuaZipFile dstFile(&qzip);
-        if (!dstFile.open(QFile::WriteOnly, QuaZipNewInfo(dstFilePath, srcFilePath))) {
-            qInfo("Could not open '%s' for writing.", qPrintable(srcFilePath));
+        if (!dstFile.open(QFile::WriteOnly, QuaZipNewInfo(srcFileInfo), nullptr, srcFileInfo.crc,
+                          method, level, true)) {
+            srcFile.close();
             continue;
         }
 
         const int bufferLength = 65535;
         char buffer[bufferLength];
+        qint64 bytesCopied = 0;
         while (!srcFile.atEnd()) {
-            const int nrBytes = srcFile.read(buffer, bufferLength);
-            dstFile.write(buffer, nrBytes);
-            if (nrBytes < bufferLength)
+            const qint64 nrBytes = srcFile.read(buffer, bufferLength);
+            if (nrBytes <= 0)
                 break;
+            bytesCopied += dstFile.write(buffer, nrBytes);
         }
 
         dstFile.close();
         srcFile.close();
+
+        if (bytesCopied != qint64(srcFileInfo.compressedSize) || dstFile.getZipError() != ZIP_OK) {
+            qInfo("Could not copy '%s' from previous archive.", qPrintable(srcFileInfo.name));
+            srcZip.close();
+            return false;
+        }
+
+        copiedEntries.insert(srcFileInfo.name);
     }
+
+    srcZip.close();
+
+    return true;
 }
 
-bool doZip(const QFileInfo &fileInfo, const QDir &rootDir)
+bool doZip(const QFileInfo &fileInfo, const QDir &rootDir,
+           const DocumentFileSystemArchive *archive = nullptr,
+           const DocumentFileSystemLazyArchive *lazyArchive = nullptr,
+           const QSet<QString> &lazyMembers = QSet<QString>(),
+           DocumentFileSystemZipStats *stats = nullptr)
 {
     const QString zipFileName = fileInfo.absoluteFilePath();
 
+    QElapsedTimer timer;
+    timer.start();
+
     QuaZip qzip(zipFileName);
     qzip.setUtf8Enabled(true);
     if (!qzip.open(QuaZip::mdCreate)) {
@@ -318,55 +1084,191 @@ bool doZip(const QFileInfo &fileInfo, const QDir &rootDir)
         return false;
     }
 
-    doZipRecursively(rootDir, rootDir, qzip);
+    QSet<QString> copiedEntries;
+    if (archive != nullptr && !doCopyUnmodifiedEntries(*archive, rootDir, qzip, copiedEntries)) {
+        qzip.close();
+        return false;
+    }
+
+    // Members that were never extracted from the lazy archive are not in the folder at all, the
+    // archive would be incomplete without them.
+    if (!lazyMembers.isEmpty()
+        && (lazyArchive == nullptr
+            || !lazyArchive->copyMembers(lazyMembers, rootDir, qzip, copiedEntries))) {
+        qzip.close();
+        return false;
+    }
+
+    QList<DocumentFileSystemZipEntry> zipEntries;
+    doCollectZipEntries(rootDir, rootDir, copiedEntries, zipEntries);
+
+    DocumentFileSystemZipStats zipStats;
+    zipStats.copiedEntries = copiedEntries.size();
+    doZipEntries(zipEntries, qzip, zipStats);
 
     qzip.close();
 
+    zipStats.bytesOut = QFileInfo(zipFileName).size();
+    zipStats.elapsed = timer.elapsed();
+    if (stats)
+        *stats = zipStats;
+
     return true;
 }
 
-bool saveTask(const QByteArray &header, bool encrypt, const QDir &folder,
-              const QString &targetFileName, QMutex *mutex)
+bool writeHeaderFile(const QByteArray &data, bool encrypt, const QString &fileName)
 {
-    QMutexLocker mutexLocker(mutex);
-
-    QByteArray headerData = header;
+    QByteArray fileData = data;
     if (encrypt) {
         SimpleCrypt sc(REST_CRYPT_KEY);
-        headerData = sc.encryptToByteArray(headerData);
+        fileData = sc.encryptToByteArray(fileData);
     }
 
-    const QString headerFileName =
-            folder.filePath(encrypt ? DocumentFileSystemData::encryptedHeaderFile
-                                    : DocumentFileSystemData::normalHeaderFile);
-    QSaveFile headerFile(headerFileName);
-    if (!headerFile.open(QFile::WriteOnly))
+    QSaveFile file(fileName);
+    if (!file.open(QFile::WriteOnly))
         return false;
 
-    headerFile.write(headerData);
-    if (!headerFile.commit())
+    file.write(fileData);
+    return file.commit();
+}
+
+bool saveTask(const QByteArray &header, DocumentFileSystem::HeaderFormat headerFormat,
+              const QByteArray &metadata, bool encrypt, const QDir &folder,
+              const QString &targetFileName, DocumentFileSystemData *d)
+{
+    QMutexLocker mutexLocker(&d->folderMutex);
+
+    const QString headerName = DocumentFileSystemData::headerFileName(headerFormat, encrypt);
+    const QString headerFileName = folder.filePath(headerName);
+    if (!writeHeaderFile(header, encrypt, headerFileName))
         return false;
 
+    // A header left behind by a save in another format, or with another encryption setting,
+    // must not make it into the archive. load() could pick it over the one written above.
+    QSet<QString> staleHeaderNames;
+    for (const DocumentFileSystemData::HeaderFile &headerFile :
+         DocumentFileSystemData::headerFiles()) {
+        if (headerFile.name == headerName)
+            continue;
+
+        staleHeaderNames.insert(headerFile.name);
+        QFile::remove(folder.filePath(headerFile.name));
+    }
+
+    // Metadata is optional, readers fall back to the header if it's missing.
+    if (!metadata.isEmpty()) {
+        const QString metadataFileName =
+                folder.filePath(encrypt ? DocumentFileSystemData::encryptedMetadataFile
+                                        : DocumentFileSystemData::normalMetadataFile);
+        if (!writeHeaderFile(metadata, encrypt, metadataFileName))
+            return false;
+    }
+
+    // Snapshot the state of the previous archive and of the files in the folder
+    // before zipping, so that files touched while we are zipping are not
+    // mistaken to be clean during the next save.
+    DocumentFileSystemArchive previousArchive;
+    QSet<QString> lazyMembers;
+    {
+        QMutexLocker archiveMutexLocker(&d->archiveMutex);
+        d->lazyMembers -= staleHeaderNames;
+        previousArchive = d->archive;
+        lazyMembers = d->lazyMembers;
+    }
+    previousArchive.dirtyEntries.insert(folder.relativeFilePath(headerFileName));
+
+    DocumentFileSystemArchive newArchive;
+    newArchive.captureEntries(folder, d->filePaths());
+
     const QString tmpFileName = QStandardPaths::writableLocation(QStandardPaths::TempLocation)
             + QStringLiteral("/scrite_") + QString::number(QDateTime::currentMSecsSinceEpoch())
             + QStringLiteral("_temp.scrite");
 
     const QFileInfo fileInfo(tmpFileName);
-    bool success = doZip(fileInfo, folder);
+    DocumentFileSystemZipStats zipStats;
+    bool success = false;
+    const DocumentFileSystemLazyArchive *lazyArchive = d->lazyArchive.data();
+    if (previousArchive.isUsable())
+        success = doZip(fileInfo, folder, &previousArchive, lazyArchive, lazyMembers, &zipStats);
+    if (!success) {
+        QFile::remove(tmpFileName);
+        success = doZip(fileInfo, folder, nullptr, lazyArchive, lazyMembers, &zipStats);
+    }
 
     if (success && QFile::exists(tmpFileName) && QFileInfo(tmpFileName).size() > 0) {
+        // The lazy archive may be mapping the very file we are about to replace. It has to be
+        // let go of before that, and picked up again from the replacement.
+        const bool replacingLazyArchive = lazyArchive != nullptr
+                && lazyArchive->fileName == QFileInfo(targetFileName).absoluteFilePath();
+        QMutexLocker lazyArchiveLocker(replacingLazyArchive ? &d->archiveMutex : nullptr);
+        if (replacingLazyArchive)
+            d->lazyArchive->close();
+
         if (QFile::exists(targetFileName))
             success &= QFile::remove(targetFileName);
         if (success)
             success &= QFile::copy(tmpFileName, targetFileName);
+
+        // Should the replacement not open, the members not extracted yet are pulled out of the
+        // temporary copy before it is removed. The save fails if even that doesn't work, as
+        // the folder no longer has everything that the document needs.
+        if (replacingLazyArchive && !(success && d->lazyArchive->open(targetFileName))) {
+            bool extracted = d->lazyArchive->open(tmpFileName);
+            for (const QString &lazyMember : qAsConst(d->lazyMembers)) {
+                const QString dstFileName = folder.absoluteFilePath(lazyMember);
+                if (extracted && !QFileInfo::exists(dstFileName))
+                    extracted = d->lazyArchive->extract(lazyMember, dstFileName);
+            }
+
+            d->lazyArchive.reset();
+            d->lazyMembers.clear();
+            if (!extracted) {
+                qWarning("Could not reopen %s, unextracted files are lost.",
+                         qPrintable(targetFileName));
+                success = false;
+            }
+        }
+
         QFile::remove(tmpFileName);
     }
 
+    QMutexLocker archiveMutexLocker(&d->archiveMutex);
+    if (success) {
+        newArchive.captureFile(targetFileName);
+        newArchive.dirtyEntries = d->archive.dirtyEntries - previousArchive.dirtyEntries;
+        d->archive = newArchive;
+
+        // Members written into the folder in the meantime (like the header) are lazy no more.
+        for (auto it = d->lazyMembers.begin(); it != d->lazyMembers.end();) {
+            if (QFileInfo::exists(folder.absoluteFilePath(*it)))
+                it = d->lazyMembers.erase(it);
+            else
+                ++it;
+        }
+
+        const qreal seconds = qMax(zipStats.elapsed, qint64(1)) / 1000.0;
+        d->saveStatistics = QJsonObject();
+        d->saveStatistics.insert(QStringLiteral("compressedEntries"), zipStats.compressedEntries);
+        d->saveStatistics.insert(QStringLiteral("storedEntries"), zipStats.storedEntries);
+        d->saveStatistics.insert(QStringLiteral("copiedEntries"), zipStats.copiedEntries);
+        d->saveStatistics.insert(QStringLiteral("bytesIn"), zipStats.bytesIn);
+        d->saveStatistics.insert(QStringLiteral("bytesOut"), zipStats.bytesOut);
+        d->saveStatistics.insert(QStringLiteral("zipTime"), zipStats.elapsed);
+        d->saveStatistics.insert(QStringLiteral("throughput"),
+                                 qreal(zipStats.bytesIn) / (1024 * 1024) / seconds);
+
+#ifndef QT_NO_DEBUG_OUTPUT
+        qDebug() << "PA: DocumentFileSystem.Save " << targetFileName << d->saveStatistics;
+#endif
+    }
+
     return success;
 }
 
 bool DocumentFileSystem::save(const QString &fileName, bool encrypt, SaveMode mode)
 {
+    PROFILE_THIS_FUNCTION;
+
     if (fileName.isEmpty())
         return false;
 
@@ -423,21 +1325,61 @@ bool DocumentFileSystem::save(const QString &fileName, bool encrypt, SaveMode mo
         watcher->setObjectName(saveTaskWatcher);
         connect(watcher, &QFutureWatcher<bool>::finished, this,
                 &DocumentFileSystem::saveTaskFinished);
-        watcher->setFuture(QtConcurrent::run(saveTask, d->header, encrypt, QDir(d->folder->path()),
-                                             fileName, &d->folderMutex));
+        const QByteArray header = d->header;
+        const HeaderFormat headerFormat = d->headerFormat;
+        const QByteArray metadata = d->metadata;
+        const QDir folder(d->folder->path());
+        DocumentFileSystemData *data = d;
+        watcher->setFuture(QtConcurrent::run([=]() -> bool {
+            return saveTask(header, headerFormat, metadata, encrypt, folder, fileName, data);
+        }));
 
         return true;
     }
 
-    const bool ret =
-            saveTask(d->header, encrypt, QDir(d->folder->path()), fileName, &d->folderMutex);
+    const bool ret = saveTask(d->header, d->headerFormat, d->metadata, encrypt,
+                              QDir(d->folder->path()), fileName, d);
     return ret;
 #endif
 }
 
-void DocumentFileSystem::setHeader(const QByteArray &header)
+QFuture<bool> DocumentFileSystem::saveSnapshot(const QString &fileName, bool encrypt,
+                                               const SnapshotFunction &snapshot,
+                                               HeaderFormat headerFormat)
+{
+    PROFILE_THIS_FUNCTION;
+
+    // Ensure that unwanted files are no longer in the DFS folder
+    if (!fileName.isEmpty() && snapshot)
+        this->cleanup();
+
+    const QDir folder(d->folder->path());
+    DocumentFileSystemData *data = d;
+    return QtConcurrent::run([=]() -> bool {
+        PROFILE_SCOPE("DocumentFileSystem::saveSnapshot() task");
+
+        if (fileName.isEmpty() || !snapshot)
+            return false;
+
+        QByteArray header, metadata;
+        snapshot(header, metadata);
+        if (header.isEmpty())
+            return false;
+
+        return saveTask(header, headerFormat, metadata, encrypt, folder, fileName, data);
+    });
+}
+
+QJsonObject DocumentFileSystem::saveStatistics() const
+{
+    QMutexLocker archiveMutexLocker(&d->archiveMutex);
+    return d->saveStatistics;
+}
+
+void DocumentFileSystem::setHeader(const QByteArray &header, HeaderFormat format)
 {
     d->header = header;
+    d->headerFormat = format;
 }
 
 QByteArray DocumentFileSystem::header() const
@@ -445,11 +1387,313 @@ QByteArray DocumentFileSystem::header() const
     return d->header;
 }
 
+DocumentFileSystem::HeaderFormat DocumentFileSystem::headerFormat() const
+{
+    return d->headerFormat;
+}
+
+static void writeCborValue(QCborStreamWriter &writer, const QJsonValue &value)
+{
+    switch (value.type()) {
+    case QJsonValue::Object: {
+        const QJsonObject object = value.toObject();
+        writer.startMap(quint64(object.size()));
+        for (auto it = object.constBegin(), end = object.constEnd(); it != end; ++it) {
+            writer.append(it.key());
+            writeCborValue(writer, it.value());
+        }
+        writer.endMap();
+    } break;
+    case QJsonValue::Array: {
+        const QJsonArray array = value.toArray();
+        writer.startArray(quint64(array.size()));
+        for (const QJsonValue &item : array)
+            writeCborValue(writer, item);
+        writer.endArray();
+    } break;
+    case QJsonValue::String:
+        writer.append(value.toString());
+        break;
+    case QJsonValue::Double: {
+        // Most numbers in the header are counts, indexes and enum values. Integers take up
+        // a fraction of the space taken by doubles in CBOR.
+        const double number = value.toDouble();
+        if (qAbs(number) < 9007199254740992.0 && double(qint64(number)) == number)
+            writer.append(qint64(number));
+        else
+            writer.append(number);
+    } break;
+    case QJsonValue::Bool:
+        writer.append(value.toBool());
+        break;
+    default:
+        writer.append(nullptr);
+        break;
+    }
+}
+
+static QString readCborString(QCborStreamReader &reader)
+{
+    QString ret;
+    auto chunk = reader.readString();
+    while (chunk.status == QCborStreamReader::Ok) {
+        ret += chunk.data;
+        chunk = reader.readString();
+    }
+    return ret;
+}
+
+static QJsonValue readCborValue(QCborStreamReader &reader)
+{
+    switch (reader.type()) {
+    case QCborStreamReader::Map: {
+        QJsonObject ret;
+        reader.enterContainer();
+        while (reader.lastError() == QCborError::NoError && reader.hasNext()) {
+            // JSON objects can only have string keys, nothing else is ever written here.
+            if (!reader.isString()) {
+                reader.next();
+                reader.next();
+                continue;
+            }
+
+            const QString key = readCborString(reader);
+            ret.insert(key, readCborValue(reader));
+        }
+        if (reader.lastError() == QCborError::NoError)
+            reader.leaveContainer();
+        return ret;
+    }
+    case QCborStreamReader::Array: {
+        QJsonArray ret;
+        reader.enterContainer();
+        while (reader.lastError() == QCborError::NoError && reader.hasNext())
+            ret.append(readCborValue(reader));
+        if (reader.lastError() == QCborError::NoError)
+            reader.leaveContainer();
+        return ret;
+    }
+    case QCborStreamReader::String:
+        return readCborString(reader);
+    default:
+        return QCborValue::fromCbor(reader).toJsonValue();
+    }
+}
+
+// Reads values at keyPaths out of the map the reader is positioned at, skipping everything else.
+static void readCborFields(QCborStreamReader &reader, const QStringList &keyPaths,
+                           QJsonObject &fields)
+{
+    if (!reader.isMap()) {
+        reader.next();
+        return;
+    }
+
+    reader.enterContainer();
+    while (reader.lastError() == QCborError::NoError && reader.hasNext()) {
+        if (!reader.isString()) {
+            reader.next();
+            reader.next();
+            continue;
+        }
+
+        const QString key = readCborString(reader);
+
+        bool wanted = false;
+        QStringList subKeyPaths;
+        for (const QString &keyPath : keyPaths) {
+            if (keyPath == key)
+                wanted = true;
+            else if (keyPath.length() > key.length() && keyPath.startsWith(key)
+                     && keyPath.at(key.length()) == QLatin1Char('/'))
+                subKeyPaths.append(keyPath.mid(key.length() + 1));
+        }
+
+        if (wanted)
+            fields.insert(key, readCborValue(reader));
+        else if (!subKeyPaths.isEmpty() && reader.isMap()) {
+            QJsonObject subFields;
+            readCborFields(reader, subKeyPaths, subFields);
+            fields.insert(key, subFields);
+        } else
+            reader.next();
+    }
+
+    if (reader.lastError() == QCborError::NoError)
+        reader.leaveContainer();
+}
+
+static void copyJsonFields(const QJsonObject &object, const QStringList &keyPaths,
+                           QJsonObject &fields)
+{
+    QHash<QString, QStringList> subKeyPaths;
+    for (const QString &keyPath : keyPaths) {
+        const int slash = keyPath.indexOf(QLatin1Char('/'));
+        if (slash < 0) {
+            if (object.contains(keyPath))
+                fields.insert(keyPath, object.value(keyPath));
+        } else
+            subKeyPaths[keyPath.left(slash)].append(keyPath.mid(slash + 1));
+    }
+
+    for (auto it = subKeyPaths.constBegin(), end = subKeyPaths.constEnd(); it != end; ++it) {
+        if (fields.contains(it.key()))
+            continue;
+
+        const QJsonValue value = object.value(it.key());
+        if (!value.isObject())
+            continue;
+
+        QJsonObject subFields;
+        copyJsonFields(value.toObject(), it.value(), subFields);
+        fields.insert(it.key(), subFields);
+    }
+}
+
+QByteArray DocumentFileSystem::encodeHeader(const QJsonObject &json, HeaderFormat format)
+{
+    PROFILE_THIS_FUNCTION;
+
+    if (format == JsonHeader)
+        return QJsonDocument(json).toJson();
+
+    QByteArray ret;
+    QCborStreamWriter writer(&ret);
+    writeCborValue(writer, json);
+    return ret;
+}
+
+QJsonObject DocumentFileSystem::decodeHeader(const QByteArray &header, HeaderFormat format)
+{
+    PROFILE_THIS_FUNCTION;
+
+    if (format == JsonHeader)
+        return QJsonDocument::fromJson(header).object();
+
+    QCborStreamReader reader(header);
+    if (!reader.isMap())
+        return QJsonObject();
+
+    const QJsonValue ret = readCborValue(reader);
+    return reader.lastError() == QCborError::NoError ? ret.toObject() : QJsonObject();
+}
+
+QJsonObject DocumentFileSystem::decodeHeader(const QByteArray &header, HeaderFormat format,
+                                             const QStringList &keyPaths)
+{
+    PROFILE_THIS_FUNCTION;
+
+    QJsonObject ret;
+    if (format == JsonHeader) {
+        copyJsonFields(QJsonDocument::fromJson(header).object(), keyPaths, ret);
+        return ret;
+    }
+
+    QCborStreamReader reader(header);
+    readCborFields(reader, keyPaths, ret);
+    return reader.lastError() == QCborError::NoError ? ret : QJsonObject();
+}
+
+void DocumentFileSystem::setMetadata(const QByteArray &metadata)
+{
+    d->metadata = metadata;
+}
+
+QByteArray DocumentFileSystem::metadata() const
+{
+    return d->metadata;
+}
+
+bool DocumentFileSystem::peek(const QString &fileName, QByteArray *metadata, QByteArray *header,
+                              const QStringList &paths, QMap<QString, QByteArray> *files,
+                              HeaderFormat *headerFormat)
+{
+    PROFILE_THIS_FUNCTION;
+
+    QFile file(fileName);
+    if (!file.open(QFile::ReadOnly))
+        return false;
+
+    const int markerLength = ::DocumentFileSystemMaker->length();
+    if (file.read(markerLength) == *::DocumentFileSystemMaker)
+        return false;
+    file.close();
+
+    QuaZip qzip(fileName);
+    qzip.setUtf8Enabled(true);
+    if (!qzip.open(QuaZip::mdUnzip))
+        return false;
+
+    // Only the central directory is scanned, the only members read are the ones asked for.
+    QHash<QString, QByteArray> members;
+    QSet<QString> headerFiles = { DocumentFileSystemData::normalMetadataFile,
+                                  DocumentFileSystemData::encryptedMetadataFile };
+    for (const DocumentFileSystemData::HeaderFile &headerFile :
+         DocumentFileSystemData::headerFiles())
+        headerFiles.insert(headerFile.name);
+    const QSet<QString> wantedPaths(paths.begin(), paths.end());
+    QStringList headerPaths;
+    for (bool more = qzip.goToFirstFile(); more; more = qzip.goToNextFile()) {
+        const QString name = qzip.getCurrentFileName();
+        if (headerFiles.contains(name))
+            headerPaths.append(name);
+        else if (files != nullptr && wantedPaths.contains(name)) {
+            QuaZipFile member(&qzip);
+            if (member.open(QFile::ReadOnly))
+                files->insert(name, member.readAll());
+        }
+    }
+
+    auto readHeaderFile = [&qzip](const QString &path, bool encrypted) -> QByteArray {
+        if (!qzip.setCurrentFile(path))
+            return QByteArray();
+
+        QuaZipFile member(&qzip);
+        if (!member.open(QFile::ReadOnly))
+            return QByteArray();
+
+        const QByteArray data = member.readAll();
+        if (!encrypted)
+            return data;
+
+        SimpleCrypt sc(REST_CRYPT_KEY);
+        return sc.decryptToByteArray(data);
+    };
+
+    if (metadata != nullptr) {
+        if (headerPaths.contains(DocumentFileSystemData::normalMetadataFile))
+            *metadata = readHeaderFile(DocumentFileSystemData::normalMetadataFile, false);
+        else if (headerPaths.contains(DocumentFileSystemData::encryptedMetadataFile))
+            *metadata = readHeaderFile(DocumentFileSystemData::encryptedMetadataFile, true);
+    }
+
+    if (header != nullptr && (metadata == nullptr || metadata->isEmpty())) {
+        for (const DocumentFileSystemData::HeaderFile &headerFile :
+             DocumentFileSystemData::headerFiles()) {
+            if (!headerPaths.contains(headerFile.name))
+                continue;
+
+            *header = readHeaderFile(headerFile.name, headerFile.encrypted);
+            if (headerFormat != nullptr)
+                *headerFormat = headerFile.format;
+            break;
+        }
+    }
+
+    qzip.close();
+
+    return true;
+}
+
 QFile *DocumentFileSystem::open(const QString &path, QFile::OpenMode mode)
 {
     if (path.isEmpty())
         return nullptr;
 
+    // Writing over a lazy member doesn't need it extracted first.
+    if ((mode & QFile::WriteOnly) && !(mode & (QFile::ReadOnly | QFile::Append)))
+        d->forgetLazyMember(path);
+
     const QString completePath = this->absolutePath(path, true);
     if (!QFile::exists(completePath) && mode == QIODevice::ReadOnly)
         return nullptr;
@@ -460,6 +1704,9 @@ QFile *DocumentFileSystem::open(const QString &path, QFile::OpenMode mode)
         return nullptr;
     }
 
+    if (mode & QFile::WriteOnly)
+        d->markDirty(completePath);
+
     return file;
 }
 
@@ -470,6 +1717,12 @@ QByteArray DocumentFileSystem::read(const QString &path)
     if (path.isEmpty())
         return ret;
 
+    // Lazy members are read straight from the archive, without extracting them.
+    bool ok = false;
+    ret = d->readLazyMember(path, &ok);
+    if (ok)
+        return ret;
+
     const QString completePath = this->absolutePath(path);
     if (!QFile::exists(completePath))
         return ret;
@@ -489,11 +1742,14 @@ bool DocumentFileSystem::write(const QString &path, const QByteArray &bytes)
     if (path.isEmpty() || bytes.isEmpty())
         return false;
 
+    d->forgetLazyMember(path);
+
     const QString completePath = this->absolutePath(path, true);
     DocumentFile file(completePath, this);
     if (!file.open(QFile::WriteOnly))
         return false;
 
+    d->markDirty(completePath);
     file.write(bytes);
     return true;
 }
@@ -558,8 +1814,11 @@ bool DocumentFileSystem::remove(const QString &path)
     if (path.isEmpty())
         return false;
 
+    const bool wasLazyMember = d->isLazyMember(path);
+    d->forgetLazyMember(path);
+
     const QString completePath = this->absolutePath(path);
-    return QFile::remove(completePath);
+    return QFile::remove(completePath) || wasLazyMember;
 }
 
 QString DocumentFileSystem::absolutePath(const QString &path, bool mkpath) const
@@ -568,12 +1827,17 @@ QString DocumentFileSystem::absolutePath(const QString &path, bool mkpath) const
         return QString();
 
     if (QDir::isAbsolutePath(path)) {
-        if (path.startsWith(d->folder->path()))
+        if (path.startsWith(d->folder->path())) {
+            d->extractLazyMember(path);
             return path;
+        }
 
         return QString();
     }
 
+    // Whoever asks for a path on disk is going to need the file there.
+    d->extractLazyMember(path);
+
     const QString ret = d->folder->filePath(path);
     const QFileInfo fi(ret);
     if (!fi.exists() && mkpath) {
@@ -609,6 +1873,9 @@ bool DocumentFileSystem::exists(const QString &path) const
     if (path.isEmpty())
         return false;
 
+    if (d->isLazyMember(path))
+        return true;
+
     const QString completePath = this->absolutePath(path);
     return QFile::exists(completePath);
 }
@@ -655,6 +1922,8 @@ QString DocumentFileSystem::addFile(const QString &srcFile, const QString &dstPa
     if (!QFile::copy(srcFile, dstPath))
         return QString();
 
+    d->markDirty(absDstPath);
+
     // That's it
     return this->relativePath(absDstPath);
 }
@@ -709,12 +1978,22 @@ QString DocumentFileSystem::addImage(const QImage &srcImage, const QString &dstP
 
     const QString suffix = QFileInfo(absDstPath).suffix().toUpper();
     const bool ret = imageToSave.save(absDstPath, qPrintable(suffix));
+    d->markDirty(absDstPath);
     return ret ? this->relativePath(absDstPath) : QString();
 }
 
 void DocumentFileSystem::cleanup()
 {
-    const QStringList filePaths = d->filePaths();
+    QStringList filePaths = d->filePaths();
+    {
+        QMutexLocker archiveMutexLocker(&d->archiveMutex);
+        const QSet<QString> extractedPaths(filePaths.begin(), filePaths.end());
+        for (const QString &lazyMember : qAsConst(d->lazyMembers)) {
+            if (!extractedPaths.contains(lazyMember))
+                filePaths.append(lazyMember);
+        }
+    }
+
     for (const QString &filePath : filePaths) {
         int claims = 0;
         emit auction(filePath, &claims);
@@ -811,6 +2090,8 @@ DocumentFile::~DocumentFile()
 void DocumentFile::onAboutToClose()
 {
     if (m_fileSystem != nullptr) {
+        if (this->openMode() & QFile::WriteOnly)
+            m_fileSystem->d->markDirty(this->fileName());
         m_fileSystem->d->files.removeOne(this);
         m_fileSystem = nullptr;
     }
@@ -16,10 +16,15 @@
 
 #include <QObject>
 
+#include <QMap>
 #include <QFile>
 #include <QSize>
 #include <QImage>
+#include <QFuture>
 #include <QFileInfo>
+#include <QJsonObject>
+
+#include <functional>
 
 class DocumentFile;
 
@@ -36,14 +41,65 @@ public:
 
     void hardReset();
 
+    // In LazyLoadMode the archive is kept open and its members are extracted into the DFS folder
+    // only when needed as files on disk, for example when absolutePath() or fileInfo() is asked
+    // for them. read() serves them straight out of the archive.
     enum Format { UnknownFormat, ScriteFormat, ZipFormat };
-    bool load(const QString &fileName, Format *format = nullptr);
+    enum LoadMode { ExtractingLoadMode, LazyLoadMode };
+    bool load(const QString &fileName, Format *format = nullptr,
+              LoadMode mode = ExtractingLoadMode);
+
+    // Takes over everything loaded into other, which is left empty. This lets a document be
+    // loaded into a DocumentFileSystem of its own on a worker thread, without the one in use
+    // being touched until it is ready.
+    void adopt(DocumentFileSystem &other);
+
+    // The header is saved as JSON by default. CborHeader saves it as CBOR instead, which is
+    // smaller and quicker to parse, but can't be read by versions of Scrite before this one.
+    enum HeaderFormat { JsonHeader, CborHeader };
 
     enum SaveMode { BlockingSaveMode, NonBlockingSaveMode };
     bool save(const QString &fileName, bool encrypt = false, SaveMode mode = BlockingSaveMode);
 
-    void setHeader(const QByteArray &header);
+    // Saves a copy of the document into fileName without touching header() and metadata().
+    // Only cleanup happens on the calling thread. The snapshot function is called on a worker
+    // thread to produce header and metadata bytes, after which contents of the folder are
+    // zipped, reusing unchanged entries of the previous save.
+    using SnapshotFunction = std::function<void(QByteArray &header, QByteArray &metadata)>;
+    QFuture<bool> saveSnapshot(const QString &fileName, bool encrypt,
+                               const SnapshotFunction &snapshot,
+                               HeaderFormat headerFormat = JsonHeader);
+
+    // Entry counts, byte counts, time taken (ms) and throughput (MB/s) of the last ZIP save.
+    QJsonObject saveStatistics() const;
+
+    // load() picks up either header format, headerFormat() tells which one was found.
+    void setHeader(const QByteArray &header, HeaderFormat format = JsonHeader);
     QByteArray header() const;
+    HeaderFormat headerFormat() const;
+
+    static QByteArray encodeHeader(const QJsonObject &json, HeaderFormat format);
+    static QJsonObject decodeHeader(const QByteArray &header, HeaderFormat format);
+
+    // Returns only the values at the given '/' separated key paths (for example,
+    // "screenplay/title"), nested the same way as in the header. CBOR headers are streamed
+    // through, subtrees that are not asked for are skipped over without being decoded.
+    static QJsonObject decodeHeader(const QByteArray &header, HeaderFormat format,
+                                    const QStringList &keyPaths);
+
+    // Small summary of the document, saved alongside the header so that it can be listed
+    // without reading the whole header. See ScriteFileInfo.
+    void setMetadata(const QByteArray &metadata);
+    QByteArray metadata() const;
+
+    // Reads the metadata and the given files straight out of a saved document, without
+    // extracting anything else. The header is read only if metadata was not asked for, or
+    // isn't available. Returns false if the document couldn't be read this way (for example,
+    // if it was saved in the older non-ZIP format), in which case load() has to be used.
+    static bool peek(const QString &fileName, QByteArray *metadata, QByteArray *header,
+                     const QStringList &paths = QStringList(),
+                     QMap<QString, QByteArray> *files = nullptr,
+                     HeaderFormat *headerFormat = nullptr);
 
     QFile *open(const QString &path, QFile::OpenMode mode = QFile::ReadOnly);
 
@@ -551,15 +551,18 @@ void ScreenplayPageLayout::configure(QTextDocument *document) const
     const QSizeF pageSize = stdResolution ? m_paperRect.size()
                                           : m_pageLayout.pageSize().sizePixels(qt_defaultDpi());
 
+    // Each of these lays out the whole document again, so we skip them when nothing changes.
     document->setUseDesignMetrics(true);
-    document->setPageSize(pageSize);
+    if (document->pageSize() != pageSize)
+        document->setPageSize(pageSize);
 
     QTextFrameFormat format;
     format.setTopMargin(pixelMargins.top());
     format.setBottomMargin(pixelMargins.bottom());
     format.setLeftMargin(pixelMargins.left());
     format.setRightMargin(pixelMargins.right());
-    document->rootFrame()->setFrameFormat(format);
+    if (document->rootFrame()->frameFormat() != format)
+        document->rootFrame()->setFrameFormat(format);
 }
 
 void ScreenplayPageLayout::configure(QPagedPaintDevice *printer) const
@@ -650,6 +653,9 @@ ScreenplayFormat::ScreenplayFormat(QObject *parent)
 {
     m_padding[0] = 0; // just to get rid of the unused private variable warning.
 
+    static QAtomicInteger<quint64> lastSerialNumber;
+    m_serialNumber = ++lastSerialNumber;
+
     for (int i = SceneElement::Min; i <= SceneElement::Max; i++) {
         SceneElementFormat *elementFormat = new SceneElementFormat(SceneElement::Type(i), this);
         connect(elementFormat, &SceneElementFormat::elementFormatChanged, this,
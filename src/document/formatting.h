@@ -411,6 +411,9 @@ public:
 
     void useUserSpecifiedFonts();
 
+    // Unlike the address of a format, this is never reused within the process.
+    quint64 serialNumber() const { return m_serialNumber; }
+
     // Interface interface
     void deserializeFromJson(const QJsonObject &);
 
@@ -429,6 +432,7 @@ private:
     int m_fontZoomLevelIndex = -1;
     bool m_inTransaction = false;
     int m_nrChangesDuringTransation = 0;
+    quint64 m_serialNumber = 0;
     QList<int> m_fontPointSizes;
     QVariantList m_fontZoomLevels;
     QObjectProperty<QScreen> m_screen;
@@ -24,6 +24,7 @@
 #include "screenplaytextdocument.h"
 
 #include <QUuid>
+#include <QCache>
 #include <QFuture>
 #include <QSGNode>
 #include <QPainter>
@@ -56,7 +57,7 @@ static QDataStream &operator>>(QDataStream &ds, QTextLayout::FormatRange &format
 }
 
 class PushSceneUndoCommand;
-class SceneUndoCommand : public QUndoCommand
+class SceneUndoCommand : public QUndoCommand, public UndoCommandMemoryUsage
 {
 public:
     static SceneUndoCommand *current;
@@ -71,18 +72,59 @@ public:
     int id() const { return ID; }
     bool mergeWith(const QUndoCommand *other);
 
+    // UndoCommandMemoryUsage interface
+    void releaseMemory();
+    void endMergeRun();
+
 private:
+    void updateMemoryUsage();
+
     QByteArray toByteArray(Scene *scene) const;
     Scene *fromByteArray(const QByteArray &bytes) const;
 
+    QByteArray before() const;
+    QByteArray after() const;
+    void setAfter(const QByteArray &after);
+
 private:
+    /**
+     * Scene snapshot after the edit, stored as a delta against the snapshot
+     * before the edit. Most edits change a few bytes in one paragraph, plus
+     * a few scattered bytes like cursor position and string lengths, so the
+     * delta is a common prefix & suffix with a list of runs in between. Each
+     * run either copies bytes from the same offset in the before snapshot, or
+     * supplies literal bytes that replace as many bytes in there.
+     */
+    struct Delta
+    {
+        struct Run
+        {
+            int copyLength = 0;
+            QByteArray literal;
+        };
+
+        int prefix = 0;
+        int suffix = 0;
+        QVector<Run> runs;
+
+        static Delta evaluate(const QByteArray &from, const QByteArray &to);
+        QByteArray apply(const QByteArray &from) const;
+        int size() const;
+    };
+
     friend class PushSceneUndoCommand;
     Scene *m_scene = nullptr;
     QString m_sceneId;
-    QByteArray m_after;
-    QByteArray m_before;
+    Delta m_after;
+    QByteArray m_before; // qCompress()ed
+
+    // Uncompressed snapshots, kept only while edits can merge into this command, so that
+    // merging doesn't uncompress and rebuild them on every keystroke.
+    QByteArray m_beforeSnapshot;
+    QByteArray m_afterSnapshot;
     bool m_allowMerging = true;
-    char m_padding[7];
+    bool m_memoryReleased = false;
+    char m_padding[6];
     QDateTime m_timestamp;
 };
 
@@ -93,15 +135,23 @@ SceneUndoCommand::SceneUndoCommand(Scene *scene, bool allowMerging)
 {
     m_padding[0] = 0; // just to get rid of the unused private variable warning.
     m_sceneId = m_scene->id();
-    m_before = this->toByteArray(scene);
+
+    const QByteArray before = this->toByteArray(scene);
+    m_before = qCompress(before, 1);
+    if (m_allowMerging)
+        m_beforeSnapshot = before;
+    this->updateMemoryUsage();
 }
 
 SceneUndoCommand::~SceneUndoCommand() { }
 
 void SceneUndoCommand::undo()
 {
+    if (m_memoryReleased)
+        return;
+
     SceneUndoCommand::current = this;
-    Scene *scene = this->fromByteArray(m_before);
+    Scene *scene = this->fromByteArray(this->before());
     SceneUndoCommand::current = nullptr;
 
     if (scene == nullptr)
@@ -111,13 +161,16 @@ void SceneUndoCommand::undo()
 void SceneUndoCommand::redo()
 {
     if (m_scene != nullptr) {
-        m_after = this->toByteArray(m_scene);
+        this->setAfter(this->toByteArray(m_scene));
         m_scene = nullptr;
         return;
     }
 
+    if (m_memoryReleased)
+        return;
+
     SceneUndoCommand::current = this;
-    Scene *scene = this->fromByteArray(m_after);
+    Scene *scene = this->fromByteArray(this->after());
     SceneUndoCommand::current = nullptr;
 
     if (scene == nullptr)
@@ -126,7 +179,7 @@ void SceneUndoCommand::redo()
 
 bool SceneUndoCommand::mergeWith(const QUndoCommand *other)
 {
-    if (m_allowMerging && this->id() == other->id()) {
+    if (m_allowMerging && !m_memoryReleased && this->id() == other->id()) {
         const SceneUndoCommand *cmd = reinterpret_cast<const SceneUndoCommand *>(other);
         if (cmd->m_allowMerging == false)
             return false;
@@ -137,7 +190,7 @@ bool SceneUndoCommand::mergeWith(const QUndoCommand *other)
         const qint64 timegap = qAbs(m_timestamp.msecsTo(cmd->m_timestamp));
         static qint64 minTimegap = 1000;
         if (timegap < minTimegap) {
-            m_after = cmd->m_after;
+            this->setAfter(cmd->after());
             m_timestamp = cmd->m_timestamp;
             return true;
         }
@@ -146,6 +199,27 @@ bool SceneUndoCommand::mergeWith(const QUndoCommand *other)
     return false;
 }
 
+void SceneUndoCommand::releaseMemory()
+{
+    m_before.clear();
+    m_after = Delta();
+    m_memoryReleased = true;
+    this->endMergeRun();
+}
+
+void SceneUndoCommand::endMergeRun()
+{
+    m_beforeSnapshot.clear();
+    m_afterSnapshot.clear();
+    this->updateMemoryUsage();
+}
+
+void SceneUndoCommand::updateMemoryUsage()
+{
+    this->setMemoryUsage(int(sizeof(SceneUndoCommand)) + m_before.size() + m_after.size()
+                         + m_beforeSnapshot.size() + m_afterSnapshot.size());
+}
+
 QByteArray SceneUndoCommand::toByteArray(Scene *scene) const
 {
     return scene->toByteArray();
@@ -156,6 +230,112 @@ Scene *SceneUndoCommand::fromByteArray(const QByteArray &bytes) const
     return Scene::fromByteArray(bytes);
 }
 
+QByteArray SceneUndoCommand::before() const
+{
+    return m_beforeSnapshot.isEmpty() ? qUncompress(m_before) : m_beforeSnapshot;
+}
+
+QByteArray SceneUndoCommand::after() const
+{
+    return m_afterSnapshot.isEmpty() ? m_after.apply(this->before()) : m_afterSnapshot;
+}
+
+void SceneUndoCommand::setAfter(const QByteArray &after)
+{
+    m_after = Delta::evaluate(this->before(), after);
+    if (!m_beforeSnapshot.isEmpty())
+        m_afterSnapshot = after;
+    this->updateMemoryUsage();
+}
+
+SceneUndoCommand::Delta SceneUndoCommand::Delta::evaluate(const QByteArray &from,
+                                                          const QByteArray &to)
+{
+    Delta ret;
+
+    const int fromSize = from.size();
+    const int toSize = to.size();
+    const int maxCommon = qMin(fromSize, toSize);
+    const char *f = from.constData();
+    const char *t = to.constData();
+
+    while (ret.prefix < maxCommon && f[ret.prefix] == t[ret.prefix])
+        ++ret.prefix;
+
+    while (ret.suffix < maxCommon - ret.prefix
+           && f[fromSize - ret.suffix - 1] == t[toSize - ret.suffix - 1])
+        ++ret.suffix;
+
+    // Runs of equal bytes shorter than this are cheaper to store as literals.
+    static const int minCopyLength = 16;
+
+    const int fromMiddle = fromSize - ret.prefix - ret.suffix;
+    const int toMiddle = toSize - ret.prefix - ret.suffix;
+    const int alignedLength = qMin(fromMiddle, toMiddle);
+    f += ret.prefix;
+    t += ret.prefix;
+
+    Run run;
+    int i = 0;
+    while (i < alignedLength) {
+        int j = i;
+        while (j < alignedLength && f[j] == t[j])
+            ++j;
+
+        if (j - i >= minCopyLength) {
+            if (!run.literal.isEmpty()) {
+                ret.runs.append(run);
+                run = Run();
+            }
+            run.copyLength = j - i;
+            ret.runs.append(run);
+            run = Run();
+        } else
+            run.literal.append(t + i, j - i);
+
+        i = j;
+        while (j < alignedLength && f[j] != t[j])
+            ++j;
+        run.literal.append(t + i, j - i);
+        i = j;
+    }
+
+    run.literal.append(t + alignedLength, toMiddle - alignedLength);
+    if (!run.literal.isEmpty())
+        ret.runs.append(run);
+
+    return ret;
+}
+
+QByteArray SceneUndoCommand::Delta::apply(const QByteArray &from) const
+{
+    QByteArray ret;
+    ret.reserve(from.size());
+    ret.append(from.constData(), prefix);
+
+    int offset = prefix;
+    for (const Run &run : runs) {
+        if (run.copyLength > 0) {
+            ret.append(from.constData() + offset, run.copyLength);
+            offset += run.copyLength;
+        } else {
+            ret.append(run.literal);
+            offset += run.literal.size();
+        }
+    }
+
+    ret.append(from.constData() + from.size() - suffix, suffix);
+    return ret;
+}
+
+int SceneUndoCommand::Delta::size() const
+{
+    int ret = int(sizeof(Delta));
+    for (const Run &run : runs)
+        ret += int(sizeof(Run)) + run.literal.size();
+    return ret;
+}
+
 class PushSceneUndoCommand
 {
     friend class SceneElement;
@@ -977,6 +1157,16 @@ DistinctElementValuesMap::DistinctElementValuesMap(SceneElement::Type type) : m_
 
 DistinctElementValuesMap::~DistinctElementValuesMap() { }
 
+static inline bool isMuteCharacterElement(SceneElement::Type type,
+                                          const QList<SceneElement *> &elements)
+{
+    if (type != SceneElement::Character || elements.size() != 1)
+        return false;
+
+    const QVariant value = elements.first()->property("#mute");
+    return value.isValid() && value.toBool();
+}
+
 bool DistinctElementValuesMap::include(SceneElement *element)
 {
     // This function returns true if distinctValues() would return
@@ -985,19 +1175,30 @@ bool DistinctElementValuesMap::include(SceneElement *element)
         return false;
 
     if (element->type() == m_type) {
-        const bool ret = this->remove(element);
-
         QString newName = element->formattedText();
         newName = newName.section('(', 0, 0).trimmed();
         if ((m_type == SceneElement::Shot || m_type == SceneElement::Transition)
             && newName.endsWith(':'))
             newName = newName.left(newName.length() - 1);
+
+        // Most edits don't change the value, for instance typing a parenthetical
+        // after the name, or changing alignment. Nothing to do in that case.
+        auto it = m_forwardMap.find(element);
+        if (it != m_forwardMap.end() && it.value() == newName)
+            return false;
+
+        const bool ret = this->remove(element);
         if (newName.isEmpty())
             return ret;
 
-        m_forwardMap[element] = newName;
-        m_reverseMap[newName].append(element);
-        return true;
+        QList<SceneElement *> &list = m_reverseMap[newName];
+        const bool wasMute = isMuteCharacterElement(m_type, list);
+        list.append(element);
+        m_forwardMap.insert(element, newName);
+        if (list.size() == 1)
+            m_distinctValuesDirty = true;
+
+        return ret || wasMute || list.size() == 1;
     }
 
     if (m_forwardMap.contains(element))
@@ -1012,19 +1213,16 @@ bool DistinctElementValuesMap::remove(SceneElement *element)
     // a different list after this function returns
     const QString oldName = m_forwardMap.take(element);
     if (!oldName.isEmpty()) {
-        QList<SceneElement *> &list = m_reverseMap[oldName];
-        if (list.removeOne(element)) {
-            if (list.isEmpty()) {
-                m_reverseMap.remove(oldName);
+        auto it = m_reverseMap.find(oldName);
+        if (it != m_reverseMap.end() && it->removeOne(element)) {
+            if (it->isEmpty()) {
+                m_reverseMap.erase(it);
+                m_distinctValuesDirty = true;
                 return true;
             }
 
-            if (list.size() == 1) {
-                const QVariant value =
-                        m_type == SceneElement::Character ? list.first()->property("#mute") : false;
-                if (value.isValid() && value.toBool())
-                    return true;
-            }
+            if (isMuteCharacterElement(m_type, it.value()))
+                return true;
         }
     }
 
@@ -1041,14 +1239,21 @@ bool DistinctElementValuesMap::remove(const QString &name)
         return false;
 
     for (SceneElement *element : elements)
-        m_forwardMap.take(element);
+        m_forwardMap.remove(element);
 
+    m_distinctValuesDirty = true;
     return true;
 }
 
 QStringList DistinctElementValuesMap::distinctValues() const
 {
-    return m_reverseMap.keys();
+    if (m_distinctValuesDirty) {
+        m_distinctValues = m_reverseMap.keys();
+        std::sort(m_distinctValues.begin(), m_distinctValues.end());
+        m_distinctValuesDirty = false;
+    }
+
+    return m_distinctValues;
 }
 
 bool DistinctElementValuesMap::containsValue(const QString &value) const
@@ -2815,69 +3020,98 @@ struct SceneSizeHintItem_TaskResult
 };
 Q_DECLARE_METATYPE(SceneSizeHintItem_TaskResult)
 
-SceneSizeHintItem_TaskResult SceneSizeHintItem_Task2(const qreal devicePixelRatio,
-                                                     const Scene *scene,
-                                                     const ScreenplayFormat *format,
-                                                     bool evaluateSize = true,
-                                                     bool evaluateImage = true)
+/**
+ * Everything required to lay out a scene, captured on the GUI thread. Text formats are
+ * implicitly shared values, so they can be handed over to a worker thread as they are,
+ * unlike the Scene and ScreenplayFormat objects they are created from.
+ */
+struct SceneSizeHintItem_TaskInput
 {
-    SceneSizeHintItem_TaskResult result;
-
-    const qreal pageWidth = format->pageLayout()->contentWidth();
+    struct Paragraph
+    {
+        QString text;
+        QTextBlockFormat blockFormat;
+        QTextCharFormat charFormat;
+    };
 
-    QTextDocument document;
-    document.setTextWidth(pageWidth);
-    document.setDefaultFont(format->defaultFont());
+    qreal devicePixelRatio = 1.0;
+    qreal pageWidth = 0;
+    QFont defaultFont;
+    QVector<Paragraph> paragraphs;
+    bool evaluateSize = true;
+    bool evaluateImage = true;
 
-    QTextCursor cursor(&document);
+    SceneSizeHintItem_TaskInput(const qreal dpr, const Scene *scene,
+                                const ScreenplayFormat *format, bool size, bool image)
+        : devicePixelRatio(dpr), evaluateSize(size), evaluateImage(image)
+    {
+        pageWidth = format->pageLayout()->contentWidth();
+        defaultFont = format->defaultFont();
+        paragraphs.reserve(scene->elementCount() + 1);
+
+        if (scene->heading()->isEnabled()) {
+            const SceneElementFormat *style = format->elementFormat(SceneElement::Heading);
+
+            Paragraph heading;
+            heading.text = scene->heading()->text();
+            heading.blockFormat = style->createBlockFormat(Qt::Alignment(), &pageWidth);
+            heading.blockFormat.setTopMargin(0);
+            heading.charFormat = style->createCharFormat(&pageWidth);
+            paragraphs.append(heading);
+        }
 
-    if (scene->heading()->isEnabled()) {
-        const SceneElementFormat *style = format->elementFormat(SceneElement::Heading);
-        QTextBlockFormat blockFormat = style->createBlockFormat(Qt::Alignment(), &pageWidth);
-        QTextCharFormat charFormat = style->createCharFormat(&pageWidth);
-        blockFormat.setTopMargin(0);
+        for (int j = 0; j < scene->elementCount(); j++) {
+            const SceneElement *para = scene->elementAt(j);
+            const SceneElementFormat *style = format->elementFormat(para->type());
+
+            Paragraph paragraph;
+            paragraph.text = para->text();
+            paragraph.blockFormat = style->createBlockFormat(para->alignment(), &pageWidth);
+            if (!scene->heading()->isEnabled() && j == 0)
+                paragraph.blockFormat.setTopMargin(0);
+            paragraph.charFormat = style->createCharFormat(&pageWidth);
+            paragraphs.append(paragraph);
+        }
 
-        cursor.setCharFormat(charFormat);
-        cursor.setBlockFormat(blockFormat);
-#if 0
-        TransliterationUtils::polishFontsAndInsertTextAtCursor(cursor, scene->heading()->text(),
-                                                               QVector<QTextLayout::FormatRange>());
-#else
-        cursor.insertText(scene->heading()->text());
-#endif
-        cursor.insertBlock();
+        // A heading is always followed by a block, even if the scene has no paragraphs.
+        if (scene->heading()->isEnabled() && scene->elementCount() == 0) {
+            Paragraph emptyParagraph = paragraphs.first();
+            emptyParagraph.text.clear();
+            paragraphs.append(emptyParagraph);
+        }
     }
+};
+
+SceneSizeHintItem_TaskResult SceneSizeHintItem_Task(const SceneSizeHintItem_TaskInput &input)
+{
+    PROFILE_THIS_FUNCTION;
+
+    SceneSizeHintItem_TaskResult result;
+
+    QTextDocument document;
+    document.setTextWidth(input.pageWidth);
+    document.setDefaultFont(input.defaultFont);
 
-    for (int j = 0; j < scene->elementCount(); j++) {
-        const SceneElement *para = scene->elementAt(j);
-        const SceneElementFormat *style = format->elementFormat(para->type());
+    QTextCursor cursor(&document);
+    for (int j = 0; j < input.paragraphs.size(); j++) {
+        const SceneSizeHintItem_TaskInput::Paragraph &paragraph = input.paragraphs.at(j);
         if (j)
             cursor.insertBlock();
 
-        QTextBlockFormat blockFormat = style->createBlockFormat(para->alignment(), &pageWidth);
-        QTextCharFormat charFormat = style->createCharFormat(&pageWidth);
-        if (!scene->heading()->isEnabled() && j == 0)
-            blockFormat.setTopMargin(0);
-
-        cursor.setCharFormat(charFormat);
-        cursor.setBlockFormat(blockFormat);
-#if 0
-        TransliterationUtils::polishFontsAndInsertTextAtCursor(cursor, para->text(),
-                                                               para->textFormats());
-#else
-        cursor.insertText(para->text());
-#endif
+        cursor.setCharFormat(paragraph.charFormat);
+        cursor.setBlockFormat(paragraph.blockFormat);
+        cursor.insertText(paragraph.text);
     }
 
-    const QSizeF docSize = document.size() * devicePixelRatio;
+    const QSizeF docSize = document.size() * input.devicePixelRatio;
 
-    if (evaluateSize)
-        result.documentSize = document.size() * devicePixelRatio;
+    if (input.evaluateSize)
+        result.documentSize = docSize;
 
-    if (evaluateImage) {
+    if (input.evaluateImage) {
         result.documentImage = QImage(docSize.toSize(), QImage::Format_ARGB32);
         result.documentImage.fill(Qt::transparent);
-        result.documentImage.setDevicePixelRatio(devicePixelRatio);
+        result.documentImage.setDevicePixelRatio(input.devicePixelRatio);
 
         QPainter paint(&result.documentImage);
         paint.setRenderHint(QPainter::Antialiasing);
@@ -2891,28 +3125,104 @@ SceneSizeHintItem_TaskResult SceneSizeHintItem_Task2(const qreal devicePixelRati
     return result;
 }
 
-SceneSizeHintItem_TaskResult SceneSizeHintItem_Task(const qreal devicePixelRatio,
-                                                    const QJsonObject &sceneJson,
-                                                    const QJsonObject &formatJson,
-                                                    bool evaluateSize = true,
-                                                    bool evaluateImage = true)
-{
-    SceneSizeHintItem_TaskResult result;
+/**
+ * Layouts of scenes are shared by all SceneSizeHintItem instances in the process. The same
+ * scene is often shown on the structure canvas, the timeline and elsewhere, and most
+ * changes to a document don't touch most of its scenes. Requests are keyed by what goes
+ * into the layout, and identical requests in flight share one task.
+ */
+struct SceneSizeHintItem_CacheKey
+{
+    // The hash only picks the bucket, keys are equal only if the texts themselves are.
+    uint contentHash = 0;
+    QStringList texts;
+    QVector<int> attributes;
+    quint64 formatSerialNumber = 0;
+    int formatRevision = 0;
+    qreal pageWidth = 0;
+    qreal devicePixelRatio = 1.0;
+    bool evaluateImage = true;
+
+    SceneSizeHintItem_CacheKey() { }
+    SceneSizeHintItem_CacheKey(const qreal dpr, const Scene *scene,
+                               const ScreenplayFormat *fmt, bool image)
+        : formatSerialNumber(fmt->serialNumber()),
+          formatRevision(fmt->modificationTime()),
+          pageWidth(fmt->pageLayout()->contentWidth()),
+          devicePixelRatio(dpr),
+          evaluateImage(image)
+    {
+        auto combine = [](uint seed, uint value) {
+            return seed ^ (value + 0x9e3779b9 + (seed << 6) + (seed >> 2));
+        };
 
-    Scene scene;
-    ScreenplayFormat format;
-    format.resetToFactoryDefaults();
+        const SceneHeading *heading = scene->heading();
+        attributes.append(heading->isEnabled() ? 1 : 0);
+        contentHash = combine(contentHash, heading->isEnabled() ? 1 : 0);
+        if (heading->isEnabled()) {
+            texts.append(heading->text());
+            contentHash = combine(contentHash, qHash(texts.last()));
+        }
 
-    if (!QObjectSerializer::fromJson(formatJson, &format))
-        return result;
+        for (int j = 0; j < scene->elementCount(); j++) {
+            const SceneElement *para = scene->elementAt(j);
+            texts.append(para->text());
+            attributes.append(int(para->type()));
+            attributes.append(int(para->alignment()));
+            contentHash = combine(contentHash, uint(para->type()));
+            contentHash = combine(contentHash, uint(para->alignment()));
+            contentHash = combine(contentHash, qHash(texts.last()));
+        }
+    }
 
-    if (!QObjectSerializer::fromJson(sceneJson, &scene))
-        return result;
+    bool operator==(const SceneSizeHintItem_CacheKey &other) const
+    {
+        return contentHash == other.contentHash && formatSerialNumber == other.formatSerialNumber
+                && formatRevision == other.formatRevision
+                && qFuzzyCompare(pageWidth, other.pageWidth)
+                && qFuzzyCompare(devicePixelRatio, other.devicePixelRatio)
+                && evaluateImage == other.evaluateImage && attributes == other.attributes
+                && texts == other.texts;
+    }
+};
 
-    format.pageLayout()->evaluateRectsNow();
-    return SceneSizeHintItem_Task2(devicePixelRatio, &scene, &format, evaluateSize, evaluateImage);
+inline uint qHash(const SceneSizeHintItem_CacheKey &key, uint seed = 0)
+{
+    return qHash(key.contentHash, seed) ^ qHash(key.formatSerialNumber)
+            ^ qHash(key.formatRevision) ^ uint(key.evaluateImage);
 }
 
+struct SceneSizeHintItem_Cache
+{
+    // Cost is in kilobytes, upto 64 MB of preview images are kept around.
+    SceneSizeHintItem_Cache() { results.setMaxCost(64 * 1024); }
+
+    const SceneSizeHintItem_TaskResult *find(const SceneSizeHintItem_CacheKey &key)
+    {
+        // A result with an image can stand in for a request that needs only the size.
+        if (!key.evaluateImage) {
+            SceneSizeHintItem_CacheKey imageKey = key;
+            imageKey.evaluateImage = true;
+            if (const SceneSizeHintItem_TaskResult *result = results.object(imageKey))
+                return result;
+        }
+
+        return results.object(key);
+    }
+
+    void insert(const SceneSizeHintItem_CacheKey &key, const SceneSizeHintItem_TaskResult &result)
+    {
+        const int cost = qMax(1, int(result.documentImage.sizeInBytes() / 1024));
+        results.insert(key, new SceneSizeHintItem_TaskResult(result), cost);
+    }
+
+    QCache<SceneSizeHintItem_CacheKey, SceneSizeHintItem_TaskResult> results;
+    QHash<SceneSizeHintItem_CacheKey, QFuture<SceneSizeHintItem_TaskResult>> pending;
+};
+
+// Only ever used from the GUI thread, task inputs and results are passed by value.
+Q_GLOBAL_STATIC(SceneSizeHintItem_Cache, TheSceneSizeHintItemCache)
+
 void SceneSizeHintItem::timerEvent(QTimerEvent *te)
 {
     if (te->timerId() == m_updateTimer.timerId()) {
@@ -2937,6 +3247,18 @@ void SceneSizeHintItem::timerEvent(QTimerEvent *te)
         }
 
         if (m_asynchronous) {
+            const qreal dpr = window->effectiveDevicePixelRatio();
+            const bool evaluateImage = this->isVisible();
+            const SceneSizeHintItem_CacheKey key(dpr, m_scene, m_format, evaluateImage);
+
+            SceneSizeHintItem_Cache *cache = TheSceneSizeHintItemCache;
+            if (const SceneSizeHintItem_TaskResult *result = cache->find(key)) {
+                m_documentImage = result->documentImage;
+                this->updateSize(result->documentSize);
+                this->update();
+                return;
+            }
+
             // Since the result travels from background thread to main thread
             static int taskResultTypeId = qRegisterMetaType<SceneSizeHintItem_TaskResult>();
             Q_UNUSED(taskResultTypeId)
@@ -2945,6 +3267,8 @@ void SceneSizeHintItem::timerEvent(QTimerEvent *te)
             watcher->setObjectName(watcherName);
             connect(watcher, &QFutureWatcher<SceneSizeHintItem_TaskResult>::finished, this, [=]() {
                 const SceneSizeHintItem_TaskResult result = watcher->result();
+                if (cache->pending.remove(key) > 0)
+                    cache->insert(key, result);
                 m_documentImage = result.documentImage;
                 this->updateSize(result.documentSize);
                 this->update();
@@ -2952,12 +3276,14 @@ void SceneSizeHintItem::timerEvent(QTimerEvent *te)
             connect(watcher, &QFutureWatcher<SceneSizeHintItem_TaskResult>::finished, watcher,
                     &QObject::deleteLater);
 
-            const QJsonObject sceneJson = QObjectSerializer::toJson(m_scene);
-            const QJsonObject formatJson = QObjectSerializer::toJson(m_format);
+            QFuture<SceneSizeHintItem_TaskResult> future = cache->pending.value(key);
+            if (!cache->pending.contains(key)) {
+                const SceneSizeHintItem_TaskInput input(dpr, m_scene, m_format, true,
+                                                        evaluateImage);
+                future = QtConcurrent::run(SceneSizeHintItem_Task, input);
+                cache->pending.insert(key, future);
+            }
 
-            QFuture<SceneSizeHintItem_TaskResult> future =
-                    QtConcurrent::run(SceneSizeHintItem_Task, window->effectiveDevicePixelRatio(),
-                                      sceneJson, formatJson, true, this->isVisible());
             watcher->setFuture(future);
         } else {
             this->updateSizeAndImageNow();
@@ -3038,8 +3364,18 @@ void SceneSizeHintItem::updateSizeAndImageNow()
         this->setHasPendingComputeSize(false);
         m_documentImage = QImage();
     } else {
-        const SceneSizeHintItem_TaskResult result = SceneSizeHintItem_Task2(
-                window->effectiveDevicePixelRatio(), m_scene, m_format, true, this->isVisible());
+        const qreal dpr = window->effectiveDevicePixelRatio();
+        const SceneSizeHintItem_CacheKey key(dpr, m_scene, m_format, this->isVisible());
+
+        SceneSizeHintItem_Cache *cache = TheSceneSizeHintItemCache;
+        const SceneSizeHintItem_TaskResult *cachedResult = cache->find(key);
+        const SceneSizeHintItem_TaskResult result = cachedResult
+                ? *cachedResult
+                : SceneSizeHintItem_Task(SceneSizeHintItem_TaskInput(dpr, m_scene, m_format, true,
+                                                                     this->isVisible()));
+        if (cachedResult == nullptr)
+            cache->insert(key, result);
+
         m_documentImage = result.documentImage;
         this->updateSize(result.documentSize);
     }
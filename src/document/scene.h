@@ -15,6 +15,7 @@
 #define SCENE_H
 
 #include <QMap>
+#include <QHash>
 #include <QList>
 #include <QColor>
 #include <QPointer>
@@ -244,7 +245,8 @@ public:
     ~DistinctElementValuesMap();
 
     // These functions returns true if distinctValues() would return
-    // a different list after this function returns
+    // a different list after this function returns. Re-including an element whose
+    // value hasn't changed is a no-op.
     bool include(SceneElement *element);
     bool remove(SceneElement *element);
     bool remove(const QString &name);
@@ -259,8 +261,12 @@ public:
 
 private:
     SceneElement::Type m_type = SceneElement::Character;
-    QMap<SceneElement *, QString> m_forwardMap;
-    QMap<QString, QList<SceneElement *>> m_reverseMap;
+    QHash<SceneElement *, QString> m_forwardMap;
+    QHash<QString, QList<SceneElement *>> m_reverseMap;
+
+    // Sorted keys of m_reverseMap, rebuilt only when a value comes or goes.
+    mutable QStringList m_distinctValues;
+    mutable bool m_distinctValuesDirty = false;
 };
 
 class CharacterElementMap : public DistinctElementValuesMap
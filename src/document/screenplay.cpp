@@ -2457,6 +2457,10 @@ QJsonArray Screenplay::search(const QString &text, int flags) const
 
     QJsonArray ret;
 
+    const QSet<SceneElement *> candidates = this->searchCandidates(text);
+    if (candidates.isEmpty())
+        return ret;
+
     const int nrScenes = m_elements.size();
     for (int i = 0; i < nrScenes; i++) {
         Scene *scene = m_elements.at(i)->scene();
@@ -2468,6 +2472,8 @@ QJsonArray Screenplay::search(const QString &text, int flags) const
         const int nrElements = scene->elementCount();
         for (int j = 0; j < nrElements; j++) {
             SceneElement *element = scene->elementAt(j);
+            if (!candidates.contains(element))
+                continue;
 
             const QJsonArray results = element->find(text, flags);
             if (!results.isEmpty()) {
@@ -2498,6 +2504,10 @@ int Screenplay::replace(const QString &text, const QString &replacementText, int
 
     int counter = 0;
 
+    const QSet<SceneElement *> candidates = this->searchCandidates(text);
+    if (candidates.isEmpty())
+        return counter;
+
     const int nrScenes = m_elements.size();
     for (int i = 0; i < nrScenes; i++) {
         Scene *scene = m_elements.at(i)->scene();
@@ -2509,6 +2519,9 @@ int Screenplay::replace(const QString &text, const QString &replacementText, int
         const int nrElements = scene->elementCount();
         for (int j = 0; j < nrElements; j++) {
             SceneElement *element = scene->elementAt(j);
+            if (!candidates.contains(element))
+                continue;
+
             const QJsonArray results = element->find(text, flags);
             counter += results.size();
 
@@ -2540,6 +2553,27 @@ int Screenplay::replace(const QString &text, const QString &replacementText, int
     return counter;
 }
 
+QSet<SceneElement *> Screenplay::searchCandidates(const QString &text) const
+{
+    if (text.isEmpty())
+        return QSet<SceneElement *>();
+
+    // Paragraphs are only re-indexed if their text changed since the last search, so this pass
+    // is just a hash lookup per paragraph. The index then narrows down paragraphs that
+    // SceneElement::find() needs to look at.
+    for (ScreenplayElement *screenplayElement : m_elements) {
+        Scene *scene = screenplayElement->scene();
+        if (scene == nullptr)
+            continue;
+
+        const int nrElements = scene->elementCount();
+        for (int j = 0; j < nrElements; j++)
+            m_searchIndex->update(scene->elementAt(j));
+    }
+
+    return m_searchIndex->lookup(text);
+}
+
 void Screenplay::resetSceneNumbers()
 {
     this->evaluateSceneNumbers(true);
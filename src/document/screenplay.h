@@ -18,6 +18,7 @@
 #include "modifiable.h"
 #include "execlatertimer.h"
 #include "qobjectproperty.h"
+#include "screenplaysearchindex.h"
 
 #include <QJsonArray>
 #include <QJsonValue>
@@ -617,6 +618,9 @@ private:
     ExecLaterTimer m_paragraphCountEvaluationTimer;
     ExecLaterTimer m_evalHeightHintsAvailableTimer;
     ExecLaterTimer m_selectedElementsOmitStatusChangedTimer;
+
+    QSet<SceneElement *> searchCandidates(const QString &text) const;
+    ScreenplaySearchIndex *m_searchIndex = new ScreenplaySearchIndex(this);
 };
 
 /**
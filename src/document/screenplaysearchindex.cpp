@@ -0,0 +1,192 @@
+/****************************************************************************
+**
+** Copyright (C) VCreate Logic Pvt. Ltd. Bengaluru
+** Author: Prashanth N Udupa (prashanth@scrite.io)
+**
+** This code is distributed under GPL v3. Complete text of the license
+** can be found here: https://www.gnu.org/licenses/gpl-3.0.txt
+**
+** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+**
+****************************************************************************/
+
+#include "scene.h"
+#include "screenplaysearchindex.h"
+
+#include <QVector>
+
+#include <algorithm>
+
+static inline quint64 packGram(const QChar *chars, int length)
+{
+    quint64 ret = quint64(length) << 48;
+    for (int i = 0; i < length; i++)
+        ret |= quint64(chars[i].unicode()) << (32 - 16 * i);
+    return ret;
+}
+
+ScreenplaySearchIndex::ScreenplaySearchIndex(QObject *parent) : QObject(parent) { }
+
+ScreenplaySearchIndex::~ScreenplaySearchIndex() { }
+
+void ScreenplaySearchIndex::update(SceneElement *element)
+{
+    if (element == nullptr)
+        return;
+
+    const bool known = m_elementGrams.contains(element);
+    if (known && !m_dirtyElements.contains(element))
+        return;
+
+    if (!known) {
+        // Only the pointer value is used once the element is gone, it is never dereferenced.
+        connect(element, &SceneElement::textChanged, this,
+                [=]() { m_dirtyElements.insert(element); });
+        connect(element, &QObject::destroyed, this, [=]() { this->forget(element); });
+    }
+
+    m_dirtyElements.remove(element);
+
+    // Only touch postings of n-grams that actually changed, an edit typically changes a handful.
+    QSet<quint64> &grams = m_elementGrams[element];
+    const QSet<quint64> newGrams = gramsOf(element->text());
+
+    for (const quint64 gram : qAsConst(grams)) {
+        if (newGrams.contains(gram))
+            continue;
+
+        auto it = m_postings.find(gram);
+        if (it == m_postings.end())
+            continue;
+
+        it->remove(element);
+        if (it->isEmpty())
+            m_postings.erase(it);
+    }
+
+    for (const quint64 gram : newGrams) {
+        if (!grams.contains(gram))
+            m_postings[gram].insert(element);
+    }
+
+    grams = newGrams;
+}
+
+void ScreenplaySearchIndex::remove(SceneElement *element)
+{
+    if (element == nullptr || !m_elementGrams.contains(element))
+        return;
+
+    disconnect(element, nullptr, this, nullptr);
+    this->forget(element);
+}
+
+void ScreenplaySearchIndex::clear()
+{
+    const QList<SceneElement *> elements = m_elementGrams.keys();
+    for (SceneElement *element : elements)
+        disconnect(element, nullptr, this, nullptr);
+
+    m_postings.clear();
+    m_elementGrams.clear();
+    m_dirtyElements.clear();
+}
+
+void ScreenplaySearchIndex::forget(SceneElement *element)
+{
+    auto it = m_elementGrams.find(element);
+    if (it == m_elementGrams.end())
+        return;
+
+    for (const quint64 gram : qAsConst(it.value())) {
+        auto pit = m_postings.find(gram);
+        if (pit == m_postings.end())
+            continue;
+
+        pit->remove(element);
+        if (pit->isEmpty())
+            m_postings.erase(pit);
+    }
+
+    m_elementGrams.erase(it);
+    m_dirtyElements.remove(element);
+}
+
+QSet<SceneElement *> ScreenplaySearchIndex::lookup(const QString &text) const
+{
+    const QVector<quint64> grams = queryGramsOf(text);
+    if (grams.isEmpty())
+        return QSet<SceneElement *>();
+
+    // Intersect postings starting from the rarest n-gram, so that the working set stays small
+    QVector<const QSet<SceneElement *> *> postings;
+    postings.reserve(grams.size());
+    for (const quint64 gram : grams) {
+        auto it = m_postings.constFind(gram);
+        if (it == m_postings.constEnd())
+            return QSet<SceneElement *>();
+        postings.append(&it.value());
+    }
+
+    std::sort(postings.begin(), postings.end(),
+              [](const QSet<SceneElement *> *a, const QSet<SceneElement *> *b) {
+                  return a->size() < b->size();
+              });
+
+    QSet<SceneElement *> ret = *postings.first();
+    for (int i = 1; i < postings.size() && !ret.isEmpty(); i++) {
+        const QSet<SceneElement *> *posting = postings.at(i);
+        for (auto it = ret.begin(); it != ret.end();) {
+            if (posting->contains(*it))
+                ++it;
+            else
+                it = ret.erase(it);
+        }
+    }
+
+    return ret;
+}
+
+QSet<quint64> ScreenplaySearchIndex::gramsOf(const QString &text)
+{
+    // QString::toCaseFolded() maps one code unit to one code unit, so n-grams of the folded
+    // text line up with what QString::indexOf(..., Qt::CaseInsensitive) compares.
+    const QString folded = text.toCaseFolded();
+    const QChar *chars = folded.constData();
+    const int length = folded.length();
+
+    QSet<quint64> ret;
+    ret.reserve(length * 3);
+    for (int i = 0; i < length; i++) {
+        for (int n = 1; n <= 3 && i + n <= length; n++)
+            ret.insert(packGram(chars + i, n));
+    }
+
+    return ret;
+}
+
+QVector<quint64> ScreenplaySearchIndex::queryGramsOf(const QString &text)
+{
+    const QString folded = text.toCaseFolded();
+    const QChar *chars = folded.constData();
+    const int length = folded.length();
+
+    QVector<quint64> ret;
+    if (length == 0)
+        return ret;
+
+    if (length < 3) {
+        ret.append(packGram(chars, length));
+        return ret;
+    }
+
+    ret.reserve(length - 2);
+    for (int i = 0; i + 3 <= length; i++) {
+        const quint64 gram = packGram(chars + i, 3);
+        if (!ret.contains(gram))
+            ret.append(gram);
+    }
+
+    return ret;
+}
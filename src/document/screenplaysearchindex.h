@@ -0,0 +1,61 @@
+/****************************************************************************
+**
+** Copyright (C) VCreate Logic Pvt. Ltd. Bengaluru
+** Author: Prashanth N Udupa (prashanth@scrite.io)
+**
+** This code is distributed under GPL v3. Complete text of the license
+** can be found here: https://www.gnu.org/licenses/gpl-3.0.txt
+**
+** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+**
+****************************************************************************/
+
+#ifndef SCREENPLAYSEARCHINDEX_H
+#define SCREENPLAYSEARCHINDEX_H
+
+#include <QSet>
+#include <QHash>
+#include <QObject>
+
+class SceneElement;
+
+/**
+ * Inverted index of case-folded 1, 2 and 3 character n-grams over scene paragraphs.
+ *
+ * Paragraphs are marked dirty whenever their text changes and are re-indexed lazily on the
+ * next lookup, so typing costs nothing extra. A lookup returns a superset of paragraphs that
+ * can contain the query; exact matching (case, whole words) is still done by
+ * SceneElement::find() on just those paragraphs.
+ */
+class ScreenplaySearchIndex : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ScreenplaySearchIndex(QObject *parent = nullptr);
+    ~ScreenplaySearchIndex();
+
+    // Brings the index up to date for the given paragraph, no-op if it is already current.
+    void update(SceneElement *element);
+    void remove(SceneElement *element);
+    void clear();
+
+    QSet<SceneElement *> lookup(const QString &text) const;
+
+    int elementCount() const { return m_elementGrams.size(); }
+    int gramCount() const { return m_postings.size(); }
+
+private:
+    // Drops postings of an element without touching the element itself, it may be dying.
+    void forget(SceneElement *element);
+    static QSet<quint64> gramsOf(const QString &text);
+    static QVector<quint64> queryGramsOf(const QString &text);
+
+private:
+    QSet<SceneElement *> m_dirtyElements;
+    QHash<SceneElement *, QSet<quint64>> m_elementGrams;
+    QHash<quint64, QSet<SceneElement *>> m_postings;
+};
+
+#endif // SCREENPLAYSEARCHINDEX_H
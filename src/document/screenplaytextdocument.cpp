@@ -1134,6 +1134,8 @@ void ScreenplayTextDocument::setCurrentPageAndPosition(int page, qreal pos)
 
 void ScreenplayTextDocument::loadScreenplay()
 {
+    PROFILE_THIS_FUNCTION;
+
 #ifdef DISPLAY_DOCUMENT_IN_TEXTEDIT
     static QTextEdit *textEdit = nullptr;
     if (m_purpose == ForDisplay) {
@@ -2204,35 +2206,101 @@ void ScreenplayTextDocument::evaluateCurrentPageAndPosition()
 
 void ScreenplayTextDocument::evaluatePageBoundaries(bool revalCurrentPageAndPosition)
 {
+    PROFILE_THIS_FUNCTION;
+
     // NOTE: Please do not call this function from anywhere other than
     // timerEvent(), while handling m_pageBoundaryEvalTimer
     QList<QPair<int, int>> pgBoundaries;
 
     if (m_formatting != nullptr && m_textDocument != nullptr && m_screenplay != nullptr) {
-        m_textDocument->setDefaultFont(m_formatting->defaultFont());
+        if (m_pageBoundaryDocument != m_textDocument.data()) {
+            if (m_pageBoundaryDocument != nullptr)
+                disconnect(m_pageBoundaryDocument.data(), &QTextDocument::contentsChange, this,
+                           &ScreenplayTextDocument::onTextDocumentContentsChange);
+            m_pageBoundaryDocument = m_textDocument.data();
+            connect(m_pageBoundaryDocument.data(), &QTextDocument::contentsChange, this,
+                    &ScreenplayTextDocument::onTextDocumentContentsChange);
+            m_pageBoundaryChange.full = true;
+        }
+
+        // Font and page size changes lay out the whole document again, without reporting
+        // any change in contents.
+        const QSizeF pageSizeBefore = m_textDocument->pageSize();
+        const QTextFrameFormat rootFrameFormatBefore = m_textDocument->rootFrame()->frameFormat();
+        if (m_textDocument->defaultFont() != m_formatting->defaultFont()) {
+            m_textDocument->setDefaultFont(m_formatting->defaultFont());
+            m_pageBoundaryChange.full = true;
+        }
         m_formatting->pageLayout()->configure(m_textDocument);
+        if (m_textDocument->pageSize() != pageSizeBefore
+            || m_textDocument->rootFrame()->frameFormat() != rootFrameFormatBefore)
+            m_pageBoundaryChange.full = true;
 
         const ScreenplayPageLayout *pageLayout = m_formatting->pageLayout();
         const QMarginsF pageMargins = pageLayout->margins();
 
-        QRectF paperRect = pageLayout->paperRect();
+        const QRectF paperRect = pageLayout->paperRect();
         QAbstractTextDocumentLayout *layout = m_textDocument->documentLayout();
 
-        const int endCursorPosition = m_textDocument->characterCount() - 1;
-
-        qreal fpageCount = 0.1;
+        auto pageContentsRect = [=](int pageIndex) {
+            return QRectF(0, pageIndex * paperRect.height(), paperRect.width(), paperRect.height())
+                    .adjusted(pageMargins.left(), pageMargins.top(), -pageMargins.right(),
+                              -pageMargins.bottom());
+        };
 
+        const int endCursorPosition = m_textDocument->characterCount() - 1;
         const int pageCount = m_textDocument->pageCount();
         int pageIndex = 0;
+
+        /**
+         * Layout only flows downwards, so pages that end before the first edited block
+         * (and the one before it, in case it is kept together with the edited block) cannot
+         * have changed. We reuse those as is, and re-evaluate pages from there on. Once we
+         * are past the edited region and a page starts exactly where one of the previously
+         * evaluated pages (shifted by the edit) did, rest of the pages line up as well.
+         */
+        const QList<QPair<int, int>> oldBoundaries = m_pageBoundaries;
+        const PageBoundaryChange change = m_pageBoundaryChange;
+        const bool incremental = !change.full && !oldBoundaries.isEmpty();
+
+        if (incremental) {
+            if (change.from < 0) {
+                if (oldBoundaries.size() == pageCount)
+                    pgBoundaries = oldBoundaries;
+            } else {
+                const QTextBlock changedBlock = m_textDocument->findBlock(change.from);
+                const QTextBlock reuseBlock =
+                        changedBlock.isValid() ? changedBlock.previous() : QTextBlock();
+                const int reuseBefore = reuseBlock.isValid() ? reuseBlock.position() : 0;
+
+                while (pgBoundaries.size() < qMin(oldBoundaries.size(), pageCount - 1)
+                       && oldBoundaries.at(pgBoundaries.size()).second < reuseBefore)
+                    pgBoundaries << oldBoundaries.at(pgBoundaries.size());
+            }
+            pageIndex = pgBoundaries.size();
+        }
+
         while (pageIndex < pageCount) {
-            paperRect = QRectF(0, pageIndex * paperRect.height(), paperRect.width(),
-                               paperRect.height());
-            const QRectF contentsRect =
-                    paperRect.adjusted(pageMargins.left(), pageMargins.top(), -pageMargins.right(),
-                                       -pageMargins.bottom());
+            const QRectF contentsRect = pageContentsRect(pageIndex);
             const int firstPosition = pgBoundaries.isEmpty()
                     ? layout->hitTest(contentsRect.topLeft(), Qt::FuzzyHit)
                     : pgBoundaries.last().second + 1;
+
+            if (incremental && change.from >= 0 && firstPosition >= change.to) {
+                const int oldFirstPosition = firstPosition - change.delta;
+                auto it = std::lower_bound(
+                        oldBoundaries.begin(), oldBoundaries.end(), oldFirstPosition,
+                        [](const QPair<int, int> &b, int pos) { return b.first < pos; });
+                if (it != oldBoundaries.end() && it->first == oldFirstPosition
+                    && pageIndex + (oldBoundaries.end() - it) == pageCount) {
+                    for (; it != oldBoundaries.end(); ++it)
+                        pgBoundaries << qMakePair(it->first + change.delta,
+                                                  it->second + change.delta);
+                    pgBoundaries.last().second = endCursorPosition;
+                    break;
+                }
+            }
+
             const int lastPosition = pageIndex == pageCount - 1
                     ? endCursorPosition
                     : layout->hitTest(contentsRect.bottomRight(), Qt::FuzzyHit);
@@ -2240,22 +2308,24 @@ void ScreenplayTextDocument::evaluatePageBoundaries(bool revalCurrentPageAndPosi
                                       lastPosition >= 0 ? lastPosition : endCursorPosition);
 
             ++pageIndex;
+        }
 
-            if (pageIndex == pageCount) {
-                ScreenplayElement *lastElement =
-                        m_screenplay->elementAt(m_screenplay->elementCount() - 1);
-                if (lastElement == nullptr)
-                    fpageCount = 0.01;
+        qreal fpageCount = 0.1;
+        if (pageCount > 0) {
+            ScreenplayElement *lastElement =
+                    m_screenplay->elementAt(m_screenplay->elementCount() - 1);
+            if (lastElement == nullptr)
+                fpageCount = 0.01;
+            else {
+                QTextFrame *lastFrame = this->findTextFrame(lastElement);
+                if (lastFrame == nullptr)
+                    fpageCount = pageCount;
                 else {
-                    QTextFrame *lastFrame = this->findTextFrame(lastElement);
-                    if (lastFrame == nullptr)
-                        fpageCount = pageCount;
-                    else {
-                        const QRectF lastFrameRect = layout->frameBoundingRect(lastFrame);
-                        fpageCount = pageCount - 1;
-                        fpageCount += (lastFrameRect.bottom() - contentsRect.top())
-                                / contentsRect.height();
-                    }
+                    const QRectF contentsRect = pageContentsRect(pageCount - 1);
+                    const QRectF lastFrameRect = layout->frameBoundingRect(lastFrame);
+                    fpageCount = pageCount - 1;
+                    fpageCount +=
+                            (lastFrameRect.bottom() - contentsRect.top()) / contentsRect.height();
                 }
             }
         }
@@ -2263,8 +2333,12 @@ void ScreenplayTextDocument::evaluatePageBoundaries(bool revalCurrentPageAndPosi
         this->setPageCount(fpageCount);
     }
 
-    m_pageBoundaries = pgBoundaries;
-    emit pageBoundariesChanged();
+    m_pageBoundaryChange = PageBoundaryChange();
+
+    if (m_pageBoundaries != pgBoundaries) {
+        m_pageBoundaries = pgBoundaries;
+        emit pageBoundariesChanged();
+    }
 
     if (revalCurrentPageAndPosition)
         this->evaluateCurrentPageAndPosition();
@@ -2275,6 +2349,25 @@ void ScreenplayTextDocument::evaluatePageBoundariesLater()
     m_pageBoundaryEvalTimer.start(500, this);
 }
 
+void ScreenplayTextDocument::onTextDocumentContentsChange(int position, int charsRemoved,
+                                                          int charsAdded)
+{
+    // Track the edited range in current document positions, along with how much
+    // positions after it have moved, since page boundaries were last evaluated.
+    PageBoundaryChange &change = m_pageBoundaryChange;
+    if (change.from < 0) {
+        change.from = position;
+        change.to = position + charsAdded;
+    } else {
+        change.from = qMin(change.from, position);
+        if (change.to > position)
+            change.to = qMax(position + charsAdded, change.to + charsAdded - charsRemoved);
+        else
+            change.to = qMax(change.to, position + charsAdded);
+    }
+    change.delta += charsAdded - charsRemoved;
+}
+
 void ScreenplayTextDocument::formatAllBlocks()
 {
     if (m_screenplay == nullptr || m_formatting == nullptr || m_updating || !m_componentComplete
@@ -16,6 +16,7 @@
 
 #include <QTime>
 #include <QtMath>
+#include <QPointer>
 #include <QTextDocument>
 #include <QQmlParserStatus>
 #include <QPagedPaintDevice>
@@ -331,6 +332,7 @@ private:
     void evaluateCurrentPageAndPosition();
     void evaluatePageBoundaries(bool revalCurrentPageAndPosition = true);
     void evaluatePageBoundariesLater();
+    void onTextDocumentContentsChange(int position, int charsRemoved, int charsAdded);
     void formatAllBlocks();
     bool updateFromScreenplayElement(const ScreenplayElement *element);
     void loadScreenplayElement(const ScreenplayElement *element, QTextCursor &cursor);
@@ -387,6 +389,15 @@ private:
     bool m_connectedToFormattingSignals = false;
     QPagedPaintDevice::PageSize m_paperSize = QPagedPaintDevice::Letter;
     QList<QPair<int, int>> m_pageBoundaries;
+    struct PageBoundaryChange
+    {
+        bool full = false;
+        int from = -1;
+        int to = -1;
+        int delta = 0;
+    };
+    PageBoundaryChange m_pageBoundaryChange;
+    QPointer<QTextDocument> m_pageBoundaryDocument;
     QObjectProperty<Screenplay> m_screenplay;
     friend class ScreenplayTextDocumentUpdate;
     QObjectProperty<QTextDocument> m_textDocument;
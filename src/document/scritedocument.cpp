@@ -26,6 +26,7 @@
 #include "pdfexporter.h"
 #include "odtexporter.h"
 #include "localstorage.h"
+#include "scritefileinfo.h"
 #include "htmlexporter.h"
 #include "textexporter.h"
 #include "notification.h"
@@ -39,6 +40,7 @@
 #include "fountainimporter.h"
 #include "fountainexporter.h"
 #include "qobjectserializer.h"
+#include "timeprofiler.h"
 #include "finaldraftimporter.h"
 #include "finaldraftexporter.h"
 #include "screenplaysubsetreport.h"
@@ -56,6 +58,7 @@
 #include <QDateTime>
 #include <QClipboard>
 #include <QScopeGuard>
+#include <QEventLoop>
 #include <QElapsedTimer>
 #include <QJsonDocument>
 #include <QFutureWatcher>
@@ -243,13 +246,15 @@ void ScriteDocumentBackups::loadMetaData(int row)
                 MetaData ret;
 
                 DocumentFileSystem dfs;
-                if (!dfs.load(fileName)) {
+                if (!dfs.load(fileName, nullptr, DocumentFileSystem::LazyLoadMode)) {
                     ret.loaded = true;
                     return ret;
                 }
 
-                const QJsonDocument jsonDoc = QJsonDocument::fromJson(dfs.header());
-                const QJsonObject docObj = jsonDoc.object();
+                const QJsonObject docObj =
+                        DocumentFileSystem::decodeHeader(dfs.header(), dfs.headerFormat(),
+                                                         { QStringLiteral("structure/elements"),
+                                                           QStringLiteral("screenplay/elements") });
 
                 const QJsonObject structure = docObj.value(QStringLiteral("structure")).toObject();
                 ret.structureElementCount =
@@ -704,6 +709,14 @@ ScriteDocument *ScriteDocument::instance()
     return theInstance;
 }
 
+DocumentFileSystem::HeaderFormat ScriteDocument::headerFormatForSaving()
+{
+    const QSettings *settings = Application::instance()->settings();
+    return settings->value(QStringLiteral("Installation/cborDocumentHeader"), false).toBool()
+            ? DocumentFileSystem::CborHeader
+            : DocumentFileSystem::JsonHeader;
+}
+
 ScriteDocument::ScriteDocument(QObject *parent)
     : QObject(parent),
       m_autoSaveTimer("ScriteDocument.m_autoSaveTimer"),
@@ -1215,6 +1228,7 @@ void ScriteDocument::reset()
 
     UndoStack::clearAllStacks();
     m_docFileSystem.hardReset();
+    m_serializedSections.clear();
 
     this->setSessionId(QUuid::createUuid().toString());
     this->setDocumentId(QUuid::createUuid().toString());
@@ -1276,6 +1290,19 @@ void ScriteDocument::reset()
     connect(m_formatting, &ScreenplayFormat::formatChanged, this, &ScriteDocument::markAsModified);
     connect(m_printFormat, &ScreenplayFormat::formatChanged, this, &ScriteDocument::markAsModified);
 
+    connect(m_structure, &Structure::structureChanged, this,
+            [=]() { m_serializedSections.remove(QStringLiteral("structure")); });
+    connect(m_screenplay, &Screenplay::screenplayChanged, this,
+            [=]() { m_serializedSections.remove(QStringLiteral("screenplay")); });
+    connect(m_formatting, &ScreenplayFormat::formatChanged, this,
+            [=]() { m_serializedSections.remove(QStringLiteral("formatting")); });
+    connect(m_printFormat, &ScreenplayFormat::formatChanged, this,
+            [=]() { m_serializedSections.remove(QStringLiteral("printFormat")); });
+    this->trackSerializedSection(m_structure);
+    this->trackSerializedSection(m_screenplay);
+    this->trackSerializedSection(m_formatting);
+    this->trackSerializedSection(m_printFormat);
+
     emit justReset();
 
     ExecLaterTimer::call(
@@ -1339,7 +1366,7 @@ bool ScriteDocument::importFromClipboard()
 
 bool ScriteDocument::open(const QString &fileName)
 {
-    if (fileName == m_fileName)
+    if (fileName == m_fileName || m_loadInProgress)
         return false;
 
     HourGlass hourGlass;
@@ -1358,6 +1385,9 @@ bool ScriteDocument::open(const QString &fileName)
 
 bool ScriteDocument::openAnonymously(const QString &fileName)
 {
+    if (m_loadInProgress)
+        return false;
+
     HourGlass hourGlass;
 
     this->setBusyMessage("Loading ...");
@@ -1375,6 +1405,8 @@ bool ScriteDocument::openAnonymously(const QString &fileName)
 
 void ScriteDocument::saveAs(const QString &givenFileName)
 {
+    PROFILE_THIS_FUNCTION;
+
     HourGlass hourGlass;
     QString fileName = this->polishFileName(givenFileName.trimmed());
     fileName = Application::instance()->sanitiseFileName(fileName);
@@ -1413,9 +1445,16 @@ void ScriteDocument::saveAs(const QString &givenFileName)
 
     emit aboutToSave();
 
-    const QJsonObject json = QObjectSerializer::toJson(this);
-    const QByteArray bytes = QJsonDocument(json).toJson();
-    m_docFileSystem.setHeader(bytes);
+    // Auto-save only serializes sections that were modified since the last save,
+    // so that its cost is proportional to the edit and not the whole document.
+    const QJsonObject json = m_autoSaveMode ? this->toJsonReusingUnchangedSections()
+                                            : QObjectSerializer::toJson(this);
+
+    const DocumentFileSystem::HeaderFormat headerFormat = ScriteDocument::headerFormatForSaving();
+    const QByteArray bytes = DocumentFileSystem::encodeHeader(json, headerFormat);
+    m_docFileSystem.setHeader(bytes, headerFormat);
+    m_docFileSystem.setMetadata(
+            QJsonDocument(ScriteFileInfo::extractMetadata(json)).toJson(QJsonDocument::Compact));
 
 #ifndef QT_NO_DEBUG_OUTPUT
     const bool saveJson = true;
@@ -1427,7 +1466,8 @@ void ScriteDocument::saveAs(const QString &givenFileName)
         const QString fileName2 = fi.absolutePath() + "/" + fi.completeBaseName() + ".json";
         QFile file2(fileName2);
         file2.open(QFile::WriteOnly);
-        file2.write(bytes);
+        file2.write(headerFormat == DocumentFileSystem::JsonHeader ? bytes
+                                                                    : QJsonDocument(json).toJson());
     }
 
     if (m_autoSaveMode) {
@@ -1478,6 +1518,12 @@ void ScriteDocument::saveAs(const QString &givenFileName)
     }
 }
 
+QJsonObject ScriteDocument::toJsonReusingUnchangedSections()
+{
+    QScopedValueRollback<bool> rollback(m_reuseSerializedSections, true);
+    return QObjectSerializer::toJson(this);
+}
+
 void ScriteDocument::save()
 {
     HourGlass hourGlass;
@@ -1953,6 +1999,13 @@ bool ScriteDocument::runSaveSanityChecks(const QString &givenFileName)
     const QString fileName = givenFileName.trimmed();
 
     // Multiple things could go wrong while saving a file.
+    // 0. A document is still being opened, see load().
+    if (m_loadInProgress) {
+        m_errorReport->setErrorMessage(
+                QStringLiteral("Cannot save while a document is being opened."));
+        return false;
+    }
+
     // 1. File name is empty.
     if (fileName.isEmpty()) {
         m_errorReport->setErrorMessage(QStringLiteral("File name cannot be empty"));
@@ -2215,11 +2268,22 @@ void ScriteDocument::setFileName(const QString &val)
 
 bool ScriteDocument::load(const QString &fileName)
 {
+    PROFILE_THIS_FUNCTION;
+
     m_errorReport->clear();
 
     QJsonObject details;
     details.insert(QStringLiteral("revealOnDesktopRequest"), fileName);
 
+    // The event loop is spun while the file is read, which must not start another load.
+    if (m_loadInProgress) {
+        m_errorReport->setErrorMessage(
+                QStringLiteral("Cannot open %1 while another document is being opened.")
+                        .arg(fileName),
+                details);
+        return false;
+    }
+
     if (!QFileInfo(fileName).isReadable()) {
         m_errorReport->setErrorMessage(QStringLiteral("Cannot open %1 for reading.").arg(fileName),
                                        details);
@@ -2242,22 +2306,27 @@ bool ScriteDocument::load(const QString &fileName)
 
     struct LoadCleanup
     {
-        LoadCleanup(ScriteDocument *doc) : m_document(doc) { m_document->m_errorReport->clear(); }
+        LoadCleanup(ScriteDocument *doc) : m_document(doc)
+        {
+            m_document->m_errorReport->clear();
+            m_document->m_loadInProgress = true;
+            m_document->setLoading(true);
+        }
 
         ~LoadCleanup()
         {
-            if (m_loadBegun) {
+            if (m_loadBegun)
                 m_document->m_progressReport->finish();
-                m_document->setLoading(false);
-            } else
+            else
                 m_document->m_docFileSystem.hardReset();
+            m_document->setLoading(false);
+            m_document->m_loadInProgress = false;
         }
 
         void begin()
         {
             m_loadBegun = true;
             m_document->m_progressReport->start();
-            m_document->setLoading(true);
         }
 
     private:
@@ -2265,32 +2334,80 @@ bool ScriteDocument::load(const QString &fileName)
         ScriteDocument *m_document;
     } loadCleanup(this);
 
-    int format = DocumentFileSystem::ScriteFormat;
-    bool loaded = this->classicLoad(fileName);
-    if (!loaded)
-        loaded = this->modernLoad(fileName, &format);
+    QElapsedTimer loadTimer;
+    loadTimer.start();
 
-    if (!loaded) {
-        m_errorReport->setErrorMessage(QStringLiteral("%1 is not a Scrite document.").arg(fileName),
-                                       details);
-        return false;
-    }
+    // Reading (and unzipping) the file and parsing the header JSON don't touch
+    // any QObject in the document, so they are done in a separate thread. This
+    // keeps the UI responsive while large documents are read from disk. The file
+    // is read into a DocumentFileSystem of its own, which m_docFileSystem takes
+    // over once it is read, so that nothing on this thread can get in the way.
+    DocumentFileSystem loadedFileSystem;
+    DocumentFileSystem *dfs = &loadedFileSystem;
+
+    struct ReadResult
+    {
+        bool loaded = false;
+        QJsonObject json;
+        qint64 readTime = 0;
+        qint64 parseTime = 0;
+        qint64 headerSize = 0;
+    };
+
+    QFuture<ReadResult> readFuture = QtConcurrent::run([=]() -> ReadResult {
+        ReadResult result;
+
+        QElapsedTimer timer;
+        timer.start();
+
+        int format = DocumentFileSystem::ScriteFormat;
+        result.loaded = ScriteDocument::classicLoad(fileName, dfs);
+        if (!result.loaded)
+            result.loaded = ScriteDocument::modernLoad(fileName, dfs, &format);
+        result.readTime = timer.restart();
 
-    const QJsonDocument jsonDoc = format == DocumentFileSystem::ZipFormat
-            ? QJsonDocument::fromJson(m_docFileSystem.header())
-            : QJsonDocument::fromBinaryData(m_docFileSystem.header());
+        if (!result.loaded)
+            return result;
+
+        const QByteArray header = dfs->header();
+        result.json = format == DocumentFileSystem::ZipFormat
+                ? DocumentFileSystem::decodeHeader(header, dfs->headerFormat())
+                : QJsonDocument::fromBinaryData(header).object();
+        result.headerSize = header.size();
+        result.parseTime = timer.elapsed();
 
 #ifndef QT_NO_DEBUG_OUTPUT
-    {
-        const QFileInfo fi(fileName);
-        const QString fileName2 = fi.absolutePath() + "/" + fi.completeBaseName() + ".json";
-        QFile file2(fileName2);
-        file2.open(QFile::WriteOnly);
-        file2.write(jsonDoc.toJson());
-    }
+        {
+            const QFileInfo fi(fileName);
+            const QString fileName2 = fi.absolutePath() + "/" + fi.completeBaseName() + ".json";
+            QFile file2(fileName2);
+            file2.open(QFile::WriteOnly);
+            file2.write(QJsonDocument(result.json).toJson());
+        }
 #endif
 
-    const QJsonObject json = jsonDoc.object();
+        return result;
+    });
+
+    if (!readFuture.isFinished()) {
+        QEventLoop eventLoop;
+        QFutureWatcher<ReadResult> readFutureWatcher;
+        connect(&readFutureWatcher, &QFutureWatcher<ReadResult>::finished, &eventLoop,
+                &QEventLoop::quit);
+        readFutureWatcher.setFuture(readFuture);
+        if (!readFuture.isFinished())
+            eventLoop.exec(QEventLoop::ExcludeUserInputEvents);
+    }
+
+    const ReadResult readResult = readFuture.result();
+    m_docFileSystem.adopt(loadedFileSystem);
+    if (!readResult.loaded) {
+        m_errorReport->setErrorMessage(QStringLiteral("%1 is not a Scrite document.").arg(fileName),
+                                       details);
+        return false;
+    }
+
+    const QJsonObject json = readResult.json;
     if (json.isEmpty()) {
         m_errorReport->setErrorMessage(QStringLiteral("%1 is not a Scrite document.").arg(fileName),
                                        details);
@@ -2357,12 +2474,18 @@ bool ScriteDocument::load(const QString &fileName)
 
     loadCleanup.begin();
 
+    QElapsedTimer deserializeTimer;
+    deserializeTimer.start();
+
     UndoStack::ignoreUndoCommands = true;
     const bool ret = QObjectSerializer::fromJson(json, this);
     if (m_screenplay->currentElementIndex() == 0)
         m_screenplay->setCurrentElementIndex(-1);
     UndoStack::ignoreUndoCommands = false;
     UndoStack::clearAllStacks();
+    m_serializedSections.clear();
+
+    const qint64 deserializeTime = deserializeTimer.elapsed();
 
     // When we finish loading, QML begins lazy initialization of the UI
     // for displaying the document. In the process even a small 1/2 pixel
@@ -2385,13 +2508,25 @@ bool ScriteDocument::load(const QString &fileName)
         notification->setActive(true);
     }
 
+    m_loadTimings = QJsonObject();
+    m_loadTimings.insert(QStringLiteral("read"), readResult.readTime);
+    m_loadTimings.insert(QStringLiteral("parse"), readResult.parseTime);
+    m_loadTimings.insert(QStringLiteral("deserialize"), deserializeTime);
+    m_loadTimings.insert(QStringLiteral("total"), loadTimer.elapsed());
+    m_loadTimings.insert(QStringLiteral("headerSize"), readResult.headerSize);
+    emit loadTimingsChanged();
+
+#ifndef QT_NO_DEBUG_OUTPUT
+    qDebug() << "PA: ScriteDocument.Load " << fileName << m_loadTimings;
+#endif
+
     emit collaboratorsChanged();
     emit justLoaded();
 
     return ret;
 }
 
-bool ScriteDocument::classicLoad(const QString &fileName)
+bool ScriteDocument::classicLoad(const QString &fileName, DocumentFileSystem *dfs)
 {
     if (fileName.isEmpty())
         return false;
@@ -2408,14 +2543,14 @@ bool ScriteDocument::classicLoad(const QString &fileName)
     file.seek(0);
 
     const QByteArray bytes = file.readAll();
-    m_docFileSystem.setHeader(bytes);
+    dfs->setHeader(bytes);
     return true;
 }
 
-bool ScriteDocument::modernLoad(const QString &fileName, int *format)
+bool ScriteDocument::modernLoad(const QString &fileName, DocumentFileSystem *dfs, int *format)
 {
     DocumentFileSystem::Format dfsFormat;
-    const bool ret = m_docFileSystem.load(fileName, &dfsFormat);
+    const bool ret = dfs->load(fileName, &dfsFormat, DocumentFileSystem::LazyLoadMode);
     if (format)
         *format = dfsFormat;
     return ret;
@@ -2562,13 +2697,59 @@ void ScriteDocument::prepareForDeserialization()
     // Nothing to do
 }
 
-bool ScriteDocument::canSerialize(const QMetaObject *, const QMetaProperty &) const
+static const QStringList &serializedSectionNames()
+{
+    static const QStringList ret({ QStringLiteral("structure"), QStringLiteral("screenplay"),
+                                   QStringLiteral("formatting"), QStringLiteral("printFormat") });
+    return ret;
+}
+
+// Not every stored property of a section's root object is covered by the section's own change
+// signal, canvasUIMode of Structure for instance. Any of them changing invalidates the section.
+void ScriteDocument::trackSerializedSection(QObject *section)
 {
+    static const QMetaMethod invalidateMethod = ScriteDocument::staticMetaObject.method(
+            ScriteDocument::staticMetaObject.indexOfSlot("invalidateSerializedSection()"));
+
+    const QMetaObject *mo = section->metaObject();
+    for (int i = QObject::staticMetaObject.propertyCount(); i < mo->propertyCount(); i++) {
+        const QMetaProperty prop = mo->property(i);
+        if (prop.isStored(section) && prop.hasNotifySignal())
+            connect(section, prop.notifySignal(), this, invalidateMethod, Qt::UniqueConnection);
+    }
+}
+
+void ScriteDocument::invalidateSerializedSection()
+{
+    const QObject *section = this->sender();
+    if (section == m_structure)
+        m_serializedSections.remove(QStringLiteral("structure"));
+    else if (section == m_screenplay)
+        m_serializedSections.remove(QStringLiteral("screenplay"));
+    else if (section == m_formatting)
+        m_serializedSections.remove(QStringLiteral("formatting"));
+    else if (section == m_printFormat)
+        m_serializedSections.remove(QStringLiteral("printFormat"));
+}
+
+bool ScriteDocument::canSerialize(const QMetaObject *mo, const QMetaProperty &prop) const
+{
+    if (m_reuseSerializedSections && mo == &ScriteDocument::staticMetaObject && prop.isValid())
+        return !m_serializedSections.contains(QString::fromLatin1(prop.name()));
+
     return true;
 }
 
 void ScriteDocument::serializeToJson(QJsonObject &json) const
 {
+    const QStringList &sectionNames = ::serializedSectionNames();
+    for (const QString &sectionName : sectionNames) {
+        if (m_reuseSerializedSections && m_serializedSections.contains(sectionName))
+            json.insert(sectionName, m_serializedSections.value(sectionName));
+        else if (json.contains(sectionName))
+            m_serializedSections.insert(sectionName, json.value(sectionName).toObject());
+    }
+
     json.insert(QStringLiteral("collaborators"), QJsonValue::fromVariant(m_collaborators));
     json.insert(QStringLiteral("documentId"), m_documentId);
 
@@ -15,6 +15,7 @@
 #define SCRITEDOCUMENT_H
 
 #include <QDir>
+#include <QHash>
 #include <QJsonArray>
 #include <QQmlEngine>
 
@@ -329,6 +330,10 @@ class ScriteDocument : public QObject, public QObjectSerializer::Interface
 public:
     static ScriteDocument *instance();
     ~ScriteDocument();
+
+    // CBOR headers can't be read by older versions, so they are saved only if the
+    // Installation/cborDocumentHeader setting asks for it.
+    static DocumentFileSystem::HeaderFormat headerFormatForSaving();
     Q_SIGNAL void aboutToDelete(ScriteDocument *doc);
 
     Q_PROPERTY(bool readOnly READ isReadOnly NOTIFY readOnlyChanged)
@@ -471,6 +476,11 @@ public:
     bool isLoading() const { return m_loading; }
     Q_SIGNAL void loadingChanged();
 
+    // Time (in milliseconds) spent in each phase of the most recent load.
+    Q_PROPERTY(QJsonObject loadTimings READ loadTimings NOTIFY loadTimingsChanged STORED false)
+    QJsonObject loadTimings() const { return m_loadTimings; }
+    Q_SIGNAL void loadTimingsChanged();
+
     Q_PROPERTY(QJsonObject userData READ userData WRITE setUserData NOTIFY userDataChanged)
     void setUserData(const QJsonObject &val);
     QJsonObject userData() const { return m_userData; }
@@ -547,6 +557,10 @@ public:
 
     // Callers must be responsible for how they use this.
     DocumentFileSystem *fileSystem() { return &m_docFileSystem; }
+
+    // Serializes the document, reusing sections that didn't change since they were last
+    // serialized. Sections serialized afresh are cached for the next call, or auto-save.
+    QJsonObject toJsonReusingUnchangedSections();
     Q_INVOKABLE void blockUI() { this->setLoading(true); }
     Q_INVOKABLE void unblockUI() { this->setLoading(false); }
 
@@ -572,8 +586,9 @@ private:
     void setModified(bool val);
     void setFileName(const QString &val);
     bool load(const QString &fileName);
-    bool classicLoad(const QString &fileName);
-    bool modernLoad(const QString &fileName, int *format = nullptr);
+    static bool classicLoad(const QString &fileName, DocumentFileSystem *dfs);
+    static bool modernLoad(const QString &fileName, DocumentFileSystem *dfs,
+                           int *format = nullptr);
     void structureElementIndexChanged();
     void screenplayElementIndexChanged();
     void setCreatedOnThisComputer(bool val);
@@ -581,6 +596,8 @@ private:
     void screenplayElementMoved(ScreenplayElement *ptr, int from, int to);
     void screenplayAboutToMoveElements(int at);
     void clearModifiedLater();
+    void trackSerializedSection(QObject *section);
+    Q_SLOT void invalidateSerializedSection();
 
 public:
     // QObjectSerializer::Interface implementation
@@ -599,6 +616,7 @@ private:
     bool m_busy = false;
     bool m_locked = false;
     bool m_loading = false;
+    bool m_loadInProgress = false;
     bool m_modified = false;
     bool m_autoSave = true;
     bool m_readOnly = false;
@@ -608,6 +626,7 @@ private:
     bool m_fromScriptalay = false;
     QString m_documentId;
     QJsonObject m_userData;
+    QJsonObject m_loadTimings;
     QString m_fileName;
     QString m_busyMessage;
     QStringList m_collaborators;
@@ -633,6 +652,11 @@ private:
     ExecLaterTimer m_evaluateStructureElementSequenceTimer;
     bool m_syncingStructureScreenplayCurrentIndex = false;
 
+    // JSON of top-level sections as of the last save. Auto-saves reuse
+    // sections that were not modified since, instead of serializing them again.
+    bool m_reuseSerializedSections = false;
+    mutable QHash<QString, QJsonObject> m_serializedSections;
+
     ErrorReport *m_errorReport = new ErrorReport(this);
     ProgressReport *m_progressReport = new ProgressReport(this);
 };
@@ -62,6 +62,8 @@ ScriteDocumentVault::ScriteDocumentVault(QObject *parent) : QAbstractListModel(p
     m_saveToVaultTimer.setInterval(2000);
     m_saveToVaultTimer.setSingleShot(true);
     connect(&m_saveToVaultTimer, &QTimer::timeout, this, &ScriteDocumentVault::saveToVault);
+    connect(&m_saveToVaultWatcher, &QFutureWatcher<bool>::finished, this,
+            &ScriteDocumentVault::onSaveToVaultFinished);
 
     connect(m_document, &ScriteDocument::documentChanged, this,
             &ScriteDocumentVault::onDocumentChanged);
@@ -161,7 +163,7 @@ QHash<int, QByteArray> ScriteDocumentVault::roleNames() const
 
 void ScriteDocumentVault::onDocumentAboutToReset()
 {
-    this->saveToVault();
+    this->saveToVaultAndWait();
 }
 
 void ScriteDocumentVault::onDocumentJustReset()
@@ -171,6 +173,9 @@ void ScriteDocumentVault::onDocumentJustReset()
 
 void ScriteDocumentVault::onDocumentJustSaved()
 {
+    // Otherwise a snapshot still being written would bring the vault file back.
+    m_saveToVaultWatcher.waitForFinished();
+
     const QString fileName = this->vaultFilePath();
     QFile::remove(fileName);
     m_saveToVaultTimer.stop();
@@ -198,6 +203,14 @@ void ScriteDocumentVault::saveToVault()
     if (m_nrUnsavedChanges <= 0 || !m_enabled)
         return;
 
+    // One snapshot at a time, onSaveToVaultFinished() schedules the next one if required.
+    if (m_saveToVaultWatcher.isRunning())
+        return;
+
+    // The document is being loaded, see ScriteDocument::load().
+    if (m_document != nullptr && m_document->isLoading())
+        return;
+
     m_nrUnsavedChanges = 0;
 
     if (m_document == nullptr)
@@ -207,30 +220,58 @@ void ScriteDocumentVault::saveToVault()
         return;
 
     if (m_document->fileName().isEmpty() || !m_document->isAutoSave()) {
+        PROFILE_THIS_FUNCTION;
+
         DocumentFileSystem *dfs = m_document->fileSystem();
 
+        // Only sections modified since they were last serialized are walked here, the rest
+        // come from the document's cache. QJsonObject is implicitly shared, so the snapshot
+        // handed to the worker thread stays as it is no matter what happens to the document
+        // meanwhile. Converting it to bytes and zipping happen over there.
         const QString fileName = this->vaultFilePath();
         const QJsonObject json = [=]() {
-            QJsonObject ret = QObjectSerializer::toJson(m_document);
+            QJsonObject ret = m_document->toJsonReusingUnchangedSections();
             ret.insert(QStringLiteral("$sourceFileName"), m_document->fileName());
             return ret;
         }();
-        const QByteArray bytes = QJsonDocument(json).toJson();
         const bool encrypt = m_document->hasCollaborators();
-        dfs->setHeader(bytes);
-        dfs->save(fileName, encrypt);
-
-        this->updateModelFromFolderLater();
+        const DocumentFileSystem::HeaderFormat headerFormat =
+                ScriteDocument::headerFormatForSaving();
+
+        m_saveToVaultWatcher.setFuture(dfs->saveSnapshot(
+                fileName, encrypt,
+                [json, headerFormat](QByteArray &header, QByteArray &metadata) {
+                    header = DocumentFileSystem::encodeHeader(json, headerFormat);
+                    metadata = QJsonDocument(ScriteFileInfo::extractMetadata(json))
+                                       .toJson(QJsonDocument::Compact);
+                },
+                headerFormat));
     }
 }
 
+void ScriteDocumentVault::saveToVaultAndWait()
+{
+    m_saveToVaultWatcher.waitForFinished();
+    this->saveToVault();
+    m_saveToVaultWatcher.waitForFinished();
+}
+
+void ScriteDocumentVault::onSaveToVaultFinished()
+{
+    this->updateModelFromFolderLater();
+
+    // Changes made while the snapshot was being written were not part of it.
+    if (m_nrUnsavedChanges > 0 && m_document != nullptr && !m_saveToVaultTimer.isActive())
+        m_saveToVaultTimer.start();
+}
+
 void ScriteDocumentVault::cleanup()
 {
     if (m_document == nullptr)
         return;
 
     qApp->removeEventFilter(this);
-    this->saveToVault();
+    this->saveToVaultAndWait();
     m_document = nullptr;
 }
 
@@ -16,6 +16,7 @@
 
 #include <QTimer>
 #include <QQmlEngine>
+#include <QFutureWatcher>
 #include <QFileInfoList>
 #include <QAbstractItemModel>
 
@@ -70,6 +71,8 @@ private:
     void onDocumentJustLoaded();
     void onDocumentChanged();
     void saveToVault();
+    void saveToVaultAndWait();
+    void onSaveToVaultFinished();
     void cleanup();
     void updateModelFromFolder();
     void updateModelFromFolderLater();
@@ -83,6 +86,7 @@ private:
     bool m_enabled = true;
     QString m_folder;
     QTimer m_saveToVaultTimer;
+    QFutureWatcher<bool> m_saveToVaultWatcher;
     int m_nrUnsavedChanges = 0;
     ScriteDocument *m_document = nullptr;
     QFileSystemWatcher *m_folderWatcher = nullptr;
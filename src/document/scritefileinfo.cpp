@@ -54,6 +54,19 @@ ScriteFileInfo ScriteFileInfo::load(const QString &filePath)
     return load(fi);
 }
 
+// Parts of the header that extractMetadata() looks at, so that the rest need not be decoded.
+static QJsonObject decodeMetadataFields(const QByteArray &header,
+                                       DocumentFileSystem::HeaderFormat headerFormat)
+{
+    static const QStringList keyPaths = {
+        QStringLiteral("documentId"),         QStringLiteral("screenplay/title"),
+        QStringLiteral("screenplay/subtitle"), QStringLiteral("screenplay/author"),
+        QStringLiteral("screenplay/logline"),  QStringLiteral("screenplay/version"),
+        QStringLiteral("screenplay/elements")
+    };
+    return DocumentFileSystem::decodeHeader(header, headerFormat, keyPaths);
+}
+
 ScriteFileInfo ScriteFileInfo::load(const QFileInfo &fileInfo)
 {
     ScriteFileInfo ret;
@@ -61,38 +74,80 @@ ScriteFileInfo ScriteFileInfo::load(const QFileInfo &fileInfo)
         && !fileInfo.isReadable())
         return ret;
 
-    DocumentFileSystem dfs;
-    if (!dfs.load(fileInfo.absoluteFilePath()))
-        return ret;
+    const QString coverPagePath = Screenplay::standardCoverPathPhotoPath();
 
-    const QJsonDocument jsonDoc = QJsonDocument::fromJson(dfs.header());
-    const QJsonObject docObj = jsonDoc.object();
-    const QJsonObject screenplayObj = docObj.value("screenplay").toObject();
-    const QJsonArray screenplayElementsArr = screenplayObj.value("elements").toArray();
+    // Documents saved by this version carry a small metadata file, for others only the header
+    // is read. Documents in the (much) older format have to be fully loaded.
+    QJsonObject metadata;
+    QImage coverPageImage;
+    QByteArray metadataBytes, headerBytes;
+    DocumentFileSystem::HeaderFormat headerFormat = DocumentFileSystem::JsonHeader;
+    QMap<QString, QByteArray> files;
+    if (DocumentFileSystem::peek(fileInfo.absoluteFilePath(), &metadataBytes, &headerBytes,
+                                 { coverPagePath }, &files, &headerFormat)) {
+        metadata = metadataBytes.isEmpty()
+                ? ScriteFileInfo::extractMetadata(decodeMetadataFields(headerBytes, headerFormat))
+                : QJsonDocument::fromJson(metadataBytes).object();
+        if (files.contains(coverPagePath))
+            coverPageImage = QImage::fromData(files.value(coverPagePath));
+    } else {
+        DocumentFileSystem dfs;
+        if (!dfs.load(fileInfo.absoluteFilePath()))
+            return ret;
+
+        metadata = ScriteFileInfo::extractMetadata(
+                decodeMetadataFields(dfs.header(), dfs.headerFormat()));
+
+        const QString coverPageFilePath = dfs.absolutePath(coverPagePath);
+        if (QFile::exists(coverPageFilePath))
+            coverPageImage = QImage(coverPageFilePath);
+    }
+
+    if (metadata.isEmpty())
+        return ret;
 
     ret.filePath = fileInfo.absoluteFilePath();
     ret.fileName = fileInfo.fileName();
     ret.baseFileName = fileInfo.completeBaseName();
     ret.fileSize = fileInfo.size();
     ret.fileInfo = fileInfo;
-    ret.documentId = docObj.value("documentId").toString();
-    ret.title = screenplayObj.value("title").toString().trimmed();
-    ret.subtitle = screenplayObj.value("subtitle").toString().trimmed();
-    ret.author = screenplayObj.value("author").toString().trimmed();
-    ret.logline = screenplayObj.value("logline").toString().trimmed();
-    ret.version = screenplayObj.value("version").toString().trimmed();
-    ret.sceneCount = std::count_if(screenplayElementsArr.begin(), screenplayElementsArr.end(),
-                                   [](const QJsonValue &item) {
-                                       const QJsonObject &itemObj = item.toObject();
-                                       return itemObj.value("elementType").toString()
-                                               == QStringLiteral("SceneElementType");
-                                   });
-
-    const QString coverPagePath = dfs.absolutePath(Screenplay::standardCoverPathPhotoPath());
-    ret.coverPageImage = QFile::exists(coverPagePath)
-            ? QImage(coverPagePath).scaled(512, 512, Qt::KeepAspectRatio, Qt::SmoothTransformation)
-            : QImage();
+    ret.documentId = metadata.value("documentId").toString();
+    ret.title = metadata.value("title").toString();
+    ret.subtitle = metadata.value("subtitle").toString();
+    ret.author = metadata.value("author").toString();
+    ret.logline = metadata.value("logline").toString();
+    ret.version = metadata.value("version").toString();
+    ret.sceneCount = metadata.value("sceneCount").toInt();
+
+    ret.coverPageImage = coverPageImage.isNull()
+            ? QImage()
+            : coverPageImage.scaled(512, 512, Qt::KeepAspectRatio, Qt::SmoothTransformation);
     ret.hasCoverPage = !ret.coverPageImage.isNull();
 
     return ret;
 }
+
+QJsonObject ScriteFileInfo::extractMetadata(const QJsonObject &documentJson)
+{
+    QJsonObject ret;
+    if (documentJson.isEmpty())
+        return ret;
+
+    const QJsonObject screenplayObj = documentJson.value("screenplay").toObject();
+    const QJsonArray screenplayElementsArr = screenplayObj.value("elements").toArray();
+
+    ret.insert("documentId", documentJson.value("documentId").toString());
+    ret.insert("title", screenplayObj.value("title").toString().trimmed());
+    ret.insert("subtitle", screenplayObj.value("subtitle").toString().trimmed());
+    ret.insert("author", screenplayObj.value("author").toString().trimmed());
+    ret.insert("logline", screenplayObj.value("logline").toString().trimmed());
+    ret.insert("version", screenplayObj.value("version").toString().trimmed());
+    ret.insert("sceneCount",
+               int(std::count_if(screenplayElementsArr.begin(), screenplayElementsArr.end(),
+                                 [](const QJsonValue &item) {
+                                     const QJsonObject &itemObj = item.toObject();
+                                     return itemObj.value("elementType").toString()
+                                             == QStringLiteral("SceneElementType");
+                                 })));
+    return ret;
+}
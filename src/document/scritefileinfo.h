@@ -18,6 +18,7 @@
 #include <QString>
 #include <QImage>
 #include <QFileInfo>
+#include <QJsonObject>
 
 struct ScriteFileInfo
 {
@@ -89,6 +90,10 @@ public:
     static ScriteFileInfo load(const QString &filePath);
     static ScriteFileInfo load(const QFileInfo &fileInfo);
 
+    // Picks out what load() needs from a document's JSON, so that it can be saved
+    // as metadata along with the document (see DocumentFileSystem::setMetadata())
+    static QJsonObject extractMetadata(const QJsonObject &documentJson);
+
     bool operator==(const ScriteFileInfo &other) const { return this->filePath == other.filePath; }
 };
 
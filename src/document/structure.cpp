@@ -2602,8 +2602,7 @@ void Annotation::onDfsAuction(const QString &filePath, int *claims)
 
 Structure::Structure(QObject *parent)
     : QObject(parent),
-      m_scriteDocument(qobject_cast<ScriteDocument *>(parent)),
-      m_locationHeadingsMapTimer("Structure.m_locationHeadingsMapTimer")
+      m_scriteDocument(qobject_cast<ScriteDocument *>(parent))
 {
     connect(m_notes, &Notes::notesModified, this, &Structure::structureChanged);
     connect(this, &Structure::zoomLevelChanged, this, &Structure::structureChanged);
@@ -2964,18 +2963,18 @@ void Structure::removeElement(StructureElement *ptr)
     this->updateCharacterNamesShotsTransitionsAndTagsLater();
 
     m_elements.removeAt(index);
+    this->unindexSceneLocation(ptr);
 
     disconnect(ptr, &StructureElement::elementChanged, this, &Structure::structureChanged);
     disconnect(ptr, &StructureElement::aboutToDelete, this, &Structure::removeElement);
-    disconnect(ptr, &StructureElement::sceneLocationChanged, this,
-               &Structure::updateLocationHeadingMapLater);
+    disconnect(ptr, &StructureElement::sceneHeadingChanged, this,
+               &Structure::onStructureElementSceneHeadingChanged);
     disconnect(ptr, &StructureElement::geometryChanged, &m_elements,
                &QObjectListModel<StructureElement *>::objectChanged);
     disconnect(ptr, &StructureElement::aboutToDelete, &m_elements,
                &QObjectListModel<StructureElement *>::objectDestroyed);
     disconnect(ptr, &StructureElement::stackIdChanged, &m_elementStacks,
                &StructureElementStacks::evaluateStacksLater);
-    this->updateLocationHeadingMapLater();
 
     emit elementCountChanged();
     emit elementsChanged();
@@ -3025,15 +3024,14 @@ void Structure::insertElement(StructureElement *ptr, int index)
 
     connect(ptr, &StructureElement::elementChanged, this, &Structure::structureChanged);
     connect(ptr, &StructureElement::aboutToDelete, this, &Structure::removeElement);
-    connect(ptr, &StructureElement::sceneLocationChanged, this,
-            &Structure::updateLocationHeadingMapLater);
+    connect(ptr, &StructureElement::sceneHeadingChanged, this,
+            &Structure::onStructureElementSceneHeadingChanged);
     connect(ptr, &StructureElement::geometryChanged, &m_elements,
             &QObjectListModel<StructureElement *>::objectChanged);
     connect(ptr, &StructureElement::aboutToDelete, &m_elements,
             &QObjectListModel<StructureElement *>::objectDestroyed);
     connect(ptr, &StructureElement::stackIdChanged, &m_elementStacks,
             &StructureElementStacks::evaluateStacksLater);
-    this->updateLocationHeadingMapLater();
 
     this->onStructureElementSceneChanged(ptr);
 
@@ -3076,8 +3074,8 @@ void Structure::setElements(const QList<StructureElement *> &list)
 
         connect(element, &StructureElement::elementChanged, this, &Structure::structureChanged);
         connect(element, &StructureElement::aboutToDelete, this, &Structure::removeElement);
-        connect(element, &StructureElement::sceneLocationChanged, this,
-                &Structure::updateLocationHeadingMapLater);
+        connect(element, &StructureElement::sceneHeadingChanged, this,
+                &Structure::onStructureElementSceneHeadingChanged);
         connect(element, &StructureElement::geometryChanged, &m_elements,
                 &QObjectListModel<StructureElement *>::objectChanged);
         connect(element, &StructureElement::aboutToDelete, &m_elements,
@@ -4773,17 +4771,29 @@ QStringList Structure::sortCharacterNames(const QStringList &givenNames) const
     if (givenNames.length() <= 1)
         return givenNames;
 
-    QStringList names = givenNames;
+    // Look up priorities once per name, instead of once per comparison.
+    QHash<QString, int> priorities;
+    for (const Character *character : m_characters.constList()) {
+        if (!priorities.contains(character->name()))
+            priorities.insert(character->name(), character->priority());
+    }
 
-    std::sort(names.begin(), names.end(), [=](const QString &a, const QString &b) {
-        const Character *ac = this->findCharacter(a);
-        const Character *bc = this->findCharacter(b);
-        const int ap = ac ? ac->priority() : 0;
-        const int bp = bc ? bc->priority() : 0;
-        if (ap == bp)
-            return a < b;
-        return ap > bp;
-    });
+    QVector<QPair<int, QString>> items;
+    items.reserve(givenNames.size());
+    for (const QString &name : givenNames)
+        items.append(qMakePair(priorities.value(name.trimmed().toUpper(), 0), name));
+
+    std::sort(items.begin(), items.end(),
+              [](const QPair<int, QString> &a, const QPair<int, QString> &b) {
+                  if (a.first == b.first)
+                      return a.second < b.second;
+                  return a.first > b.first;
+              });
+
+    QStringList names;
+    names.reserve(items.size());
+    for (const QPair<int, QString> &item : qAsConst(items))
+        names.append(item.second);
 
     return names;
 }
@@ -4871,12 +4881,6 @@ bool Structure::event(QEvent *event)
 
 void Structure::timerEvent(QTimerEvent *event)
 {
-    if (m_locationHeadingsMapTimer.timerId() == event->timerId()) {
-        m_locationHeadingsMapTimer.stop();
-        this->updateLocationHeadingMap();
-        return;
-    }
-
     if (m_updateCharacterNamesShotsTransitionsAndTagsTimer.timerId() == event->timerId()) {
         m_updateCharacterNamesShotsTransitionsAndTagsTimer.stop();
         this->updateCharacterNamesShotsTransitionsAndTags();
@@ -4979,27 +4983,86 @@ int Structure::staticElementCount(QQmlListProperty<StructureElement> *list)
     return reinterpret_cast<Structure *>(list->data)->elementCount();
 }
 
-void Structure::updateLocationHeadingMap()
+QStringList Structure::allLocations() const
+{
+    if (m_sortedLocationsDirty) {
+        m_sortedLocations = m_locationHeadings.keys();
+        std::sort(m_sortedLocations.begin(), m_sortedLocations.end());
+        m_sortedLocationsDirty = false;
+    }
+
+    return m_sortedLocations;
+}
+
+QMap<QString, QList<SceneHeading *>> Structure::locationHeadingsMap() const
 {
-    QMap<QString, QList<SceneHeading *>> map;
+    // Headings are listed in the order of elements in the structure, which the index
+    // doesn't track. This is only required for reports, so it's built on demand.
+    QMap<QString, QList<SceneHeading *>> ret;
     for (StructureElement *element : m_elements.constList()) {
         Scene *scene = element->scene();
-        if (scene == nullptr || !scene->heading()->isEnabled())
+        if (scene == nullptr)
             continue;
 
-        const QString location = scene->heading()->location();
-        if (location.isEmpty())
-            continue;
+        const QString location = m_headingLocations.value(scene->heading());
+        if (!location.isEmpty())
+            ret[location].append(scene->heading());
+    }
 
-        map[location].append(scene->heading());
+    return ret;
+}
+
+void Structure::indexSceneLocation(StructureElement *element)
+{
+    Scene *scene = element ? element->scene() : nullptr;
+    if (scene == nullptr)
+        return;
+
+    SceneHeading *heading = scene->heading();
+    const QString location = heading->isEnabled() ? heading->location() : QString();
+
+    auto it = m_headingLocations.find(heading);
+    if (it != m_headingLocations.end()) {
+        if (it.value() == location)
+            return;
+
+        this->unindexSceneLocation(element);
     }
 
-    m_locationHeadingsMap = map;
+    if (location.isEmpty())
+        return;
+
+    QList<SceneHeading *> &headings = m_locationHeadings[location];
+    if (headings.isEmpty())
+        m_sortedLocationsDirty = true;
+    headings.append(heading);
+    m_headingLocations.insert(heading, location);
 }
 
-void Structure::updateLocationHeadingMapLater()
+void Structure::unindexSceneLocation(StructureElement *element)
 {
-    m_locationHeadingsMapTimer.start(0, this);
+    Scene *scene = element ? element->scene() : nullptr;
+    if (scene == nullptr)
+        return;
+
+    const QString location = m_headingLocations.take(scene->heading());
+    if (location.isEmpty())
+        return;
+
+    auto it = m_locationHeadings.find(location);
+    if (it == m_locationHeadings.end())
+        return;
+
+    it->removeOne(scene->heading());
+    if (it->isEmpty()) {
+        m_locationHeadings.erase(it);
+        m_sortedLocationsDirty = true;
+    }
+}
+
+void Structure::onStructureElementSceneHeadingChanged()
+{
+    this->indexSceneLocation(qobject_cast<StructureElement *>(this->sender()));
 }
 
 void Structure::onStructureElementSceneChanged(StructureElement *element)
@@ -5014,86 +5077,126 @@ void Structure::onStructureElementSceneChanged(StructureElement *element)
     connect(element->scene(), &Scene::aboutToRemoveSceneElement, this,
             &Structure::onAboutToRemoveSceneElement);
 
+    int dirtyIndexes = 0;
     Scene *scene = element->scene();
     for (int i = 0; i < scene->elementCount(); i++) {
         SceneElement *element = scene->elementAt(i);
-        if (!m_characterElementMap.include(element))
-            if (!m_transitionElementMap.include(element))
-                m_shotElementMap.include(element);
+        if (m_characterElementMap.include(element))
+            dirtyIndexes |= CharacterNamesIndex;
+        else if (m_transitionElementMap.include(element))
+            dirtyIndexes |= TransitionsIndex;
+        else if (m_shotElementMap.include(element))
+            dirtyIndexes |= ShotsIndex;
     }
 
-    this->updateLocationHeadingMapLater();
-    this->updateCharacterNamesShotsTransitionsAndTagsLater();
+    this->indexSceneLocation(element);
+    this->markIndexesDirty(dirtyIndexes);
 }
 
 void Structure::onSceneElementChanged(SceneElement *element, Scene::SceneElementChangeType)
 {
-    if (m_characterElementMap.include(element) || m_transitionElementMap.include(element)
-        || m_shotElementMap.include(element))
-        updateCharacterNamesShotsTransitionsAndTagsLater();
+    // All three maps are offered the element, because it may have changed type and
+    // has to move from one map to another.
+    int dirtyIndexes = 0;
+    if (m_characterElementMap.include(element))
+        dirtyIndexes |= CharacterNamesIndex;
+    if (m_transitionElementMap.include(element))
+        dirtyIndexes |= TransitionsIndex;
+    if (m_shotElementMap.include(element))
+        dirtyIndexes |= ShotsIndex;
+
+    this->markIndexesDirty(dirtyIndexes);
 }
 
 void Structure::onAboutToRemoveSceneElement(SceneElement *element)
 {
-    if (m_characterElementMap.remove(element) || m_transitionElementMap.remove(element)
-        || m_shotElementMap.remove(element))
-        updateCharacterNamesShotsTransitionsAndTagsLater();
+    int dirtyIndexes = 0;
+    if (m_characterElementMap.remove(element))
+        dirtyIndexes |= CharacterNamesIndex;
+    if (m_transitionElementMap.remove(element))
+        dirtyIndexes |= TransitionsIndex;
+    if (m_shotElementMap.remove(element))
+        dirtyIndexes |= ShotsIndex;
+
+    this->markIndexesDirty(dirtyIndexes);
+}
+
+static QStringList sortedUnion(const QStringList &sortedValues, QStringList otherValues)
+{
+    std::sort(otherValues.begin(), otherValues.end());
+    otherValues.erase(std::unique(otherValues.begin(), otherValues.end()), otherValues.end());
+
+    QStringList ret;
+    ret.reserve(sortedValues.size() + otherValues.size());
+    std::set_union(sortedValues.begin(), sortedValues.end(), otherValues.begin(),
+                   otherValues.end(), std::back_inserter(ret));
+    return ret;
 }
 
 void Structure::updateCharacterNamesShotsTransitionsAndTags()
 {
-    QStringList names = m_characterElementMap.characterNames();
-    QSet<QString> tags;
+    const int dirtyIndexes = m_dirtyIndexes;
+    m_dirtyIndexes = 0;
 
-    const QList<Character *> characters = m_characters.list();
-    for (Character *character : characters) {
-        const QString name = character->name();
-        if (!names.contains(name))
-            names.append(name);
+    if (dirtyIndexes & CharacterNamesIndex) {
+        QStringList names = m_characterElementMap.characterNames();
+        QSet<QString> nameSet(names.begin(), names.end());
+        QSet<QString> tags;
 
-        const QStringList ctags = character->tags();
-        tags += QSet<QString>(ctags.begin(), ctags.end());
-    }
+        const QList<Character *> characters = m_characters.list();
+        for (Character *character : characters) {
+            const QString name = character->name();
+            if (!nameSet.contains(name)) {
+                nameSet.insert(name);
+                names.append(name);
+            }
 
-    names = this->sortCharacterNames(names);
-    if (names != m_characterNames) {
-        m_characterNames = names;
-        emit characterNamesChanged();
-    }
+            const QStringList ctags = character->tags();
+            tags += QSet<QString>(ctags.begin(), ctags.end());
+        }
+
+        names = this->sortCharacterNames(names);
+        if (names != m_characterNames) {
+            m_characterNames = names;
+            emit characterNamesChanged();
+        }
 
-    const QStringList tagValues = tags.values();
-    if (tagValues != m_characterTags) {
-        m_characterTags = tags.values();
-        emit characterTagsChanged();
+        const QStringList tagValues = tags.values();
+        if (tagValues != m_characterTags) {
+            m_characterTags = tags.values();
+            emit characterTagsChanged();
+        }
     }
 
-    const QStringList shots = [=]() {
-        QSet<QString> set = QSet<QString>::fromList(m_shotElementMap.shots());
-        set += QSet<QString>::fromList(Scrite::defaultShots());
-        QStringList ret = QStringList::fromSet(set);
-        std::sort(ret.begin(), ret.end());
-        return ret;
-    }();
-    if (shots != m_shots) {
-        m_shots = shots;
-        emit shotsChanged();
+    if (dirtyIndexes & ShotsIndex) {
+        const QStringList shots = sortedUnion(m_shotElementMap.shots(), Scrite::defaultShots());
+        if (shots != m_shots) {
+            m_shots = shots;
+            emit shotsChanged();
+        }
     }
 
-    const QStringList transitions = [=]() {
-        QSet<QString> set = QSet<QString>::fromList(m_transitionElementMap.transitions());
-        set += QSet<QString>::fromList(Scrite::defaultTransitions());
-        QStringList ret = QStringList::fromSet(set);
-        std::sort(ret.begin(), ret.end());
-        return ret;
-    }();
-    if (transitions != m_transitions) {
-        m_transitions = transitions;
-        emit transitionsChanged();
+    if (dirtyIndexes & TransitionsIndex) {
+        const QStringList transitions =
+                sortedUnion(m_transitionElementMap.transitions(), Scrite::defaultTransitions());
+        if (transitions != m_transitions) {
+            m_transitions = transitions;
+            emit transitionsChanged();
+        }
     }
 }
 
 void Structure::updateCharacterNamesShotsTransitionsAndTagsLater()
 {
+    this->markIndexesDirty(CharacterNamesIndex | TransitionsIndex | ShotsIndex);
+}
+
+void Structure::markIndexesDirty(int indexes)
+{
+    if (indexes == 0)
+        return;
+
+    m_dirtyIndexes |= indexes;
     m_updateCharacterNamesShotsTransitionsAndTagsTimer.start(0, this);
 }
 
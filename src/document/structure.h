@@ -898,10 +898,17 @@ public:
     Q_INVOKABLE static QStringList standardLocationTypes();
     Q_INVOKABLE static QStringList standardMoments();
 
-    Q_INVOKABLE QStringList allLocations() const { return m_locationHeadingsMap.keys(); }
-    QMap<QString, QList<SceneHeading *>> locationHeadingsMap() const
+    Q_INVOKABLE QStringList allLocations() const;
+    QMap<QString, QList<SceneHeading *>> locationHeadingsMap() const;
+
+    // Constant time lookups into indexes that are kept up to date as scenes are edited.
+    QList<SceneHeading *> locationHeadings(const QString &location) const
+    {
+        return m_locationHeadings.value(location);
+    }
+    QList<SceneElement *> characterElements(const QString &name) const
     {
-        return m_locationHeadingsMap;
+        return m_characterElementMap.characterElements(name);
     }
 
     Q_PROPERTY(int currentElementIndex READ currentElementIndex WRITE setCurrentElementIndex NOTIFY
@@ -1091,16 +1098,22 @@ private:
     int m_currentElementIndex = -1;
     qreal m_zoomLevel = 1.0;
 
-    void updateLocationHeadingMap();
-    void updateLocationHeadingMapLater();
-    ExecLaterTimer m_locationHeadingsMapTimer;
-    QMap<QString, QList<SceneHeading *>> m_locationHeadingsMap;
+    void indexSceneLocation(StructureElement *element);
+    void unindexSceneLocation(StructureElement *element);
+    void onStructureElementSceneHeadingChanged();
+    QHash<SceneHeading *, QString> m_headingLocations;
+    QHash<QString, QList<SceneHeading *>> m_locationHeadings;
+    mutable QStringList m_sortedLocations;
+    mutable bool m_sortedLocationsDirty = false;
 
     void onStructureElementSceneChanged(StructureElement *element = nullptr);
     void onSceneElementChanged(SceneElement *element, Scene::SceneElementChangeType type);
     void onAboutToRemoveSceneElement(SceneElement *element);
     void updateCharacterNamesShotsTransitionsAndTags();
     void updateCharacterNamesShotsTransitionsAndTagsLater();
+    enum DirtyIndex { CharacterNamesIndex = 1, TransitionsIndex = 2, ShotsIndex = 4 };
+    void markIndexesDirty(int indexes);
+    int m_dirtyIndexes = 0;
     ExecLaterTimer m_updateCharacterNamesShotsTransitionsAndTagsTimer;
     CharacterElementMap m_characterElementMap;
     TransitionElementMap m_transitionElementMap;
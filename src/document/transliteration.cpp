@@ -41,6 +41,34 @@
 
 #include <PhTranslateLib>
 
+namespace {
+
+// Scripts of all characters up to the end of the Malayalam block, which covers Latin and
+// all Indic scripts that we support. A flat table is faster to look up than QChar::script()
+struct ScriptTable
+{
+    enum { Size = 0x0D80 };
+    Q_STATIC_ASSERT(QChar::ScriptCount <= 256);
+
+    ScriptTable()
+    {
+        for (int i = 0; i < Size; i++)
+            scripts[i] = quint8(QChar(ushort(i)).script());
+    }
+
+    quint8 scripts[Size];
+};
+
+}
+
+Q_GLOBAL_STATIC(ScriptTable, TheScriptTable)
+
+static inline QChar::Script scriptOf(const QChar &ch)
+{
+    const ushort code = ch.unicode();
+    return code < ScriptTable::Size ? QChar::Script(TheScriptTable->scripts[code]) : ch.script();
+}
+
 static QStringList getCustomFontFilePaths()
 {
     const QStringList customFonts = QStringList()
@@ -82,6 +110,8 @@ TransliterationEngine *TransliterationEngine::instance(QCoreApplication *app)
 TransliterationEngine::TransliterationEngine(QObject *parent) : QObject(parent)
 {
     // CAPTURE_CALL_GRAPH;
+    m_boundariesCache.setMaxCost(4096);
+
     const QMetaObject *mo = &TransliterationEngine::staticMetaObject;
     const QMetaEnum languageEnum = mo->enumerator(mo->indexOfEnumerator("Language"));
     const QStringList customFontPaths = ::getCustomFontFilePaths();
@@ -628,6 +658,13 @@ QString TransliterationEngine::transliteratedParagraph(const QString &paragraph,
 QFont TransliterationEngine::languageFont(TransliterationEngine::Language language,
                                           bool preferAppFonts) const
 {
+    if (preferAppFonts) {
+        QMutexLocker locker(&m_cacheMutex);
+        auto it = m_languageFonts.constFind(language);
+        if (it != m_languageFonts.constEnd())
+            return it.value();
+    }
+
     const QFontDatabase &fontDb = ::Application::fontDatabase();
     const QString preferredFontFamily = m_languageFontFamily.value(language);
 
@@ -638,7 +675,16 @@ QFont TransliterationEngine::languageFont(TransliterationEngine::Language langua
         fontFamily = languageFontFamilies.first();
     }
 
-    return fontFamily.isEmpty() ? Application::instance()->font() : QFont(fontFamily);
+    const QFont font = fontFamily.isEmpty() ? Application::instance()->font() : QFont(fontFamily);
+
+    // Looking up font families of a writing system is expensive, and this is called
+    // for every boundary of every paragraph.
+    if (preferAppFonts) {
+        QMutexLocker locker(&m_cacheMutex);
+        m_languageFonts.insert(language, font);
+    }
+
+    return font;
 }
 
 QStringList
@@ -722,6 +768,8 @@ void TransliterationEngine::setPreferredFontFamilyForLanguage(
 
     const QString after = m_languageFontFamily.value(language);
     if (before != after) {
+        this->clearCaches();
+
         QSettings *settings = Application::instance()->settings();
         settings->setValue(QStringLiteral("Transliteration/") + languageAsString(language)
                                    + QStringLiteral("_Font"),
@@ -732,21 +780,30 @@ void TransliterationEngine::setPreferredFontFamilyForLanguage(
 
 TransliterationEngine::Language TransliterationEngine::languageForScript(QChar::Script script)
 {
-    static QMap<QChar::Script, Language> scriptLanguageMap;
-    if (scriptLanguageMap.isEmpty()) {
-        scriptLanguageMap[QChar::Script_Latin] = English;
-        scriptLanguageMap[QChar::Script_Devanagari] = Hindi;
-        scriptLanguageMap[QChar::Script_Bengali] = Bengali;
-        scriptLanguageMap[QChar::Script_Gurmukhi] = Punjabi;
-        scriptLanguageMap[QChar::Script_Gujarati] = Gujarati;
-        scriptLanguageMap[QChar::Script_Oriya] = Oriya;
-        scriptLanguageMap[QChar::Script_Tamil] = Tamil;
-        scriptLanguageMap[QChar::Script_Telugu] = Telugu;
-        scriptLanguageMap[QChar::Script_Kannada] = Kannada;
-        scriptLanguageMap[QChar::Script_Malayalam] = Malayalam;
+    switch (script) {
+    case QChar::Script_Devanagari:
+        return Hindi;
+    case QChar::Script_Bengali:
+        return Bengali;
+    case QChar::Script_Gurmukhi:
+        return Punjabi;
+    case QChar::Script_Gujarati:
+        return Gujarati;
+    case QChar::Script_Oriya:
+        return Oriya;
+    case QChar::Script_Tamil:
+        return Tamil;
+    case QChar::Script_Telugu:
+        return Telugu;
+    case QChar::Script_Kannada:
+        return Kannada;
+    case QChar::Script_Malayalam:
+        return Malayalam;
+    default:
+        break;
     }
 
-    return scriptLanguageMap.value(script, English);
+    return English;
 }
 
 QChar::Script TransliterationEngine::scriptForLanguage(Language language)
@@ -820,10 +877,47 @@ QList<TransliterationEngine::Boundary>
 TransliterationEngine::evaluateBoundaries(const QString &text,
                                           bool /*bundleCommonScriptChars*/) const
 {
+    if (text.isEmpty())
+        return QList<Boundary>();
+
+    {
+        QMutexLocker locker(&m_cacheMutex);
+        if (const QList<Boundary> *boundaries = m_boundariesCache.object(text))
+            return *boundaries;
+    }
+
+    const QList<Boundary> ret = this->segmentText(text);
+
+    QMutexLocker locker(&m_cacheMutex);
+    m_boundariesCache.insert(text, new QList<Boundary>(ret));
+    return ret;
+}
+
+QList<TransliterationEngine::Boundary>
+TransliterationEngine::segmentText(const QString &text) const
+{
+    PROFILE_THIS_FUNCTION;
+
     QList<Boundary> ret;
     if (text.isEmpty())
         return ret;
 
+    // Most paragraphs are written entirely in English. Segmenting them by words, only
+    // to merge all of them back into one boundary, is a waste.
+    const bool englishOnly = std::all_of(text.begin(), text.end(), [](const QChar &ch) {
+        const QChar::Script script = scriptOf(ch);
+        return script == QChar::Script_Latin || script == QChar::Script_Common
+                || script == QChar::Script_Inherited;
+    });
+    if (englishOnly) {
+        Boundary item;
+        item.start = 0;
+        item.end = text.length() - 1;
+        item.evalStringLanguageAndFont(text);
+        ret.append(item);
+        return ret;
+    }
+
     // Create a boundary item for each word found in the given text
     QTextBoundaryFinder boundaryFinder(QTextBoundaryFinder::Word, text);
     while (boundaryFinder.position() < text.length()) {
@@ -913,8 +1007,9 @@ TransliterationEngine::evaluateBoundaries(const QString &text,
         const QSet<QChar::Script> scripts = [](const QString &text) -> QSet<QChar::Script> {
             QSet<QChar::Script> ret;
             for (const QChar &ch : text) {
-                if (ch.script() != QChar::Script_Common)
-                    ret += ch.script();
+                const QChar::Script script = scriptOf(ch);
+                if (script != QChar::Script_Common)
+                    ret += script;
             }
             return ret;
         }(b.string);
@@ -924,11 +1019,11 @@ TransliterationEngine::evaluateBoundaries(const QString &text,
 
         QChar::Script script = TransliterationEngine::scriptForLanguage(b.language);
         for (int j = b.end; j >= b.start; j--) {
-            const QChar ch = b.string.at(j - b.start);
-            if (ch.script() == QChar::Script_Common || ch.script() == QChar::Script_Inherited)
+            const QChar::Script chScript = scriptOf(b.string.at(j - b.start));
+            if (chScript == QChar::Script_Common || chScript == QChar::Script_Inherited)
                 continue;
 
-            if (ch.script() != script) {
+            if (chScript != script) {
                 Boundary b2;
                 b2.start = j + 1;
                 b2.end = b.end;
@@ -936,7 +1031,7 @@ TransliterationEngine::evaluateBoundaries(const QString &text,
                 ret.insert(i + 1, b2);
                 b.end = j;
                 b.evalStringLanguageAndFont(text);
-                script = ch.script();
+                script = chScript;
             }
         }
     }
@@ -988,15 +1083,22 @@ void TransliterationEngine::evaluateBoundariesAndInsertText(QTextCursor &cursor,
 QChar::Script TransliterationEngine::determineScript(const QString &val)
 {
     for (int i = 0; i < val.length(); i++) {
-        const QChar ch = val.at(i);
-        if (ch.script() == QChar::Script_Common || ch.script() == QChar::Script_Inherited)
+        const QChar::Script script = scriptOf(val.at(i));
+        if (script == QChar::Script_Common || script == QChar::Script_Inherited)
             continue;
-        return ch.script();
+        return script;
     }
 
     return QChar::Script_Latin;
 }
 
+void TransliterationEngine::clearCaches()
+{
+    QMutexLocker locker(&m_cacheMutex);
+    m_languageFonts.clear();
+    m_boundariesCache.clear();
+}
+
 QString TransliterationEngine::formattedHtmlOf(const QString &text) const
 {
     QString html;
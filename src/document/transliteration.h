@@ -19,6 +19,8 @@
 #include <QMap>
 #include <QFont>
 #include <QEvent>
+#include <QCache>
+#include <QMutex>
 #include <QObject>
 #include <QJsonArray>
 #include <QQmlEngine>
@@ -174,6 +176,8 @@ private:
     TransliterationEngine(QObject *parent = nullptr);
     void setEnabledLanguages(const QList<int> &val);
     void determineEnabledLanguages();
+    QList<Boundary> segmentText(const QString &text) const;
+    void clearCaches();
 
 private:
     void *m_transliterator = nullptr;
@@ -185,6 +189,12 @@ private:
     QMap<Language, QString> m_languageFontFamily;
     QMap<Language, QStringList> m_languageFontFilePaths;
     mutable QMap<Language, QStringList> m_availableLanguageFontFamilies;
+
+    // The same paragraphs are segmented over and over again while highlighting,
+    // exporting and generating reports, so results are kept around keyed by text.
+    mutable QMutex m_cacheMutex;
+    mutable QMap<Language, QFont> m_languageFonts;
+    mutable QCache<QString, QList<Boundary>> m_boundariesCache;
 };
 
 class Transliterator : public QObject
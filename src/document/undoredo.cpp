@@ -15,6 +15,19 @@
 #include "application.h"
 
 #include <QQmlListReference>
+#include <QScopedValueRollback>
+
+UndoCommandMemoryUsage::~UndoCommandMemoryUsage()
+{
+    this->setMemoryUsage(0);
+}
+
+void UndoCommandMemoryUsage::setMemoryUsage(int val)
+{
+    if (m_stack != nullptr)
+        m_stack->adjustMemoryUsage(val - m_memoryUsage);
+    m_memoryUsage = val;
+}
 
 UndoStack::UndoStack(QObject *parent) : QUndoStack(parent)
 {
@@ -22,9 +35,26 @@ UndoStack::UndoStack(QObject *parent) : QUndoStack(parent)
 
     connect(Application::instance()->undoGroup(), &QUndoGroup::activeStackChanged, this,
             &UndoStack::activeChanged);
+    connect(this, &QUndoStack::indexChanged, this, &UndoStack::evaluateMemoryUsage);
+}
+
+UndoStack::~UndoStack()
+{
+    // Commands report to this stack when they are deleted, so they must go first.
+    this->clear();
 }
 
-UndoStack::~UndoStack() { }
+void UndoStack::setMemoryLimit(int val)
+{
+    val = qMax(val, 0);
+    if (m_memoryLimit == val)
+        return;
+
+    m_memoryLimit = val;
+    emit memoryLimitChanged();
+
+    this->evaluateMemoryUsage();
+}
 
 void UndoStack::setActive(bool val)
 {
@@ -48,6 +78,68 @@ void UndoStack::clearAllStacks()
 
 bool UndoStack::ignoreUndoCommands = false;
 
+void UndoStack::adjustMemoryUsage(int delta)
+{
+    if (delta == 0)
+        return;
+
+    m_memoryUsage += delta;
+    emit memoryUsageChanged();
+}
+
+void UndoStack::evaluateMemoryUsage()
+{
+    auto memoryUsageOf = [](const QUndoCommand *cmd) -> UndoCommandMemoryUsage * {
+        return dynamic_cast<UndoCommandMemoryUsage *>(const_cast<QUndoCommand *>(cmd));
+    };
+
+    if (this->count() == 0)
+        m_nrReleasedCommands = 0;
+
+    // Commands are accounted for once they land on top of the stack. Commands merged into
+    // the one on top never get here.
+    const int index = this->index();
+    if (index > 0) {
+        UndoCommandMemoryUsage *cmd = memoryUsageOf(this->command(index - 1));
+        if (cmd != nullptr && cmd->m_stack == nullptr) {
+            cmd->m_stack = this;
+            this->adjustMemoryUsage(cmd->m_memoryUsage);
+
+            if (index > 1) {
+                UndoCommandMemoryUsage *prevCmd = memoryUsageOf(this->command(index - 2));
+                if (prevCmd != nullptr)
+                    prevCmd->endMergeRun();
+            }
+        }
+    }
+
+    // Released commands are obsolete, so QUndoStack deletes them as they are undone without
+    // doing anything. Once the user has undone everything above them, they are dropped in
+    // one go, so that the stack never offers an undo that does nothing.
+    if (m_nrReleasedCommands > 0 && index <= m_nrReleasedCommands
+        && !m_droppingReleasedCommands) {
+        QScopedValueRollback<bool> rollback(m_droppingReleasedCommands, true);
+        while (this->index() > 0) {
+            this->undo();
+            --m_nrReleasedCommands;
+        }
+        return;
+    }
+
+    // Release the oldest commands, until we are within the limit. The most recent undo-able
+    // command and commands that can be redone are never released. Anything older than a
+    // released command is released along with it, whether it holds snapshots or not.
+    if (m_memoryLimit > 0) {
+        const int nrReleasableCommands = index - 1;
+        while (m_memoryUsage > m_memoryLimit && m_nrReleasedCommands < nrReleasableCommands) {
+            QUndoCommand *cmd = const_cast<QUndoCommand *>(this->command(m_nrReleasedCommands++));
+            if (UndoCommandMemoryUsage *memCmd = memoryUsageOf(cmd))
+                memCmd->releaseMemory();
+            cmd->setObsolete(true);
+        }
+    }
+}
+
 QUndoStack *UndoStack::active()
 {
     if (ignoreUndoCommands)
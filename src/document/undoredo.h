@@ -26,6 +26,34 @@
 #include "garbagecollector.h"
 #include "qobjectserializer.h"
 
+/**
+ * Undo commands that hold on to sizeable snapshots implement this interface,
+ * so that UndoStack can account for the memory used by its history and drop
+ * the oldest commands once it crosses UndoStack::memoryLimit.
+ */
+class UndoStack;
+class UndoCommandMemoryUsage
+{
+public:
+    virtual ~UndoCommandMemoryUsage();
+    int memoryUsage() const { return m_memoryUsage; }
+
+    // Called when the stack gives up on this command, it is dropped from the stack later.
+    virtual void releaseMemory() = 0;
+
+    // Called once another command lands on top of this one in the stack.
+    virtual void endMergeRun() { }
+
+protected:
+    // Commands must report every change in the size of their snapshots.
+    void setMemoryUsage(int val);
+
+private:
+    friend class UndoStack;
+    int m_memoryUsage = 0;
+    UndoStack *m_stack = nullptr;
+};
+
 class UndoStack : public QUndoStack
 {
     Q_OBJECT
@@ -40,10 +68,32 @@ public:
     bool isActive() const;
     Q_SIGNAL void activeChanged();
 
+    // Maximum number of bytes that undo commands in this stack can hold on to.
+    // Zero (the default) means no limit.
+    Q_PROPERTY(int memoryLimit READ memoryLimit WRITE setMemoryLimit NOTIFY memoryLimitChanged)
+    void setMemoryLimit(int val);
+    int memoryLimit() const { return m_memoryLimit; }
+    Q_SIGNAL void memoryLimitChanged();
+
+    Q_PROPERTY(int memoryUsage READ memoryUsage NOTIFY memoryUsageChanged)
+    int memoryUsage() const { return m_memoryUsage; }
+    Q_SIGNAL void memoryUsageChanged();
+
     static void clearAllStacks();
 
     static bool ignoreUndoCommands;
     static QUndoStack *active();
+
+private:
+    friend class UndoCommandMemoryUsage;
+    void adjustMemoryUsage(int delta);
+    void evaluateMemoryUsage();
+
+private:
+    int m_memoryLimit = 0;
+    int m_memoryUsage = 0;
+    int m_nrReleasedCommands = 0;
+    bool m_droppingReleasedCommands = false;
 };
 
 class ObjectPropertyInfoList;
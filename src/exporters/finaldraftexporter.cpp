@@ -14,10 +14,8 @@
 #include "finaldraftexporter.h"
 #include "application.h"
 
-#include <QDomDocument>
-#include <QDomElement>
-#include <QDomAttr>
 #include <QFileInfo>
+#include <QXmlStreamWriter>
 
 FinalDraftExporter::FinalDraftExporter(QObject *parent) : AbstractExporter(parent) { }
 
@@ -67,18 +65,27 @@ bool FinalDraftExporter::doExport(QIODevice *device)
 
     this->progress()->setProgressStep(1.0 / qreal(nrElements + 1));
 
-    QDomDocument doc;
-
-    QDomElement rootE = doc.createElement(QStringLiteral("FinalDraft"));
-    rootE.setAttribute(QStringLiteral("DocumentType"), QStringLiteral("Script"));
-    rootE.setAttribute(QStringLiteral("Template"), QStringLiteral("No"));
-    rootE.setAttribute(QStringLiteral("Version"), QStringLiteral("2"));
-    doc.appendChild(rootE);
-
-    QDomElement contentE = doc.createElement(QStringLiteral("Content"));
-    rootE.appendChild(contentE);
-
-    auto addTextToParagraph = [&doc, this](QDomElement &paraE, const QString &text,
+    /**
+     * Paragraphs are written out as they are visited, instead of building a DOM of the whole
+     * screenplay first and then serializing it. For large screenplays that DOM used to take
+     * up several times the memory of the output itself.
+     */
+    QXmlStreamWriter xml(device);
+    xml.setCodec("utf-8");
+    xml.setAutoFormatting(true);
+    xml.setAutoFormattingIndent(2);
+    xml.writeStartDocument(QStringLiteral("1.0"), false);
+
+    xml.writeStartElement(QStringLiteral("FinalDraft"));
+    xml.writeAttribute(QStringLiteral("DocumentType"), QStringLiteral("Script"));
+    xml.writeAttribute(QStringLiteral("Template"), QStringLiteral("No"));
+    xml.writeAttribute(QStringLiteral("Version"), QStringLiteral("2"));
+
+    xml.writeStartElement(QStringLiteral("Content"));
+
+    // Must be called right after the paragraph's start element is written, and before any of
+    // its child elements, since it may write the Alignment attribute.
+    auto addTextToParagraph = [&xml, this](const QString &text,
                                            Qt::Alignment overrideAlignment = Qt::Alignment(),
                                            const QVector<QTextLayout::FormatRange> &textFormats =
                                                    QVector<QTextLayout::FormatRange>()) {
@@ -87,16 +94,16 @@ bool FinalDraftExporter::doExport(QIODevice *device)
             switch (overrideAlignment) {
             default:
             case Qt::AlignLeft:
-                paraE.setAttribute(alignmentAttr, QStringLiteral("Left"));
+                xml.writeAttribute(alignmentAttr, QStringLiteral("Left"));
                 break;
             case Qt::AlignRight:
-                paraE.setAttribute(alignmentAttr, QStringLiteral("Right"));
+                xml.writeAttribute(alignmentAttr, QStringLiteral("Right"));
                 break;
             case Qt::AlignHCenter:
-                paraE.setAttribute(alignmentAttr, QStringLiteral("Center"));
+                xml.writeAttribute(alignmentAttr, QStringLiteral("Center"));
                 break;
             case Qt::AlignJustify:
-                paraE.setAttribute(alignmentAttr, QStringLiteral("Justify"));
+                xml.writeAttribute(alignmentAttr, QStringLiteral("Justify"));
                 break;
             }
         }
@@ -108,97 +115,88 @@ bool FinalDraftExporter::doExport(QIODevice *device)
             mergedTextFormats = TransliterationEngine::mergeTextFormats(breakup, textFormats);
         }
 
-        auto createTextElement = [&]() {
-            QDomElement textE = doc.createElement(QStringLiteral("Text"));
-            textE.setAttribute(QStringLiteral("Font"), QStringLiteral("Courier Final Draft"));
-            textE.setAttribute(QStringLiteral("Language"), QStringLiteral("English"));
-            paraE.appendChild(textE);
-            return textE;
-        };
-
         if (mergedTextFormats.isEmpty()) {
-            QDomElement textE = createTextElement();
-            textE.appendChild(doc.createTextNode(text));
-        } else {
-            for (const QTextLayout::FormatRange &format : qAsConst(mergedTextFormats)) {
-                const QString snippet = text.mid(format.start, format.length);
-                if (snippet.isEmpty())
-                    continue;
-
-                QDomElement textE = createTextElement();
-
-                QStringList styles;
-                if (format.format.hasProperty(QTextFormat::FontWeight)) {
-                    if (format.format.fontWeight() == QFont::Bold)
-                        styles << QStringLiteral("Bold");
-                }
+            xml.writeStartElement(QStringLiteral("Text"));
+            xml.writeAttribute(QStringLiteral("Font"), QStringLiteral("Courier Final Draft"));
+            xml.writeAttribute(QStringLiteral("Language"), QStringLiteral("English"));
+            xml.writeCharacters(text);
+            xml.writeEndElement();
+            return;
+        }
 
-                if (format.format.hasProperty(QTextFormat::FontItalic)) {
-                    if (format.format.fontItalic())
-                        styles << QStringLiteral("Italic");
+        for (const QTextLayout::FormatRange &format : qAsConst(mergedTextFormats)) {
+            const QString snippet = text.mid(format.start, format.length);
+            if (snippet.isEmpty())
+                continue;
+
+            QString font = QStringLiteral("Courier Final Draft");
+            QString language = QStringLiteral("English");
+            if (m_markLanguagesExplicitly) {
+                TransliterationEngine::Language lang =
+                        (TransliterationEngine::Language)format.format
+                                .property(QTextFormat::UserProperty)
+                                .toInt();
+                if (lang != TransliterationEngine::English) {
+                    font = TransliterationEngine::instance()
+                                   ->languageFont(lang, m_useScriteFonts)
+                                   .family();
+                    language = TransliterationEngine::instance()->languageAsString(lang);
                 }
+            }
 
-                if (format.format.hasProperty(QTextFormat::TextUnderlineStyle)) {
-                    if (format.format.fontUnderline())
-                        styles << QStringLiteral("Underline");
-                }
+            xml.writeStartElement(QStringLiteral("Text"));
+            xml.writeAttribute(QStringLiteral("Font"), font);
+            xml.writeAttribute(QStringLiteral("Language"), language);
+
+            QStringList styles;
+            if (format.format.hasProperty(QTextFormat::FontWeight)) {
+                if (format.format.fontWeight() == QFont::Bold)
+                    styles << QStringLiteral("Bold");
+            }
 
-                if (!styles.isEmpty())
-                    textE.setAttribute(QStringLiteral("Style"), styles.join('+'));
+            if (format.format.hasProperty(QTextFormat::FontItalic)) {
+                if (format.format.fontItalic())
+                    styles << QStringLiteral("Italic");
+            }
 
-                if (format.format.hasProperty(QTextFormat::BackgroundBrush)) {
-                    const QColor color = format.format.background().color();
-                    textE.setAttribute(QStringLiteral("Background"), fdxColorCode(color));
-                }
+            if (format.format.hasProperty(QTextFormat::TextUnderlineStyle)) {
+                if (format.format.fontUnderline())
+                    styles << QStringLiteral("Underline");
+            }
 
-                if (format.format.hasProperty(QTextFormat::ForegroundBrush)) {
-                    const QColor color = format.format.foreground().color();
-                    textE.setAttribute(QStringLiteral("Color"), fdxColorCode(color));
-                }
+            if (!styles.isEmpty())
+                xml.writeAttribute(QStringLiteral("Style"), styles.join('+'));
 
-                if (m_markLanguagesExplicitly) {
-                    TransliterationEngine::Language lang =
-                            (TransliterationEngine::Language)format.format
-                                    .property(QTextFormat::UserProperty)
-                                    .toInt();
-                    if (lang != TransliterationEngine::English) {
-                        const QFont font = TransliterationEngine::instance()->languageFont(
-                                lang, m_useScriteFonts);
-                        textE.setAttribute(QStringLiteral("Font"), font.family());
-                        textE.setAttribute(
-                                QStringLiteral("Language"),
-                                TransliterationEngine::instance()->languageAsString(lang));
-                    }
-                }
+            if (format.format.hasProperty(QTextFormat::BackgroundBrush)) {
+                const QColor color = format.format.background().color();
+                xml.writeAttribute(QStringLiteral("Background"), fdxColorCode(color));
+            }
 
-                textE.appendChild(doc.createTextNode(snippet));
+            if (format.format.hasProperty(QTextFormat::ForegroundBrush)) {
+                const QColor color = format.format.foreground().color();
+                xml.writeAttribute(QStringLiteral("Color"), fdxColorCode(color));
             }
+
+            xml.writeCharacters(snippet);
+            xml.writeEndElement();
         }
     };
 
-    QStringList locations;
     for (int i = 0; i < nrElements; i++) {
         const ScreenplayElement *element = screenplay->elementAt(i);
         if (element->elementType() != ScreenplayElement::SceneElementType)
             continue;
 
-        QDomElement paragraphContainerE = contentE;
         if (element->isOmitted()) {
-            QDomElement paragraphE = doc.createElement(QStringLiteral("Paragraph"));
-            contentE.appendChild(paragraphE);
-
-            paragraphE.setAttribute(QStringLiteral("Type"), QStringLiteral("Scene Heading"));
+            xml.writeStartElement(QStringLiteral("Paragraph"));
+            xml.writeAttribute(QStringLiteral("Type"), QStringLiteral("Scene Heading"));
             if (element->hasUserSceneNumber())
-                paragraphE.setAttribute(QStringLiteral("Number"), element->userSceneNumber());
+                xml.writeAttribute(QStringLiteral("Number"), element->userSceneNumber());
 
-            QDomElement textE = doc.createElement(QStringLiteral("Text"));
-            textE.appendChild(doc.createTextNode(QStringLiteral("OMITTED")));
-            paragraphE.appendChild(textE);
+            xml.writeTextElement(QStringLiteral("Text"), QStringLiteral("OMITTED"));
 
-            QDomElement omittedSceneE = doc.createElement(QStringLiteral("OmittedScene"));
-            paragraphE.appendChild(omittedSceneE);
-
-            paragraphContainerE = omittedSceneE;
+            // Paragraphs of the omitted scene go in here, both elements are closed after them.
+            xml.writeStartElement(QStringLiteral("OmittedScene"));
         }
 
         const Scene *scene = element->scene();
@@ -207,16 +205,13 @@ bool FinalDraftExporter::doExport(QIODevice *device)
 
         if (heading->isEnabled() || scene->hasSynopsis()
             || (selement && selement->hasNativeTitle())) {
-            QDomElement paragraphE = doc.createElement(QStringLiteral("Paragraph"));
-            paragraphContainerE.appendChild(paragraphE);
-
-            paragraphE.setAttribute(QStringLiteral("Type"), QStringLiteral("Scene Heading"));
+            xml.writeStartElement(QStringLiteral("Paragraph"));
+            xml.writeAttribute(QStringLiteral("Type"), QStringLiteral("Scene Heading"));
             if (element->hasUserSceneNumber())
-                paragraphE.setAttribute(QStringLiteral("Number"), element->userSceneNumber());
+                xml.writeAttribute(QStringLiteral("Number"), element->userSceneNumber());
 
             if (heading->isEnabled()) {
-                addTextToParagraph(paragraphE, heading->text());
-                locations.append(heading->location());
+                addTextToParagraph(heading->text());
 
                 if (!locationTypes.contains(heading->locationType()))
                     locationTypes.append(heading->locationType());
@@ -226,10 +221,9 @@ bool FinalDraftExporter::doExport(QIODevice *device)
             }
 
             if (scene->hasSynopsis() || (selement && selement->hasNativeTitle())) {
-                QDomElement scenePropsE = doc.createElement(QStringLiteral("SceneProperties"));
-                paragraphE.appendChild(scenePropsE);
+                xml.writeStartElement(QStringLiteral("SceneProperties"));
                 if (selement && selement->hasNativeTitle())
-                    scenePropsE.setAttribute(QStringLiteral("Title"), selement->nativeTitle());
+                    xml.writeAttribute(QStringLiteral("Title"), selement->nativeTitle());
 
                 const QColor sceneColor = scene->color();
                 const QColor tintColor(QStringLiteral("#E7FFFFFF"));
@@ -239,14 +233,11 @@ bool FinalDraftExporter::doExport(QIODevice *device)
                                          (sceneColor.blueF() + tintColor.blueF()) / 2,
                                          (sceneColor.alphaF() + tintColor.alphaF()) / 2);
 
-                scenePropsE.setAttribute(QStringLiteral("Color"), fdxColorCode(exportSceneColor));
+                xml.writeAttribute(QStringLiteral("Color"), fdxColorCode(exportSceneColor));
 
                 if (scene->hasSynopsis()) {
-                    QDomElement summaryE = doc.createElement(QStringLiteral("Summary"));
-                    scenePropsE.appendChild(summaryE);
-
-                    QDomElement summaryParagraphE = doc.createElement(QStringLiteral("Paragraph"));
-                    summaryE.appendChild(summaryParagraphE);
+                    xml.writeStartElement(QStringLiteral("Summary"));
+                    xml.writeStartElement(QStringLiteral("Paragraph"));
 
                     const QString synopsis = scene->synopsis();
                     QVector<QTextLayout::FormatRange> formats;
@@ -261,73 +252,72 @@ bool FinalDraftExporter::doExport(QIODevice *device)
                     format.format.setForeground(Application::textColorFor(exportSceneColor));
                     formats.append(format);
 #endif
-                    addTextToParagraph(summaryParagraphE, synopsis, Qt::Alignment(), formats);
+                    addTextToParagraph(synopsis, Qt::Alignment(), formats);
+
+                    xml.writeEndElement(); // Paragraph
+                    xml.writeEndElement(); // Summary
                 }
+
+                xml.writeEndElement(); // SceneProperties
             }
+
+            xml.writeEndElement(); // Paragraph
         }
 
         const int nrSceneElements = scene->elementCount();
         for (int j = 0; j < nrSceneElements; j++) {
             const SceneElement *sceneElement = scene->elementAt(j);
-            QDomElement paragraphE = doc.createElement(QStringLiteral("Paragraph"));
-            paragraphContainerE.appendChild(paragraphE);
-
-            paragraphE.setAttribute(QStringLiteral("Type"), sceneElement->typeAsString());
-            addTextToParagraph(paragraphE, sceneElement->formattedText(), sceneElement->alignment(),
+            xml.writeStartElement(QStringLiteral("Paragraph"));
+            xml.writeAttribute(QStringLiteral("Type"), sceneElement->typeAsString());
+            addTextToParagraph(sceneElement->formattedText(), sceneElement->alignment(),
                                sceneElement->textFormats());
+            xml.writeEndElement();
+        }
+
+        if (element->isOmitted()) {
+            xml.writeEndElement(); // OmittedScene
+            xml.writeEndElement(); // Paragraph
         }
 
         this->progress()->tick();
     }
 
-    QDomElement watermarkingE = doc.createElement(QStringLiteral("Watermarking"));
-    rootE.appendChild(watermarkingE);
-    watermarkingE.setAttribute(QStringLiteral("Text"), qApp->applicationName());
+    xml.writeEndElement(); // Content
 
-    QDomElement smartTypeE = doc.createElement("SmartType");
-    rootE.appendChild(smartTypeE);
+    xml.writeStartElement(QStringLiteral("Watermarking"));
+    xml.writeAttribute(QStringLiteral("Text"), qApp->applicationName());
+    xml.writeEndElement();
 
-    const QStringList characters = structure->allCharacterNames();
-    QDomElement charactersE = doc.createElement(QStringLiteral("Characters"));
-    smartTypeE.appendChild(charactersE);
-    for (const QString &name : qAsConst(characters)) {
-        QDomElement characterE = doc.createElement(QStringLiteral("Character"));
-        charactersE.appendChild(characterE);
-        characterE.appendChild(doc.createTextNode(name));
-    }
+    xml.writeStartElement(QStringLiteral("SmartType"));
 
-    locations.removeDuplicates();
-    std::sort(locations.begin(), locations.end());
+    const QStringList characters = structure->allCharacterNames();
+    xml.writeStartElement(QStringLiteral("Characters"));
+    for (const QString &name : characters)
+        xml.writeTextElement(QStringLiteral("Character"), name);
+    xml.writeEndElement();
 
-    QDomElement timesOfDayE = doc.createElement(QStringLiteral("TimesOfDay"));
-    smartTypeE.appendChild(timesOfDayE);
-    timesOfDayE.setAttribute(QStringLiteral("Separator"), QStringLiteral(" - "));
+    xml.writeStartElement(QStringLiteral("TimesOfDay"));
+    xml.writeAttribute(QStringLiteral("Separator"), QStringLiteral(" - "));
     std::sort(moments.begin(), moments.end());
-    for (const QString &moment : qAsConst(moments)) {
-        QDomElement timeOfDayE = doc.createElement(QStringLiteral("TimeOfDay"));
-        timesOfDayE.appendChild(timeOfDayE);
-        timeOfDayE.appendChild(doc.createTextNode(moment));
-    }
+    for (const QString &moment : qAsConst(moments))
+        xml.writeTextElement(QStringLiteral("TimeOfDay"), moment);
+    xml.writeEndElement();
 
     std::sort(locationTypes.begin(), locationTypes.end());
-    QDomElement sceneIntrosE = doc.createElement(QStringLiteral("SceneIntros"));
-    smartTypeE.appendChild(sceneIntrosE);
-    sceneIntrosE.setAttribute(QStringLiteral("Separator"), QStringLiteral(". "));
-    for (const QString &locationType : qAsConst(locationTypes)) {
-        QDomElement sceneIntroE = doc.createElement(QStringLiteral("SceneIntro"));
-        sceneIntrosE.appendChild(sceneIntroE);
-        sceneIntroE.appendChild(doc.createTextNode(locationType));
+    xml.writeStartElement(QStringLiteral("SceneIntros"));
+    xml.writeAttribute(QStringLiteral("Separator"), QStringLiteral(". "));
+    for (const QString &locationType : qAsConst(locationTypes))
+        xml.writeTextElement(QStringLiteral("SceneIntro"), locationType);
+    xml.writeEndElement();
+
+    xml.writeEndElement(); // SmartType
+    xml.writeEndElement(); // FinalDraft
+    xml.writeEndDocument();
+
+    if (xml.hasError()) {
+        this->error()->setErrorMessage(QStringLiteral("Error writing to file."));
+        return false;
     }
 
-    const QString xml = doc.toString(2);
-
-    QTextStream ts(device);
-    ts.setCodec("utf-8");
-    ts.setAutoDetectUnicode(true);
-
-    ts << "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"no\"?>\n";
-    ts << xml;
-    ts.flush();
-
     return true;
 }
@@ -14,9 +14,27 @@
 #include "finaldraftimporter.h"
 #include "application.h"
 
-#include <QXmlSimpleReader>
+#include <functional>
+#include <QXmlStreamReader>
 
-static void fixOmittedScenes(QDomElement &contentE);
+namespace {
+
+struct FdxParagraph
+{
+    QString type;
+    QString flags;
+    QString number;
+    QString alignment;
+    QString text;
+    QVector<QTextLayout::FormatRange> formats;
+
+    bool hasSceneProperties = false;
+    QString title;
+    QString color;
+    QString summary;
+};
+
+}
 
 FinalDraftImporter::FinalDraftImporter(QObject *parent) : AbstractImporter(parent) { }
 
@@ -37,284 +55,257 @@ static QColor fromFdxColorCode(const QString &code)
     return QColor(code.mid(0, 1) + red + green + blue);
 }
 
-bool FinalDraftImporter::doImport(QIODevice *device)
+static QTextCharFormat fromFdxTextAttributes(const QXmlStreamAttributes &attributes)
 {
-    QString errMsg;
-    int errLine = -1;
-    int errCol = -1;
+    QTextCharFormat format;
+
+    const QStringList styles =
+            attributes.value(QStringLiteral("Style")).toString().split(QChar('+'));
+    if (styles.contains(QStringLiteral("Bold")))
+        format.setFontWeight(QFont::Bold);
+    if (styles.contains(QStringLiteral("Italic")))
+        format.setFontItalic(true);
+    if (styles.contains(QStringLiteral("Underline")))
+        format.setFontUnderline(true);
+
+    const QString colorAttr = QStringLiteral("Color");
+    const QString backgroundAttr = QStringLiteral("Background");
+    if (attributes.hasAttribute(colorAttr))
+        format.setForeground(QBrush(fromFdxColorCode(attributes.value(colorAttr).toString())));
+    if (attributes.hasAttribute(backgroundAttr))
+        format.setBackground(
+                QBrush(fromFdxColorCode(attributes.value(backgroundAttr).toString())));
+
+    return format;
+}
+
+/**
+ * Reads the <Paragraph> element the reader is positioned at, upto and including its end tag.
+ *
+ * Omitted scenes show up in FDX files as paragraphs nested within an <OmittedScene> element of
+ * an outer "Scene Heading" paragraph. Those nested paragraphs are flagged as "Omitted" and passed
+ * on to omittedParagraphHandler as soon as they are read, while the outer paragraph itself is
+ * flagged as "Ignore".
+ */
+static void readFdxParagraph(QXmlStreamReader &xml, FdxParagraph &paragraph,
+                             const std::function<void(FdxParagraph &)> &omittedParagraphHandler)
+{
+    const QString paragraphName = QStringLiteral("Paragraph");
+
+    const QXmlStreamAttributes attributes = xml.attributes();
+    paragraph.type = attributes.value(QStringLiteral("Type")).toString();
+    paragraph.flags = attributes.value(QStringLiteral("Flags")).toString();
+    paragraph.number = attributes.value(QStringLiteral("Number")).toString();
+    paragraph.alignment = attributes.value(QStringLiteral("Alignment")).toString();
+
+    while (xml.readNextStartElement()) {
+        const QStringRef name = xml.name();
+        if (name == QStringLiteral("Text")) {
+            QTextLayout::FormatRange format;
+            format.format = fromFdxTextAttributes(xml.attributes());
+            format.start = paragraph.text.length();
+
+            // Unlike QDomDocument::setContent(), this retains whitespace-only text. Quite often
+            // that's all there is between two differently formatted runs of text.
+            paragraph.text += xml.readElementText(QXmlStreamReader::IncludeChildElements);
+
+            format.length = paragraph.text.length() - format.start;
+            if (!format.format.isEmpty())
+                paragraph.formats.append(format);
+        } else if (name == QStringLiteral("SceneProperties")) {
+            const QXmlStreamAttributes propertyAttributes = xml.attributes();
+            paragraph.hasSceneProperties = true;
+            paragraph.title = propertyAttributes.value(QStringLiteral("Title")).toString();
+            paragraph.color = propertyAttributes.value(QStringLiteral("Color")).toString();
+
+            while (xml.readNextStartElement()) {
+                if (xml.name() != QStringLiteral("Summary")) {
+                    xml.skipCurrentElement();
+                    continue;
+                }
+
+                bool summaryRead = false;
+                while (xml.readNextStartElement()) {
+                    if (summaryRead || xml.name() != paragraphName) {
+                        xml.skipCurrentElement();
+                        continue;
+                    }
+
+                    // Ignore formatting, just retain the text.
+                    FdxParagraph summaryParagraph;
+                    readFdxParagraph(xml, summaryParagraph, omittedParagraphHandler);
+                    paragraph.summary = summaryParagraph.text;
+                    summaryRead = true;
+                }
+            }
+        } else if (name == QStringLiteral("OmittedScene")) {
+            paragraph.flags = QStringLiteral("Ignore");
+
+            while (xml.readNextStartElement()) {
+                if (xml.name() != paragraphName) {
+                    xml.skipCurrentElement();
+                    continue;
+                }
+
+                FdxParagraph omittedParagraph;
+                readFdxParagraph(xml, omittedParagraph, omittedParagraphHandler);
+                omittedParagraph.flags = QStringLiteral("Omitted");
+                omittedParagraphHandler(omittedParagraph);
+            }
+        } else
+            xml.skipCurrentElement();
+    }
+}
 
+bool FinalDraftImporter::doImport(QIODevice *device)
+{
     /**
-     * We cannot use QDomDocument::setContent(QIODevice*, QString*, int*, int*)
-     * because DOM Elements with spaces will be read as empty strings, instead of
-     * actual number of spaces. This is obviously a problem for us.
-     *
-     * The only way to address that is to actually use a QXmlInputSource over the
-     * QIODevice, and then parse that using QXmlSimpleReader instance.
-     *
-     * In Qt 5.15, QXmlInputSource and QXmlSimpleReader classes are depricated.
-     * But until we can find a replacement that also parses spaces properly,
-     * we will have to simply use these deprecated classes.
+     * FDX files from studios can have tens of thousands of paragraphs along with revision
+     * history, so we don't build a DOM out of it. Paragraphs are read one at a time from the
+     * stream, and paragraphs of a scene are added to it all at once.
      */
+    QXmlStreamReader xml(device);
 
-    QXmlInputSource xmlInputSource(device);
-    QXmlSimpleReader xmlParser;
-
-    QDomDocument doc;
-    if (!doc.setContent(&xmlInputSource, &xmlParser, &errMsg, &errLine, &errCol)) {
+    auto reportParseError = [&xml, this]() {
         const QString msg = QStringLiteral("Parse Error: %1 at Line %2, Column %3")
-                                    .arg(errMsg)
-                                    .arg(errLine)
-                                    .arg(errCol);
+                                    .arg(xml.errorString())
+                                    .arg(xml.lineNumber())
+                                    .arg(xml.columnNumber());
         this->error()->setErrorMessage(msg);
         return false;
-    }
+    };
+
+    if (!xml.readNextStartElement()) {
+        if (xml.hasError())
+            return reportParseError();
 
-    QDomElement rootE = doc.documentElement();
-    if (rootE.tagName() != QStringLiteral("FinalDraft")) {
         this->error()->setErrorMessage("Not a Final-Draft file.");
         return false;
     }
 
-    const int fdxVersion = rootE.attribute("Version").toInt();
-    if (rootE.attribute("DocumentType") != QStringLiteral("Script") || fdxVersion < 1
-        || fdxVersion > 5) {
-        this->error()->setErrorMessage("Unrecognised Final Draft file version.");
+    if (xml.name() != QStringLiteral("FinalDraft")) {
+        this->error()->setErrorMessage("Not a Final-Draft file.");
         return false;
     }
 
-    QDomElement contentE = rootE.firstChildElement(QStringLiteral("Content"));
-    QDomNodeList paragraphs = contentE.elementsByTagName(QStringLiteral("Paragraph"));
-    if (paragraphs.isEmpty()) {
-        this->error()->setErrorMessage(QStringLiteral("No paragraphs to import."));
+    const QXmlStreamAttributes rootAttributes = xml.attributes();
+    const int fdxVersion = rootAttributes.value(QStringLiteral("Version")).toInt();
+    if (rootAttributes.value(QStringLiteral("DocumentType")) != QStringLiteral("Script")
+        || fdxVersion < 1 || fdxVersion > 5) {
+        this->error()->setErrorMessage("Unrecognised Final Draft file version.");
         return false;
     }
 
-    ::fixOmittedScenes(contentE);
+    const QHash<QString, SceneElement::Type> types(
+            { { QStringLiteral("Scene Heading"), SceneElement::Heading },
+              { QStringLiteral("Action"), SceneElement::Action },
+              { QStringLiteral("Character"), SceneElement::Character },
+              { QStringLiteral("Dialogue"), SceneElement::Dialogue },
+              { QStringLiteral("Parenthetical"), SceneElement::Parenthetical },
+              { QStringLiteral("Shot"), SceneElement::Shot },
+              { QStringLiteral("Transition"), SceneElement::Transition } });
+    const QHash<QString, Qt::Alignment> alignments(
+            { { QStringLiteral("Left"), Qt::AlignLeft },
+              { QStringLiteral("Right"), Qt::AlignRight },
+              { QStringLiteral("Center"), Qt::AlignCenter } });
+
+    // The number of paragraphs is not known upfront, so progress is reported based on how much
+    // of the file has been read.
+    const int nrProgressSteps = 100;
+    const qint64 deviceSize = device->isSequential() ? 0 : device->size();
+    int progressStepsTaken = 0;
+    this->progress()->setProgressStep(1.0 / qreal(nrProgressSteps + 1));
+
+    auto updateProgress = [&]() {
+        if (deviceSize <= 0)
+            return;
+
+        const qint64 bytesRead = qMin(device->pos(), deviceSize);
+        const int steps = int(bytesRead * nrProgressSteps / deviceSize);
+        for (; progressStepsTaken < steps; progressStepsTaken++)
+            this->progress()->tick();
+    };
 
     Scene *scene = nullptr;
-    this->progress()->setProgressStep(1.0 / qreal(paragraphs.size() + 1));
-    this->configureCanvas(paragraphs.size());
-
-    auto parseParagraphTexts =
-            [](const QDomElement &paragraphE) -> QPair<QString, QVector<QTextLayout::FormatRange>> {
-        QVector<QTextLayout::FormatRange> formats;
-        QString text;
-        if (paragraphE.isNull())
-            return qMakePair(text, formats);
-
-        const QString textN = QStringLiteral("Text");
-        QDomElement textE = paragraphE.firstChildElement(textN);
-        while (!textE.isNull()) {
-            QTextLayout::FormatRange format;
-            format.start = text.length();
-
-            const QString textEText = textE.text();
-            text += textEText;
-
-            format.length = text.length() - format.start;
-
-            const QStringList styles = textE.attribute(QStringLiteral("Style")).split(QChar('+'));
-            if (styles.contains(QStringLiteral("Bold")))
-                format.format.setFontWeight(QFont::Bold);
-            if (styles.contains(QStringLiteral("Italic")))
-                format.format.setFontItalic(true);
-            if (styles.contains(QStringLiteral("Underline")))
-                format.format.setFontUnderline(true);
+    QList<SceneElement *> sceneElements;
+    int nrParagraphs = 0;
 
-            const QString colorAttr = QStringLiteral("Color");
-            const QString backgroundAttr = QStringLiteral("Background");
-            if (textE.hasAttribute(colorAttr))
-                format.format.setForeground(QBrush(fromFdxColorCode(textE.attribute(colorAttr))));
-            if (textE.hasAttribute(backgroundAttr))
-                format.format.setBackground(
-                        QBrush(fromFdxColorCode(textE.attribute(backgroundAttr))));
-
-            if (!format.format.isEmpty())
-                formats.append(format);
-
-            textE = textE.nextSiblingElement(textN);
-        }
-
-        return qMakePair(text, formats);
+    auto addPendingSceneElements = [&]() {
+        this->addSceneElements(scene, sceneElements);
+        sceneElements.clear();
     };
 
-    const QStringList types({ QStringLiteral("Scene Heading"), QStringLiteral("Action"),
-                              QStringLiteral("Character"), QStringLiteral("Dialogue"),
-                              QStringLiteral("Parenthetical"), QStringLiteral("Shot"),
-                              QStringLiteral("Transition") });
-    const QString paragraphName = QStringLiteral("Paragraph");
-    QDomElement paragraphE = contentE.firstChildElement(paragraphName);
-    while (!paragraphE.isNull()) {
-        TraverseDomElement tde(paragraphE, this->progress());
-
-        const QString flags = paragraphE.attribute(QStringLiteral("Flags"));
-        if (flags == "Ignore")
-            continue;
+    const std::function<void(FdxParagraph &)> importParagraph = [&](FdxParagraph &paragraph) {
+        ++nrParagraphs;
 
-        const QString type = paragraphE.attribute(QStringLiteral("Type"));
-        const int typeIndex = types.indexOf(type);
-        if (typeIndex < 0)
-            continue;
+        if (paragraph.flags == QStringLiteral("Ignore"))
+            return;
 
-        const QString alignmentHint = paragraphE.attribute(QStringLiteral("Alignment"));
-        const Qt::Alignment alignment = [alignmentHint]() {
-            return QHash<QString, Qt::Alignment>({ { QStringLiteral("Left"), Qt::AlignLeft },
-                                                   { QStringLiteral("Right"), Qt::AlignRight },
-                                                   { QStringLiteral("Center"), Qt::AlignCenter } })
-                    .value(alignmentHint, Qt::Alignment());
-        }();
+        auto typeIt = types.constFind(paragraph.type);
+        if (typeIt == types.constEnd())
+            return;
 
-        const QPair<QString, QVector<QTextLayout::FormatRange>> paragraphText =
-                parseParagraphTexts(paragraphE);
+        if (typeIt.value() == SceneElement::Heading) {
+            addPendingSceneElements();
 
-        const QString text = paragraphText.first;
-        const QVector<QTextLayout::FormatRange> formats = paragraphText.second;
-
-        SceneElement *sceneElement = nullptr;
-        switch (typeIndex) {
-        case 0: {
-            scene = this->createScene(text);
+            scene = this->createScene(paragraph.text);
 
             ScreenplayElement *element = this->document()->screenplay()->elementAt(
                     this->document()->screenplay()->elementCount() - 1);
-            element->setOmitted(flags == "Omitted");
-
-            const QString number = paragraphE.attribute(QStringLiteral("Number"));
-            if (!number.isEmpty())
-                element->setUserSceneNumber(number);
-
-            const QDomElement sceneProperiesE =
-                    paragraphE.firstChildElement(QStringLiteral("SceneProperties"));
-            if (!sceneProperiesE.isNull()) {
-                const QString title = sceneProperiesE.attribute(QStringLiteral("Title"));
-                const QColor color =
-                        fromFdxColorCode(sceneProperiesE.attribute(QStringLiteral("Color")));
-                scene->setColor(color);
-                scene->structureElement()->setTitle(title);
-
-                const QDomElement summaryE =
-                        sceneProperiesE.firstChildElement(QStringLiteral("Summary"));
-                const QDomElement summaryParagraphE = summaryE.isNull()
-                        ? QDomElement()
-                        : summaryE.firstChildElement(paragraphName);
-                const QPair<QString, QVector<QTextLayout::FormatRange>> summaryParagraphText =
-                        parseParagraphTexts(summaryParagraphE);
-
-                // Ignore formatting, just retain the text.
-                scene->setSynopsis(summaryParagraphText.first);
+            element->setOmitted(paragraph.flags == QStringLiteral("Omitted"));
+
+            if (!paragraph.number.isEmpty())
+                element->setUserSceneNumber(paragraph.number);
+
+            if (paragraph.hasSceneProperties) {
+                scene->setColor(fromFdxColorCode(paragraph.color));
+                scene->structureElement()->setTitle(paragraph.title);
+                scene->setSynopsis(paragraph.summary);
             }
-        } break;
-        case 1:
-            sceneElement = this->addSceneElement(scene, SceneElement::Action, text);
-            break;
-        case 2:
-            sceneElement = this->addSceneElement(scene, SceneElement::Character, text);
-            break;
-        case 3:
-            sceneElement = this->addSceneElement(scene, SceneElement::Dialogue, text);
-            break;
-        case 4:
-            sceneElement = this->addSceneElement(scene, SceneElement::Parenthetical, text);
-            break;
-        case 5:
-            sceneElement = this->addSceneElement(scene, SceneElement::Shot, text);
-            break;
-        case 6:
-            sceneElement = this->addSceneElement(scene, SceneElement::Transition, text);
-            break;
+
+            return;
         }
 
+        SceneElement *sceneElement =
+                this->createSceneElement(scene, typeIt.value(), paragraph.text);
         if (sceneElement != nullptr) {
-            sceneElement->setAlignment(alignment);
-            sceneElement->setTextFormats(formats);
+            sceneElement->setAlignment(alignments.value(paragraph.alignment, Qt::Alignment()));
+            sceneElement->setTextFormats(paragraph.formats);
+            sceneElements.append(sceneElement);
         }
-    }
-
-    return true;
-}
-
-void fixOmittedScenes(QDomElement &contentE)
-{
-    /**
-     * The final-draft importer is built to process a flat <Paragraph> hierarchy like this.
-     *
-     * <FinalDraft ...>
-     * <Content>
-     *   <Paragraph ...>
-     *
-     *   </Paragraph>
-     *
-     *   <Paragraph ....>
-     *
-     *   </Paragraph>
-     *
-     *   ....
-     * </Content>
-     * </FinalDraft>
-     *
-     * However, if there are omitted scenes, then they show up like this in the FDX file.
-     *
-     * <FinalDraft ...>
-     *  <Content>
-     *      <Paragraph Type="Scene Heading" ...>
-     *          <Text>Omitted</Text>
-     *          <OmittedScene>
-     *              <Paragraph Type="Scene Heading" ...>...</Paragraph>
-     *              <Paragraph Type="Action" ...>...</Paragraph>
-     *              <Paragraph Type="Character" ...>...</Paragraph>
-     *              <Paragraph Type="Dialog" ...>...</Paragraph>
-     *              <Paragraph Type="Shot" ...>...</Paragraph>
-     *              .....
-     *          </OmittedScene>
-     *      </Paragraph>
-     *      <Paragraph Type="Scene Heading">...</Paragraph>
-     *      ....
-     *  </Content>
-     * </FinalDraft>
-     *
-     * We need to transform this into ...
-     *
-     * <FinalDraft ...>
-     *  <Content>
-     *     <Paragraph Flags="Omitted" Type="Scene Heading" ...>...</Paragraph>
-     *     <Paragraph Flags="Omitted" Type="Action" ...>...</Paragraph>
-     *     <Paragraph Flags="Omitted" Type="Character" ...>...</Paragraph>
-     *     <Paragraph Flags="Omitted" Type="Dialog" ...>...</Paragraph>
-     *     <Paragraph Flags="Omitted" Type="Shot" ...>...</Paragraph>
-     *     .....
-     *     <Paragraph Flags="Ignore" Type="Scene Heading" ...>
-     *          <Text>Omitted</Text>
-     *          <OmittedScene>
-     *     </Paragraph>
-     *     <Paragraph Type="Scene Heading">...</Paragraph>
-     *     ....
-     *  </Content>
-     * </FinalDraft>
-     *
-     * So, that the existing parser can continue to import this FDX file without
-     * having to make too many adjustments.
-     *
-     * So, that's what this function does!
-     */
+    };
 
     const QString paragraphName = QStringLiteral("Paragraph");
-    const QString omittedSceneName = QStringLiteral("OmittedScene");
-    const QString flagsAttr = QStringLiteral("Flags");
-
-    QDomElement paragraphE = contentE.firstChildElement(paragraphName);
-    while (!paragraphE.isNull()) {
-
-        QDomElement omittedSceneE = paragraphE.firstChildElement(omittedSceneName);
-        if (!omittedSceneE.isNull()) {
-            paragraphE.setAttribute(flagsAttr, QStringLiteral("Ignore"));
-            const QDomNodeList childParagraphs = omittedSceneE.elementsByTagName(paragraphName);
-            for (int i = childParagraphs.size() - 1; i >= 0; i--) {
-                QDomElement childParagraphE = childParagraphs.at(i).toElement();
-                childParagraphE.setAttribute(flagsAttr, QStringLiteral("Omitted"));
-                contentE.insertAfter(childParagraphE, paragraphE);
+    while (xml.readNextStartElement()) {
+        if (xml.name() != QStringLiteral("Content")) {
+            xml.skipCurrentElement();
+            continue;
+        }
+
+        while (xml.readNextStartElement()) {
+            if (xml.name() != paragraphName) {
+                xml.skipCurrentElement();
+                continue;
             }
+
+            FdxParagraph paragraph;
+            readFdxParagraph(xml, paragraph, importParagraph);
+            importParagraph(paragraph);
+            updateProgress();
         }
+    }
+
+    addPendingSceneElements();
 
-        paragraphE = paragraphE.nextSiblingElement(paragraphName);
+    if (xml.hasError())
+        return reportParseError();
+
+    if (nrParagraphs == 0) {
+        this->error()->setErrorMessage(QStringLiteral("No paragraphs to import."));
+        return false;
     }
+
+    this->configureCanvas(nrParagraphs);
+
+    return true;
 }
@@ -14,7 +14,6 @@
 #ifndef FINALDRAFTIMPORTER_H
 #define FINALDRAFTIMPORTER_H
 
-#include <QDomDocument>
 #include "abstractimporter.h"
 
 class FinalDraftImporter : public AbstractImporter
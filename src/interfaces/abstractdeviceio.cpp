@@ -16,6 +16,8 @@
 
 #include <QFile>
 
+bool AbstractDeviceIO::m_featureCheckSkipped = false;
+
 AbstractDeviceIO::AbstractDeviceIO(QObject *parent) : QObject(parent), m_document(this, "document")
 {
 }
@@ -40,6 +40,11 @@ public:
     ScriteDocument *document() const { return m_document; }
     Q_SIGNAL void documentChanged();
 
+    // Lets importers, exporters and reports work without a login. Only the headless benchmark
+    // sets this, so that it needs neither an account nor the network.
+    static void setFeatureCheckSkipped(bool val) { m_featureCheckSkipped = val; }
+    static bool isFeatureCheckSkipped() { return m_featureCheckSkipped; }
+
 protected:
     AbstractDeviceIO(QObject *parent = nullptr);
     virtual QString polishFileName(const QString &fileName) const;
@@ -50,6 +55,7 @@ protected:
     ErrorReport *error() const { return m_errorReport; }
 
 private:
+    static bool m_featureCheckSkipped;
     QString m_fileName;
     ErrorReport *m_errorReport = new ErrorReport(this);
     QObjectProperty<ScriteDocument> m_document;
@@ -13,6 +13,7 @@
 
 #include "abstractexporter.h"
 #include "application.h"
+#include "timeprofiler.h"
 #include "scrite.h"
 #include "user.h"
 
@@ -51,6 +52,9 @@ QString AbstractExporter::nameFilters() const
 
 bool AbstractExporter::isFeatureEnabled() const
 {
+    if (AbstractDeviceIO::isFeatureCheckSkipped())
+        return true;
+
     if (User::instance()->isLoggedIn()) {
         const bool allReportsEnabled = AppFeature::isEnabled(Scrite::ExportFeature);
         const bool thisSpecificReportEnabled =
@@ -69,6 +73,8 @@ QJsonObject AbstractExporter::configurationFormInfo() const
 
 bool AbstractExporter::write(AbstractExporter::Target target)
 {
+    PROFILE_THIS_FUNCTION;
+
     auto cleanup = qScopeGuard([=]() { GarbageCollector::instance()->add(this); });
 
     QString fileName = this->fileName();
@@ -15,6 +15,7 @@
 #include "scrite.h"
 #include "undoredo.h"
 #include "application.h"
+#include "timeprofiler.h"
 #include "abstractimporter.h"
 
 #include <QFile>
@@ -43,6 +44,9 @@ QString AbstractImporter::nameFilters() const
 
 bool AbstractImporter::isFeatureEnabled() const
 {
+    if (AbstractDeviceIO::isFeatureCheckSkipped())
+        return true;
+
     if (User::instance()->isLoggedIn()) {
         const bool allImportersEnabled = AppFeature::isEnabled(Scrite::ImportFeature);
         const bool thisSpecificImporterEnabled = allImportersEnabled
@@ -56,6 +60,8 @@ bool AbstractImporter::isFeatureEnabled() const
 
 bool AbstractImporter::read()
 {
+    PROFILE_THIS_FUNCTION;
+
     auto cleanup = qScopeGuard([=]() { GarbageCollector::instance()->add(this); });
 
     QString fileName = this->fileName();
@@ -193,3 +199,36 @@ SceneElement *AbstractImporter::addSceneElement(Scene *scene, SceneElement::Type
     scene->addElement(element);
     return element;
 }
+
+SceneElement *AbstractImporter::createSceneElement(Scene *scene, SceneElement::Type type,
+                                                   const QString &text)
+{
+    if (scene == nullptr || type == SceneElement::Heading || text.isEmpty())
+        return nullptr;
+
+    SceneElement *element = new SceneElement(scene);
+    element->setType(type);
+    element->setText(text);
+    return element;
+}
+
+void AbstractImporter::addSceneElements(Scene *scene, const QList<SceneElement *> &elements)
+{
+    if (scene == nullptr || elements.isEmpty())
+        return;
+
+    if (scene->elementCount() > 0) {
+        for (SceneElement *element : elements)
+            scene->addElement(element);
+        return;
+    }
+
+    // One model reset, instead of a row insertion per paragraph.
+    scene->setElements(elements);
+
+    // Scene::addElement() does this, so that character names are collected during import.
+    for (SceneElement *element : elements) {
+        if (element->type() == SceneElement::Character)
+            emit scene->sceneElementChanged(element, Scene::ElementTypeChange);
+    }
+}
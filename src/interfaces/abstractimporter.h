@@ -47,6 +47,11 @@ protected:
     Scene *createScene(const QString &heading);
     SceneElement *addSceneElement(Scene *scene, SceneElement::Type type, const QString &text);
 
+    // Paragraphs created using createSceneElement() belong to the scene, but are not part of it
+    // until addSceneElements() is called. This lets importers add a whole scene in one go.
+    SceneElement *createSceneElement(Scene *scene, SceneElement::Type type, const QString &text);
+    void addSceneElements(Scene *scene, const QList<SceneElement *> &elements);
+
     void setBreakTitle(ScreenplayElement *element, const QString &title)
     {
         element->setBreakTitle(title);
@@ -16,6 +16,7 @@
 #include "user.h"
 #include "scrite.h"
 #include "application.h"
+#include "timeprofiler.h"
 #include "qtextdocumentpagedprinter.h"
 
 #include <QDir>
@@ -79,6 +80,9 @@ QIcon AbstractReportGenerator::icon() const
 
 bool AbstractReportGenerator::isFeatureEnabled() const
 {
+    if (AbstractDeviceIO::isFeatureCheckSkipped())
+        return true;
+
     if (User::instance()->isLoggedIn()) {
         const bool allReportsEnabled = AppFeature::isEnabled(Scrite::ReportFeature);
         const bool thisSpecificImporterEnabled = allReportsEnabled
@@ -119,6 +123,8 @@ QString AbstractReportGenerator::name() const
 
 bool AbstractReportGenerator::generate()
 {
+    PROFILE_THIS_FUNCTION;
+
     auto cleanup = qScopeGuard([=]() { GarbageCollector::instance()->add(this); });
 
     QString fileName = this->fileName();
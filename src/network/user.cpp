@@ -424,7 +424,10 @@ User *User::instance()
     static User *theUser = new User(qApp);
 
     if (firstTime) {
-        if (refreshSessionToken && LocalStorage::load("loginToken").isValid()) {
+        // Processes that can't keep what they store, like batch export workers, use the
+        // session they are given instead of starting new ones.
+        if (refreshSessionToken && !LocalStorage::isReadOnly()
+            && LocalStorage::load("loginToken").isValid()) {
             SessionNewRestApiCall *newSession = new SessionNewRestApiCall(theUser);
             if (!newSession->call()) {
                 newSession->deleteLater();
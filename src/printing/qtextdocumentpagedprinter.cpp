@@ -15,6 +15,7 @@
 #include "scrite.h"
 #include "ruleritem.h"
 #include "application.h"
+#include "timeprofiler.h"
 #include "scritedocument.h"
 #include "qtextdocumentpagedprinter.h"
 
@@ -26,6 +27,7 @@
 #include <QSettings>
 #include <QTextBlock>
 #include <QPaintEngine>
+#include <QElapsedTimer>
 #include <QAbstractTextDocumentLayout>
 
 HeaderFooter::HeaderFooter(Type type, QObject *parent) : QObject(parent), m_type(type)
@@ -373,6 +375,17 @@ bool QTextDocumentPagedPrinter::print(QTextDocument *document, QPagedPaintDevice
     m_printer = printer;
 
     m_errorReport->clear();
+    m_timings = QJsonObject();
+
+    QElapsedTimer stageTimer;
+    stageTimer.start();
+    auto finishStage = [&](const char *name, const QString &key) {
+        const qint64 ns = stageTimer.nsecsElapsed();
+        if (TimeProfiler::isEnabled())
+            TimeProfiler::record(name, TimeProfiler::nowNs() - ns, ns);
+        m_timings.insert(key, qreal(ns) / 1e6);
+        stageTimer.restart();
+    };
 
     if (m_textDocument == nullptr) {
         m_errorReport->setErrorMessage("No document to print.");
@@ -535,6 +548,8 @@ bool QTextDocumentPagedPrinter::print(QTextDocument *document, QPagedPaintDevice
     const int fromPageNr = 1;
     const int toPageNr = doc->pageCount();
 
+    finishStage("QTextDocumentPagedPrinter::print(layout)", QStringLiteral("layoutMs"));
+
     m_progressReport->start();
     m_progressReport->setProgressStep(1 / qreal(doc->pageCount() + 1));
     int pageNr = fromPageNr;
@@ -569,6 +584,9 @@ bool QTextDocumentPagedPrinter::print(QTextDocument *document, QPagedPaintDevice
     m_footer->finish();
     m_progressReport->finish();
 
+    finishStage("QTextDocumentPagedPrinter::print(write)", QStringLiteral("writeMs"));
+    m_timings.insert(QStringLiteral("pageCount"), toPageNr);
+
     return true;
 }
 
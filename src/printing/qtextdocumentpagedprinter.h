@@ -17,6 +17,7 @@
 #include <QColor>
 #include <QEvent>
 #include <QObject>
+#include <QJsonObject>
 #include <QTextDocument>
 #include <QPagedPaintDevice>
 
@@ -230,6 +231,10 @@ public:
 
     Q_INVOKABLE bool print(QTextDocument *document, QPagedPaintDevice *device);
 
+    // Time spent by the last print() call in each stage: layoutMs and writeMs, along with
+    // pageCount.
+    Q_INVOKABLE QJsonObject timings() const { return m_timings; }
+
     static void loadSettings(HeaderFooter *header, HeaderFooter *footer, Watermark *watermark);
 
 private:
@@ -250,6 +255,7 @@ private:
     QTextDocumentPageSideBarInterface *m_sideBar = nullptr;
     QRectF m_headerRect;
     QRectF m_footerRect;
+    QJsonObject m_timings;
 };
 
 #endif // QTEXTDOCUMENTPAGEDPRINTER_H
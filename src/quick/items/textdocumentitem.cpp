@@ -13,32 +13,178 @@
 
 #include "textdocumentitem.h"
 
+#include <QSet>
 #include <QtMath>
+#include <QCache>
 #include <QImage>
 #include <QTimer>
+#include <QPicture>
 #include <QPainter>
+#include <QTextBlock>
+#include <QTextFrame>
+#include <QTextCursor>
 #include <QQuickWindow>
-#include <QQuickPaintedItem>
+#include <QFutureWatcher>
+#include <QtConcurrentRun>
+#include <QSGSimpleTextureNode>
 #include <QAbstractTextDocumentLayout>
 
-class TextDocumentViewportItem : public QQuickPaintedItem
+// Edge of a square tile, in item coordinates.
+static const int TextDocumentTileSize = 256;
+
+// Rows of tiles rendered ahead of time, above and below the viewport.
+static const int TextDocumentPrefetchRows = 2;
+
+struct TextDocumentTileKey
+{
+    int row = 0;
+    int column = 0;
+    qreal scale = 1.0;
+    qreal devicePixelRatio = 1.0;
+    qreal textWidth = 0;
+    int revision = 0;
+
+    // Area of the document covered by this tile, in document coordinates.
+    QRectF documentRect(const QSizeF &documentSize) const
+    {
+        const qreal size = TextDocumentTileSize / scale;
+        const QRectF rect(column * size, row * size, size, size);
+        return rect.intersected(QRectF(QPointF(0, 0), documentSize));
+    }
+
+    bool operator==(const TextDocumentTileKey &other) const
+    {
+        return row == other.row && column == other.column && qFuzzyCompare(scale, other.scale)
+                && qFuzzyCompare(devicePixelRatio, other.devicePixelRatio)
+                && qFuzzyCompare(textWidth, other.textWidth) && revision == other.revision;
+    }
+};
+
+inline uint qHash(const TextDocumentTileKey &key, uint seed = 0)
+{
+    auto combine = [](uint seed, uint value) {
+        return seed ^ (value + 0x9e3779b9 + (seed << 6) + (seed >> 2));
+    };
+
+    uint ret = combine(seed, uint(key.row));
+    ret = combine(ret, uint(key.column));
+    ret = combine(ret, uint(key.revision));
+    return combine(ret, qHash(qRound(key.scale * 1000)));
+}
+
+struct TextDocumentTileCache
+{
+    // Cost is in kilobytes, upto 48 MB of tiles are kept around per item.
+    TextDocumentTileCache() { tiles.setMaxCost(48 * 1024); }
+
+    void insert(const TextDocumentTileKey &key, const QImage &image)
+    {
+        const int cost = qMax(1, int(image.sizeInBytes() / 1024));
+        tiles.insert(key, new QImage(image), cost);
+    }
+
+    // Tiles of the old revision that lie entirely above documentY are carried over to the new
+    // revision, the rest are dropped.
+    void invalidate(int oldRevision, int newRevision, qreal documentY)
+    {
+        QList<QPair<TextDocumentTileKey, QImage>> carriedOver;
+
+        const QList<TextDocumentTileKey> keys = tiles.keys();
+        for (const TextDocumentTileKey &key : keys) {
+            if (key.revision != oldRevision
+                || (key.row + 1) * TextDocumentTileSize / key.scale > documentY)
+                continue;
+
+            if (const QImage *image = tiles.object(key)) {
+                TextDocumentTileKey newKey = key;
+                newKey.revision = newRevision;
+                carriedOver.append(qMakePair(newKey, *image));
+            }
+        }
+
+        tiles.clear();
+        for (const QPair<TextDocumentTileKey, QImage> &tile : qAsConst(carriedOver))
+            this->insert(tile.first, tile.second);
+    }
+
+    void clear()
+    {
+        tiles.clear();
+        pending.clear();
+    }
+
+    QCache<TextDocumentTileKey, QImage> tiles;
+    QSet<TextDocumentTileKey> pending;
+};
+
+static QImage createTileImage(const QSizeF &size, qreal dpr)
+{
+    QImage image((size * dpr).toSize(), QImage::Format_ARGB32_Premultiplied);
+    image.setDevicePixelRatio(dpr);
+    image.fill(Qt::transparent);
+    return image;
+}
+
+static void drawTile(QPainter *painter, QTextDocument *document, const QRectF &documentRect,
+                     qreal scale)
+{
+    painter->scale(scale, scale);
+    painter->translate(-documentRect.topLeft());
+    painter->setClipRect(documentRect);
+    painter->setRenderHint(QPainter::Antialiasing);
+    painter->setRenderHint(QPainter::TextAntialiasing);
+
+    QAbstractTextDocumentLayout::PaintContext ctx;
+    ctx.clip = documentRect;
+    document->documentLayout()->draw(painter, ctx);
+}
+
+// Runs on a worker thread, only the recorded picture is touched here.
+static QImage rasterizeTile(const QPicture &picture, const QSizeF &size, qreal dpr)
+{
+    QImage image = createTileImage(size, dpr);
+
+    QPainter painter(&image);
+    painter.setRenderHint(QPainter::Antialiasing);
+    painter.setRenderHint(QPainter::TextAntialiasing);
+    painter.drawPicture(0, 0, picture);
+    painter.end();
+
+    return image;
+}
+
+class TextDocumentViewportItem : public QQuickItem
 {
 public:
     explicit TextDocumentViewportItem(TextDocumentItem *parent);
     ~TextDocumentViewportItem();
 
-    void setViewportImage(const QImage &image)
+    struct Tile
     {
-        m_image = image;
+        TextDocumentTileKey key;
+        QRectF rect; // in item coordinates
+        QImage image;
+    };
+
+    void setTiles(const QList<Tile> &tiles)
+    {
+        m_tiles = tiles;
         this->update();
     }
-    QImage viewportImage() const { return m_image; }
 
-    // QQuickPaintedItem interface
-    void paint(QPainter *painter);
+    // QQuickItem interface
+    QSGNode *updatePaintNode(QSGNode *oldNode, UpdatePaintNodeData *);
 
 private:
-    QImage m_image;
+    QList<Tile> m_tiles;
+};
+
+class TextDocumentTileNode : public QSGSimpleTextureNode
+{
+public:
+    TextDocumentTileNode() { this->setOwnsTexture(true); }
+
+    TextDocumentTileKey key;
 };
 
 TextDocumentItem::TextDocumentItem(QQuickItem *parent) : QQuickItem(parent)
@@ -57,9 +203,14 @@ TextDocumentItem::TextDocumentItem(QQuickItem *parent) : QQuickItem(parent)
 
     m_viewportItem = new TextDocumentViewportItem(this);
     m_viewportItem->setVisible(false);
+
+    m_tileCache = new TextDocumentTileCache;
 }
 
-TextDocumentItem::~TextDocumentItem() { }
+TextDocumentItem::~TextDocumentItem()
+{
+    delete m_tileCache;
+}
 
 void TextDocumentItem::setDocument(QTextDocument *val)
 {
@@ -68,6 +219,7 @@ void TextDocumentItem::setDocument(QTextDocument *val)
 
     if (m_document) {
         m_document->disconnect(m_documentChangeHandler);
+        m_document->disconnect(this);
         if (m_document->parent() == this)
             m_document->deleteLater();
     }
@@ -75,8 +227,15 @@ void TextDocumentItem::setDocument(QTextDocument *val)
     m_document = val;
     emit documentChanged();
 
-    if (m_document)
+    m_tileCache->clear();
+    m_dirtyFromPosition = -1;
+    ++m_documentRevision;
+
+    if (m_document) {
         connect(m_document, SIGNAL(contentsChanged()), m_documentChangeHandler, SLOT(start()));
+        connect(m_document, &QTextDocument::contentsChange, this,
+                &TextDocumentItem::onDocumentContentsChange);
+    }
 
     m_documentChangeHandler->start();
 }
@@ -141,54 +300,127 @@ void TextDocumentItem::updateViewport()
         return;
     }
 
-    const qreal maxViewportDim = 4000.0 / m_documentScale;
-
     const qreal contentY =
             (m_flickable == nullptr ? 0 : m_flickable->property("contentY").toDouble())
             - m_verticalPadding;
-
-    const qreal x = 0;
-    const qreal y = contentY / m_documentScale;
-    const qreal width = qMin(m_document->textWidth(), maxViewportDim);
-    const qreal height = (qMin(m_flickable == nullptr ? this->height()
-                                                      : (m_flickable->height() + m_verticalPadding),
-                               maxViewportDim))
-            / m_documentScale;
-    const QRectF rect(x, y, width, height);
-    if (rect.isEmpty()) {
+    const qreal viewportHeight = m_flickable == nullptr
+            ? this->height()
+            : (m_flickable->height() + m_verticalPadding);
+
+    const QSizeF documentSize(m_document->textWidth(), m_document->size().height());
+    const QSizeF contentSize = documentSize * m_documentScale;
+    const QRectF viewportRect(0, qMax(contentY, 0.0), contentSize.width(),
+                              qMin(contentY + viewportHeight, contentSize.height())
+                                      - qMax(contentY, 0.0));
+    if (viewportRect.isEmpty()) {
         m_viewportItem->setVisible(false);
         return;
     }
 
     const qreal dpr = this->window() ? this->window()->devicePixelRatio() : 1.0;
-    const QSizeF viewportSize(width * m_documentScale, height * m_documentScale);
-
-    QImage image((viewportSize * dpr).toSize(), QImage::Format_ARGB32);
-    image.setDevicePixelRatio(dpr);
-    image.fill(Qt::transparent);
-
-    QPainter paint;
-    paint.begin(&image);
-    paint.scale(m_documentScale, m_documentScale);
-    paint.translate(-x, -y);
-    paint.setRenderHint(QPainter::Antialiasing);
-    paint.setRenderHint(QPainter::TextAntialiasing);
+    const int nrRows = qCeil(contentSize.height() / TextDocumentTileSize);
+    const int nrColumns = qCeil(contentSize.width() / TextDocumentTileSize);
+    const int fromRow = qFloor(viewportRect.top() / TextDocumentTileSize);
+    const int toRow = qMin(qCeil(viewportRect.bottom() / TextDocumentTileSize), nrRows) - 1;
+    const qreal x = qMax((this->width() - contentSize.width()) / 2, 0.0);
+
+    TextDocumentTileKey key;
+    key.scale = m_documentScale;
+    key.devicePixelRatio = dpr;
+    key.textWidth = documentSize.width();
+    key.revision = m_documentRevision;
+
+    // Only tiles that are not in the cache are rendered now, everything else is reused as is.
+    QList<TextDocumentViewportItem::Tile> tiles;
+    for (int row = fromRow; row <= toRow; row++) {
+        for (int column = 0; column < nrColumns; column++) {
+            key.row = row;
+            key.column = column;
+
+            const QRectF documentRect = key.documentRect(documentSize);
+
+            TextDocumentViewportItem::Tile tile;
+            tile.key = key;
+            tile.rect = QRectF(x + documentRect.x() * m_documentScale,
+                               documentRect.y() * m_documentScale,
+                               documentRect.width() * m_documentScale,
+                               documentRect.height() * m_documentScale);
+
+            if (const QImage *image = m_tileCache->tiles.object(key))
+                tile.image = *image;
+            else {
+                tile.image = createTileImage(tile.rect.size(), dpr);
+
+                QPainter painter(&tile.image);
+                drawTile(&painter, m_document, documentRect, m_documentScale);
+                painter.end();
+
+                m_tileCache->insert(key, tile.image);
+            }
+
+            tiles.append(tile);
+        }
+    }
 
-    QAbstractTextDocumentLayout *layout = m_document->documentLayout();
+    m_viewportItem->setTiles(tiles);
+    m_viewportItem->setPosition(QPointF(0, 0));
+    m_viewportItem->setSize(QSizeF(this->width(), this->height()));
+    m_viewportItem->setVisible(true);
 
-    QAbstractTextDocumentLayout::PaintContext ctx;
-    ctx.clip = rect;
-    layout->draw(&paint, ctx);
+    this->prefetchTiles(qMax(fromRow - TextDocumentPrefetchRows, 0),
+                        qMin(toRow + TextDocumentPrefetchRows, nrRows - 1));
+}
 
-    paint.end();
+void TextDocumentItem::prefetchTiles(int fromRow, int toRow)
+{
+    const qreal dpr = this->window() ? this->window()->devicePixelRatio() : 1.0;
+    const QSizeF documentSize(m_document->textWidth(), m_document->size().height());
+    const int nrColumns = qCeil(documentSize.width() * m_documentScale / TextDocumentTileSize);
+
+    TextDocumentTileKey key;
+    key.scale = m_documentScale;
+    key.devicePixelRatio = dpr;
+    key.textWidth = documentSize.width();
+    key.revision = m_documentRevision;
+
+    for (int row = fromRow; row <= toRow; row++) {
+        for (int column = 0; column < nrColumns; column++) {
+            key.row = row;
+            key.column = column;
+            if (m_tileCache->tiles.contains(key) || m_tileCache->pending.contains(key))
+                continue;
+
+            // QTextDocument can only be used from the GUI thread. Recording a tile is cheap,
+            // rasterizing it is what takes time, and that happens on a worker thread.
+            const QRectF documentRect = key.documentRect(documentSize);
+            const QSizeF tileSize = documentRect.size() * m_documentScale;
+
+            QPicture picture;
+            QPainter painter(&picture);
+            drawTile(&painter, m_document, documentRect, m_documentScale);
+            painter.end();
+
+            m_tileCache->pending.insert(key);
+
+            QFutureWatcher<QImage> *watcher = new QFutureWatcher<QImage>(this);
+            connect(watcher, &QFutureWatcher<QImage>::finished, this, [=]() {
+                m_tileCache->pending.remove(key);
+                if (key.revision == m_documentRevision)
+                    m_tileCache->insert(key, watcher->result());
+                watcher->deleteLater();
+            });
+            watcher->setFuture(QtConcurrent::run(rasterizeTile, picture, tileSize, dpr));
+        }
+    }
+}
 
-    m_viewportItem->setViewportImage(image);
+void TextDocumentItem::onDocumentContentsChange(int position, int charsRemoved, int charsAdded)
+{
+    Q_UNUSED(charsRemoved)
+    Q_UNUSED(charsAdded)
 
-    m_viewportItem->setX(qMax((this->width() - viewportSize.width()) / 2, 0.0));
-    m_viewportItem->setY(contentY);
-    m_viewportItem->setWidth(viewportSize.width());
-    m_viewportItem->setHeight(viewportSize.height());
-    m_viewportItem->setVisible(true);
+    m_dirtyFromPosition =
+            m_dirtyFromPosition < 0 ? position : qMin(m_dirtyFromPosition, position);
 }
 
 void TextDocumentItem::onDocumentChanged()
@@ -203,17 +435,63 @@ void TextDocumentItem::onDocumentChanged()
     if (qFuzzyIsNull(m_document->textWidth()))
         m_document->setTextWidth(this->width());
     this->setHeight(qCeil(m_document->size().height() * m_documentScale));
+
+    if (m_dirtyFromPosition >= 0) {
+        // Everything from the top of the outermost frame containing the change may have moved.
+        qreal dirtyFromY = 0;
+        const QTextBlock block = m_document->findBlock(m_dirtyFromPosition);
+        if (block.isValid()) {
+            QAbstractTextDocumentLayout *layout = m_document->documentLayout();
+            QTextFrame *frame = QTextCursor(block).currentFrame();
+            while (frame && frame->parentFrame() && frame->parentFrame()->parentFrame())
+                frame = frame->parentFrame();
+
+            dirtyFromY = frame && frame->parentFrame() ? layout->frameBoundingRect(frame).top()
+                                                       : layout->blockBoundingRect(block).top();
+        }
+
+        m_tileCache->invalidate(m_documentRevision, m_documentRevision + 1, dirtyFromY);
+        ++m_documentRevision;
+        m_dirtyFromPosition = -1;
+    }
+
     this->updateViewport();
 }
 
 TextDocumentViewportItem::TextDocumentViewportItem(TextDocumentItem *parent)
-    : QQuickPaintedItem(parent)
+    : QQuickItem(parent)
 {
+    this->setFlag(ItemHasContents, true);
 }
 
 TextDocumentViewportItem::~TextDocumentViewportItem() { }
 
-void TextDocumentViewportItem::paint(QPainter *painter)
+QSGNode *TextDocumentViewportItem::updatePaintNode(QSGNode *oldNode, UpdatePaintNodeData *)
 {
-    painter->drawImage(0, 0, m_image);
+    QSGNode *rootNode = oldNode ? oldNode : new QSGNode;
+
+    // Nodes of tiles that are still shown keep their textures, only new tiles are uploaded.
+    QHash<TextDocumentTileKey, TextDocumentTileNode *> oldTileNodes;
+    while (QSGNode *childNode = rootNode->firstChild()) {
+        rootNode->removeChildNode(childNode);
+        TextDocumentTileNode *tileNode = static_cast<TextDocumentTileNode *>(childNode);
+        oldTileNodes.insert(tileNode->key, tileNode);
+    }
+
+    for (const Tile &tile : qAsConst(m_tiles)) {
+        TextDocumentTileNode *tileNode = oldTileNodes.take(tile.key);
+        if (tileNode == nullptr) {
+            tileNode = new TextDocumentTileNode;
+            tileNode->key = tile.key;
+            tileNode->setFiltering(QSGTexture::Linear);
+            tileNode->setTexture(this->window()->createTextureFromImage(tile.image));
+        }
+
+        tileNode->setRect(tile.rect);
+        rootNode->appendChildNode(tileNode);
+    }
+
+    qDeleteAll(oldTileNodes);
+
+    return rootNode;
 }
@@ -17,7 +17,15 @@
 #include <QQuickItem>
 #include <QTextDocument>
 
+struct TextDocumentTileCache;
 class TextDocumentViewportItem;
+
+/**
+ * Shows a QTextDocument within a flickable. The document is rendered in square tiles, which are
+ * cached and uploaded as textures, so that scrolling only renders tiles that were not visible
+ * before. Edits invalidate tiles from the top of the changed frame downwards. Tiles just above
+ * and below the viewport are rendered ahead of time on a worker thread.
+ */
 class TextDocumentItem : public QQuickItem
 {
     Q_OBJECT
@@ -55,6 +63,8 @@ public:
 private:
     void updateViewport();
     void onDocumentChanged();
+    void onDocumentContentsChange(int position, int charsRemoved, int charsAdded);
+    void prefetchTiles(int fromRow, int toRow);
 
 private:
     bool m_invertColors = false;
@@ -65,6 +75,9 @@ private:
     QTimer *m_viewportUpdateHandler = nullptr;
     QTimer *m_documentChangeHandler = nullptr;
     TextDocumentViewportItem *m_viewportItem = nullptr;
+    TextDocumentTileCache *m_tileCache = nullptr;
+    int m_documentRevision = 0;
+    int m_dirtyFromPosition = -1;
 };
 
 #endif // TEXTDOCUMENTITEM_H
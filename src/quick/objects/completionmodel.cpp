@@ -15,6 +15,7 @@
 #include "timeprofiler.h"
 #include "application.h"
 
+#include <QSet>
 #include <QKeyEvent>
 #include <QtConcurrentRun>
 #include <QGuiApplication>
@@ -41,6 +42,8 @@ CompletionModel::CompletionModel(QObject *parent) : QAbstractListModel(parent)
             &CompletionModel::currentCompletionChanged);
     connect(this, &QAbstractListModel::rowsRemoved, this,
             &CompletionModel::currentCompletionChanged);
+    connect(this, &QAbstractListModel::dataChanged, this,
+            &CompletionModel::currentCompletionChanged);
     connect(this, &QAbstractListModel::modelReset, this,
             &CompletionModel::currentCompletionChanged);
 }
@@ -55,7 +58,7 @@ void CompletionModel::setStrings(const QStringList &val)
     m_strings = val;
     emit stringsChanged();
 
-    this->prepareStrings();
+    this->updateStrings();
 }
 
 void CompletionModel::setPriorityStrings(QStringList val)
@@ -240,38 +243,53 @@ void CompletionModel::setCurrentRow(int val)
 
 void CompletionModel::filterStrings()
 {
+    PROFILE_THIS_FUNCTION;
+
     if (!m_enabled || m_completionPrefix.size() < m_minimumCompletionPrefixLength
-        || m_strings2.isEmpty()) {
+        || m_completions.isEmpty()) {
         this->clearFilterStrings();
         return;
     }
 
-    bool someFilteringHappened = false;
-    QStringList fstrings;
-    if (m_completionPrefix.isEmpty())
-        fstrings = m_strings2;
-    else {
-        if (m_completionPrefix.isEmpty())
-            fstrings = m_strings2;
-        // if an exact match was found, then clear the completion model
-        // even if there is another potential match possible.
-        else if (m_strings2.contains(m_completionPrefix, Qt::CaseInsensitive))
-            fstrings.clear();
-        else
-            std::copy_if(m_strings2.begin(), m_strings2.end(), std::back_inserter(fstrings),
-                         [&](const QString &item) {
-                             const bool ret =
-                                     item.startsWith(m_completionPrefix, Qt::CaseInsensitive);
-                             someFilteringHappened |= !ret;
-                             return ret;
-                         });
+    // Completions of a prefix form a contiguous range in m_completions.
+    const QString prefixKey = m_completionPrefix.toCaseFolded();
+    auto begin = std::lower_bound(
+            m_completions.constBegin(), m_completions.constEnd(), prefixKey,
+            [](const Completion &item, const QString &key) { return item.key < key; });
+
+    // if an exact match was found, then clear the completion model
+    // even if there is another potential match possible.
+    if (!prefixKey.isEmpty() && begin != m_completions.constEnd() && begin->key == prefixKey) {
+        this->clearFilterStrings();
+        return;
     }
 
-    this->beginResetModel();
-    m_filteredStrings = fstrings.isEmpty() ? fstrings
-            : m_maxVisibleItems > 0        ? fstrings.mid(0, m_maxVisibleItems)
-                                           : fstrings;
-    this->endResetModel();
+    auto end = std::partition_point(
+            begin, m_completions.constEnd(),
+            [&prefixKey](const Completion &item) { return item.key.startsWith(prefixKey); });
+
+    QVector<const Completion *> matches;
+    matches.reserve(int(std::distance(begin, end)));
+    for (auto it = begin; it != end; ++it)
+        matches.append(&(*it));
+
+    const bool someFilteringHappened = matches.size() < m_completions.size();
+
+    // Only as many matches as can be shown need to be ranked.
+    const int nrMatches = m_maxVisibleItems > 0 ? qMin(m_maxVisibleItems, matches.size())
+                                                : matches.size();
+    std::partial_sort(matches.begin(), matches.begin() + nrMatches, matches.end(),
+                      [](const Completion *a, const Completion *b) {
+                          return a->rank < b->rank
+                                  || (a->rank == b->rank && a->string < b->string);
+                      });
+
+    QStringList fstrings;
+    fstrings.reserve(nrMatches);
+    for (int i = 0; i < nrMatches; i++)
+        fstrings.append(matches.at(i)->string);
+
+    this->setFilteredStrings(fstrings);
 
     if (m_filteredStrings.isEmpty() || !someFilteringHappened)
         this->setCurrentRow(-1);
@@ -281,41 +299,119 @@ void CompletionModel::filterStrings()
 
 void CompletionModel::prepareStrings()
 {
-    m_strings2.clear();
-    m_priorityStrings2.clear();
+    m_priorityRanks.clear();
+    for (int i = 0; i < m_priorityStrings.size(); i++) {
+        const QString key = m_priorityStrings.at(i).toCaseFolded();
+        if (!m_priorityRanks.contains(key))
+            m_priorityRanks.insert(key, i - m_priorityStrings.size());
+    }
 
-    if (m_acceptEnglishStringsOnly)
-        std::copy_if(m_strings.begin(), m_strings.end(), std::back_inserter(m_strings2),
-                     isEnglishString);
-    else
-        m_strings2 = m_strings;
-    m_strings2.removeDuplicates();
-
-    std::copy_if(m_priorityStrings.begin(), m_priorityStrings.end(),
-                 std::back_inserter(m_priorityStrings2), [=](const QString &item) {
-                     return m_strings2.contains(item, Qt::CaseInsensitive);
-                 });
-    m_priorityStrings2.removeDuplicates();
-
-    if (m_sortStrings)
-        std::sort(m_strings2.begin(), m_strings2.end());
-
-    for (int i = m_priorityStrings2.size() - 1; i >= 0; i--) {
-        const QString priorityString2 = m_priorityStrings2.at(i);
-        m_strings2.removeOne(priorityString2);
-        m_strings2.prepend(priorityString2);
+    m_completions.clear();
+    this->updateStrings();
+}
+
+void CompletionModel::updateStrings()
+{
+    PROFILE_THIS_FUNCTION;
+
+    // Strings often change by just a few items, for example when a character is added
+    // to the screenplay. So only new strings are case folded and sorted, before being
+    // merged with the ones already known.
+    QHash<QString, int> positions;
+    positions.reserve(m_strings.size());
+    for (const QString &string : qAsConst(m_strings)) {
+        if (!positions.contains(string) && this->acceptsString(string))
+            positions.insert(string, positions.size());
+    }
+
+    QSet<QString> knownStrings;
+    knownStrings.reserve(m_completions.size());
+
+    int nrKnown = 0;
+    for (int i = 0; i < m_completions.size(); i++) {
+        if (!positions.contains(m_completions.at(i).string))
+            continue;
+
+        knownStrings.insert(m_completions.at(i).string);
+        if (nrKnown != i)
+            m_completions[nrKnown] = m_completions.at(i);
+        ++nrKnown;
+    }
+    m_completions.resize(nrKnown);
+
+    for (auto it = positions.constBegin(); it != positions.constEnd(); ++it) {
+        if (knownStrings.contains(it.key()))
+            continue;
+
+        Completion completion;
+        completion.key = it.key().toCaseFolded();
+        completion.string = it.key();
+        m_completions.append(completion);
     }
 
+    auto lessThan = [](const Completion &a, const Completion &b) {
+        return a.key < b.key || (a.key == b.key && a.string < b.string);
+    };
+    std::sort(m_completions.begin() + nrKnown, m_completions.end(), lessThan);
+    std::inplace_merge(m_completions.begin(), m_completions.begin() + nrKnown,
+                       m_completions.end(), lessThan);
+
+    for (Completion &completion : m_completions)
+        completion.rank = m_priorityRanks.value(
+                completion.key, m_sortStrings ? 0 : positions.value(completion.string));
+
     this->filterStrings();
 }
 
 void CompletionModel::clearFilterStrings()
 {
-    if (!m_filteredStrings.isEmpty()) {
-        this->beginResetModel();
-        m_filteredStrings.clear();
-        this->endResetModel();
+    this->setFilteredStrings(QStringList());
+    this->setCurrentRow(-1);
+}
+
+void CompletionModel::setFilteredStrings(const QStringList &val)
+{
+    if (m_filteredStrings == val)
+        return;
+
+    // Report only rows that actually changed, so that views showing completions
+    // don't have to recreate all their delegates on every key stroke.
+    const int oldSize = m_filteredStrings.size();
+    const int newSize = val.size();
+
+    int head = 0;
+    while (head < oldSize && head < newSize && m_filteredStrings.at(head) == val.at(head))
+        ++head;
+
+    int tail = 0;
+    while (tail < oldSize - head && tail < newSize - head
+           && m_filteredStrings.at(oldSize - tail - 1) == val.at(newSize - tail - 1))
+        ++tail;
+
+    const int nrOldRows = oldSize - head - tail;
+    const int nrNewRows = newSize - head - tail;
+    const int nrReplacedRows = qMin(nrOldRows, nrNewRows);
+
+    if (nrOldRows > nrNewRows) {
+        this->beginRemoveRows(QModelIndex(), head + nrReplacedRows, head + nrOldRows - 1);
+        m_filteredStrings.erase(m_filteredStrings.begin() + head + nrReplacedRows,
+                                m_filteredStrings.begin() + head + nrOldRows);
+        this->endRemoveRows();
+    } else if (nrNewRows > nrOldRows) {
+        this->beginInsertRows(QModelIndex(), head + nrReplacedRows, head + nrNewRows - 1);
+        for (int i = nrReplacedRows; i < nrNewRows; i++)
+            m_filteredStrings.insert(head + i, val.at(head + i));
+        this->endInsertRows();
     }
 
-    this->setCurrentRow(-1);
+    if (nrReplacedRows > 0) {
+        for (int i = 0; i < nrReplacedRows; i++)
+            m_filteredStrings[head + i] = val.at(head + i);
+        emit dataChanged(this->index(head), this->index(head + nrReplacedRows - 1));
+    }
+}
+
+bool CompletionModel::acceptsString(const QString &string) const
+{
+    return !m_acceptEnglishStringsOnly || isEnglishString(string);
 }
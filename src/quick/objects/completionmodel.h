@@ -14,8 +14,10 @@
 #ifndef COMPLETIONMODEL_H
 #define COMPLETIONMODEL_H
 
-#include <QAbstractListModel>
+#include <QHash>
+#include <QVector>
 #include <QQmlEngine>
+#include <QAbstractListModel>
 
 class CompletionModel : public QAbstractListModel
 {
@@ -105,7 +107,10 @@ protected:
 private:
     void filterStrings();
     void prepareStrings();
+    void updateStrings();
     void clearFilterStrings();
+    void setFilteredStrings(const QStringList &val);
+    bool acceptsString(const QString &string) const;
 
 private:
     int m_currentRow = -1;
@@ -116,9 +121,19 @@ private:
     bool m_sortStrings = true;
     int m_maxVisibleItems = 7;
     QString m_completionPrefix;
-    QStringList m_strings2;
-    QStringList m_priorityStrings2;
     QStringList m_filteredStrings;
+
+    // Accepted strings, sorted by their case folded form, so that all completions of a
+    // prefix are found with a binary search. Rank orders completions for display:
+    // priority strings come first, followed by others in sorted or given order.
+    struct Completion
+    {
+        QString key;
+        QString string;
+        int rank = 0;
+    };
+    QVector<Completion> m_completions;
+    QHash<QString, int> m_priorityRanks;
     bool m_filterKeyStrokes = false;
     bool m_acceptEnglishStringsOnly = true;
     int m_minimumCompletionPrefixLength = 0;
@@ -21,10 +21,171 @@
 #include "application.h"
 #include "scritedocument.h"
 
+#include <QMutex>
+#include <QPointer>
 #include <QTextTable>
 #include <QScopeGuard>
 #include <QTextCursor>
 #include <QTextDocument>
+#include <QAbstractTextDocumentLayout>
+
+/**
+ * Measures scenes one at a time in a small text document laid out with the print format, and
+ * keeps the results until the scene (or the format) is modified. Reports are constructed afresh
+ * each time they are generated, so this lives for the duration of the process.
+ *
+ * Reports may be generated off the GUI thread, so callers must hold mutex() for as long as
+ * they set the format and read metrics.
+ */
+class StatisticsReportSceneMetricsCache : public QObject
+{
+public:
+    StatisticsReportSceneMetricsCache() { }
+    ~StatisticsReportSceneMetricsCache() { }
+
+    QMutex *mutex() { return &m_mutex; }
+
+    void setFormat(const ScreenplayFormat *format, qreal pageWidth);
+    StatisticsReport::SceneMetrics metrics(const Scene *scene);
+
+private:
+    StatisticsReport::SceneMetrics measure(const Scene *scene) const;
+
+private:
+    QMutex m_mutex;
+    qreal m_pageWidth = 0;
+    int m_formatModificationTime = -1;
+    QPointer<const ScreenplayFormat> m_format;
+    QHash<const Scene *, StatisticsReport::SceneMetrics> m_metrics;
+};
+
+Q_GLOBAL_STATIC(StatisticsReportSceneMetricsCache, GlobalSceneMetricsCache)
+
+void StatisticsReportSceneMetricsCache::setFormat(const ScreenplayFormat *format, qreal pageWidth)
+{
+    if (m_format == format && m_formatModificationTime == format->modificationTime()
+        && m_pageWidth == pageWidth)
+        return;
+
+    m_format = format;
+    m_pageWidth = pageWidth;
+    m_formatModificationTime = format->modificationTime();
+    m_metrics.clear();
+}
+
+StatisticsReport::SceneMetrics StatisticsReportSceneMetricsCache::metrics(const Scene *scene)
+{
+    auto it = m_metrics.find(scene);
+    if (it == m_metrics.end()) {
+        // Only the pointer value is used once the scene is gone, it is never dereferenced.
+        connect(
+                scene, &QObject::destroyed, this,
+                [=]() {
+                    QMutexLocker locker(&m_mutex);
+                    m_metrics.remove(scene);
+                },
+                Qt::DirectConnection);
+        it = m_metrics.insert(scene, this->measure(scene));
+    } else if (it->modificationTime != scene->modificationTime()
+               || it->headingEnabled != scene->heading()->isEnabled()
+               || it->elementCount != scene->elementCount())
+        *it = this->measure(scene);
+
+    return it.value();
+}
+
+StatisticsReport::SceneMetrics StatisticsReportSceneMetricsCache::measure(const Scene *scene) const
+{
+    StatisticsReport::SceneMetrics ret;
+    ret.modificationTime = scene->modificationTime();
+    ret.headingEnabled = scene->heading()->isEnabled();
+    ret.elementCount = scene->elementCount();
+    if (ret.headingEnabled)
+        ret.location = scene->heading()->location();
+
+    const QStringList characterNames = scene->characterNames();
+    for (const QString &name : characterNames)
+        ret.characterPresence.insert(name.toUpper(), scene->characterPresence(name) + 2);
+
+    if (m_format.isNull())
+        return ret;
+
+    const ScreenplayFormat *format = m_format;
+    const qreal pageWidth = m_pageWidth;
+
+    QTextDocument document;
+    document.setUseDesignMetrics(true);
+    document.setTextWidth(pageWidth);
+    document.setDefaultFont(format->defaultFont());
+
+    QTextCursor cursor(&document);
+    auto prepareCursor = [=](QTextCursor &cursor, SceneElement::Type paraType,
+                             Qt::Alignment overrideAlignment) {
+        const SceneElementFormat *eformat = format->elementFormat(paraType);
+        QTextBlockFormat blockFormat = eformat->createBlockFormat(overrideAlignment, &pageWidth);
+        QTextCharFormat charFormat = eformat->createCharFormat(&pageWidth);
+        cursor.setCharFormat(charFormat);
+        cursor.setBlockFormat(blockFormat);
+    };
+
+    auto polishFontsAndInsertTextAtCursor = [](QTextCursor &cursor, const QString &text) {
+        TransliterationEngine::instance()->evaluateBoundariesAndInsertText(cursor, text);
+    };
+
+    QList<QPair<SceneElement::Type, QTextBlock>> blocks;
+    QHash<const SceneElement *, QTextBlock> paraBlocks;
+
+    if (ret.headingEnabled) {
+        prepareCursor(cursor, SceneElement::Heading, Qt::Alignment());
+        polishFontsAndInsertTextAtCursor(cursor, scene->heading()->text());
+        blocks.append(qMakePair(SceneElement::Heading, cursor.block()));
+    }
+
+    for (int p = 0; p < scene->elementCount(); p++) {
+        if (cursor.position() > 0)
+            cursor.insertBlock();
+
+        const SceneElement *para = scene->elementAt(p);
+        prepareCursor(cursor, para->type(), para->alignment());
+        polishFontsAndInsertTextAtCursor(cursor, para->text());
+        blocks.append(qMakePair(para->type(), cursor.block()));
+        paraBlocks.insert(para, cursor.block());
+    }
+
+    if (blocks.isEmpty())
+        return ret;
+
+    QAbstractTextDocumentLayout *layout = document.documentLayout();
+    for (const auto &block : qAsConst(blocks)) {
+        const qreal paraHeight = layout->blockBoundingRect(block.second).height();
+
+        ret.typeCounts[block.first] += 1;
+        ret.typeLengths[block.first] += paraHeight;
+        ret.paragraphsLength += paraHeight;
+        if (paraHeight > 0)
+            ret.minParagraphLength = qFuzzyIsNull(ret.minParagraphLength)
+                    ? paraHeight
+                    : qMin(paraHeight, ret.minParagraphLength);
+    }
+
+    const QRectF firstBlockRect = layout->blockBoundingRect(blocks.first().second);
+    const QRectF lastBlockRect = layout->blockBoundingRect(blocks.last().second);
+    ret.spanLength = qMax(lastBlockRect.bottom() - firstBlockRect.top(), 0.0);
+
+    const auto dialogues = scene->dialogueElements();
+    auto it = dialogues.constBegin();
+    auto end = dialogues.constEnd();
+    while (it != end) {
+        QPair<int, qreal> &dialogue = ret.dialogues[it.key()];
+        for (const SceneElement *para : it.value()) {
+            dialogue.first += 1;
+            dialogue.second += layout->blockBoundingRect(paraBlocks.value(para)).height();
+        }
+        ++it;
+    }
+
+    return ret;
+}
 
 StatisticsReport::StatisticsReport(QObject *parent) : AbstractReportGenerator(parent) { }
 
@@ -134,33 +295,20 @@ QList<StatisticsReport::Distribution> StatisticsReport::textDistribution(bool co
     QList<StatisticsReport::Distribution> ret;
 
     QMap<SceneElement::Type, StatisticsReport::Distribution> map;
-    if (m_textBlockMap.isEmpty() || m_textDocument.isEmpty())
+    if (m_sceneMetrics.isEmpty())
         return ret;
 
-    auto add = [&map](SceneElement::Type type, qreal pixelLength) {
-        auto distribution = map.value(type);
-        distribution.count += 1;
-        distribution.pixelLength += pixelLength;
-        map.insert(type, distribution);
-    };
-
     {
         // First, lets sum up pixel lengths of all paragraph types.
-        auto it = m_textBlockMap.constBegin();
-        auto end = m_textBlockMap.constEnd();
-        while (it != end) {
-            const QObject *object = it.key();
-            const SceneElement *paragraph = qobject_cast<const SceneElement *>(object);
-            if (paragraph) {
-                if (paragraph)
-                    add(paragraph->type(), this->pixelLength(paragraph));
-            } else {
-                const SceneHeading *heading = qobject_cast<const SceneHeading *>(object);
-                if (heading)
-                    add(SceneElement::Heading, this->pixelLength(heading));
+        for (const SceneMetrics &metrics : m_sceneMetrics) {
+            auto it = metrics.typeLengths.constBegin();
+            auto end = metrics.typeLengths.constEnd();
+            while (it != end) {
+                Distribution &distribution = map[it.key()];
+                distribution.count += metrics.typeCounts.value(it.key());
+                distribution.pixelLength += it.value();
+                ++it;
             }
-
-            ++it;
         }
 
         if (compact) {
@@ -209,16 +357,13 @@ QList<StatisticsReport::Distribution> StatisticsReport::dialogueDistribution() c
         if (scene == nullptr || element->isOmitted())
             continue;
 
-        auto dialogues = scene->dialogueElements();
-        auto it = dialogues.constBegin();
-        auto end = dialogues.constEnd();
+        const SceneMetrics metrics = m_sceneMetrics.value(scene);
+        auto it = metrics.dialogues.constBegin();
+        auto end = metrics.dialogues.constEnd();
         while (it != end) {
-            auto paragraphs = it.value();
-            for (auto paragraph : qAsConst(paragraphs)) {
-                Distribution &dist = map[it.key()];
-                dist.pixelLength += this->pixelLength(paragraph);
-                dist.count++;
-            }
+            Distribution &dist = map[it.key()];
+            dist.count += it.value().first;
+            dist.pixelLength += it.value().second;
             ++it;
         }
     }
@@ -408,8 +553,8 @@ QList<StatisticsReport::Distribution> StatisticsReport::episodeDistribution() co
 
 bool StatisticsReport::doGenerate(QTextDocument *textDocument)
 {
-    auto guard = qScopeGuard([=]() { this->cleanupTextDocument(); });
-    this->prepareTextDocument();
+    auto guard = qScopeGuard([=]() { this->cleanupSceneMetrics(); });
+    this->prepareSceneMetrics();
 
     /**
      * This function is called to generate report into ODT files.
@@ -543,8 +688,8 @@ bool StatisticsReport::usePdfWriter() const
 
 bool StatisticsReport::directPrintToPdf(QPdfWriter *pdfWriter)
 {
-    auto guard = qScopeGuard([=]() { this->cleanupTextDocument(); });
-    this->prepareTextDocument();
+    auto guard = qScopeGuard([=]() { this->cleanupSceneMetrics(); });
+    this->prepareSceneMetrics();
 
     const Screenplay *screenplay = this->document()->screenplay();
 
@@ -559,10 +704,10 @@ bool StatisticsReport::directPrintToPdf(QPdfWriter *pdfWriter)
     return ret;
 }
 
-void StatisticsReport::prepareTextDocument()
+void StatisticsReport::prepareSceneMetrics()
 {
     HourGlass hourGlass;
-    this->cleanupTextDocument();
+    this->cleanupSceneMetrics();
 
     const Screenplay *screenplay = this->document()->screenplay();
     const ScreenplayFormat *format = this->document()->printFormat();
@@ -570,194 +715,92 @@ void StatisticsReport::prepareTextDocument()
     m_pageHeight = qCeil(format->pageLayout()->contentRect().height());
     m_millisecondsPerPixel = (format->secondsPerPage() * 1000) / m_pageHeight;
 
-    m_textDocument.setUseDesignMetrics(true);
-    m_textDocument.setTextWidth(pageWidth);
-    m_textDocument.setDefaultFont(format->defaultFont());
-
-    QTextCursor cursor(&m_textDocument);
-    auto prepareCursor = [=](QTextCursor &cursor, SceneElement::Type paraType,
-                             Qt::Alignment overrideAlignment) {
-        const SceneElementFormat *eformat = format->elementFormat(paraType);
-        QTextBlockFormat blockFormat = eformat->createBlockFormat(overrideAlignment, &pageWidth);
-        QTextCharFormat charFormat = eformat->createCharFormat(&pageWidth);
-        cursor.setCharFormat(charFormat);
-        cursor.setBlockFormat(blockFormat);
-    };
-
-    auto polishFontsAndInsertTextAtCursor = [](QTextCursor &cursor, const QString &text) {
-        TransliterationEngine::instance()->evaluateBoundariesAndInsertText(cursor, text);
-    };
+    StatisticsReportSceneMetricsCache *cache = GlobalSceneMetricsCache;
+    QMutexLocker cacheLocker(cache->mutex());
+    cache->setFormat(format, pageWidth);
 
+    // Only scenes modified since the last report are measured again, rest come from the cache.
     const int nrElements = screenplay->elementCount();
+    m_lineHeight = m_pageHeight;
     for (int i = 0; i < nrElements; i++) {
         const ScreenplayElement *element = screenplay->elementAt(i);
-        if (element->scene() == nullptr || element->isOmitted())
-            continue;
-
         const Scene *scene = element->scene();
-        if (scene->heading()->isEnabled()) {
-            if (cursor.position() > 0)
-                cursor.insertBlock();
-            prepareCursor(cursor, SceneElement::Heading, Qt::Alignment());
-            polishFontsAndInsertTextAtCursor(cursor, scene->heading()->text());
-            m_textBlockMap.insert(scene->heading(), cursor.block());
-        }
-
-        for (int p = 0; p < scene->elementCount(); p++) {
-            if (cursor.position() > 0)
-                cursor.insertBlock();
+        if (scene == nullptr || element->isOmitted() || m_sceneMetrics.contains(scene))
+            continue;
 
-            const SceneElement *para = scene->elementAt(p);
-            prepareCursor(cursor, para->type(), para->alignment());
-            polishFontsAndInsertTextAtCursor(cursor, para->text());
-            m_textBlockMap.insert(para, cursor.block());
-        }
+        const SceneMetrics metrics = cache->metrics(scene);
+        m_sceneMetrics.insert(scene, metrics);
+        m_paragraphsLength += metrics.paragraphsLength;
+        if (metrics.minParagraphLength > 0)
+            m_lineHeight = qMin(metrics.minParagraphLength, m_lineHeight);
     }
 
-    if (m_textDocument.isEmpty() || m_textBlockMap.isEmpty()) {
+    if (m_sceneMetrics.isEmpty() || qFuzzyIsNull(m_paragraphsLength)) {
         m_paragraphsLength = 0;
         m_lineHeight = 1;
         return;
     }
 
-    QAbstractTextDocumentLayout *layout = m_textDocument.documentLayout();
-    auto it = m_textBlockMap.constBegin();
-    auto end = m_textBlockMap.constEnd();
-    m_lineHeight = m_pageHeight;
-    while (it != end) {
-        const QTextBlock paraBlock = m_textBlockMap.value(it.key());
-        const QRectF paraBlockRect = layout->blockBoundingRect(paraBlock);
-        const qreal paraHeight = paraBlockRect.height();
-
-        m_paragraphsLength += paraHeight;
-        if (paraHeight > 0)
-            m_lineHeight = qMin(paraHeight, m_lineHeight);
-
-        ++it;
-    }
-
+    // Each scene is preceded by a blank line, just like it would be on paper.
     for (int i = 0; i < nrElements; i++) {
         const ScreenplayElement *element = screenplay->elementAt(i);
-        if (element->scene() == nullptr || element->isOmitted())
+        const Scene *scene = element->scene();
+        if (scene == nullptr || element->isOmitted())
             continue;
 
-        const Scene *scene = element->scene();
-        const QObject *para = scene->heading()->isEnabled() ? (QObject *)scene->heading()
-                                                            : (QObject *)scene->elementAt(0);
-        const QTextBlock block = m_textBlockMap.value(para);
-        if (block.isValid()) {
-            QTextCursor cursor(block);
-            cursor.select(QTextCursor::BlockUnderCursor);
-
-            QTextBlockFormat format;
-            format.setTopMargin(block.blockFormat().topMargin() + m_lineHeight);
-            cursor.mergeBlockFormat(format);
-        }
+        m_totalPixelLength += m_sceneMetrics.value(scene).spanLength + m_lineHeight;
     }
 }
 
-void StatisticsReport::cleanupTextDocument()
+void StatisticsReport::cleanupSceneMetrics()
 {
-    m_textBlockMap.clear();
-    m_textDocument.clear();
+    m_sceneMetrics.clear();
     m_pageHeight = 0;
     m_paragraphsLength = 0;
+    m_totalPixelLength = 0;
     m_millisecondsPerPixel = 0;
 }
 
-qreal StatisticsReport::pixelLength() const
-{
-    return m_textDocument.isEmpty() ? 0.0 : m_textDocument.size().height();
-}
-
 qreal StatisticsReport::pixelLength(const Scene *scene) const
 {
-    return scene ? qMax(this->boundingRect(scene).height(), 0.0) : 0;
-}
+    if (scene == nullptr || qFuzzyIsNull(m_pageHeight))
+        return 0;
 
-qreal StatisticsReport::pixelLength(const SceneHeading *heading) const
-{
-    return qMax(this->boundingRect(heading).height(), 0.0);
-}
+    auto it = m_sceneMetrics.constFind(scene);
+    if (it == m_sceneMetrics.constEnd() || it->elementCount == 0)
+        return 0;
 
-qreal StatisticsReport::pixelLength(const SceneElement *para) const
-{
-    return qMax(this->boundingRect(para).height(), 0.0);
+    return it->spanLength + 2 * m_lineHeight;
 }
 
 qreal StatisticsReport::pixelLength(const ScreenplayElement *element) const
 {
-    return qMax(this->boundingRect(element).height(), 0.0);
-}
-
-QRectF StatisticsReport::boundingRect(const Scene *scene) const
-{
-    QRectF nullRect;
-    if (scene == nullptr || m_textDocument.isEmpty() || qFuzzyIsNull(m_pageHeight))
-        return nullRect;
-
-    QTextBlock fromBlock, toBlock;
-
-    if (scene->heading()->isEnabled()) {
-        if (!m_textBlockMap.contains(scene->heading()))
-            return nullRect;
-
-        fromBlock = m_textBlockMap.value(scene->heading());
-        toBlock = fromBlock;
-    } else {
-        const SceneElement *firstPara = scene->elementAt(0);
-        if (firstPara == nullptr || !m_textBlockMap.contains(firstPara))
-            return nullRect;
-
-        fromBlock = m_textBlockMap.value(firstPara);
-        toBlock = fromBlock;
-    }
-
-    const SceneElement *lastPara = scene->elementAt(scene->elementCount() - 1);
-    if (!lastPara || !m_textBlockMap.contains(lastPara))
-        return nullRect;
-
-    toBlock = m_textBlockMap.value(lastPara);
-
-    QAbstractTextDocumentLayout *layout = m_textDocument.documentLayout();
-    const QRectF fromBlockRect = layout->blockBoundingRect(fromBlock);
-    const QRectF toBlockRect = layout->blockBoundingRect(toBlock);
-    return QRectF(fromBlockRect.topLeft(), toBlockRect.bottomRight() + QPointF(0, m_lineHeight));
-}
-
-QRectF StatisticsReport::boundingRectOfHeadingOrParagraph(const QObject *object) const
-{
-    QRectF nullRect;
-    if (object == nullptr || m_textDocument.isEmpty() || qFuzzyIsNull(m_pageHeight))
-        return nullRect;
-
-    if (!m_textBlockMap.contains(object))
-        return nullRect;
-
-    QAbstractTextDocumentLayout *layout = m_textDocument.documentLayout();
-    const QTextBlock paraBlock = m_textBlockMap.value(object);
-    const QRectF paraBlockRect = layout->blockBoundingRect(paraBlock);
-    return paraBlockRect;
-}
-
-QRectF StatisticsReport::boundingRect(const ScreenplayElement *element) const
-{
-    QRectF nullRect;
     if (element->scene())
-        return this->boundingRect(element->scene());
+        return this->pixelLength(element->scene());
 
     const Screenplay *screenplay = this->document()->screenplay();
     ScreenplayElement *ncelement = const_cast<ScreenplayElement *>(element);
     const QList<int> idxList = screenplay->sceneElementsInBreak(ncelement);
     if (idxList.isEmpty())
-        return nullRect;
+        return 0;
+
+    // The length of a scene includes a blank line on either side of it. Consecutive scenes in a
+    // break share the one between them, so it is counted only once.
+    qreal ret = 0;
+    int nrScenes = 0;
+    for (int idx : idxList) {
+        const ScreenplayElement *sceneElement = screenplay->elementAt(idx);
+        if (sceneElement == nullptr || sceneElement->isOmitted())
+            continue;
 
-    const QRectF firstRect = this->boundingRect(screenplay->elementAt(idxList.first()));
-    const QRectF lastRect = this->boundingRect(screenplay->elementAt(idxList.last()));
-    if (firstRect.isNull() || lastRect.isNull())
-        return nullRect;
+        const qreal sceneLength = this->pixelLength(sceneElement->scene());
+        if (sceneLength > 0) {
+            ret += sceneLength;
+            ++nrScenes;
+        }
+    }
 
-    return QRectF(firstRect.topLeft(), lastRect.bottomRight() + QPointF(0, m_lineHeight));
+    return nrScenes > 1 ? ret - (nrScenes - 1) * m_lineHeight : ret;
 }
 
 QTime StatisticsReport::pageLengthToTime(qreal val) const
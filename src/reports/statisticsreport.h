@@ -14,6 +14,7 @@
 #ifndef STATISTICSREPORT_H
 #define STATISTICSREPORT_H
 
+#include <QHash>
 #include <QTime>
 #include <QList>
 #include <QtMath>
@@ -153,9 +154,27 @@ protected:
 private:
     friend class StatisticsReportTimeline;
     friend class StatisticsReportKeyNumbers;
+    friend class StatisticsReportSceneMetricsCache;
 
-    void prepareTextDocument();
-    void cleanupTextDocument();
+    // Per-scene measurements, shared across reports and recomputed only when a scene changes
+    struct SceneMetrics
+    {
+        int modificationTime = -1;
+        bool headingEnabled = false;
+        int elementCount = 0;
+        qreal spanLength = 0; // from the top of the first block to the bottom of the last one
+        qreal paragraphsLength = 0;
+        qreal minParagraphLength = 0;
+        QString location;
+        QMap<SceneElement::Type, int> typeCounts;
+        QMap<SceneElement::Type, qreal> typeLengths;
+        QHash<QString, QPair<int, qreal>> dialogues; // character name -> (count, pixel length)
+        QHash<QString, int> characterPresence; // upper case character name -> presence
+    };
+    SceneMetrics sceneMetrics(const Scene *scene) const { return m_sceneMetrics.value(scene); }
+
+    void prepareSceneMetrics();
+    void cleanupSceneMetrics();
 
     qreal pageHeight() const { return m_pageHeight; }
 
@@ -164,14 +183,6 @@ private:
     {
         return this->pixelLengthToTime(this->pixelLength(scene));
     }
-    QTime timeLength(const SceneHeading *heading) const
-    {
-        return this->pixelLengthToTime(this->pixelLength(heading));
-    }
-    QTime timeLength(const SceneElement *para) const
-    {
-        return this->pixelLengthToTime(this->pixelLength(para));
-    }
     QTime timeLength(const ScreenplayElement *element) const
     {
         return this->pixelLengthToTime(this->pixelLength(element));
@@ -186,37 +197,15 @@ private:
     {
         return this->pageLength(this->pixelLength(scene));
     }
-    qreal pageLength(const SceneHeading *heading) const
-    {
-        return this->pageLength(this->pixelLength(heading));
-    }
-    qreal pageLength(const SceneElement *para) const
-    {
-        return this->pageLength(this->pixelLength(para));
-    }
     qreal pageLength(const ScreenplayElement *element) const
     {
         return this->pageLength(this->pixelLength(element));
     }
 
-    qreal pixelLength() const;
+    qreal pixelLength() const { return m_totalPixelLength; }
     qreal pixelLength(const Scene *scene) const;
-    qreal pixelLength(const SceneHeading *heading) const;
-    qreal pixelLength(const SceneElement *para) const;
     qreal pixelLength(const ScreenplayElement *element) const;
 
-    QRectF boundingRect(const Scene *scene) const;
-    QRectF boundingRect(const SceneHeading *heading) const
-    {
-        return this->boundingRectOfHeadingOrParagraph(heading);
-    }
-    QRectF boundingRect(const SceneElement *para) const
-    {
-        return this->boundingRectOfHeadingOrParagraph(para);
-    }
-    QRectF boundingRectOfHeadingOrParagraph(const QObject *object) const;
-    QRectF boundingRect(const ScreenplayElement *element) const;
-
     QTime pixelLengthToTime(qreal val) const
     {
         return this->pageLengthToTime(this->pageLength(val));
@@ -226,14 +215,14 @@ private:
     void polish(Distribution &report) const;
 
 private:
-    QTextDocument m_textDocument;
-    QMap<const QObject *, QTextBlock> m_textBlockMap;
+    QHash<const Scene *, SceneMetrics> m_sceneMetrics;
     qreal m_pageHeight = 0;
     qreal m_lineHeight = 0;
     qreal m_scaleFactor = 1.0;
     int m_maxLocationPresenceGraphs = 6;
     int m_maxCharacterPresenceGraphs = 6;
     qreal m_paragraphsLength = 0; // usually smaller than pageHeight
+    qreal m_totalPixelLength = 0;
     qreal m_millisecondsPerPixel = 0;
     QStringList m_locations;
     QStringList m_characterNames;
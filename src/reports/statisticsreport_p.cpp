@@ -925,10 +925,8 @@ StatisticsReportTimeline::evalCharacterPresence(const StatisticsReport *report)
             specificCharacterNames.isEmpty() ? allCharacterNames : specificCharacterNames;
 
     QList<QPair<QString, QList<int>>> ret = this->evalPresence(
-            report, characterNames, [](const Scene *scene, const QString &characterName) -> int {
-                return scene->hasCharacter(characterName)
-                        ? scene->characterPresence(characterName) + 2
-                        : 0;
+            report, characterNames, [report](const Scene *scene) -> QHash<QString, int> {
+                return report->sceneMetrics(scene).characterPresence;
             });
     if (!specificCharacterNames.isEmpty())
         ret = ret.mid(0, specificCharacterNames.size());
@@ -948,11 +946,15 @@ StatisticsReportTimeline::evalLocationPresence(const StatisticsReport *report) c
 
     QString lastLocation;
     QList<QPair<QString, QList<int>>> ret = this->evalPresence(
-            report, locations, [&lastLocation](const Scene *scene, const QString &location) -> int {
+            report, locations, [report, &lastLocation](const Scene *scene) -> QHash<QString, int> {
+                const StatisticsReport::SceneMetrics metrics = report->sceneMetrics(scene);
                 const QString sceneLocation =
-                        scene->heading()->isEnabled() ? scene->heading()->location() : lastLocation;
-                const int ret = sceneLocation == location ? 10 : 0;
+                        metrics.headingEnabled ? metrics.location : lastLocation;
                 lastLocation = sceneLocation;
+
+                QHash<QString, int> ret;
+                if (!sceneLocation.isEmpty())
+                    ret.insert(sceneLocation.toUpper(), 10);
                 return ret;
             });
 
@@ -966,7 +968,7 @@ StatisticsReportTimeline::evalLocationPresence(const StatisticsReport *report) c
 
 QList<QPair<QString, QList<int>>> StatisticsReportTimeline::evalPresence(
         const StatisticsReport *report, const QStringList &allNames,
-        std::function<int(const Scene *, const QString &)> determinePresenceFunc) const
+        std::function<QHash<QString, int>(const Scene *)> scenePresenceFunc) const
 {
     QList<QPair<QString, QList<int>>> ret;
 
@@ -974,22 +976,42 @@ QList<QPair<QString, QList<int>>> StatisticsReportTimeline::evalPresence(
     const QList<ScreenplayElement *> sceneElements = screenplay->getFilteredElements(
             [](ScreenplayElement *e) { return e->scene() != nullptr && !e->isOmitted(); });
 
-    for (const QString &name : allNames)
-        ret << qMakePair(name, QList<int>());
+    // Each scene reports only names present in it, so this costs scenes x names-per-scene
+    // instead of scenes x all-names. Absent names share the same list of zeros.
+    const QList<int> zeros = QVector<int>(sceneElements.size(), 0).toList();
+    QMultiHash<QString, int> nameIndexes;
+    for (int i = 0; i < allNames.size(); i++) {
+        ret << qMakePair(allNames.at(i), zeros);
+        nameIndexes.insert(allNames.at(i).toUpper(), i);
+    }
 
-    for (const auto sceneElement : sceneElements) {
-        auto scene = sceneElement->scene();
-        for (auto &pair : ret)
-            pair.second.append(determinePresenceFunc(scene, pair.first));
+    QVector<int> totals(allNames.size(), 0);
+    for (int s = 0; s < sceneElements.size(); s++) {
+        const QHash<QString, int> presence = scenePresenceFunc(sceneElements.at(s)->scene());
+        auto it = presence.constBegin();
+        auto end = presence.constEnd();
+        while (it != end) {
+            auto nit = nameIndexes.constFind(it.key());
+            while (nit != nameIndexes.constEnd() && nit.key() == it.key()) {
+                ret[nit.value()].second[s] = it.value();
+                totals[nit.value()] += it.value();
+                ++nit;
+            }
+            ++it;
+        }
     }
 
-    std::sort(ret.begin(), ret.end(),
-              [](const QPair<QString, QList<int>> &a, const QPair<QString, QList<int>> &b) {
-                  return std::accumulate(a.second.begin(), a.second.end(), 0)
-                          > std::accumulate(b.second.begin(), b.second.end(), 0);
-              });
+    QVector<int> order(allNames.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(),
+              [&totals](int a, int b) { return totals.at(a) > totals.at(b); });
 
-    return ret;
+    QList<QPair<QString, QList<int>>> sorted;
+    sorted.reserve(ret.size());
+    for (int idx : qAsConst(order))
+        sorted << ret.at(idx);
+
+    return sorted;
 }
 
 QGraphicsRectItem *StatisticsReportTimeline::createCharacterPresenceGraph(
@@ -17,6 +17,7 @@
 #include <QJsonArray>
 #include <QRegularExpression>
 #include <QTextBlock>
+#include <QTextCodec>
 #include <QTextDocument>
 #include <QtDebug>
 
@@ -25,7 +26,6 @@ static bool resolveEmphasis(const QString &input, QString &plainText,
                             QVector<QTextLayout::FormatRange> &formats);
 static bool encodeEmphasis(const QString &plainText,
                            const QVector<QTextLayout::FormatRange> &formats, QString &mdText);
-static QStringList sceneHeadingPrefixes();
 
 } // namespace Fountain
 
@@ -106,94 +106,480 @@ QJsonObject Fountain::Element::toJson() const
     return ret;
 }
 
-Fountain::Parser::Parser(const QString &content, int options) : m_options(options)
+namespace {
+
+inline bool isRegExpSpace(QChar ch)
 {
-    this->parseContents(content);
+    // What \s matches in QRegularExpression, without UseUnicodePropertiesOption
+    const ushort uc = ch.unicode();
+    return uc == ' ' || (uc >= '\t' && uc <= '\r');
 }
 
-Fountain::Parser::Parser(const QByteArray &content, int options) : m_options(options)
+inline bool isRegExpWordChar(QChar ch)
 {
-    this->parseContents(QString::fromUtf8(content));
+    const ushort uc = ch.unicode();
+    return (uc >= 'a' && uc <= 'z') || (uc >= 'A' && uc <= 'Z') || (uc >= '0' && uc <= '9')
+            || uc == '_';
 }
 
-Fountain::Parser::Parser(QIODevice *device, int options) : m_options(options)
+inline bool isWhitespaceOnly(QStringView text)
 {
-    if (device) {
-        if (!device->isOpen())
-            device->open(QIODevice::ReadOnly);
+    return std::all_of(text.begin(), text.end(), [](QChar ch) { return ch.isSpace(); });
+}
 
-        if (device->isOpen())
-            this->parseContents(QString::fromUtf8(device->readAll()));
+inline void append(QString &to, QStringView text)
+{
+    to.append(text.data(), text.size());
+}
 
-        device->close();
+inline QStringView leftTrimmed(QStringView text)
+{
+    int i = 0;
+    while (i < text.size() && text.at(i).isSpace())
+        ++i;
+    return text.mid(i);
+}
+
+bool isUpperCase(QStringView text)
+{
+    bool ascii = true;
+    for (const QChar ch : text) {
+        const ushort uc = ch.unicode();
+        if (uc >= 'a' && uc <= 'z')
+            return false;
+        ascii &= uc < 0x80;
     }
+
+    if (ascii)
+        return true;
+
+    // Some letters have no single character upper-case form, leave them to QString::toUpper()
+    const QString string = text.toString();
+    return string.toUpper() == string;
 }
 
-Fountain::Parser::~Parser() { }
+bool containsNonLatinLetters(QStringView text)
+{
+    for (const QChar ch : text) {
+        if (ch.unicode() >= 0x80 && ch.isLetter() && ch.script() != QChar::Script_Latin)
+            return true;
+    }
+    return false;
+}
 
-QJsonObject Fountain::Parser::toJson() const
+QString simplified(QStringView text)
 {
-    QJsonObject ret;
+    return text.toString().simplified();
+}
 
-    ret["#kind"] = "Fountain/Parser/Json";
-    ret["#standard"] = "https://fountain.io/syntax/";
+/*
+ * Lines like "CUT TO: INT. HOUSE - DAY" pack a transition and scene heading into one line.
+ * Returns index of the colon after which the line must be split, or -1.
+ * Equivalent to matching ^[A-Z ]*: *\b(INT|EXT|EST|INT\.?\/ ?EXT|I\/E)\b
+ */
+int transitionHeadingSplitIndex(QStringView line)
+{
+    int i = 0;
+    while (i < line.size() && (line.at(i) == QLatin1Char(' ') || line.at(i).isUpper())
+           && line.at(i).unicode() < 0x80)
+        ++i;
 
-    QJsonObject titlePage;
-    for (const QPair<QString, QString> &tuple : m_titlePage)
-        titlePage[tuple.first] = tuple.second;
-    if (!titlePage.isEmpty())
-        ret["titlePage"] = titlePage;
+    if (i >= line.size() || line.at(i) != QLatin1Char(':'))
+        return -1;
 
-    QJsonArray body;
-    for (const Fountain::Element &element : m_body)
-        body.append(element.toJson());
+    const int colonIndex = i++;
+    while (i < line.size() && line.at(i) == QLatin1Char(' '))
+        ++i;
 
-    if (!body.isEmpty())
-        ret["body"] = body;
+    const QStringView rest = line.mid(i);
+    for (const char *word : { "INT", "EXT", "EST", "I/E" }) {
+        const QLatin1String latin1Word(word);
+        if (rest.startsWith(latin1Word)
+            && (rest.size() == latin1Word.size() || !isRegExpWordChar(rest.at(latin1Word.size()))))
+            return colonIndex;
+    }
+
+    return -1;
+}
+
+/*
+ * Power user: Scene Headings can optionally be appended with Scene Numbers. Scene numbers
+ * are any alphanumerics (plus dashes and periods), wrapped in #.
+ *
+ * Equivalent to matching (.*)(\#([0-9A-Za-z\.\)-]+)\#) and keeping only the first capture
+ * as heading.
+ */
+QString extractSceneNumber(QString &sceneHeading)
+{
+    auto isSceneNumberChar = [](QChar ch) {
+        const ushort uc = ch.unicode();
+        return (uc >= '0' && uc <= '9') || (uc >= 'A' && uc <= 'Z') || (uc >= 'a' && uc <= 'z')
+                || uc == '.' || uc == ')' || uc == '-';
+    };
+
+    const QChar hash('#');
+    for (int from = sceneHeading.lastIndexOf(hash); from >= 0;
+         from = from > 0 ? sceneHeading.lastIndexOf(hash, from - 1) : -1) {
+        int to = from + 1;
+        while (to < sceneHeading.length() && isSceneNumberChar(sceneHeading.at(to)))
+            ++to;
+
+        if (to == from + 1 || to >= sceneHeading.length() || sceneHeading.at(to) != hash)
+            continue;
+
+        const QString number = sceneHeading.mid(from + 1, to - from - 1);
+        sceneHeading = QStringView(sceneHeading).left(from).trimmed().toString();
+        return number;
+    }
+
+    return QString();
+}
+
+/*
+ * https://fountain.io/syntax/#notes
+ *
+ * Removes all [[notes]] from text, and optionally reports the first one. Returns false if
+ * there were no notes to remove. Notes spanning across elements are not supported.
+ */
+bool removeNotes(QString &text, QString *firstNote = nullptr)
+{
+    const QLatin1String noteOpen("[["), noteClose("]]");
+
+    int from = text.indexOf(noteOpen);
+    int to = from < 0 ? -1 : text.indexOf(noteClose, from + 2);
+    if (to < 0)
+        return false;
+
+    if (firstNote)
+        *firstNote = text.mid(from + 2, to - from - 2);
+
+    QString ret;
+    ret.reserve(text.length());
+
+    int copiedUpto = 0;
+    while (from >= 0 && to >= 0) {
+        append(ret, QStringView(text).mid(copiedUpto, from - copiedUpto));
+        copiedUpto = to + 2;
+
+        from = text.indexOf(noteOpen, copiedUpto);
+        to = from < 0 ? -1 : text.indexOf(noteClose, from + 2);
+    }
+    append(ret, QStringView(text).mid(copiedUpto));
+
+    text = ret;
+    return true;
+}
+
+/*
+ * Same as folding (texts[i] + " " + joined).trimmed() from the last text backwards, which is
+ * how adjacent action and dialogue paragraphs have always been joined. But without copying the
+ * joined text over and over again.
+ */
+QString joinAdjacentTexts(const QStringList &texts)
+{
+    const int nrTexts = texts.size();
+    if (nrTexts == 1)
+        return texts.first();
+
+    const QString tail = (texts.at(nrTexts - 2) + QLatin1Char(' ') + texts.last()).trimmed();
+
+    QVector<QStringView> segments; // in reverse order
+    if (!tail.isEmpty())
+        segments.append(tail);
+
+    for (int i = nrTexts - 3; i >= 0; i--) {
+        const QStringView text = leftTrimmed(texts.at(i));
+        if (segments.isEmpty()) {
+            if (!text.trimmed().isEmpty())
+                segments.append(text.trimmed());
+        } else if (!text.isEmpty())
+            segments.append(text);
+    }
+
+    int length = qMax(segments.size() - 1, 0);
+    for (const QStringView segment : qAsConst(segments))
+        length += segment.size();
+
+    QString ret;
+    ret.reserve(length);
+    for (int i = segments.size() - 1; i >= 0; i--) {
+        append(ret, segments.at(i));
+        if (i > 0)
+            ret += QLatin1Char(' ');
+    }
 
     return ret;
 }
 
-void Fountain::Parser::parseContents(const QString &givenContent)
+/**
+ * Classifies Fountain content in a single pass, one line at a time, as it comes in.
+ *
+ * Classifying a line only requires knowing whether the lines around it are blank. So lines are
+ * held back until the next non-blank line shows up, which also takes care of ignoring trailing
+ * whitespace in the content. The only other thing held back is the first paragraph, until it is
+ * known whether its a title page or not.
+ */
+class LineParser
 {
-    m_body.clear();
-    m_titlePage.clear();
+public:
+    LineParser(int options, Fountain::Body &body, Fountain::TitlePage &titlePage)
+        : m_options(options), m_body(body), m_titlePage(titlePage)
+    {
+    }
+
+    void addContent(QStringView content);
+    void finish();
+
+private:
+    void addRawLine(QStringView line);
+    void addUncommentedLine(QStringView line);
+    void addLine(const QString &line);
+    void addBodyLine(const QString &line);
+
+    QStringView whitespaceRemoved(QStringView line) const;
+    bool isLineBreak(QStringView line) const { return this->whitespaceRemoved(line).isEmpty(); }
+    void parseTitlePage();
+    void parseBodyLine(QStringView line, bool nextLineIsEmpty);
+    void addElement(Fountain::Element &&element);
+    void flushJoinedElement();
+    void finalizeElement(Fountain::Element &element) const;
+
+private:
+    const int m_options = Fountain::Parser::DefaultOptions;
+    Fountain::Body &m_body;
+    Fountain::TitlePage &m_titlePage;
+
+    QString m_partialLine;
+
+    bool m_contentStarted = false;
+    bool m_inComment = false;
+    QString m_lineBeforeComment;
+    QString m_commentedContent; // restored verbatim if the comment is never closed
+
+    bool m_titlePageDone = false;
+    QStringList m_titlePageLines;
+
+    QStringList m_pendingLines;
+    bool m_prevLineIsEmpty = true;
+    bool m_inDialogue = false;
+    int m_nrParentheticals = 0;
 
-    if (m_options == 0) {
-        const QStringList lines = givenContent.split("\n", Qt::SkipEmptyParts);
-        std::transform(lines.begin(), lines.end(), std::back_inserter(m_body),
-                       [](const QString &line) {
-                           Fountain::Element fElement;
-                           fElement.type = Fountain::Element::Action;
-                           fElement.text = line.trimmed();
-                           return fElement;
-                       });
+    Fountain::Element m_joinedElement;
+    QStringList m_joinedTexts;
+};
+
+void LineParser::addContent(QStringView content)
+{
+    const QChar newline('\n');
+
+    int from = 0;
+    while (from < content.size()) {
+        const int to = content.indexOf(newline, from);
+        if (to < 0) {
+            append(m_partialLine, content.mid(from));
+            break;
+        }
+
+        if (m_partialLine.isEmpty())
+            this->addRawLine(content.mid(from, to - from));
+        else {
+            append(m_partialLine, content.mid(from, to - from));
+            this->addRawLine(m_partialLine);
+            m_partialLine.clear();
+        }
+
+        from = to + 1;
+    }
+}
+
+void LineParser::finish()
+{
+    if (!m_partialLine.isEmpty()) {
+        this->addRawLine(m_partialLine);
+        m_partialLine.clear();
+    }
+
+    if (m_inComment) {
+        // Unterminated comments are not comments at all.
+        m_inComment = false;
+
+        QString content = m_lineBeforeComment + m_commentedContent;
+        content.chop(1); // newline added after the last line
+        m_lineBeforeComment.clear();
+        m_commentedContent.clear();
+
+        const QStringList lines = content.split(QLatin1Char('\n'));
+        for (const QString &line : lines)
+            this->addUncommentedLine(line);
+    }
+
+    if (!m_titlePageDone) {
+        // Without a blank line in the content, there is no title page.
+        m_titlePageDone = true;
+        for (const QString &line : qAsConst(m_titlePageLines))
+            this->addBodyLine(line);
+        m_titlePageLines.clear();
+    }
+
+    // Trailing whitespace in the content is ignored.
+    while (!m_pendingLines.isEmpty() && isWhitespaceOnly(m_pendingLines.last()))
+        m_pendingLines.removeLast();
+
+    if (!m_pendingLines.isEmpty()) {
+        Q_ASSERT(m_pendingLines.size() == 1);
+        const QString line = m_pendingLines.takeFirst();
+
+        int length = line.length();
+        while (length > 0 && line.at(length - 1).isSpace())
+            --length;
+        this->parseBodyLine(QStringView(line).left(length), true);
+    }
+
+    this->flushJoinedElement();
+}
+
+void LineParser::addRawLine(QStringView line)
+{
+    if (m_options == Fountain::Parser::NoOption) {
+        if (!line.isEmpty()) {
+            Fountain::Element element;
+            element.type = Fountain::Element::Action;
+            element.text = line.trimmed().toString();
+            m_body.append(element);
+        }
         return;
     }
 
-    // Remove leading whitespaces in each line, standardize all new-lines
-    const QString content = this->cleanup(givenContent);
+    // Leading whitespace in the content is ignored
+    if (!m_contentStarted) {
+        line = leftTrimmed(line);
+        if (line.isEmpty())
+            return;
+        m_contentStarted = true;
+    }
+
+    // Remove /* comments */, which can span across lines.
+    const QLatin1String commentOpen("/*"), commentClose("*/");
+
+    QString uncommentedLine;
+    bool lineHasComments = false;
+    while (true) {
+        if (m_inComment) {
+            const int closeIndex = line.indexOf(commentClose);
+            if (closeIndex < 0) {
+                append(m_commentedContent, line);
+                m_commentedContent += QLatin1Char('\n');
+                return;
+            }
+
+            m_inComment = false;
+            m_commentedContent.clear();
+            uncommentedLine = m_lineBeforeComment;
+            m_lineBeforeComment.clear();
+            lineHasComments = true;
+            line = line.mid(closeIndex + 2);
+        }
 
-    // See if the file has title-page fields.
-    const int firstBlankLine = content.indexOf("\n\n");
-    if (firstBlankLine >= 0) {
-        const QString titlePageContent = content.left(firstBlankLine);
-        this->parseTitlePage(titlePageContent);
+        const int openIndex = line.indexOf(commentOpen);
+        if (openIndex < 0)
+            break;
 
-        const QString bodyContent =
-                m_titlePage.isEmpty() ? content : content.mid(firstBlankLine + 1);
-        this->parseBody(bodyContent);
+        const int closeIndex = line.indexOf(commentClose, openIndex + 2);
+        if (closeIndex < 0) {
+            m_inComment = true;
+            m_lineBeforeComment = uncommentedLine;
+            append(m_lineBeforeComment, line.left(openIndex));
+            m_commentedContent = line.mid(openIndex).toString() + QLatin1Char('\n');
+            return;
+        }
+
+        append(uncommentedLine, line.left(openIndex));
+        lineHasComments = true;
+        line = line.mid(closeIndex + 2);
+    }
+
+    if (lineHasComments) {
+        append(uncommentedLine, line);
+        this->addUncommentedLine(uncommentedLine);
     } else
-        this->parseBody(content);
+        this->addUncommentedLine(line);
 }
 
-void Fountain::Parser::parseTitlePage(const QString &content)
+void LineParser::addUncommentedLine(QStringView line)
+{
+    const int splitIndex = transitionHeadingSplitIndex(line);
+    if (splitIndex < 0) {
+        this->addLine(line.toString());
+        return;
+    }
+
+    this->addLine(line.left(splitIndex + 1).toString());
+    this->addLine(QString());
+    this->addLine(line.mid(splitIndex + 1).toString());
+}
+
+void LineParser::addLine(const QString &line)
+{
+    if (m_titlePageDone) {
+        this->addBodyLine(line);
+        return;
+    }
+
+    // Title page, if any, is in the first paragraph.
+    if (!line.isEmpty()) {
+        m_titlePageLines.append(line);
+        return;
+    }
+
+    m_titlePageDone = true;
+    this->parseTitlePage();
+    if (m_titlePage.isEmpty()) {
+        for (const QString &titlePageLine : qAsConst(m_titlePageLines))
+            this->addBodyLine(titlePageLine);
+    }
+    m_titlePageLines.clear();
+
+    this->addBodyLine(line);
+}
+
+void LineParser::addBodyLine(const QString &line)
+{
+    if (m_pendingLines.isEmpty() || isWhitespaceOnly(line)) {
+        m_pendingLines.append(line);
+        return;
+    }
+
+    m_pendingLines.append(line);
+    for (int i = 0; i < m_pendingLines.size() - 1; i++)
+        this->parseBodyLine(m_pendingLines.at(i), this->isLineBreak(m_pendingLines.at(i + 1)));
+    m_pendingLines.erase(m_pendingLines.begin(), m_pendingLines.end() - 1);
+}
+
+QStringView LineParser::whitespaceRemoved(QStringView line) const
+{
+    while (!line.isEmpty()
+           && (line.last() == QLatin1Char('\r') || line.last() == QLatin1Char('\n')))
+        line.chop(1);
+
+    if (m_options & Fountain::Parser::IgnoreLeadingWhitespaceOption) {
+        while (!line.isEmpty() && isRegExpSpace(line.first()))
+            line = line.mid(1);
+    }
+
+    if (m_options & Fountain::Parser::IgnoreTrailingWhiteSpaceOption) {
+        while (!line.isEmpty() && isRegExpSpace(line.last()))
+            line.chop(1);
+    }
+
+    return line;
+}
+
+void LineParser::parseTitlePage()
 {
     const QChar colon = ':';
     const QChar newline = '\n';
-    const QStringList lines = content.split(newline, Qt::SkipEmptyParts);
 
-    for (const QString &line : lines) {
+    for (const QString &line : qAsConst(m_titlePageLines)) {
         const QString trimmedLine = line.trimmed();
 
         if (trimmedLine.contains(colon)) {
@@ -223,202 +609,120 @@ void Fountain::Parser::parseTitlePage(const QString &content)
     }
 }
 
-void Fountain::Parser::parseBody(const QString &content)
+void LineParser::parseBodyLine(QStringView line, bool nextLineIsEmpty)
 {
-    // Split content across line boundary
-    const QChar newline = '\n';
-    const QStringList lines = content.split(newline);
+    const bool prevLineIsEmpty = m_prevLineIsEmpty;
+    const QStringView lineContent = this->whitespaceRemoved(line);
 
-    auto isPageBreak = [](const QString &text) -> bool {
-        /*
-         * http://fountain.io/syntax/#page-breaks
-         */
-        static const QRegularExpression regExp("={3,}");
-        const QRegularExpressionMatch match = regExp.match(text);
-        return (match.hasMatch() && match.captured() == text);
-    };
+    if (lineContent.isEmpty()) {
+        m_prevLineIsEmpty = true;
+        m_inDialogue = false;
+        this->flushJoinedElement();
+        return;
+    }
+
+    m_prevLineIsEmpty = false;
+
+    Fountain::Element element;
 
-    // Construct an element for each line, assuming that each line is a new
-    // element.
-    std::transform(lines.begin(), lines.end(), std::back_inserter(m_body),
-                   [=](const QString &line) {
-                       static const QRegularExpression regex("[\r\n]+$");
-                       static const QRegularExpression leadingWhitespaceRegex("^\\s+");
-                       static const QRegularExpression trailingWhitespaceRegex("\\s+$");
-
-                       QString endingNewLinesRemoved = line;
-                       endingNewLinesRemoved.remove(regex);
-
-                       QString whiteSpacesRemoved = endingNewLinesRemoved;
-                       if (m_options & IgnoreLeadingWhitespaceOption)
-                           whiteSpacesRemoved = whiteSpacesRemoved.remove(leadingWhitespaceRegex);
-                       if (m_options & IgnoreTrailingWhiteSpaceOption)
-                           whiteSpacesRemoved = whiteSpacesRemoved.remove(trailingWhitespaceRegex);
-
-                       Fountain::Element element;
-                       element.type = whiteSpacesRemoved.isEmpty() ? Fountain::Element::LineBreak
-                               : isPageBreak(whiteSpacesRemoved)   ? Fountain::Element::PageBreak
-                                                                   : Fountain::Element::Unknown;
-                       if (element.type == Fountain::Element::Unknown) {
-                           element.text = endingNewLinesRemoved;
-
-                           element.trimmedText = line.trimmed();
-                           element.simplifiedText = line.simplified();
-                           element.containsNonLatinChars = [](const QString &text) {
-                               for (const QChar &ch : text) {
-                                   if (ch.isLetter() && ch.script() != QChar::Script_Latin)
-                                       return true;
-                               }
-                               return false;
-                           }(line);
-                       } else
-                           element.text = QString();
-
-                       return element;
-                   });
-
-    // Remove starting and trailing newlines.
-    while (m_body.size() && m_body.last().type == Fountain::Element::LineBreak)
-        m_body.takeLast();
-    while (m_body.size() && m_body.first().type == Fountain::Element::LineBreak)
-        m_body.takeFirst();
-
-    this->processSectionsAndSynopsis();
-    this->processLyrics();
-
-    this->processFormalAction();
-    this->processSceneHeadings();
-    this->processShotsAndTransitions();
-    this->processCharacters();
-    this->processDialogueAndParentheticals();
-    this->processAction();
-
-    this->joinAdjacentElements();
-
-    this->processNotes();
-    this->processEmphasis();
-
-    this->removeEmptyLines();
-
-    std::for_each(m_body.begin(), m_body.end(), [](Fountain::Element &element) {
-        element.trimmedText = QString();
-        element.simplifiedText = QString();
-    });
-}
-
-void Fountain::Parser::processFormalAction()
-{
     /*
-     * https://fountain.io/syntax/#action
+     * http://fountain.io/syntax/#page-breaks
      */
+    if (lineContent.size() >= 3
+        && std::all_of(lineContent.begin(), lineContent.end(),
+                       [](QChar ch) { return ch == QLatin1Char('='); })) {
+        m_inDialogue = false;
+        element.type = Fountain::Element::PageBreak;
+        this->addElement(std::move(element));
+        return;
+    }
 
-    for (int i = 0; i < m_body.size(); i++) {
-        Fountain::Element &element = m_body[i];
-        if (element.type != Fountain::Element::Unknown)
-            continue;
+    const QStringView trimmedText = line.trimmed();
+    const QChar firstChar = trimmedText.isEmpty() ? QChar() : trimmedText.first();
+    const QChar lastChar = trimmedText.isEmpty() ? QChar() : trimmedText.last();
 
-        const QString trimmedText = element.trimmedText;
-        if (trimmedText.startsWith('!')) {
-            element.type = Fountain::Element::Action;
-            element.text = trimmedText.mid(1);
-            continue;
+    auto classify = [&]() {
+        /*
+         * https://fountain.io/syntax/#sections-synopses
+         */
+        if (firstChar == QLatin1Char('=')) {
+            element.type = Fountain::Element::Synopsis;
+            element.text = trimmedText.mid(1).trimmed().toString();
+            return;
         }
-    }
-}
 
-void Fountain::Parser::processSceneHeadings()
-{
-    /*
-     * http://fountain.io/syntax/#scene-headings
-     */
-    for (int i = 0; i < m_body.size(); i++) {
-        Fountain::Element &element = m_body[i];
-        if (element.type != Fountain::Element::Unknown)
-            continue;
+        if (firstChar == QLatin1Char('#')) {
+            int depth = 0;
+            while (depth < trimmedText.size() && trimmedText.at(depth) == QLatin1Char('#'))
+                ++depth;
 
-        auto extractSceneNumber = [](QString &sceneHeading) -> QString {
-            /*
-             * Power user: Scene Headings can optionally be appended with Scene
-             * Numbers. Scene numbers are any alphanumerics (plus dashes and periods),
-             * wrapped in #. All of the following are valid scene numbers:
-             */
-            static const QRegularExpression regExp("(.*)(\\#([0-9A-Za-z\\.\\)-]+)\\#)");
-            const QRegularExpressionMatch match = regExp.match(sceneHeading);
-            if (match.hasMatch()) {
-                sceneHeading = match.captured(1).trimmed();
-                return match.captured(3);
-            }
+            element.type = Fountain::Element::Section;
+            element.sectionDepth = depth;
+            element.text = trimmedText.mid(depth).trimmed().toString();
+            return;
+        }
 
-            return QString();
-        };
+        /*
+         * http://fountain.io/syntax/#lyrics
+         */
+        if (firstChar == QLatin1Char('~')) {
+            element.type = Fountain::Element::Lyrics;
+            element.text = trimmedText.mid(1).trimmed().toString();
+            return;
+        }
 
-        // If the line is forced into being a scene heading
-        if (element.trimmedText.startsWith('.') && element.trimmedText.length() >= 2
-            && element.trimmedText.at(1) != QChar('.')) {
-            element.text = element.trimmedText.mid(1).toUpper().simplified();
-            element.sceneNumber = extractSceneNumber(element.text);
-            element.type = Fountain::Element::SceneHeading;
-            continue;
+        /*
+         * https://fountain.io/syntax/#action
+         */
+        if (firstChar == QLatin1Char('!')) {
+            element.type = Fountain::Element::Action;
+            element.text = trimmedText.mid(1).toString();
+            return;
         }
 
-        const bool nextLineIsEmpty = (i == m_body.size() - 1)
-                || ((i + 1) < m_body.size()
-                    && m_body.at(i + 1).type == Fountain::Element::LineBreak);
-        const bool prevLineIsEmpty =
-                i == 0 || m_body.at(i - 1).type == Fountain::Element::LineBreak;
+        /*
+         * http://fountain.io/syntax/#scene-headings
+         */
+        if (firstChar == QLatin1Char('.') && trimmedText.size() >= 2
+            && trimmedText.at(1) != QLatin1Char('.')) {
+            // The line is forced into being a scene heading
+            element.type = Fountain::Element::SceneHeading;
+            element.text = trimmedText.mid(1).toString().toUpper().simplified();
+            element.sceneNumber = extractSceneNumber(element.text);
+            return;
+        }
 
-        if (nextLineIsEmpty && prevLineIsEmpty) {
+        if (prevLineIsEmpty && nextLineIsEmpty) {
             // Otherwise it should begin with one of the following
             // INT, EXT, EST, INT./EXT, INT/EXT, I/E
-            const QStringList prefixes = Fountain::sceneHeadingPrefixes();
-            const QString simplifiedText = element.simplifiedText;
-            for (const QString &prefix : prefixes) {
-                if (simplifiedText.startsWith(prefix + ".", Qt::CaseSensitive)) {
-                    element.text = simplifiedText;
-                    element.sceneNumber = extractSceneNumber(element.text);
+            for (const char *prefix : { "INT.", "EXT.", "EST.", "INT./EXT.", "INT/EXT.", "I/E." }) {
+                if (trimmedText.startsWith(QLatin1String(prefix))) {
                     element.type = Fountain::Element::SceneHeading;
-                    continue;
+                    element.text = simplified(line);
+                    element.sceneNumber = extractSceneNumber(element.text);
+                    return;
                 }
             }
         }
-    }
-}
 
-void Fountain::Parser::processShotsAndTransitions()
-{
-    /*
-     * http://fountain.io/syntax/#transition
-     */
-
-    /**
-     * Although Fountain syntax says that transitions must end with TO:, in the
-     * real world a lot of transitions don't end that way. So, we can't really
-     * rely on that alone.
-     */
-
-    for (int i = 0; i < m_body.size(); i++) {
-        Fountain::Element &element = m_body[i];
-        if (element.type != Fountain::Element::Unknown)
-            continue;
-
-        const bool nextLineIsEmpty = (i == m_body.size() - 1)
-                || ((i + 1) < m_body.size()
-                    && m_body.at(i + 1).type == Fountain::Element::LineBreak);
-        const bool prevLineIsEmpty =
-                i == 0 || m_body.at(i - 1).type == Fountain::Element::LineBreak;
-
-        if (element.trimmedText.startsWith('>') && !element.trimmedText.endsWith('<')) {
-            element.text = element.trimmedText.mid(1).toUpper().simplified();
+        /*
+         * http://fountain.io/syntax/#transition
+         *
+         * Although Fountain syntax says that transitions must end with TO:, in the
+         * real world a lot of transitions don't end that way. So, we can't really
+         * rely on that alone.
+         */
+        if (firstChar == QLatin1Char('>') && lastChar != QLatin1Char('<')) {
             element.type = Fountain::Element::Transition;
-            continue;
+            element.text = trimmedText.mid(1).toString().toUpper().simplified();
+            return;
         }
 
-        if (prevLineIsEmpty && nextLineIsEmpty /* && element.text.toUpper() == element.text*/) {
-            const QString simplifiedText = element.simplifiedText.toUpper();
-            if (simplifiedText.endsWith("TO:")) {
-                element.text = simplifiedText;
+        if (prevLineIsEmpty && nextLineIsEmpty) {
+            if (trimmedText.endsWith(QLatin1String("TO:"), Qt::CaseInsensitive)) {
                 element.type = Fountain::Element::Transition;
-                continue;
+                element.text = simplified(line).toUpper();
+                return;
             }
 
             static const QStringList knownTransitions = { QStringLiteral("CUT TO"),
@@ -438,15 +742,6 @@ void Fountain::Parser::processShotsAndTransitions()
                                                           QStringLiteral("STOCK SHOT"),
                                                           QStringLiteral("TIME CUT"),
                                                           QStringLiteral("WIPE TO") };
-            for (const QString &knownTransition : knownTransitions) {
-                if (simplifiedText == knownTransition || simplifiedText == knownTransition + ":"
-                    || simplifiedText == knownTransition + ".") {
-                    element.text = knownTransition + ":";
-                    element.type = Fountain::Element::Transition;
-                    continue;
-                }
-            }
-
             static const QStringList knownShots = {
                 QStringLiteral("AIR"),          QStringLiteral("CLOSE ON"),
                 QStringLiteral("CLOSER ON"),    QStringLiteral("CLOSEUP"),
@@ -458,244 +753,162 @@ void Fountain::Parser::processShotsAndTransitions()
                 QStringLiteral("WIDER ANGLE")
             };
 
-            for (const QString &knownShot : knownShots) {
-                if (simplifiedText == knownShot || simplifiedText == knownShot + ":"
-                    || simplifiedText == knownShot + ".") {
-                    element.text = knownShot + ":";
-                    element.type = Fountain::Element::Shot;
-                    continue;
+            // None of the known transitions and shots are more than 18 characters long, so
+            // there is no need to look them up for longer lines.
+            const int maxKnownLength = 18;
+            const int nrNonSpaceChars = std::count_if(trimmedText.begin(), trimmedText.end(),
+                                                      [](QChar ch) { return !ch.isSpace(); });
+            if (nrNonSpaceChars <= maxKnownLength) {
+                const QString simplifiedText = simplified(line).toUpper();
+                const QString strippedText = simplifiedText.endsWith(QLatin1Char(':'))
+                                || simplifiedText.endsWith(QLatin1Char('.'))
+                        ? simplifiedText.left(simplifiedText.length() - 1)
+                        : simplifiedText;
+
+                for (const QString &candidate : { simplifiedText, strippedText }) {
+                    if (knownTransitions.contains(candidate)) {
+                        element.type = Fountain::Element::Transition;
+                        element.text = candidate + QLatin1Char(':');
+                        return;
+                    }
+
+                    if (knownShots.contains(candidate)) {
+                        element.type = Fountain::Element::Shot;
+                        element.text = candidate + QLatin1Char(':');
+                        return;
+                    }
                 }
             }
         }
-    }
-}
 
-void Fountain::Parser::processCharacters()
-{
-    /*
-     * http://fountain.io/syntax/#charater
-     */
-
-    for (int i = 0; i < m_body.size(); i++) {
-        Fountain::Element &element = m_body[i];
-        if (element.type != Fountain::Element::Unknown)
-            continue;
-
-        const bool nextLineIsEmpty = (i == m_body.size() - 1)
-                || ((i + 1) < m_body.size()
-                    && m_body.at(i + 1).type == Fountain::Element::LineBreak);
-        const bool prevLineIsEmpty =
-                i == 0 || m_body.at(i - 1).type == Fountain::Element::LineBreak;
-
-        if (prevLineIsEmpty && !nextLineIsEmpty && i + 1 < m_body.size()) {
-            const QString simplifiedText = element.simplifiedText;
-            if (simplifiedText.endsWith('.') || simplifiedText.endsWith(':')
-                || simplifiedText.startsWith('>') || simplifiedText.endsWith('<'))
-                continue;
+        /*
+         * http://fountain.io/syntax/#charater
+         */
+        if (prevLineIsEmpty && !nextLineIsEmpty) {
+            if (lastChar == QLatin1Char('.') || lastChar == QLatin1Char(':')
+                || firstChar == QLatin1Char('>') || lastChar == QLatin1Char('<'))
+                return;
 
-            if (simplifiedText.startsWith('@')) {
+            if (firstChar == QLatin1Char('@')) {
                 element.type = Fountain::Element::Character;
-                element.text = simplifiedText.mid(1).trimmed();
-                continue;
+                element.text = simplified(line).mid(1).trimmed();
+                return;
             }
 
             bool isCharacter = false;
-            const int boIndex = simplifiedText.indexOf('(');
-            const int bcIndex = simplifiedText.lastIndexOf(')');
+            const int boIndex = trimmedText.indexOf(QLatin1Char('('));
             if (boIndex > 0) {
-                if (bcIndex > 0 && bcIndex > boIndex) {
-                    const QString maybeCharacterName = simplifiedText.left(boIndex).trimmed();
-                    isCharacter = (maybeCharacterName.toUpper() == maybeCharacterName);
-                }
-            } else {
-                isCharacter = !element.containsNonLatinChars
-                        && simplifiedText.toUpper() == simplifiedText;
-            }
+                const int bcIndex = trimmedText.lastIndexOf(QLatin1Char(')'));
+                if (bcIndex > boIndex)
+                    isCharacter = isUpperCase(trimmedText.left(boIndex));
+            } else
+                isCharacter = !containsNonLatinLetters(line) && isUpperCase(trimmedText);
 
             if (isCharacter) {
                 element.type = Fountain::Element::Character;
-                element.text = simplifiedText;
-                continue;
+                element.text = simplified(line);
+                return;
             }
         }
-    }
-}
-
-void Fountain::Parser::processDialogueAndParentheticals()
-{
-    /*
-     * http://fountain.io/syntax/#dialogue
-     * http://fountain.io/syntax/#parenthetical
-     */
-
-    for (int i = 0; i < m_body.size(); i++) {
-        Fountain::Element &element = m_body[i];
-
-        // Go on until we find a character element.
-        if (element.type != Fountain::Element::Character)
-            continue;
-
-        // Once we get a character element, determine if the following lines are
-        // parentheticals or dialogue.
-        ++i;
-        int nrParentheticals = 0;
-        for (; i < m_body.size(); i++) {
-            Fountain::Element &dpElement = m_body[i];
-            if (dpElement.type != Fountain::Element::Unknown) {
-                --i;
-                break;
-            }
-
-            const QString simplifiedText = dpElement.simplifiedText;
-            dpElement.text = simplifiedText;
+    };
 
-            if (simplifiedText.startsWith('(')) {
-                ++nrParentheticals;
+    classify();
 
-                dpElement.type = Fountain::Element::Parenthetical;
-                if (simplifiedText.endsWith(')'))
-                    --nrParentheticals;
+    if (element.type == Fountain::Element::None) {
+        if (m_inDialogue) {
+            /*
+             * http://fountain.io/syntax/#dialogue
+             * http://fountain.io/syntax/#parenthetical
+             */
+            element.text = simplified(line);
+
+            if (firstChar == QLatin1Char('(') || m_nrParentheticals > 0) {
+                if (firstChar == QLatin1Char('('))
+                    ++m_nrParentheticals;
+                element.type = Fountain::Element::Parenthetical;
+                if (lastChar == QLatin1Char(')'))
+                    --m_nrParentheticals;
+            } else
+                element.type = Fountain::Element::Dialogue;
+        } else {
+            element.type = Fountain::Element::Action;
+            if (firstChar == QLatin1Char('>') && lastChar == QLatin1Char('<')) {
+                element.text = trimmedText.mid(1, trimmedText.size() - 2).trimmed().toString();
+                element.isCentered = true;
             } else {
-                if (nrParentheticals > 0) {
-                    dpElement.type = Fountain::Element::Parenthetical;
-                    if (simplifiedText.endsWith(')'))
-                        --nrParentheticals;
-                } else
-                    dpElement.type = Fountain::Element::Dialogue;
+                QStringView text = line;
+                while (!text.isEmpty()
+                       && (text.last() == QLatin1Char('\r') || text.last() == QLatin1Char('\n')))
+                    text.chop(1);
+                element.text = text.toString();
             }
         }
-    }
-}
-
-void Fountain::Parser::processLyrics()
-{
-    /*
-     * http://fountain.io/syntax/#lyrics
-     */
-    for (int i = 0; i < m_body.size(); i++) {
-        Fountain::Element &element = m_body[i];
-        if (element.type != Fountain::Element::Unknown)
-            continue;
-
-        const QString trimmedText = element.trimmedText;
+    } else if (element.type == Fountain::Element::Character) {
+        m_inDialogue = true;
+        m_nrParentheticals = 0;
+    } else
+        m_inDialogue = false;
 
-        if (trimmedText.startsWith('~')) {
-            element.type = Fountain::Element::Lyrics;
-            element.text = trimmedText.mid(1).trimmed();
-        }
-    }
+    this->addElement(std::move(element));
 }
 
-void Fountain::Parser::processSectionsAndSynopsis()
+void LineParser::addElement(Fountain::Element &&element)
 {
     /*
-     * https://fountain.io/syntax/#sections-synopses
+     * This part is specific to this particular parser. If we have two dialogue or
+     * action paragraphs adjacent to each other, we should merge them into a
+     * single paragraph.
      */
+    const bool joinable = (m_options & Fountain::Parser::JoinAdjacentElementOption)
+            && (element.type == Fountain::Element::Action
+                || element.type == Fountain::Element::Dialogue);
 
-    for (int i = 0; i < m_body.size(); i++) {
-        Fountain::Element &element = m_body[i];
-        if (element.type != Fountain::Element::Unknown)
-            continue;
-
-        QString trimmedText = element.trimmedText;
+    if (joinable && !m_joinedTexts.isEmpty() && m_joinedElement.type == element.type) {
+        m_joinedTexts.append(element.text);
+        return;
+    }
 
-        if (trimmedText.startsWith('=')) {
-            element.type = Fountain::Element::Synopsis;
-            element.text = trimmedText.mid(1).trimmed();
-            continue;
-        }
+    this->flushJoinedElement();
 
-        static const QRegularExpression sectionRegExp("^(#+)(.*)$");
-        const QRegularExpressionMatch sectionMatch = sectionRegExp.match(trimmedText);
-        if (sectionMatch.hasMatch()) {
-            const QString hashes = sectionMatch.captured(1);
-            element.type = Fountain::Element::Section;
-            element.sectionDepth = hashes.length();
-            element.text = sectionMatch.captured(2).trimmed();
-            continue;
-        }
+    if (joinable) {
+        m_joinedTexts.append(element.text);
+        m_joinedElement = std::move(element);
+        return;
     }
+
+    this->finalizeElement(element);
+    m_body.append(element);
 }
 
-void Fountain::Parser::processAction()
+void LineParser::flushJoinedElement()
 {
-    /*
-     * https://fountain.io/syntax/#action
-     */
+    if (m_joinedTexts.isEmpty())
+        return;
 
-    for (int i = 0; i < m_body.size(); i++) {
-        Fountain::Element &element = m_body[i];
-        if (element.type == Fountain::Element::Unknown)
-            element.type = Fountain::Element::Action;
+    m_joinedElement.text = joinAdjacentTexts(m_joinedTexts);
+    m_joinedTexts.clear();
 
-        if (element.type == Fountain::Element::Action) {
-            QString trimmedText = element.trimmedText;
-            if (trimmedText.startsWith('>') && trimmedText.endsWith('<')) {
-                trimmedText = trimmedText.mid(1, trimmedText.length() - 2);
-                element.text = trimmedText.trimmed();
-                element.isCentered = true;
-            }
-        }
-    }
+    this->finalizeElement(m_joinedElement);
+    m_body.append(m_joinedElement);
+    m_joinedElement = Fountain::Element();
 }
 
-void Fountain::Parser::joinAdjacentElements()
+void LineParser::finalizeElement(Fountain::Element &element) const
 {
-    /*
-     * This part is specific to this particular parser. If we have two dialogue or
-     * action paragraphs adjacent to each other, we should merge them into a
-     * single paragraph.
-     */
-    if (m_options & JoinAdjacentElementOption) {
-        const QList<Fountain::Element::Type> joinableTypes = { Fountain::Element::Action,
-                                                               Fountain::Element::Dialogue };
-
-        for (int i = m_body.size() - 1; i >= 1; i--) {
-            Fountain::Element &current = m_body[i];
-            Fountain::Element &previous = m_body[i - 1];
-            if (joinableTypes.contains(current.type) && current.type == previous.type) {
-                previous.text = previous.text + " " + current.text;
-                previous.text = previous.text.trimmed();
-
-                current.text.clear();
-                current.type = Fountain::Element::None;
-            }
+    // Here, we only support limited parsing of notes. Only action and dialogue paragraphs
+    // can have notes, they are removed from all other paragraphs.
+    if (element.type == Fountain::Element::Action
+        || element.type == Fountain::Element::Dialogue) {
+        QString note;
+        if (removeNotes(element.text, &note)) {
+            element.notes = QStringList({ note });
+            element.text = element.text.simplified();
         }
+    } else {
+        removeNotes(element.text);
+        element.text = element.text.simplified();
     }
-}
-
-void Fountain::Parser::processNotes()
-{
-    /*
-     * https://fountain.io/syntax/#notes
-     */
-
-    // Here, we only support limited parsing of notes.
-    // If JoinAdjacentElementOption is not enabled, then we only process lines
-    // in which an entire note exists.
-    // Notes with line breaks are not supported.
-
-    static const QList<Fountain::Element::Type> allowedTypes = { Fountain::Element::Action,
-                                                                 Fountain::Element::Dialogue };
-    static const QRegularExpression regex("\\[\\[(.*?)\\]\\]");
-
-    for (Fountain::Element &element : m_body) {
-        if (allowedTypes.contains(element.type)) {
-            const QRegularExpressionMatch match = regex.match(element.text);
-            if (match.hasMatch()) {
-                element.notes = match.capturedTexts();
-                if (!element.notes.isEmpty())
-                    element.notes.removeFirst();
-                element.text = element.text.remove(regex).simplified();
-            }
-        } else {
-            element.text = element.text.remove(regex).simplified();
-        }
-    }
-}
 
-void Fountain::Parser::processEmphasis()
-{
     /*
      * Fountain follows Markdown’s rules for emphasis, except that it reserves the
      * use of underscores for underlining, which is not interchangeable with
@@ -707,54 +920,94 @@ void Fountain::Parser::processEmphasis()
      *      * In this way the writer can mix and match and combine bold, italics
      * and underlining, as screenwriters often do.
      */
+    if (m_options & Fountain::Parser::ResolveEmphasisOption)
+        Fountain::resolveEmphasis(element.text, element.text, element.formats);
+}
 
-    if (m_options & ResolveEmphasisOption) {
-        for (Fountain::Element &element : m_body)
-            Fountain::resolveEmphasis(element.text, element.text, element.formats);
-    }
 }
 
-void Fountain::Parser::removeEmptyLines()
+Fountain::Parser::Parser(const QString &content, int options) : m_options(options)
 {
-    QList<Fountain::Element> filteredElements;
-    std::copy_if(m_body.begin(), m_body.end(), std::back_inserter(filteredElements),
-                 [](const Fountain::Element &element) {
-                     return (element.type != Fountain::Element::LineBreak
-                             && element.type != Fountain::Element::Unknown
-                             && element.type != Fountain::Element::None);
-                 });
+    this->parseContents(content);
+}
 
-    m_body = filteredElements;
+Fountain::Parser::Parser(const QByteArray &content, int options) : m_options(options)
+{
+    this->parseContents(QString::fromUtf8(content));
 }
 
-QString Fountain::Parser::cleanup(const QString &content) const
+Fountain::Parser::Parser(QIODevice *device, int options) : m_options(options)
 {
-    QString ret = content.trimmed();
+    if (device) {
+        if (!device->isOpen())
+            device->open(QIODevice::ReadOnly);
 
-    // Remove all comments from the entire code.
-    static const QRegularExpression commentRegex("/\\*.*?\\*/",
-                                                 QRegularExpression::DotMatchesEverythingOption);
-    ret = ret.remove(commentRegex);
+        if (device->isOpen())
+            this->parseDevice(device);
 
-    QStringList lines = ret.split("\n");
-    for (QString &line : lines) {
-        static const QRegularExpression splitTxHeadingRegex(
-                "^[A-Z ]*: *\\b(INT|EXT|EST|INT\\.?\\/ ?EXT|I\\/E)\\b");
-        if (splitTxHeadingRegex.match(line).hasMatch()) {
-            int index = line.indexOf(':');
-            line.insert(index + 1, "\n\n");
-        }
+        device->close();
     }
-    ret = lines.join("\n");
+}
+
+Fountain::Parser::~Parser() { }
+
+QJsonObject Fountain::Parser::toJson() const
+{
+    QJsonObject ret;
+
+    ret["#kind"] = "Fountain/Parser/Json";
+    ret["#standard"] = "https://fountain.io/syntax/";
+
+    QJsonObject titlePage;
+    for (const QPair<QString, QString> &tuple : m_titlePage)
+        titlePage[tuple.first] = tuple.second;
+    if (!titlePage.isEmpty())
+        ret["titlePage"] = titlePage;
+
+    QJsonArray body;
+    for (const Fountain::Element &element : m_body)
+        body.append(element.toJson());
+
+    if (!body.isEmpty())
+        ret["body"] = body;
 
     return ret;
 }
 
+void Fountain::Parser::parseContents(const QString &content)
+{
+    m_body.clear();
+    m_titlePage.clear();
+
+    LineParser parser(m_options, m_body, m_titlePage);
+    parser.addContent(content);
+    parser.finish();
+}
+
+void Fountain::Parser::parseDevice(QIODevice *device)
+{
+    m_body.clear();
+    m_titlePage.clear();
+
+    // Content is parsed as it is read, in chunks. There is no need to hold all of it in memory.
+    const qint64 chunkSize = 64 * 1024;
+    QScopedPointer<QTextDecoder> decoder(QTextCodec::codecForName("UTF-8")->makeDecoder());
+
+    LineParser parser(m_options, m_body, m_titlePage);
+    while (!device->atEnd()) {
+        const QByteArray chunk = device->read(chunkSize);
+        if (chunk.isEmpty())
+            break;
+
+        parser.addContent(decoder->toUnicode(chunk));
+    }
+    parser.finish();
+}
+
 static bool Fountain::resolveEmphasis(const QString &input, QString &plainText,
                                       QVector<QTextLayout::FormatRange> &formats)
 {
-    static const QRegularExpression regex("\\*{1,3}|_{1}");
-    if (!regex.match(input).hasMatch())
+    if (!input.contains(QLatin1Char('*')) && !input.contains(QLatin1Char('_')))
         return false;
 
     // Define regular expression patterns for formatting
@@ -858,11 +1111,6 @@ static bool Fountain::encodeEmphasis(const QString &plainText,
     return true;
 }
 
-static QStringList Fountain::sceneHeadingPrefixes()
-{
-    return { "INT", "EXT", "EST", "INT./EXT", "INT/EXT", "I/E" };
-}
-
 Fountain::Writer::Writer(QList<QPair<QString, QString>> &titlePage, const QList<Element> &body,
                          int options)
     : m_titlePage(titlePage), m_body(body), m_options(options)
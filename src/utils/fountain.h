@@ -59,13 +59,6 @@ struct Element
     QVector<QTextLayout::FormatRange> formats;
 
     QJsonObject toJson() const;
-
-private:
-    // Extra data that's only useful while parsing.
-    friend class Parser;
-    bool containsNonLatinChars = false;
-    QString simplifiedText;
-    QString trimmedText;
 };
 
 typedef QPair<QString, QString> TitlePageField;
@@ -108,28 +101,7 @@ public:
 
 private:
     void parseContents(const QString &content);
-
-    QString cleanup(const QString &content) const;
-
-    void parseTitlePage(const QString &content);
-
-    void parseBody(const QString &content);
-
-    void processFormalAction();
-    void processSceneHeadings();
-    void processShotsAndTransitions();
-    void processCharacters();
-    void processDialogueAndParentheticals();
-    void processLyrics();
-    void processSectionsAndSynopsis();
-    void processAction();
-
-    void joinAdjacentElements();
-    void processNotes();
-
-    void processEmphasis();
-
-    void removeEmptyLines();
+    void parseDevice(QIODevice *device);
 
 private:
     int m_options = DefaultOptions;
@@ -18,13 +18,190 @@
 #include <QHash>
 #include <QtMath>
 #include <QLineF>
+#include <QThread>
 #include <QTransform>
 #include <QElapsedTimer>
+#include <QScopedPointer>
+#include <QVarLengthArray>
+#include <QtConcurrentMap>
 
 using namespace GraphLayout;
 
 static const qreal fdg_constant = 0.0001;
 
+// Graphs smaller than this are laid out using exact all-pairs repulsion by default,
+// and forces on them are always accumulated on the calling thread.
+static const int fdg_barnesHutThreshold = 64;
+static const int fdg_parallelThreshold = 128;
+
+namespace {
+
+// Repulsion between two nodes; dp is the vector from the other node to this one.
+inline QPointF repulsionForce(const QPointF &dp, qreal k)
+{
+    const qreal d2 = dp.x() * dp.x() + dp.y() * dp.y();
+    return qFuzzyIsNull(d2) ? QPointF(0, 0) : dp * (k / d2);
+}
+
+/**
+ * Quadtree over node positions. Each cell knows the number of nodes in it and their centre of
+ * mass, so that a far away cell can push a node as if it were a single heavier node.
+ */
+class BarnesHutTree
+{
+public:
+    explicit BarnesHutTree(const QVector<QPointF> &positions);
+
+    QPointF repulsion(int node, qreal k, qreal theta) const;
+
+private:
+    void insert(int node);
+    int quadrant(const QPointF &pos, int cellIndex) const;
+
+private:
+    struct Cell
+    {
+        QPointF center;
+        qreal halfSize = 0;
+        QPointF positionSum;
+        int mass = 0;
+        bool leaf = true;
+        int firstChild = -1; // four consecutive cells, when not a leaf
+        int firstNode = -1; // nodes in a leaf, chained through m_nextNode
+    };
+
+    // Coincident nodes cannot be separated by splitting cells, so we stop at this depth
+    // and chain them in the same leaf.
+    enum { MaxDepth = 24 };
+
+    const QVector<QPointF> &m_positions;
+    QVector<Cell> m_cells;
+    QVector<int> m_nextNode;
+};
+
+BarnesHutTree::BarnesHutTree(const QVector<QPointF> &positions)
+    : m_positions(positions), m_nextNode(positions.size(), -1)
+{
+    if (positions.isEmpty())
+        return;
+
+    qreal minX = positions.first().x(), maxX = minX;
+    qreal minY = positions.first().y(), maxY = minY;
+    for (const QPointF &pos : positions) {
+        minX = qMin(minX, pos.x());
+        maxX = qMax(maxX, pos.x());
+        minY = qMin(minY, pos.y());
+        maxY = qMax(maxY, pos.y());
+    }
+
+    Cell root;
+    root.center = QPointF((minX + maxX) / 2, (minY + maxY) / 2);
+    root.halfSize = qMax(maxX - minX, maxY - minY) / 2 + 1e-6;
+
+    m_cells.reserve(positions.size() * 2);
+    m_cells.append(root);
+
+    for (int i = 0; i < positions.size(); i++)
+        this->insert(i);
+}
+
+QPointF BarnesHutTree::repulsion(int node, qreal k, qreal theta) const
+{
+    QPointF force(0, 0);
+    if (m_cells.isEmpty())
+        return force;
+
+    const QPointF pos = m_positions.at(node);
+    const qreal theta2 = theta * theta;
+
+    QVarLengthArray<int, 64> stack;
+    stack.append(0);
+    while (!stack.isEmpty()) {
+        const Cell &cell = m_cells.at(stack.last());
+        stack.removeLast();
+
+        if (cell.mass == 0)
+            continue;
+
+        if (cell.leaf) {
+            for (int n = cell.firstNode; n >= 0; n = m_nextNode.at(n)) {
+                if (n != node)
+                    force += repulsionForce(pos - m_positions.at(n), k);
+            }
+            continue;
+        }
+
+        const QPointF dp = pos - cell.positionSum / cell.mass;
+        const qreal d2 = dp.x() * dp.x() + dp.y() * dp.y();
+        const qreal size = 2 * cell.halfSize;
+        if (size * size < theta2 * d2) {
+            force += repulsionForce(dp, k) * cell.mass;
+            continue;
+        }
+
+        for (int i = 0; i < 4; i++)
+            stack.append(cell.firstChild + i);
+    }
+
+    return force;
+}
+
+void BarnesHutTree::insert(int node)
+{
+    const QPointF pos = m_positions.at(node);
+
+    int cellIndex = 0;
+    int depth = 0;
+    while (1) {
+        m_cells[cellIndex].mass++;
+        m_cells[cellIndex].positionSum += pos;
+
+        if (m_cells.at(cellIndex).leaf) {
+            if (m_cells.at(cellIndex).firstNode < 0 || depth >= MaxDepth) {
+                m_nextNode[node] = m_cells.at(cellIndex).firstNode;
+                m_cells[cellIndex].firstNode = node;
+                return;
+            }
+
+            // Split the leaf and push the node it had into one of its new children.
+            const Cell parent = m_cells.at(cellIndex);
+            const qreal childHalfSize = parent.halfSize / 2;
+            const int firstChild = m_cells.size();
+            for (int i = 0; i < 4; i++) {
+                Cell child;
+                child.halfSize = childHalfSize;
+                child.center = parent.center
+                        + QPointF((i & 1) ? childHalfSize : -childHalfSize,
+                                  (i & 2) ? childHalfSize : -childHalfSize);
+                m_cells.append(child);
+            }
+
+            m_cells[cellIndex].leaf = false;
+            m_cells[cellIndex].firstChild = firstChild;
+            m_cells[cellIndex].firstNode = -1;
+
+            const int existingNode = parent.firstNode;
+            Cell &existingCell = m_cells[firstChild
+                                         + this->quadrant(m_positions.at(existingNode), cellIndex)];
+            existingCell.mass = 1;
+            existingCell.positionSum = m_positions.at(existingNode);
+            existingCell.firstNode = existingNode;
+            m_nextNode[existingNode] = -1;
+        }
+
+        cellIndex = m_cells.at(cellIndex).firstChild + this->quadrant(pos, cellIndex);
+        ++depth;
+    }
+}
+
+int BarnesHutTree::quadrant(const QPointF &pos, int cellIndex) const
+{
+    const QPointF center = m_cells.at(cellIndex).center;
+    return (pos.x() >= center.x() ? 1 : 0) | (pos.y() >= center.y() ? 2 : 0);
+}
+
+}
+
 ForceDirectedLayout::ForceDirectedLayout() { }
 
 ForceDirectedLayout::~ForceDirectedLayout() { }
@@ -37,14 +214,22 @@ bool ForceDirectedLayout::layout(const Graph &graph)
 
     // If the graph contains nodes that are not part of edges within it,
     // then we must not even bother laying it out.
+    QHash<AbstractNode *, int> nodeIndexMap;
+    nodeIndexMap.reserve(graph.nodes.size());
+    for (int i = 0; i < graph.nodes.size(); i++)
+        nodeIndexMap.insert(graph.nodes.at(i), i);
+
     QHash<AbstractNode *, int> refCountMap;
+    QVector<QPair<int, int>> edges;
+    edges.reserve(graph.edges.size());
     for (AbstractEdge *edge : qAsConst(graph.edges)) {
-        const int i1 = graph.nodes.indexOf(edge->node1());
-        const int i2 = graph.nodes.indexOf(edge->node2());
+        const int i1 = nodeIndexMap.value(edge->node1(), -1);
+        const int i2 = nodeIndexMap.value(edge->node2(), -1);
         if (i1 < 0 || i2 < 0)
             return false;
         refCountMap[edge->node1()]++;
         refCountMap[edge->node2()]++;
+        edges.append(qMakePair(i1, i2));
     }
 
     for (AbstractNode *node : qAsConst(graph.nodes)) {
@@ -77,10 +262,15 @@ bool ForceDirectedLayout::layout(const Graph &graph)
     QElapsedTimer timer;
     timer.start();
 
+    QVector<QPointF> positions(graph.nodes.size());
     while (timer.elapsed() < this->maxTime()) {
+        // Forces are computed from a snapshot of positions, which can be read from any thread.
+        for (int i = 0; i < graph.nodes.size(); i++)
+            positions[i] = graph.nodes.at(i)->position();
+
         QVector<QPointF> forces(graph.nodes.size(), QPointF(0, 0));
-        calculateRepulsion(forces, graph);
-        calculateAttraction(forces, graph);
+        calculateRepulsion(forces, positions);
+        calculateAttraction(forces, positions, edges);
         bool moved = placeNodes(forces, graph);
 
         ++nrIterations;
@@ -121,35 +311,72 @@ bool ForceDirectedLayout::layout(const Graph &graph)
     return true;
 }
 
-void ForceDirectedLayout::calculateRepulsion(QVector<QPointF> &forces, const Graph &graph)
+void ForceDirectedLayout::calculateRepulsion(QVector<QPointF> &forces,
+                                             const QVector<QPointF> &positions)
 {
     const qreal k = fdg_constant;
-    for (int i = 0; i <= graph.nodes.size() - 2; i++) {
-        for (int j = i + 1; j <= graph.nodes.size() - 1; j++) {
-            const AbstractNode *n1 = graph.nodes.at(i);
-            const AbstractNode *n2 = graph.nodes.at(j);
-            const QPointF dp = n2->position() - n1->position();
-            const qreal force = k / qSqrt((qPow(dp.x(), 2.0) + qPow(dp.y(), 2.0)));
-            const qreal angle = qAtan2(dp.y(), dp.x());
-            const QPointF delta(force * qCos(angle), force * qSin(angle));
-            forces[i] -= delta;
-            forces[j] += delta;
+    const int nrNodes = positions.size();
+
+    RepulsionMethod method = m_repulsionMethod;
+    if (method == AutomaticRepulsion)
+        method = nrNodes > fdg_barnesHutThreshold ? BarnesHutRepulsion : AllPairsRepulsion;
+
+    if (method == AllPairsRepulsion && (!m_parallel || nrNodes < fdg_parallelThreshold)) {
+        for (int i = 0; i <= nrNodes - 2; i++) {
+            for (int j = i + 1; j <= nrNodes - 1; j++) {
+                const QPointF delta = repulsionForce(positions.at(j) - positions.at(i), k);
+                forces[i] -= delta;
+                forces[j] += delta;
+            }
         }
+        return;
     }
+
+    QScopedPointer<BarnesHutTree> tree;
+    if (method == BarnesHutRepulsion)
+        tree.reset(new BarnesHutTree(positions));
+
+    const qreal theta = m_barnesHutTheta;
+    auto accumulate = [&](const QPair<int, int> &range) {
+        for (int i = range.first; i < range.second; i++) {
+            if (tree.isNull()) {
+                QPointF force(0, 0);
+                for (int j = 0; j < nrNodes; j++) {
+                    if (j != i)
+                        force += repulsionForce(positions.at(i) - positions.at(j), k);
+                }
+                forces[i] += force;
+            } else
+                forces[i] += tree->repulsion(i, k, theta);
+        }
+    };
+
+    if (!m_parallel || nrNodes < fdg_parallelThreshold) {
+        accumulate(qMakePair(0, nrNodes));
+        return;
+    }
+
+    // Each range writes only into its own slots of forces, so no locking is needed.
+    const int nrRanges = qMax(1, QThread::idealThreadCount()) * 4;
+    const int rangeSize = (nrNodes + nrRanges - 1) / nrRanges;
+    QVector<QPair<int, int>> ranges;
+    for (int i = 0; i < nrNodes; i += rangeSize)
+        ranges.append(qMakePair(i, qMin(i + rangeSize, nrNodes)));
+
+    QtConcurrent::blockingMap(ranges, accumulate);
 }
 
-void ForceDirectedLayout::calculateAttraction(QVector<QPointF> &forces, const Graph &graph)
+void ForceDirectedLayout::calculateAttraction(QVector<QPointF> &forces,
+                                              const QVector<QPointF> &positions,
+                                              const QVector<QPair<int, int>> &edges)
 {
     const qreal k = fdg_constant;
-    for (AbstractEdge *edge : graph.edges) {
-        AbstractNode *n1 = edge->node1();
-        AbstractNode *n2 = edge->node2();
-        const QPointF dp = n2->position() - n1->position();
-        const int i = graph.nodes.indexOf(n1);
-        const int j = graph.nodes.indexOf(n2);
-        const qreal force = k * (qPow(dp.x(), 2.0) + qPow(dp.y(), 2.0));
-        const qreal angle = qAtan2(dp.y(), dp.x());
-        const QPointF delta(force * qCos(angle), force * qSin(angle));
+    for (const QPair<int, int> &edge : edges) {
+        const int i = edge.first;
+        const int j = edge.second;
+        const QPointF dp = positions.at(j) - positions.at(i);
+        const qreal distance = qSqrt(dp.x() * dp.x() + dp.y() * dp.y());
+        const QPointF delta = dp * (k * distance);
         forces[i] += delta;
         forces[j] -= delta;
     }
@@ -14,6 +14,7 @@
 #ifndef GRAPHLAYOUT_H
 #define GRAPHLAYOUT_H
 
+#include <QPair>
 #include <QSizeF>
 #include <QPointF>
 #include <QVector>
@@ -90,13 +91,36 @@ public:
     explicit ForceDirectedLayout();
     ~ForceDirectedLayout();
 
+    enum RepulsionMethod {
+        AutomaticRepulsion, // AllPairsRepulsion for small graphs, BarnesHutRepulsion otherwise
+        AllPairsRepulsion, // Exact, O(n^2) per iteration
+        BarnesHutRepulsion // Approximated using a quadtree, O(n log n) per iteration
+    };
+    void setRepulsionMethod(RepulsionMethod val) { m_repulsionMethod = val; }
+    RepulsionMethod repulsionMethod() const { return m_repulsionMethod; }
+
+    // Cells whose size to distance ratio is below theta are treated as a single body.
+    // Smaller values are more accurate, but slower. Used only by BarnesHutRepulsion.
+    void setBarnesHutTheta(qreal val) { m_barnesHutTheta = val; }
+    qreal barnesHutTheta() const { return m_barnesHutTheta; }
+
+    // When set, forces on large graphs are accumulated on all available cores.
+    void setParallel(bool val) { m_parallel = val; }
+    bool isParallel() const { return m_parallel; }
+
     // AbstractGraphLayout interface
     bool layout(const Graph &graph);
 
 private:
-    void calculateRepulsion(QVector<QPointF> &forces, const Graph &graph);
-    void calculateAttraction(QVector<QPointF> &forces, const Graph &graph);
+    void calculateRepulsion(QVector<QPointF> &forces, const QVector<QPointF> &positions);
+    void calculateAttraction(QVector<QPointF> &forces, const QVector<QPointF> &positions,
+                             const QVector<QPair<int, int>> &edges);
     bool placeNodes(const QVector<QPointF> &forces, const Graph &graph);
+
+private:
+    RepulsionMethod m_repulsionMethod = AutomaticRepulsion;
+    qreal m_barnesHutTheta = 0.5;
+    bool m_parallel = true;
 };
 
 }
@@ -14,6 +14,7 @@
 #include "qobjectserializer.h"
 #include "timeprofiler.h"
 
+#include <QMutex>
 #include <QtDebug>
 #include <QStack>
 #include <QColor>
@@ -23,6 +24,7 @@
 #include <QMetaProperty>
 #include <QMetaClassInfo>
 #include <QJsonDocument>
+#include <QSharedPointer>
 #include <QQmlListProperty>
 #include <QQmlListReference>
 
@@ -138,69 +140,58 @@ const QObjectSerializer::Helper *ObjectSerializerHelperRegistry::findHelper(int
 
 Q_GLOBAL_STATIC(ObjectSerializerHelperRegistry, Helpers)
 
-void QObjectSerializer::registerHelper(QObjectSerializer::Helper *helper)
+/**
+ * Everything toJson() and fromJson() need to know about the properties of a class, worked out
+ * once from its QMetaObject chain: which properties qualify for serialization, how each one is
+ * handled, its helper, its JSON key and its default value. Interface::canSerialize() can depend
+ * on the object's state, so it is still asked per object.
+ */
+struct ObjectSerializerPlan
 {
-    if (::Helpers()->contains(helper))
-        return;
+    enum Kind { ListKind, EnumKind, FlagKind, ObjectKind, ValueKind };
+
+    struct Property
+    {
+        const QMetaObject *metaObject = nullptr; // class that declares the property
+        QMetaProperty property;
+        QByteArray name;
+        QString key;
+        Kind kind = ValueKind;
+        int userType = QMetaType::UnknownType;
+        bool serializeToJson = true;
+
+        QMetaEnum enumerator; // for EnumKind and FlagKind
+        bool isFlag = false;
+        const QMetaObject *objectMetaObject = nullptr; // for ObjectKind
+        QByteArray objectClassName; // for ObjectKind
+        const QObjectSerializer::Helper *helper = nullptr;
+
+        QVariant defaultValue;
+        QJsonValue defaultJsonValue;
+        QJsonObject defaultJsonObject;
+        QJsonArray defaultJsonArray;
+    };
 
-    ::Helpers()->append(helper);
-}
+    explicit ObjectSerializerPlan(const QObject *object);
 
-QObjectSerializer::Helper::~Helper()
-{
-    ::Helpers()->removeOne(this);
-}
-
-QObjectSerializer::Interface::~Interface() { }
+    QVector<Property> properties;
+};
 
-QJsonObject QObjectSerializer::toJson(const QObject *object)
+ObjectSerializerPlan::ObjectSerializerPlan(const QObject *object)
 {
-    QJsonObject ret;
-    if (object == nullptr)
-        return ret;
-
-    QObjectSerializer::Interface *interface = qobject_cast<QObjectSerializer::Interface *>(object);
-    if (interface != nullptr)
-        interface->prepareForSerialization();
-
     QStack<const QMetaObject *> metaObjects;
-    QStringList classNames;
-    const QMetaObject *mo = object->metaObject();
-    while (mo) {
+    for (const QMetaObject *mo = object->metaObject(); mo; mo = mo->superClass())
         metaObjects.push(mo);
-        if (interface != nullptr && interface->canSerialize(mo, QMetaProperty()) == false) {
-            mo = mo->superClass();
-            continue;
-        }
-
-        classNames << QString::fromLatin1(mo->className());
-        mo = mo->superClass();
-    }
-
-    // ret.insert("_class", classNames.join(","));
 
     const QVariantMap defaultProperties =
             QObjectSerializer::cacheDefaultPropertyValues(object, true);
 
     while (!metaObjects.isEmpty()) {
-        mo = metaObjects.pop();
+        const QMetaObject *mo = metaObjects.pop();
 
         const int nrProperties = mo->propertyCount();
         for (int i = mo->propertyOffset(); i < nrProperties; i++) {
             const QMetaProperty prop = mo->property(i);
-            if (interface != nullptr && interface->canSerialize(mo, prop) == false)
-                continue;
-
-#ifdef QT_WIDGETS_LIB
-            // QGraphicsObject::parent property returns a parent QGraphicsObject.
-            // While saving a QGraphicsObject, we could end up in recursion if
-            // we are saving the QGraphicsObject's children also.
-            static const char *parentPropName = "parent";
-            if (mo == &QGraphicsObject::staticMetaObject && !qstrcmp(prop.name(), parentPropName))
-                continue;
-#endif
-
-            const QMetaType propType(prop.userType());
 
             // The objectName property wont be stored. In all my experiments so far,
             // storing objectName has turned out to be pointless.
@@ -219,86 +210,220 @@ QJsonObject QObjectSerializer::toJson(const QObject *object)
             // cant be unserialized, whats the point of storing them.
             // The only exception to this rule is if the property is returning a QObject
             // type. In which case, we have to serialize it.
+            const QMetaType propType(prop.userType());
             const bool isQObjectPointer = (propType.flags() & QMetaType::PointerToQObject);
             const bool isQQmlListProperty =
                     QByteArray(prop.typeName()).startsWith("QQmlListProperty");
             if (!prop.isWritable() && !isQObjectPointer && !isQQmlListProperty)
                 continue;
 
-            const QString propName = QString::fromLatin1(prop.name());
-            const QVariant defaultPropValue = defaultProperties.value(propName);
-            QVariant propValue = prop.read(object);
+            Property property;
+            property.metaObject = mo;
+            property.property = prop;
+            property.name = QByteArray(prop.name());
+            property.key = QString::fromLatin1(property.name);
+            property.userType = prop.userType();
 
-            if (isQQmlListProperty) {
-                QJsonArray list;
+#ifdef QT_WIDGETS_LIB
+            // QGraphicsObject::parent property returns a parent QGraphicsObject.
+            // While saving a QGraphicsObject, we could end up in recursion if
+            // we are saving the QGraphicsObject's children also.
+            static const char *parentPropName = "parent";
+            if (mo == &QGraphicsObject::staticMetaObject && !qstrcmp(prop.name(), parentPropName))
+                property.serializeToJson = false;
+#endif
 
-                QQmlListReference listRef(const_cast<QObject *>(object), prop.name());
-                for (int i = 0; i < listRef.count(); i++) {
-                    const QObject *listItem = listRef.at(i);
-                    if (listItem == nullptr)
-                        continue;
+            if (isQQmlListProperty)
+                property.kind = ListKind;
+            else if (prop.isEnumType())
+                property.kind = EnumKind;
+            else if (prop.isFlagType())
+                property.kind = FlagKind;
+            else if (isQObjectPointer)
+                property.kind = ObjectKind;
+            else
+                property.kind = ValueKind;
+
+            if (property.kind == EnumKind || property.kind == FlagKind) {
+                property.enumerator = prop.enumerator();
+                property.isFlag = prop.isFlagType();
+            }
 
-                    QJsonObject item = QObjectSerializer::toJson(listItem);
-                    list.append(item);
-                }
+            if (property.kind == ObjectKind) {
+                property.objectMetaObject = QMetaType::metaObjectForType(property.userType);
+                property.objectClassName = QByteArray(prop.typeName()).replace('*', "");
+            }
 
-                ret.insert(propName, list);
-            } else if (prop.isEnumType()) {
-                const QMetaEnum propEnum = prop.enumerator();
-                propValue = QString::fromLatin1(propEnum.valueToKey(propValue.toInt()));
-                if (defaultPropValue == propValue.toString())
-                    continue;
+            if (property.kind == ValueKind)
+                property.helper = ::Helpers()->findHelper(property.userType);
 
-                ret.insert(propName, propValue.toString());
-            } else if (prop.isFlagType()) {
-                const QMetaEnum propEnum = prop.enumerator();
-                propValue = QString::fromLatin1(propEnum.valueToKeys(propValue.toInt()));
-                if (defaultPropValue == propValue.toString())
+            property.defaultValue = defaultProperties.value(property.key);
+            property.defaultJsonValue = property.defaultValue.toJsonValue();
+            property.defaultJsonObject = property.defaultValue.toJsonObject();
+            property.defaultJsonArray = property.defaultValue.toJsonArray();
+
+            properties.append(property);
+        }
+    }
+}
+
+class ObjectSerializerPlanRegistry
+{
+public:
+    QSharedPointer<const ObjectSerializerPlan> plan(const QObject *object)
+    {
+        const QMetaObject *mo = object->metaObject();
+
+        QMutexLocker locker(&m_mutex);
+        auto it = m_plans.constFind(mo);
+        if (it != m_plans.constEnd())
+            return it.value();
+
+        QSharedPointer<const ObjectSerializerPlan> ret(new ObjectSerializerPlan(object));
+        m_plans.insert(mo, ret);
+        return ret;
+    }
+
+    // Plans in use by ongoing serializations stay alive until they are done.
+    void clear()
+    {
+        QMutexLocker locker(&m_mutex);
+        m_plans.clear();
+    }
+
+private:
+    QMutex m_mutex;
+    QHash<const QMetaObject *, QSharedPointer<const ObjectSerializerPlan>> m_plans;
+};
+
+Q_GLOBAL_STATIC(ObjectSerializerPlanRegistry, Plans)
+
+// Plans hold on to helpers and default values, they have to be worked out again if those change.
+static void invalidateObjectSerializerPlans()
+{
+    if (!::Plans.isDestroyed())
+        ::Plans()->clear();
+}
+
+void QObjectSerializer::registerHelper(QObjectSerializer::Helper *helper)
+{
+    if (::Helpers()->contains(helper))
+        return;
+
+    ::Helpers()->append(helper);
+    invalidateObjectSerializerPlans();
+}
+
+QObjectSerializer::Helper::~Helper()
+{
+    ::Helpers()->removeOne(this);
+    invalidateObjectSerializerPlans();
+}
+
+QObjectSerializer::Interface::~Interface() { }
+
+QJsonObject QObjectSerializer::toJson(const QObject *object)
+{
+    QJsonObject ret;
+    if (object == nullptr)
+        return ret;
+
+    QObjectSerializer::Interface *interface = qobject_cast<QObjectSerializer::Interface *>(object);
+    if (interface != nullptr)
+        interface->prepareForSerialization();
+
+    const QSharedPointer<const ObjectSerializerPlan> plan = ::Plans()->plan(object);
+
+    for (const ObjectSerializerPlan::Property &property : plan->properties) {
+        if (!property.serializeToJson)
+            continue;
+
+        const QMetaProperty &prop = property.property;
+        if (interface != nullptr && interface->canSerialize(property.metaObject, prop) == false)
+            continue;
+
+        const QString &propName = property.key;
+        const QVariant &defaultPropValue = property.defaultValue;
+
+        switch (property.kind) {
+        case ObjectSerializerPlan::ListKind: {
+            QJsonArray list;
+
+            QQmlListReference listRef(const_cast<QObject *>(object), property.name.constData());
+            for (int i = 0; i < listRef.count(); i++) {
+                const QObject *listItem = listRef.at(i);
+                if (listItem == nullptr)
                     continue;
 
-                ret.insert(propName, propValue.toString());
-            } else if (propType.flags() & QMetaType::PointerToQObject) {
-                propValue.convert(QMetaType::QObjectStar);
+                QJsonObject item = QObjectSerializer::toJson(listItem);
+                list.append(item);
+            }
 
-                const QObject *propObject = propValue.value<QObject *>();
-                if (propObject != nullptr) {
-                    const QJsonObject propJson = QObjectSerializer::toJson(propObject);
-                    if (!propJson.isEmpty())
-                        ret.insert(propName, propJson);
-                }
-            } else if (propValue.userType() == QMetaType::QJsonValue) {
+            ret.insert(propName, list);
+        } break;
+        case ObjectSerializerPlan::EnumKind:
+        case ObjectSerializerPlan::FlagKind: {
+            const int value = prop.read(object).toInt();
+            const QString key = property.kind == ObjectSerializerPlan::EnumKind
+                    ? QString::fromLatin1(property.enumerator.valueToKey(value))
+                    : QString::fromLatin1(property.enumerator.valueToKeys(value));
+            if (defaultPropValue == key)
+                continue;
+
+            ret.insert(propName, key);
+        } break;
+        case ObjectSerializerPlan::ObjectKind: {
+            QVariant propValue = prop.read(object);
+            propValue.convert(QMetaType::QObjectStar);
+
+            const QObject *propObject = propValue.value<QObject *>();
+            if (propObject != nullptr) {
+                const QJsonObject propJson = QObjectSerializer::toJson(propObject);
+                if (!propJson.isEmpty())
+                    ret.insert(propName, propJson);
+            }
+        } break;
+        case ObjectSerializerPlan::ValueKind: {
+            const QVariant propValue = prop.read(object);
+
+            switch (propValue.userType()) {
+            case QMetaType::QJsonValue: {
                 const QJsonValue propJsonValue = propValue.toJsonValue();
-                if (defaultPropValue.toJsonValue() == propValue.toJsonValue())
+                if (property.defaultJsonValue == propJsonValue)
                     continue;
 
                 ret.insert(propName, propJsonValue);
-            } else if (propValue.userType() == QMetaType::QJsonObject) {
+            } break;
+            case QMetaType::QJsonObject: {
                 const QJsonObject propJsonObject = propValue.toJsonObject();
-                if (defaultPropValue.toJsonObject() == propJsonObject)
+                if (property.defaultJsonObject == propJsonObject)
                     continue;
 
                 ret.insert(propName, propJsonObject);
-            } else if (propValue.userType() == QMetaType::QJsonArray) {
+            } break;
+            case QMetaType::QJsonArray: {
                 const QJsonArray propJsonArray = propValue.toJsonArray();
-                if (defaultPropValue.toJsonArray() == propJsonArray)
+                if (property.defaultJsonArray == propJsonArray)
                     continue;
 
                 ret.insert(propName, propJsonArray);
-            } else {
-                const QObjectSerializer::Helper *helper = ::Helpers()->findHelper(prop.userType());
-                if (helper == nullptr) {
+            } break;
+            default:
+                if (property.helper == nullptr) {
                     if (propValue == defaultPropValue)
                         continue;
 
                     ret.insert(propName, QJsonValue::fromVariant(propValue));
                 } else {
-                    const QJsonValue propJsonValue = helper->toJson(propValue);
-                    if (propJsonValue == defaultPropValue.toJsonValue())
+                    const QJsonValue propJsonValue = property.helper->toJson(propValue);
+                    if (propJsonValue == property.defaultJsonValue)
                         continue;
 
                     ret.insert(propName, propJsonValue);
                 }
+                break;
             }
+        } break;
         }
     }
 
@@ -330,153 +455,118 @@ bool QObjectSerializer::fromJson(const QJsonObject &json, QObject *object, QObje
     if (interface != nullptr)
         interface->prepareForDeserialization();
 
-    QStack<const QMetaObject *> metaObjects;
-    QStringList classNames;
-    const QMetaObject *mo = object->metaObject();
-    while (mo) {
-        metaObjects.push(mo);
-        if (interface != nullptr && interface->canSerialize(mo, QMetaProperty()) == false) {
-            mo = mo->superClass();
-            continue;
-        }
+    const QSharedPointer<const ObjectSerializerPlan> plan = ::Plans()->plan(object);
 
-        classNames << QString::fromLatin1(mo->className());
-        mo = mo->superClass();
-    }
+    for (const ObjectSerializerPlan::Property &property : plan->properties) {
+        const QMetaProperty &prop = property.property;
+        if (interface != nullptr && interface->canSerialize(property.metaObject, prop) == false)
+            continue;
 
-    while (!metaObjects.isEmpty()) {
-        mo = metaObjects.pop();
+        const QString &propName = property.key;
+        const auto jsonIt = json.constFind(propName);
+        if (jsonIt == json.constEnd())
+            continue;
 
-        const int nrProperties = mo->propertyCount();
-        for (int i = mo->propertyOffset(); i < nrProperties; i++) {
-            const QMetaProperty prop = mo->property(i);
-            if (interface != nullptr && interface->canSerialize(mo, prop) == false)
-                continue;
+        const QJsonValue jsonPropValue = jsonIt.value();
 
-            const QMetaType propType(prop.userType());
+        if (property.kind == ObjectSerializerPlan::ListKind) {
+            const QJsonArray list = jsonPropValue.toArray();
 
-            static const char *objectName = "objectName";
-            if (!qstrcmp(prop.name(), objectName))
-                continue;
+            QQmlListReference listRef(const_cast<QObject *>(object), property.name.constData());
+            const bool canAddObjects = interface
+                    && interface->canSetPropertyFromObjectList(propName) && listRef.canAppend();
 
-            if (!prop.isStored())
-                continue;
+            QObjectFactory listItemFactory;
+            const QByteArray className(listRef.listElementType()->className());
+            listItemFactory.add(listRef.listElementType());
 
-            const bool isQObjectPointer = (propType.flags() & QMetaType::PointerToQObject);
-            const bool isQQmlListProperty =
-                    QByteArray(prop.typeName()).startsWith("QQmlListProperty");
-            if (!prop.isWritable() && !isQObjectPointer && !isQQmlListProperty)
-                continue;
+            QList<QObject *> propertyObjects;
+            if (canAddObjects)
+                propertyObjects.reserve(list.size());
+            else if (listRef.canAppend())
+                listRef.clear();
 
-            const QString propName = QString::fromLatin1(prop.name());
-            if (!json.contains(propName))
-                continue;
+            for (int i = 0; i < list.size(); i++) {
+                const QJsonObject listItem = list.at(i).toObject();
 
-            const QJsonValue jsonPropValue = json.value(propName);
-
-            if (isQQmlListProperty) {
-                const QJsonArray list = jsonPropValue.toArray();
-
-                QQmlListReference listRef(const_cast<QObject *>(object), prop.name());
-                const bool canAddObjects =
-                        interface && interface->canSetPropertyFromObjectList(propName)
-                        && listRef.canAppend();
-
-                QObjectFactory listItemFactory;
-                const QByteArray className(listRef.listElementType()->className());
-                listItemFactory.add(listRef.listElementType());
-
-                QList<QObject *> propertyObjects;
-                if (canAddObjects)
-                    propertyObjects.reserve(list.size());
-                else if (listRef.canAppend())
-                    listRef.clear();
-
-                for (int i = 0; i < list.size(); i++) {
-                    const QJsonObject listItem = list.at(i).toObject();
-
-                    if (listRef.canAppend()) {
-                        QObject *listItemObject =
-                                listItemFactory.create(className, listRef.object());
-                        QObjectSerializer::fromJson(listItem, listItemObject, factory);
-                        if (canAddObjects)
-                            propertyObjects.append(listItemObject);
-                        else
-                            listRef.append(listItemObject);
-                    } else {
-                        QObject *listItemObject = listRef.at(i);
-                        if (listItemObject == nullptr)
-                            continue;
-                        QObjectSerializer::fromJson(listItem, listItemObject, factory);
-                    }
+                if (listRef.canAppend()) {
+                    QObject *listItemObject = listItemFactory.create(className, listRef.object());
+                    QObjectSerializer::fromJson(listItem, listItemObject, factory);
+                    if (canAddObjects)
+                        propertyObjects.append(listItemObject);
+                    else
+                        listRef.append(listItemObject);
+                } else {
+                    QObject *listItemObject = listRef.at(i);
+                    if (listItemObject == nullptr)
+                        continue;
+                    QObjectSerializer::fromJson(listItem, listItemObject, factory);
                 }
+            }
 
-                if (canAddObjects)
-                    interface->setPropertyFromObjectList(propName, propertyObjects);
+            if (canAddObjects)
+                interface->setPropertyFromObjectList(propName, propertyObjects);
 
-                continue;
-            }
+            continue;
+        }
 
-            if (prop.isEnumType() || prop.isFlagType()) {
-                const QByteArray key = jsonPropValue.toString().toLatin1();
-                const QMetaEnum enumerator = prop.enumerator();
-                const int value = prop.isFlagType()
-                        ? (key.isEmpty() ? 0 : enumerator.keysToValue(key))
-                        : enumerator.keyToValue(key);
-                prop.write(object, value);
-                continue;
-            }
+        if (property.kind == ObjectSerializerPlan::EnumKind
+            || property.kind == ObjectSerializerPlan::FlagKind) {
+            const QByteArray key = jsonPropValue.toString().toLatin1();
+            const QMetaEnum &enumerator = property.enumerator;
+            const int value = property.isFlag
+                    ? (key.isEmpty() ? 0 : enumerator.keysToValue(key))
+                    : enumerator.keyToValue(key);
+            prop.write(object, value);
+            continue;
+        }
+
+        if (property.kind == ObjectSerializerPlan::ObjectKind) {
+            QObjectFactory *usableFactory = factory;
+            QObjectFactory stopGapFactory;
 
-            if (propType.flags() & QMetaType::PointerToQObject) {
-                QObjectFactory *usableFactory = factory;
-                QObjectFactory stopGapFactory;
-
-                const QVariant propValue = prop.read(object);
-                QObject *propObject = propValue.value<QObject *>();
-                if (propObject == nullptr) {
-                    if (factory == nullptr) {
-                        stopGapFactory.add(QMetaType::metaObjectForType(prop.userType()));
-                        usableFactory = &stopGapFactory;
-                    } else
-                        factory->add(QMetaType::metaObjectForType(prop.userType()));
-
-                    if (prop.isWritable() && usableFactory != nullptr) {
-                        const QByteArray className = QByteArray(prop.typeName()).replace('*', "");
-                        propObject = usableFactory->create(className, object);
-                        if (propObject == nullptr)
-                            continue;
-
-                        prop.write(object, QVariant::fromValue(propObject));
-                    } else
+            const QVariant propValue = prop.read(object);
+            QObject *propObject = propValue.value<QObject *>();
+            if (propObject == nullptr) {
+                if (factory == nullptr) {
+                    stopGapFactory.add(property.objectMetaObject);
+                    usableFactory = &stopGapFactory;
+                } else
+                    factory->add(property.objectMetaObject);
+
+                if (prop.isWritable() && usableFactory != nullptr) {
+                    propObject = usableFactory->create(property.objectClassName, object);
+                    if (propObject == nullptr)
                         continue;
-                }
 
-                const QJsonObject propJson = jsonPropValue.toObject();
-                QObjectSerializer::fromJson(propJson, propObject, usableFactory);
-                continue;
+                    prop.write(object, QVariant::fromValue(propObject));
+                } else
+                    continue;
             }
 
-            switch (prop.userType()) {
-            case QMetaType::QJsonValue:
-                prop.write(object, QVariant::fromValue<QJsonValue>(jsonPropValue));
-                continue;
-            case QMetaType::QJsonObject:
-                prop.write(object, QVariant::fromValue<QJsonObject>(jsonPropValue.toObject()));
-                continue;
-            case QMetaType::QJsonArray:
-                prop.write(object, QVariant::fromValue<QJsonArray>(jsonPropValue.toArray()));
-                continue;
-            default:
-                break;
-            }
+            const QJsonObject propJson = jsonPropValue.toObject();
+            QObjectSerializer::fromJson(propJson, propObject, usableFactory);
+            continue;
+        }
 
-            const QObjectSerializer::Helper *helper = ::Helpers()->findHelper(prop.userType());
-            const QJsonValue propJsonValue = json.value(propName);
-            const QVariant propValue = helper == nullptr
-                    ? propJsonValue.toVariant()
-                    : helper->fromJson(propJsonValue, prop.userType());
-            prop.write(object, propValue);
+        switch (property.userType) {
+        case QMetaType::QJsonValue:
+            prop.write(object, QVariant::fromValue<QJsonValue>(jsonPropValue));
+            continue;
+        case QMetaType::QJsonObject:
+            prop.write(object, QVariant::fromValue<QJsonObject>(jsonPropValue.toObject()));
+            continue;
+        case QMetaType::QJsonArray:
+            prop.write(object, QVariant::fromValue<QJsonArray>(jsonPropValue.toArray()));
+            continue;
+        default:
+            break;
         }
+
+        const QVariant propValue = property.helper == nullptr
+                ? jsonPropValue.toVariant()
+                : property.helper->fromJson(jsonPropValue, property.userType);
+        prop.write(object, propValue);
     }
 
 #ifdef SERIALIZE_DYNAMIC_PROPERTIES
@@ -883,6 +973,7 @@ QVariant QRectFHelper::fromJson(const QJsonValue &value, int type) const
 
 QVariantMap QObjectSerializer::cacheDefaultPropertyValues(const QObject *object, bool readonly)
 {
+    static QMutex defaultPropertyValueMapMutex;
     static QMap<QByteArray, QVariantMap> defaultPropertyValueMap;
 
     QVariantMap ret;
@@ -890,8 +981,11 @@ QVariantMap QObjectSerializer::cacheDefaultPropertyValues(const QObject *object,
         return ret;
 
     const QByteArray className(object->metaObject()->className());
-    if (defaultPropertyValueMap.contains(className) || readonly)
-        return defaultPropertyValueMap.value(className);
+    {
+        QMutexLocker locker(&defaultPropertyValueMapMutex);
+        if (defaultPropertyValueMap.contains(className) || readonly)
+            return defaultPropertyValueMap.value(className);
+    }
 
     QObjectSerializer::Interface *interface = qobject_cast<QObjectSerializer::Interface *>(object);
 
@@ -957,7 +1051,13 @@ QVariantMap QObjectSerializer::cacheDefaultPropertyValues(const QObject *object,
         }
     }
 
-    defaultPropertyValueMap.insert(className, ret);
+    {
+        QMutexLocker locker(&defaultPropertyValueMapMutex);
+        defaultPropertyValueMap.insert(className, ret);
+    }
+
+    // Plans built for this class so far did not know about these defaults.
+    invalidateObjectSerializerPlans();
 
     return ret;
 }
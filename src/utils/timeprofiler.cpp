@@ -0,0 +1,339 @@
+/****************************************************************************
+**
+** Copyright (C) VCreate Logic Pvt. Ltd. Bengaluru
+** Author: Prashanth N Udupa (prashanth@scrite.io)
+**
+** This code is distributed under GPL v3. Complete text of the license
+** can be found here: https://www.gnu.org/licenses/gpl-3.0.txt
+**
+** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+**
+****************************************************************************/
+
+#include "timeprofiler.h"
+
+#include <QFile>
+#include <QHash>
+#include <QMutex>
+#include <QThread>
+#include <QVector>
+#include <QTextStream>
+#include <QJsonDocument>
+#include <QElapsedTimer>
+#include <QRandomGenerator>
+#include <QCoreApplication>
+
+namespace {
+
+struct ScopeStats
+{
+    const char *name = nullptr;
+    int threadIndex = 0;
+    qint64 count = 0;
+    qint64 totalNs = 0;
+    qint64 minNs = 0;
+    qint64 maxNs = 0;
+    QVector<qint64> samplesNs; // reservoir of durations, for percentiles
+};
+
+struct TraceEvent
+{
+    const char *name = nullptr;
+    int threadIndex = 0;
+    qint64 startNs = 0;
+    qint64 durationNs = 0;
+};
+
+struct TimeProfilerData
+{
+    enum { MaxSamplesPerScope = 1024, MaxTraceEvents = 1 << 18 };
+
+    TimeProfilerData() { clock.start(); }
+
+    int threadIndex(QThread *thread)
+    {
+        auto it = threads.find(thread);
+        if (it != threads.end())
+            return it.value();
+
+        const int index = threads.size();
+        threads.insert(thread, index);
+
+        QString name = thread->objectName();
+        if (name.isEmpty())
+            name = qApp && thread == qApp->thread() ? QStringLiteral("Main Thread")
+                                                    : QStringLiteral("Thread %1").arg(index);
+        threadNames.append(name);
+        return index;
+    }
+
+    void clear()
+    {
+        stats.clear();
+        events.clear();
+        droppedEvents = 0;
+    }
+
+    QMutex mutex;
+    QElapsedTimer clock;
+    QHash<QThread *, int> threads;
+    QStringList threadNames;
+    QHash<QPair<const char *, int>, ScopeStats> stats;
+    QVector<TraceEvent> events;
+    int droppedEvents = 0;
+};
+
+qint64 percentile(const QVector<qint64> &sortedSamples, qreal fraction)
+{
+    if (sortedSamples.isEmpty())
+        return 0;
+
+    const int index = qBound(0, int(fraction * sortedSamples.size()), sortedSamples.size() - 1);
+    return sortedSamples.at(index);
+}
+
+inline qreal toMs(qint64 ns)
+{
+    return qreal(ns) / 1e6;
+}
+
+}
+
+Q_GLOBAL_STATIC(TimeProfilerData, GlobalTimeProfilerData)
+
+QAtomicInt TimeProfiler::EnabledFlag;
+
+static void saveTimeProfilerTraceOnExit()
+{
+    const QString fileName = qEnvironmentVariable("SCRITE_PROFILE_TRACE");
+    if (!TimeProfiler::saveTrace(fileName))
+        qWarning("Couldn't write profiler trace to %s", qPrintable(fileName));
+}
+
+static void initTimeProfilerFromEnvironment()
+{
+    if (!qEnvironmentVariableIsEmpty("SCRITE_PROFILE_TRACE")) {
+        TimeProfiler::enable();
+        qAddPostRoutine(saveTimeProfilerTraceOnExit);
+    } else if (!qEnvironmentVariableIsEmpty("SCRITE_PROFILE"))
+        TimeProfiler::enable();
+}
+Q_COREAPP_STARTUP_FUNCTION(initTimeProfilerFromEnvironment)
+
+TimeProfiler::TimeProfiler(QObject *parent) : QObject(parent) { }
+
+TimeProfiler::~TimeProfiler() { }
+
+void TimeProfiler::setEnabled(bool val)
+{
+    if (TimeProfiler::isEnabled() == val)
+        return;
+
+    TimeProfiler::enable(val);
+    emit enabledChanged();
+}
+
+void TimeProfiler::enable(bool val)
+{
+    // Make sure that the clock is running before the first scope reads it.
+    if (val)
+        GlobalTimeProfilerData();
+
+    EnabledFlag.storeRelaxed(val ? 1 : 0);
+}
+
+void TimeProfiler::reset()
+{
+    TimeProfilerData *data = GlobalTimeProfilerData;
+    QMutexLocker locker(&data->mutex);
+    data->clear();
+}
+
+QJsonArray TimeProfiler::report()
+{
+    QList<ScopeStats> allStats;
+    QStringList threadNames;
+    {
+        TimeProfilerData *data = GlobalTimeProfilerData;
+        QMutexLocker locker(&data->mutex);
+        allStats = data->stats.values();
+        threadNames = data->threadNames;
+    }
+
+    std::sort(allStats.begin(), allStats.end(), [](const ScopeStats &a, const ScopeStats &b) {
+        return a.totalNs > b.totalNs;
+    });
+
+    QJsonArray ret;
+    for (ScopeStats &stats : allStats) {
+        std::sort(stats.samplesNs.begin(), stats.samplesNs.end());
+
+        QJsonObject item;
+        item.insert(QStringLiteral("name"), QString::fromLatin1(stats.name));
+        item.insert(QStringLiteral("thread"), threadNames.value(stats.threadIndex));
+        item.insert(QStringLiteral("threadIndex"), stats.threadIndex);
+        item.insert(QStringLiteral("count"), stats.count);
+        item.insert(QStringLiteral("totalMs"), toMs(stats.totalNs));
+        item.insert(QStringLiteral("minMs"), toMs(stats.minNs));
+        item.insert(QStringLiteral("maxMs"), toMs(stats.maxNs));
+        item.insert(QStringLiteral("averageMs"),
+                    stats.count ? toMs(stats.totalNs) / stats.count : 0.0);
+        item.insert(QStringLiteral("p50Ms"), toMs(percentile(stats.samplesNs, 0.5)));
+        item.insert(QStringLiteral("p90Ms"), toMs(percentile(stats.samplesNs, 0.9)));
+        item.insert(QStringLiteral("p99Ms"), toMs(percentile(stats.samplesNs, 0.99)));
+        ret.append(item);
+    }
+
+    return ret;
+}
+
+QString TimeProfiler::summary()
+{
+    const QJsonArray items = TimeProfiler::report();
+
+    QString ret;
+    QTextStream ts(&ret, QIODevice::WriteOnly);
+    ts << QStringLiteral("%1 %2 %3 %4 %5 %6 %7  %8\n")
+                    .arg(QStringLiteral("Count"), 8)
+                    .arg(QStringLiteral("Total"), 10)
+                    .arg(QStringLiteral("Min"), 9)
+                    .arg(QStringLiteral("Max"), 9)
+                    .arg(QStringLiteral("P50"), 9)
+                    .arg(QStringLiteral("P99"), 9)
+                    .arg(QStringLiteral("Thread"), -12)
+                    .arg(QStringLiteral("Scope"));
+
+    for (const QJsonValue &value : items) {
+        const QJsonObject item = value.toObject();
+        auto ms = [item](const QString &key, int width) {
+            return QStringLiteral("%1").arg(item.value(key).toDouble(), width, 'f', 3);
+        };
+        ts << QStringLiteral("%1 ").arg(item.value(QStringLiteral("count")).toInt(), 8)
+           << ms(QStringLiteral("totalMs"), 10) << " " << ms(QStringLiteral("minMs"), 9) << " "
+           << ms(QStringLiteral("maxMs"), 9) << " " << ms(QStringLiteral("p50Ms"), 9) << " "
+           << ms(QStringLiteral("p99Ms"), 9) << " "
+           << QStringLiteral("%1").arg(item.value(QStringLiteral("thread")).toString(), -12)
+           << "  " << item.value(QStringLiteral("name")).toString() << "\n";
+    }
+
+    ts.flush();
+    return ret;
+}
+
+QJsonObject TimeProfiler::traceEvents()
+{
+    QVector<TraceEvent> events;
+    QStringList threadNames;
+    int droppedEvents = 0;
+    {
+        TimeProfilerData *data = GlobalTimeProfilerData;
+        QMutexLocker locker(&data->mutex);
+        events = data->events;
+        threadNames = data->threadNames;
+        droppedEvents = data->droppedEvents;
+    }
+
+    const qint64 pid = QCoreApplication::applicationPid();
+
+    QJsonArray traceEvents;
+    for (int i = 0; i < threadNames.size(); i++) {
+        QJsonObject args;
+        args.insert(QStringLiteral("name"), threadNames.at(i));
+
+        QJsonObject event;
+        event.insert(QStringLiteral("name"), QStringLiteral("thread_name"));
+        event.insert(QStringLiteral("ph"), QStringLiteral("M"));
+        event.insert(QStringLiteral("pid"), pid);
+        event.insert(QStringLiteral("tid"), i);
+        event.insert(QStringLiteral("args"), args);
+        traceEvents.append(event);
+    }
+
+    // Names are mostly Q_FUNC_INFO literals repeated many times over, convert each just once.
+    QHash<const char *, QString> names;
+    for (const TraceEvent &e : qAsConst(events)) {
+        auto nit = names.find(e.name);
+        if (nit == names.end())
+            nit = names.insert(e.name, QString::fromLatin1(e.name));
+
+        QJsonObject event;
+        event.insert(QStringLiteral("name"), nit.value());
+        event.insert(QStringLiteral("cat"), QStringLiteral("scrite"));
+        event.insert(QStringLiteral("ph"), QStringLiteral("X"));
+        event.insert(QStringLiteral("ts"), qreal(e.startNs) / 1e3);
+        event.insert(QStringLiteral("dur"), qreal(e.durationNs) / 1e3);
+        event.insert(QStringLiteral("pid"), pid);
+        event.insert(QStringLiteral("tid"), e.threadIndex);
+        traceEvents.append(event);
+    }
+
+    QJsonObject otherData;
+    otherData.insert(QStringLiteral("droppedEvents"), droppedEvents);
+
+    QJsonObject ret;
+    ret.insert(QStringLiteral("traceEvents"), traceEvents);
+    ret.insert(QStringLiteral("displayTimeUnit"), QStringLiteral("ms"));
+    ret.insert(QStringLiteral("otherData"), otherData);
+    return ret;
+}
+
+bool TimeProfiler::saveTrace(const QString &fileName)
+{
+    if (fileName.isEmpty())
+        return false;
+
+    QFile file(fileName);
+    if (!file.open(QFile::WriteOnly))
+        return false;
+
+    const QJsonDocument doc(TimeProfiler::traceEvents());
+    return file.write(doc.toJson(QJsonDocument::Compact)) >= 0;
+}
+
+void TimeProfiler::record(const char *name, qint64 startNs, qint64 durationNs)
+{
+    TimeProfilerData *data = GlobalTimeProfilerData;
+    QThread *thread = QThread::currentThread();
+
+    QMutexLocker locker(&data->mutex);
+    const int threadIndex = data->threadIndex(thread);
+
+    ScopeStats &stats = data->stats[qMakePair(name, threadIndex)];
+    if (stats.count == 0) {
+        stats.name = name;
+        stats.threadIndex = threadIndex;
+        stats.minNs = durationNs;
+        stats.maxNs = durationNs;
+    } else {
+        stats.minNs = qMin(stats.minNs, durationNs);
+        stats.maxNs = qMax(stats.maxNs, durationNs);
+    }
+
+    ++stats.count;
+    stats.totalNs += durationNs;
+
+    // Reservoir sampling keeps percentiles representative without storing every call.
+    if (stats.samplesNs.size() < TimeProfilerData::MaxSamplesPerScope)
+        stats.samplesNs.append(durationNs);
+    else {
+        const qint64 slot = qint64(QRandomGenerator::global()->generate64() % quint64(stats.count));
+        if (slot < TimeProfilerData::MaxSamplesPerScope)
+            stats.samplesNs[int(slot)] = durationNs;
+    }
+
+    if (data->events.size() < TimeProfilerData::MaxTraceEvents) {
+        TraceEvent event;
+        event.name = name;
+        event.threadIndex = threadIndex;
+        event.startNs = startNs;
+        event.durationNs = durationNs;
+        data->events.append(event);
+    } else
+        ++data->droppedEvents;
+}
+
+qint64 TimeProfiler::nowNs()
+{
+    return GlobalTimeProfilerData->clock.nsecsElapsed();
+}
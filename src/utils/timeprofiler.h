@@ -14,7 +14,86 @@
 #ifndef TIME_PROFILER_H
 #define TIME_PROFILER_H
 
-#define PROFILE_THIS_FUNCTION
-#define PROFILE_THIS_FUNCTION2
+#include <QObject>
+#include <QAtomicInt>
+#include <QQmlEngine>
+#include <QJsonArray>
+#include <QJsonObject>
+
+/**
+ * Built-in scoped profiler. Profiling is off by default, in which case an instrumented scope
+ * costs a single relaxed atomic load. It can be switched on from QML (TimeProfiler.enabled),
+ * or before launch by setting the SCRITE_PROFILE environment variable. If SCRITE_PROFILE_TRACE
+ * names a file, profiling is switched on and a Chrome trace is written to it on exit.
+ *
+ * For every scope and thread, call counts, total/min/max and percentile durations are tracked.
+ * Individual calls are also retained (upto a limit) for export as Chrome trace-event JSON, which
+ * can be opened in chrome://tracing or https://ui.perfetto.dev
+ */
+class TimeProfiler : public QObject
+{
+    Q_OBJECT
+    QML_ELEMENT
+    QML_SINGLETON
+
+public:
+    TimeProfiler(QObject *parent = nullptr);
+    ~TimeProfiler();
+
+    Q_PROPERTY(bool enabled READ isEnabled WRITE setEnabled NOTIFY enabledChanged)
+    void setEnabled(bool val);
+    static bool isEnabled() { return EnabledFlag.loadRelaxed() != 0; }
+    Q_SIGNAL void enabledChanged();
+
+    static void enable(bool val = true);
+
+    Q_INVOKABLE static void reset();
+
+    // One object per scope and thread with count, totalMs, minMs, maxMs, averageMs,
+    // p50Ms, p90Ms and p99Ms attributes. Sorted by totalMs, largest first.
+    Q_INVOKABLE static QJsonArray report();
+
+    // Same as report(), but formatted as a plain text table.
+    Q_INVOKABLE static QString summary();
+
+    Q_INVOKABLE static QJsonObject traceEvents();
+    Q_INVOKABLE static bool saveTrace(const QString &fileName);
+
+    static void record(const char *name, qint64 startNs, qint64 durationNs);
+    static qint64 nowNs();
+
+private:
+    static QAtomicInt EnabledFlag;
+};
+
+class TimeProfilerScope
+{
+public:
+    explicit TimeProfilerScope(const char *name)
+    {
+        if (TimeProfiler::isEnabled()) {
+            m_name = name;
+            m_startNs = TimeProfiler::nowNs();
+        }
+    }
+    ~TimeProfilerScope()
+    {
+        if (m_name != nullptr)
+            TimeProfiler::record(m_name, m_startNs, TimeProfiler::nowNs() - m_startNs);
+    }
+
+private:
+    Q_DISABLE_COPY(TimeProfilerScope)
+    const char *m_name = nullptr;
+    qint64 m_startNs = 0;
+};
+
+#define PROFILER_CONCAT2(a, b) a##b
+#define PROFILER_CONCAT(a, b) PROFILER_CONCAT2(a, b)
+
+// Name must be a string literal, or otherwise outlive the profiler.
+#define PROFILE_SCOPE(name) TimeProfilerScope PROFILER_CONCAT(timeProfilerScope, __LINE__)(name)
+#define PROFILE_THIS_FUNCTION PROFILE_SCOPE(Q_FUNC_INFO)
+#define PROFILE_THIS_FUNCTION2 PROFILE_THIS_FUNCTION
 
 #endif // TIME_PROFILER_H